@@ -1,17 +1,25 @@
 d := $(dir $(lastword $(MAKEFILE_LIST)))
 
 SRCS += $(addprefix $(d), \
-	client.cc benchmark.cc replica.cc)
+	client.cc benchmark.cc replica.cc seqbench.cc hashbench.cc verifybench.cc)
 
 OBJS-benchmark := $(o)benchmark.o \
                   $(LIB-message) $(LIB-latency)
 
-$(d)client: $(o)client.o $(OBJS-benchmark) $(LIB-udptransport)
+$(d)client: $(o)client.o $(OBJS-benchmark) $(LIB-udptransport) $(LIB-iouringtransport) $(LIB-shmtransport)
 $(d)client:	$(OBJS-vr-client) $(OBJS-fastpaxos-client) $(OBJS-unreplicated-client) $(OBJS-nopaxos-client)
 $(d)client: $(OBJS-spec-client)
 
-$(d)replica: $(o)replica.o $(LIB-udptransport)
+$(d)replica: $(o)replica.o $(LIB-udptransport) $(LIB-iouringtransport) $(LIB-shmtransport)
 $(d)replica: $(OBJS-vr-replica) $(OBJS-fastpaxos-replica) $(OBJS-unreplicated-replica) $(OBJS-nopaxos-replica)
 $(d)replica: $(OBJS-spec-replica)
 
-BINS += $(d)client $(d)replica
+$(d)seqbench: $(o)seqbench.o $(LIB-message) $(LIB-configuration)
+
+$(d)hashbench: $(o)hashbench.o $(LIB-log)
+
+$(d)verifybench: $(o)verifybench.o $(LIB-signature) $(LIB-sigpipeline) \
+	$(LIB-simtransport) $(LIB-configuration)
+$(call add-LDFLAGS,$(d)verifybench,$(LIBSECP256K1_LDFLAGS))
+
+BINS += $(d)client $(d)replica $(d)seqbench $(d)hashbench $(d)verifybench
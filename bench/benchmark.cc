@@ -36,6 +36,7 @@
 #include "lib/timeval.h"
 
 #include <sys/time.h>
+#include <time.h>
 #include <string>
 #include <sstream>
 #include <algorithm>
@@ -46,9 +47,10 @@ DEFINE_LATENCY(op);
 
 BenchmarkClient::BenchmarkClient(Client &client, Transport &transport,
                                  int duration, uint64_t delay,
-                                 int tputInterval)
+                                 int tputInterval, int outstanding)
     : tputInterval(tputInterval), client(client),
-    transport(transport), duration(duration), delay(delay)
+    transport(transport), duration(duration), delay(delay),
+    outstanding(outstanding)
 {
     if (delay != 0) {
         Notice("Delay between requests: %ld ms", delay);
@@ -64,30 +66,39 @@ BenchmarkClient::Start()
     n = 0;
 
     gettimeofday(&startTime, nullptr);
-    SendNext();
+    for (int i = 0; i < outstanding; i++) {
+        SendNext();
+    }
 }
 
 void
 BenchmarkClient::SendNext()
 {
     std::ostringstream msg;
-    msg << "request" << n;
-
-    Latency_Start(&latency);
-    client.Invoke(msg.str(), std::bind(&BenchmarkClient::OnReply,
-                                       this,
-                                       std::placeholders::_1,
-                                       std::placeholders::_2));
+    msg << "request" << n++;
+
+    // Requests overlap, so each one carries its own start time
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    client.Invoke(msg.str(), [this, start](const string &request,
+                                           const string &reply) {
+        OnReply(request, reply, start);
+    });
 }
 
 void
-BenchmarkClient::OnReply(const string &request, const string &reply)
+BenchmarkClient::OnReply(const string &request, const string &reply,
+                         const struct timespec &start)
 {
     if (done) {
         return;
     }
 
-    uint64_t ns = Latency_End(&latency);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t ns = (now.tv_sec - start.tv_sec) * 1000000000ull +
+        now.tv_nsec - start.tv_nsec;
+    Latency_AddSample(&latency, '=', ns);
     latencies[ns/1000]++;
     completedOps++;
 
@@ -102,7 +113,6 @@ BenchmarkClient::OnReply(const string &request, const string &reply)
     if (diff.tv_sec >= duration) {
         Finish();
     } else {
-        n++;
         if (delay == 0) {
             SendNext();
         } else {
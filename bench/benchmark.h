@@ -41,9 +41,8 @@ class BenchmarkClient
 public:
     BenchmarkClient(Client &client, Transport &transport,
                     int duration, uint64_t delay,
-                    int tputInterval);
+                    int tputInterval, int outstanding = 1);
     void Start();
-    void OnReply(const string &request, const string &reply);
     struct Latency_t latency;
     bool done;
     int tputInterval;
@@ -53,11 +52,15 @@ public:
 
 private:
     void SendNext();
+    void OnReply(const string &request, const string &reply,
+                 const struct timespec &start);
     void Finish();
     Client &client;
     Transport &transport;
     int duration;
     uint64_t delay;
+    // Requests kept in flight at once
+    int outstanding;
     int n;
     struct timeval startTime;
     struct timeval endTime;
@@ -39,6 +39,8 @@
 #include "lib/assert.h"
 #include "lib/configuration.h"
 #include "lib/message.h"
+#include "lib/iouringtransport.h"
+#include "lib/shmtransport.h"
 #include "lib/udptransport.h"
 #include "replication/fastpaxos/client.h"
 #include "replication/nopaxos/client.h"
@@ -48,8 +50,10 @@
 static void Usage(const char *progName) {
   fprintf(stderr,
           "usage: %s [-n requests] [-t threads] [-w warmup-secs] [-s "
-          "stats-file] [-d delay-ms] [-u duration-sec] [-p udp|dpdk] [-v "
-          "device] [-x device-port] [-z transport-cmdline] -c conf-file -h "
+          "stats-file] [-d delay-ms] [-u duration-sec] [-p udp|iouring|shm] [-v "
+          "device] [-x device-port] [-z transport-cmdline] [-B io-batch-size] "
+          "[-o outstanding-requests] [-b client-batch-size] [-l batch-linger-ms] "
+          "-c conf-file -h "
           "host-address -m unreplicated|vr|fastpaxos|nopaxos\n",
           progName);
   exit(1);
@@ -66,8 +70,17 @@ int main(int argc, char **argv) {
   uint64_t client_id = 0;
   uint64_t delay = 0;
   int tputInterval = 0;
+  int ioBatchSize = 1;
+  int outstanding = 1;
+  int clientBatchSize = 1;
+  uint64_t batchLinger = 1;
   std::string host, dev, transport_cmdline;
   bool use_ehseq = false;
+  enum {
+    TRANSPORT_UDP,
+    TRANSPORT_IOURING,
+    TRANSPORT_SHM,
+  } transport_type = TRANSPORT_UDP;
 
   enum {
     PROTO_UNKNOWN,
@@ -84,7 +97,7 @@ int main(int argc, char **argv) {
 
   // Parse arguments
   int opt;
-  while ((opt = getopt(argc, argv, "a:c:d:eh:s:m:t:i:u:p:v:x:z:")) != -1) {
+  while ((opt = getopt(argc, argv, "a:b:B:c:d:eh:l:s:m:o:t:i:u:p:v:x:z:")) != -1) {
     switch (opt) {
       case 'a': {
         char *strtolPtr;
@@ -96,6 +109,16 @@ int main(int argc, char **argv) {
         break;
       }
 
+      case 'B': {
+        char *strtolPtr;
+        ioBatchSize = strtoul(optarg, &strtolPtr, 10);
+        if ((*optarg == '\0') || (*strtolPtr != '\0') || (ioBatchSize < 1)) {
+          fprintf(stderr, "option -B requires a numeric arg\n");
+          Usage(argv[0]);
+        }
+        break;
+      }
+
       case 'c':
         configPath = optarg;
         break;
@@ -118,6 +141,19 @@ int main(int argc, char **argv) {
         host = std::string(optarg);
         break;
 
+      case 'p':
+        if (strcasecmp(optarg, "udp") == 0) {
+          transport_type = TRANSPORT_UDP;
+        } else if (strcasecmp(optarg, "iouring") == 0) {
+          transport_type = TRANSPORT_IOURING;
+        } else if (strcasecmp(optarg, "shm") == 0) {
+          transport_type = TRANSPORT_SHM;
+        } else {
+          fprintf(stderr, "unknown transport '%s'\n", optarg);
+          Usage(argv[0]);
+        }
+        break;
+
       case 'v':
         dev = std::string(optarg);
         break;
@@ -145,6 +181,37 @@ int main(int argc, char **argv) {
         }
         break;
 
+      case 'o': {
+        char *strtolPtr;
+        outstanding = strtoul(optarg, &strtolPtr, 10);
+        if ((*optarg == '\0') || (*strtolPtr != '\0') || (outstanding < 1)) {
+          fprintf(stderr, "option -o requires a numeric arg\n");
+          Usage(argv[0]);
+        }
+        break;
+      }
+
+      case 'b': {
+        char *strtolPtr;
+        clientBatchSize = strtoul(optarg, &strtolPtr, 10);
+        if ((*optarg == '\0') || (*strtolPtr != '\0') ||
+            (clientBatchSize < 1)) {
+          fprintf(stderr, "option -b requires a numeric arg\n");
+          Usage(argv[0]);
+        }
+        break;
+      }
+
+      case 'l': {
+        char *strtolPtr;
+        batchLinger = strtoul(optarg, &strtolPtr, 10);
+        if ((*optarg == '\0') || (*strtolPtr != '\0')) {
+          fprintf(stderr, "option -l requires a numeric arg\n");
+          Usage(argv[0]);
+        }
+        break;
+      }
+
       case 'u': {
         char *strtolPtr;
         duration = strtoul(optarg, &strtolPtr, 10);
@@ -198,6 +265,14 @@ int main(int argc, char **argv) {
     fprintf(stderr, "option -m is required\n");
     Usage(argv[0]);
   }
+  if (clientBatchSize > 1 && proto != PROTO_NOPAXOS) {
+    fprintf(stderr, "option -b is only supported with nopaxos\n");
+    Usage(argv[0]);
+  }
+  if (clientBatchSize > outstanding) {
+    fprintf(stderr, "option -b cannot exceed outstanding requests (-o)\n");
+    Usage(argv[0]);
+  }
 
   // Load configuration
   std::ifstream configStream(configPath);
@@ -207,11 +282,26 @@ int main(int argc, char **argv) {
   }
   dsnet::Configuration config(configStream, use_ehseq);
 
-  dsnet::Transport *transport;
-  transport = new dsnet::UDPTransport(0, 0);
+  dsnet::Transport *transport = nullptr;
+  dsnet::UDPTransport *udpTransport = nullptr;
+  dsnet::IOUringTransport *uringTransport = nullptr;
+  dsnet::ShmTransport *shmTransport = nullptr;
+  switch (transport_type) {
+    case TRANSPORT_UDP:
+      transport = udpTransport =
+          new dsnet::UDPTransport(0, 0, nullptr, ioBatchSize);
+      break;
+    case TRANSPORT_IOURING:
+      transport = uringTransport = new dsnet::IOUringTransport();
+      break;
+    case TRANSPORT_SHM:
+      transport = shmTransport = new dsnet::ShmTransport();
+      break;
+  }
 
   std::vector<dsnet::Client *> clients;
   std::vector<dsnet::BenchmarkClient *> benchClients;
+  std::vector<dsnet::nopaxos::NOPaxosClient *> nopaxosClients;
   dsnet::ReplicaAddress addr(host, "0", dev);
 
   // dsnet::NopSecurity security;
@@ -221,28 +311,35 @@ int main(int argc, char **argv) {
       case PROTO_UNREPLICATED:
         client = new dsnet::unreplicated::UnreplicatedClient(config, addr,
                                                              transport,
-                                                             client_id);
+                                                             client_id,
+                                                             outstanding);
         break;
 
       case PROTO_VR:
-        client = new dsnet::vr::VRClient(config, addr, transport, client_id);
+        client = new dsnet::vr::VRClient(config, addr, transport, client_id,
+                                         outstanding);
         break;
 
       case PROTO_FASTPAXOS:
         client = new dsnet::fastpaxos::FastPaxosClient(config, addr, transport,
-                                                       client_id);
+                                                       client_id, outstanding);
         break;
 
-      case PROTO_NOPAXOS:
-        client = new dsnet::nopaxos::NOPaxosClient(config, addr, transport, client_id);
+      case PROTO_NOPAXOS: {
+        auto *nopaxosClient = new dsnet::nopaxos::NOPaxosClient(
+            config, addr, transport, client_id, outstanding, clientBatchSize,
+            batchLinger);
+        nopaxosClients.push_back(nopaxosClient);
+        client = nopaxosClient;
         break;
+      }
 
       default:
         NOT_REACHABLE();
     }
 
     dsnet::BenchmarkClient *bench = new dsnet::BenchmarkClient(
-        *client, *transport, duration, delay, tputInterval);
+        *client, *transport, duration, delay, tputInterval, outstanding);
 
     transport->Timer(0, [=]() { bench->Start(); });
     clients.push_back(client);
@@ -273,8 +370,27 @@ int main(int argc, char **argv) {
       agg_ops += benchClients[i]->completedOps;
     }
     Latency_Dump(&sum);
+    if (udpTransport != nullptr) {
+      udpTransport->PrintStats();
+    } else if (uringTransport != nullptr) {
+      uringTransport->PrintStats();
+    } else {
+      shmTransport->PrintStats();
+    }
 
     Notice("Total throughput is %ld ops/sec", agg_ops / duration);
+    if (!nopaxosClients.empty()) {
+      uint64_t batches = 0, batchedRequests = 0;
+      for (auto c : nopaxosClients) {
+        dsnet::nopaxos::NOPaxosClient::Stats stats = c->GetStats();
+        batches += stats.batches;
+        batchedRequests += stats.batchedRequests;
+      }
+      if (batches > 0) {
+        Notice("Average client batch size is %.2f",
+               (double)batchedRequests / batches);
+      }
+    }
     enum class Mode { kMedian, k90, k95, k99 };
     uint64_t count = 0;
     int median, p90, p95, p99;
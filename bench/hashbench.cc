@@ -0,0 +1,164 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * hashbench.cc:
+ *   micro-benchmark for the log's hash chain
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **********************************************************************/
+
+// Hashes the same run of log entries two ways: chaining
+// Log::ComputeHash one entry at a time, and letting a hashed Log extend
+// its chain in one pass when LastHash is asked for. Both must end on
+// the same digest.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "common/log.h"
+#include "lib/assert.h"
+
+using namespace dsnet;
+
+namespace {
+
+uint64_t
+NowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+LogEntry *
+MakeEntry(opnum_t op)
+{
+    Request request;
+    request.set_clientid(42);
+    request.set_clientreqid(op);
+    return new LogEntry(viewstamp_t(1, op), LOG_STATE_RECEIVED, request);
+}
+
+// Best of rounds, in ns per entry
+double
+PerEntry(const std::vector<LogEntry *> &entries, int rounds, string *last)
+{
+    uint64_t best = UINT64_MAX;
+    for (int r = 0; r < rounds; r++) {
+        uint64_t start = NowNs();
+        string hash = EMPTY_HASH;
+        for (const LogEntry *entry : entries) {
+            hash = Log::ComputeHash(hash, entry);
+        }
+        best = std::min(best, NowNs() - start);
+        *last = hash;
+    }
+    return (double)best / entries.size();
+}
+
+double
+Chained(size_t numEntries, int rounds, string *last)
+{
+    uint64_t best = UINT64_MAX;
+    for (int r = 0; r < rounds; r++) {
+        Log log(true);
+        for (opnum_t op = 1; op <= numEntries; op++) {
+            log.Append(MakeEntry(op));
+        }
+        uint64_t start = NowNs();
+        *last = log.LastHash();
+        best = std::min(best, NowNs() - start);
+    }
+    return (double)best / numEntries;
+}
+
+void
+Usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-n entries] [-r rounds]\n", name);
+    exit(1);
+}
+
+} // namespace
+
+int
+main(int argc, char **argv)
+{
+    size_t numEntries = 1000000;
+    int rounds = 5;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+        char *strtolPtr;
+        switch (opt) {
+            case 'n':
+                numEntries = strtoul(optarg, &strtolPtr, 10);
+                if ((*optarg == '\0') || (*strtolPtr != '\0') ||
+                    (numEntries < 1)) {
+                    fprintf(stderr, "option -n requires a numeric arg\n");
+                    Usage(argv[0]);
+                }
+                break;
+
+            case 'r':
+                rounds = strtoul(optarg, &strtolPtr, 10);
+                if ((*optarg == '\0') || (*strtolPtr != '\0') ||
+                    (rounds < 1)) {
+                    fprintf(stderr, "option -r requires a numeric arg\n");
+                    Usage(argv[0]);
+                }
+                break;
+
+            default:
+                fprintf(stderr, "Unknown argument %s\n", argv[optind]);
+                Usage(argv[0]);
+                break;
+        }
+    }
+
+    std::vector<LogEntry *> entries;
+    for (opnum_t op = 1; op <= numEntries; op++) {
+        entries.push_back(MakeEntry(op));
+    }
+
+    string perEntryHash, chainedHash;
+    double perEntry = PerEntry(entries, rounds, &perEntryHash);
+    double chained = Chained(numEntries, rounds, &chainedHash);
+    if (perEntryHash != chainedHash) {
+        Panic("Hash chain does not match ComputeHash");
+    }
+
+    printf("%zu entries, best of %d\n", numEntries, rounds);
+    printf("ComputeHash per entry: %.1f ns/entry\n", perEntry);
+    printf("Batched hash chain:    %.1f ns/entry (%.2fx)\n",
+           chained, perEntry / chained);
+
+    for (LogEntry *entry : entries) {
+        delete entry;
+    }
+    return 0;
+}
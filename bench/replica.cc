@@ -40,17 +40,33 @@
 #include <vector>
 
 #include "lib/configuration.h"
+#include "lib/iouringtransport.h"
+#include "lib/shmtransport.h"
 #include "lib/udptransport.h"
 #include "replication/fastpaxos/replica.h"
 #include "replication/nopaxos/replica.h"
 #include "replication/unreplicated/replica.h"
 #include "replication/vr/replica.h"
 
+// The transports print their stats and exit on SIGTERM/SIGINT, so the
+// replica's are printed from an exit handler to land next to them
+static dsnet::nopaxos::NOPaxosReplica *nopaxosReplica = nullptr;
+
+static void PrintReplicaStats() {
+  if (nopaxosReplica == nullptr) {
+    return;
+  }
+  dsnet::nopaxos::NOPaxosReplica::Stats stats = nopaxosReplica->GetStats();
+  Notice("Reorder buffer: %lu requests pending, at most %lu",
+         stats.pendingRequests, stats.maxPendingRequests);
+}
+
 static void Usage(const char *progName) {
   fprintf(stderr,
           "usage: %s -c conf-file [-R] -i replica-index -m "
           "unreplicated|vr|fastpaxos|nopaxos [-b batch-size] [-d "
-          "packet-drop-rate] [-r packet-reorder-rate]\n",
+          "packet-drop-rate] [-r packet-reorder-rate] [-B io-batch-size] "
+          "[-T recv-threads] [-p udp|iouring|shm]\n",
           progName);
   exit(1);
 }
@@ -61,7 +77,14 @@ int main(int argc, char **argv) {
   double dropRate = 0.0;
   double reorderRate = 0.0;
   int batchSize = 1;
+  int ioBatchSize = 1;
+  int recvThreads = 1;
   bool recover = false;
+  enum {
+    TRANSPORT_UDP,
+    TRANSPORT_IOURING,
+    TRANSPORT_SHM,
+  } transportType = TRANSPORT_UDP;
 
   dsnet::AppReplica *nullApp = new dsnet::AppReplica();
 
@@ -78,7 +101,7 @@ int main(int argc, char **argv) {
 
   // Parse arguments
   int opt;
-  while ((opt = getopt(argc, argv, "b:c:d:i:m:r:R:tw:")) != -1) {
+  while ((opt = getopt(argc, argv, "b:B:c:d:i:m:p:r:R:T:tw:")) != -1) {
     switch (opt) {
       case 'b': {
         char *strtolPtr;
@@ -90,6 +113,16 @@ int main(int argc, char **argv) {
         break;
       }
 
+      case 'B': {
+        char *strtolPtr;
+        ioBatchSize = strtoul(optarg, &strtolPtr, 10);
+        if ((*optarg == '\0') || (*strtolPtr != '\0') || (ioBatchSize < 1)) {
+          fprintf(stderr, "option -B requires a numeric arg\n");
+          Usage(argv[0]);
+        }
+        break;
+      }
+
       case 'c':
         configPath = optarg;
         break;
@@ -134,6 +167,19 @@ int main(int argc, char **argv) {
         }
         break;
 
+      case 'p':
+        if (strcasecmp(optarg, "udp") == 0) {
+          transportType = TRANSPORT_UDP;
+        } else if (strcasecmp(optarg, "iouring") == 0) {
+          transportType = TRANSPORT_IOURING;
+        } else if (strcasecmp(optarg, "shm") == 0) {
+          transportType = TRANSPORT_SHM;
+        } else {
+          fprintf(stderr, "unknown transport '%s'\n", optarg);
+          Usage(argv[0]);
+        }
+        break;
+
       case 'r': {
         char *strtodPtr;
         reorderRate = strtod(optarg, &strtodPtr);
@@ -149,6 +195,16 @@ int main(int argc, char **argv) {
         recover = true;
         break;
 
+      case 'T': {
+        char *strtolPtr;
+        recvThreads = strtoul(optarg, &strtolPtr, 10);
+        if ((*optarg == '\0') || (*strtolPtr != '\0') || (recvThreads < 1)) {
+          fprintf(stderr, "option -T requires a numeric arg\n");
+          Usage(argv[0]);
+        }
+        break;
+      }
+
       default:
         fprintf(stderr, "Unknown argument %s\n", argv[optind]);
         Usage(argv[0]);
@@ -188,35 +244,60 @@ int main(int argc, char **argv) {
     Usage(argv[0]);
   }
 
-  dsnet::UDPTransport transport(dropRate, reorderRate, nullptr);
+  dsnet::Transport *transport = nullptr;
+  switch (transportType) {
+    case TRANSPORT_UDP:
+      transport = new dsnet::UDPTransport(dropRate, reorderRate, nullptr,
+                                          ioBatchSize, recvThreads);
+      break;
+    case TRANSPORT_IOURING:
+      if (reorderRate > 0) {
+        fprintf(stderr, "option -r is not supported with io_uring\n");
+        Usage(argv[0]);
+      }
+      transport = new dsnet::IOUringTransport(dropRate);
+      break;
+    case TRANSPORT_SHM:
+      if (reorderRate > 0) {
+        fprintf(stderr, "option -r is not supported with shm\n");
+        Usage(argv[0]);
+      }
+      transport = new dsnet::ShmTransport(dropRate);
+      break;
+  }
 
   dsnet::Replica *replica;
   // dsnet::NopSecurity security;
   switch (proto) {
     case PROTO_UNREPLICATED:
       replica = new dsnet::unreplicated::UnreplicatedReplica(
-          config, index, !recover, &transport, nullApp);
+          config, index, !recover, transport, nullApp);
       break;
 
     case PROTO_VR:
-      replica = new dsnet::vr::VRReplica(config, index, !recover, &transport,
+      replica = new dsnet::vr::VRReplica(config, index, !recover, transport,
                                          batchSize, nullApp);
       break;
 
     case PROTO_FASTPAXOS:
       replica = new dsnet::fastpaxos::FastPaxosReplica(config, index, !recover,
-                                                       &transport, nullApp);
+                                                       transport, nullApp);
       break;
 
     case PROTO_NOPAXOS:
-      replica = new dsnet::nopaxos::NOPaxosReplica(config, index, !recover,
-                                                   &transport, nullApp);
+      nopaxosReplica = new dsnet::nopaxos::NOPaxosReplica(
+          config, index, !recover, transport, nullApp);
+      replica = nopaxosReplica;
+      atexit(PrintReplicaStats);
       break;
 
     default:
       NOT_REACHABLE();
   }
 
-  transport.Run();
+  transport->Run();
+  PrintReplicaStats();
+  nopaxosReplica = nullptr;
   delete replica;
+  delete transport;
 }
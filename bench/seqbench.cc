@@ -0,0 +1,550 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * seqbench.cc:
+ *   load generator and micro-benchmark for an endhost sequencer
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **********************************************************************/
+
+// Floods a running sequencer (sequencer/sequencer, the first
+// "sequencer" in the configuration) with raw packets from several
+// threads, and sinks what it stamps on sockets bound to every replica
+// address in the configuration. Senders and sinks share a clock, so
+// the sequencer has to be reachable from this host.
+
+#include <errno.h>
+#include <netdb.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#include "lib/assert.h"
+#include "lib/configuration.h"
+#include "lib/message.h"
+#include "lib/udptransport-wire.h"
+#include "replication/nopaxos/types.h"
+#include "transaction/eris/types.h"
+
+namespace nopaxos = dsnet::nopaxos;
+namespace eris = dsnet::transaction::eris;
+
+namespace {
+
+// Follows the sequencer header in every packet
+struct __attribute__((packed)) Probe
+{
+    uint32_t thread;
+    uint64_t seq;
+    uint64_t sentNs;
+};
+
+// Latency histogram buckets are 1 us wide; slower packets all land in
+// the last one
+const size_t LATENCY_BUCKETS = 100000;
+const size_t MAX_PACKET = 9000;
+const int RECV_BATCH = 32;
+
+enum Mode {
+    MODE_NOPAXOS,
+    MODE_ERIS,
+};
+
+uint64_t
+NowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+sockaddr_in
+Resolve(const dsnet::ReplicaAddress &addr)
+{
+    struct addrinfo hints, *ai;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (getaddrinfo(addr.host.c_str(), addr.port.c_str(), &hints, &ai) != 0) {
+        Panic("Failed to resolve %s:%s", addr.host.c_str(), addr.port.c_str());
+    }
+    sockaddr_in sin = *(sockaddr_in *)ai->ai_addr;
+    freeaddrinfo(ai);
+    return sin;
+}
+
+size_t
+HeaderSize(Mode mode, int groupsPerPacket)
+{
+    if (mode == MODE_NOPAXOS) {
+        return sizeof(nopaxos::SessNum) + sizeof(nopaxos::MsgNum);
+    }
+    return sizeof(eris::SessNum) + sizeof(eris::NumGroups) +
+        groupsPerPacket * (sizeof(eris::GroupID) + sizeof(eris::MsgNum));
+}
+
+struct Sender
+{
+    int idx;
+    std::thread thread;
+    uint64_t sent = 0;
+};
+
+void
+RunSender(Sender *s, Mode mode, const sockaddr_in &seq, int numGroups,
+          int groupsPerPacket, size_t packetSize, uint64_t rate,
+          int batch, const std::atomic<bool> *stop)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        PPanic("Failed to create socket");
+    }
+    int n = dsnet::SOCKET_BUF_SIZE;
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &n, sizeof(n));
+
+    size_t headerSize = HeaderSize(mode, groupsPerPacket);
+    std::vector<std::vector<char> > packets(batch,
+                                            std::vector<char>(packetSize, 0));
+    std::vector<struct mmsghdr> msgs(batch);
+    std::vector<struct iovec> iovecs(batch);
+    for (int i = 0; i < batch; i++) {
+        char *p = packets[i].data();
+        *(dsnet::Preamble *)p = dsnet::NONFRAG_MAGIC;
+        p += sizeof(dsnet::Preamble);
+        *(nopaxos::HeaderSize *)p = HTON_HEADERSIZE(headerSize);
+        if (mode == MODE_ERIS) {
+            p += sizeof(nopaxos::HeaderSize) + sizeof(eris::SessNum);
+            *(eris::NumGroups *)p = HTON_NUMGROUPS(groupsPerPacket);
+        }
+        iovecs[i].iov_base = packets[i].data();
+        iovecs[i].iov_len = packetSize;
+        struct msghdr &hdr = msgs[i].msg_hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.msg_name = const_cast<sockaddr_in *>(&seq);
+        hdr.msg_namelen = sizeof(seq);
+        hdr.msg_iov = &iovecs[i];
+        hdr.msg_iovlen = 1;
+    }
+
+    uint64_t spacing = rate > 0 ? 1000000000ULL * batch / rate : 0;
+    uint64_t next = NowNs();
+    while (!stop->load(std::memory_order_relaxed)) {
+        uint64_t now = NowNs();
+        for (int i = 0; i < batch; i++) {
+            char *p = packets[i].data() + sizeof(dsnet::Preamble) +
+                sizeof(nopaxos::HeaderSize);
+            if (mode == MODE_ERIS) {
+                // Spread the packets over the groups, groupsPerPacket
+                // consecutive ones at a time
+                p += sizeof(eris::SessNum) + sizeof(eris::NumGroups);
+                int first = (s->sent + i + s->idx) % numGroups;
+                for (int g = 0; g < groupsPerPacket; g++) {
+                    *(eris::GroupID *)p = HTON_GROUPID((first + g) % numGroups);
+                    p += sizeof(eris::GroupID) + sizeof(eris::MsgNum);
+                }
+            } else {
+                p += sizeof(nopaxos::SessNum) + sizeof(nopaxos::MsgNum);
+            }
+            Probe *probe = (Probe *)p;
+            probe->thread = s->idx;
+            probe->seq = s->sent + i;
+            probe->sentNs = now;
+        }
+
+        int sent = 0;
+        while (sent < batch) {
+            int r = sendmmsg(fd, &msgs[sent], batch - sent, 0);
+            if (r < 0) {
+                if (errno != EAGAIN && errno != ENOBUFS) {
+                    PWarning("Failed to send to the sequencer");
+                }
+                continue;
+            }
+            sent += r;
+        }
+        s->sent += batch;
+
+        if (spacing > 0) {
+            next += spacing;
+            while (NowNs() < next) {
+            }
+        }
+    }
+    close(fd);
+}
+
+struct Sink
+{
+    int group;
+    int replica;
+    int fd;
+    std::thread thread;
+    // Stamps seen for this sink's group, in all and in the current
+    // session, whose msg nums the missing count is worked out from
+    uint64_t received = 0;
+    uint64_t sessionReceived = 0;
+    uint64_t reordered = 0;
+    uint64_t sessionChanges = 0;
+    uint64_t lowest = 0;
+    uint64_t highest = 0;
+    uint64_t missing = 0;
+    std::vector<uint64_t> latencies;
+};
+
+// The msg num the sequencer gave pkt for group, or 0
+uint64_t
+ParseStamp(Mode mode, int group, const char *pkt, size_t len,
+           uint16_t *sessNum, const Probe **probe)
+{
+    if (len < sizeof(dsnet::Preamble) + sizeof(nopaxos::HeaderSize) ||
+        *(const dsnet::Preamble *)pkt != dsnet::NONFRAG_MAGIC) {
+        return 0;
+    }
+    const char *p = pkt + sizeof(dsnet::Preamble);
+    size_t headerSize = NTOH_HEADERSIZE(*(const nopaxos::HeaderSize *)p);
+    p += sizeof(nopaxos::HeaderSize);
+    if (len < sizeof(dsnet::Preamble) + sizeof(nopaxos::HeaderSize) +
+        headerSize + sizeof(Probe)) {
+        return 0;
+    }
+    *probe = (const Probe *)(p + headerSize);
+    *sessNum = NTOH_SESSNUM(*(const nopaxos::SessNum *)p);
+    p += sizeof(nopaxos::SessNum);
+    if (mode == MODE_NOPAXOS) {
+        return NTOH_MSGNUM(*(const nopaxos::MsgNum *)p);
+    }
+    int n = NTOH_NUMGROUPS(*(const eris::NumGroups *)p);
+    p += sizeof(eris::NumGroups);
+    for (int i = 0; i < n; i++) {
+        eris::GroupID g = NTOH_GROUPID(*(const eris::GroupID *)p);
+        p += sizeof(eris::GroupID);
+        if ((int)g == group) {
+            return NTOH_MSGNUM(*(const eris::MsgNum *)p);
+        }
+        p += sizeof(eris::MsgNum);
+    }
+    return 0;
+}
+
+void
+RunSink(Sink *s, Mode mode, const std::atomic<bool> *stop)
+{
+    s->latencies.assign(LATENCY_BUCKETS, 0);
+    std::vector<std::vector<char> > buffers(RECV_BATCH,
+                                            std::vector<char>(MAX_PACKET));
+    std::vector<struct mmsghdr> msgs(RECV_BATCH);
+    std::vector<struct iovec> iovecs(RECV_BATCH);
+    for (int i = 0; i < RECV_BATCH; i++) {
+        iovecs[i].iov_base = buffers[i].data();
+        iovecs[i].iov_len = MAX_PACKET;
+        memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    uint16_t session = 0;
+    bool started = false;
+    uint64_t stoppedAt = 0;
+    while (true) {
+        int n = recvmmsg(s->fd, msgs.data(), RECV_BATCH, MSG_WAITFORONE,
+                         nullptr);
+        uint64_t now = NowNs();
+        if (n <= 0) {
+            // Once the senders stop, drain until the sequencer goes quiet
+            if (stop->load()) {
+                if (stoppedAt == 0) {
+                    stoppedAt = now;
+                } else if (now - stoppedAt > 200000000ULL) {
+                    break;
+                }
+            }
+            continue;
+        }
+        stoppedAt = 0;
+        for (int i = 0; i < n; i++) {
+            uint16_t sessNum;
+            const Probe *probe;
+            uint64_t msgNum = ParseStamp(mode, s->group, buffers[i].data(),
+                                         msgs[i].msg_len, &sessNum, &probe);
+            if (msgNum == 0) {
+                continue;
+            }
+            if (!started || sessNum != session) {
+                if (started) {
+                    s->sessionChanges++;
+                    s->missing += s->highest - s->lowest + 1 -
+                        s->sessionReceived;
+                    s->sessionReceived = 0;
+                }
+                started = true;
+                session = sessNum;
+                s->lowest = s->highest = msgNum;
+            }
+            s->received++;
+            s->sessionReceived++;
+            if (msgNum < s->lowest) {
+                s->lowest = msgNum;
+                s->reordered++;
+            } else if (msgNum < s->highest) {
+                s->reordered++;
+            } else {
+                s->highest = msgNum;
+            }
+            uint64_t us = (now - probe->sentNs) / 1000;
+            s->latencies[std::min<uint64_t>(us, LATENCY_BUCKETS - 1)]++;
+        }
+    }
+    if (started) {
+        s->missing += s->highest - s->lowest + 1 - s->sessionReceived;
+    }
+}
+
+void
+Usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s -c conf-file -m nopaxos|eris [-g groups-per-packet] "
+            "[-s packet-size] [-t threads] [-u duration-sec] "
+            "[-r packets-per-sec-per-thread] [-B send-batch-size]\n",
+            name);
+    exit(1);
+}
+
+} // namespace
+
+int
+main(int argc, char **argv)
+{
+    const char *configPath = nullptr;
+    Mode mode = MODE_NOPAXOS;
+    bool haveMode = false;
+    int groupsPerPacket = 1;
+    size_t packetSize = 64;
+    int numThreads = 1;
+    int duration = 5;
+    uint64_t rate = 0;
+    int batch = 16;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "B:c:g:m:r:s:t:u:")) != -1) {
+        char *strtolPtr;
+        switch (opt) {
+            case 'B':
+                batch = strtoul(optarg, &strtolPtr, 10);
+                if ((*optarg == '\0') || (*strtolPtr != '\0') || (batch < 1)) {
+                    fprintf(stderr, "option -B requires a numeric arg\n");
+                    Usage(argv[0]);
+                }
+                break;
+
+            case 'c':
+                configPath = optarg;
+                break;
+
+            case 'g':
+                groupsPerPacket = strtoul(optarg, &strtolPtr, 10);
+                if ((*optarg == '\0') || (*strtolPtr != '\0') ||
+                    (groupsPerPacket < 1)) {
+                    fprintf(stderr, "option -g requires a numeric arg\n");
+                    Usage(argv[0]);
+                }
+                break;
+
+            case 'm':
+                haveMode = true;
+                if (strcasecmp(optarg, "nopaxos") == 0) {
+                    mode = MODE_NOPAXOS;
+                } else if (strcasecmp(optarg, "eris") == 0) {
+                    mode = MODE_ERIS;
+                } else {
+                    fprintf(stderr, "unknown mode '%s'\n", optarg);
+                    Usage(argv[0]);
+                }
+                break;
+
+            case 'r':
+                rate = strtoul(optarg, &strtolPtr, 10);
+                if ((*optarg == '\0') || (*strtolPtr != '\0')) {
+                    fprintf(stderr, "option -r requires a numeric arg\n");
+                    Usage(argv[0]);
+                }
+                break;
+
+            case 's':
+                packetSize = strtoul(optarg, &strtolPtr, 10);
+                if ((*optarg == '\0') || (*strtolPtr != '\0')) {
+                    fprintf(stderr, "option -s requires a numeric arg\n");
+                    Usage(argv[0]);
+                }
+                break;
+
+            case 't':
+                numThreads = strtoul(optarg, &strtolPtr, 10);
+                if ((*optarg == '\0') || (*strtolPtr != '\0') ||
+                    (numThreads < 1)) {
+                    fprintf(stderr, "option -t requires a numeric arg\n");
+                    Usage(argv[0]);
+                }
+                break;
+
+            case 'u':
+                duration = strtoul(optarg, &strtolPtr, 10);
+                if ((*optarg == '\0') || (*strtolPtr != '\0') ||
+                    (duration < 1)) {
+                    fprintf(stderr, "option -u requires a numeric arg\n");
+                    Usage(argv[0]);
+                }
+                break;
+
+            default:
+                fprintf(stderr, "Unknown argument %s\n", argv[optind]);
+                Usage(argv[0]);
+                break;
+        }
+    }
+
+    if (configPath == nullptr) {
+        fprintf(stderr, "option -c is required\n");
+        Usage(argv[0]);
+    }
+    if (!haveMode) {
+        fprintf(stderr, "option -m is required\n");
+        Usage(argv[0]);
+    }
+    if (groupsPerPacket > 1 && mode != MODE_ERIS) {
+        fprintf(stderr, "option -g is only supported with eris\n");
+        Usage(argv[0]);
+    }
+
+    std::ifstream configStream(configPath);
+    if (configStream.fail()) {
+        fprintf(stderr, "unable to read configuration file: %s\n",
+                configPath);
+        Usage(argv[0]);
+    }
+    dsnet::Configuration config(configStream);
+    if (config.NumSequencers() == 0) {
+        Panic("Configuration does not name a sequencer");
+    }
+    if (groupsPerPacket > config.g) {
+        Panic("Packets cannot address %d of %d groups", groupsPerPacket,
+              config.g);
+    }
+    size_t minSize = sizeof(dsnet::Preamble) + sizeof(nopaxos::HeaderSize) +
+        HeaderSize(mode, groupsPerPacket) + sizeof(Probe);
+    if (packetSize < minSize || packetSize > dsnet::MAX_UDP_MESSAGE_SIZE) {
+        Panic("Packet size must be between %zu and %zu bytes", minSize,
+              dsnet::MAX_UDP_MESSAGE_SIZE);
+    }
+
+    std::atomic<bool> sinksStop(false), sendersStop(false);
+    std::vector<Sink *> sinks;
+    for (int g = 0; g < config.g; g++) {
+        for (int r = 0; r < config.n; r++) {
+            Sink *s = new Sink();
+            s->group = g;
+            s->replica = r;
+            s->fd = socket(AF_INET, SOCK_DGRAM, 0);
+            sockaddr_in sin = Resolve(config.replica(g, r));
+            if (s->fd < 0 || bind(s->fd, (sockaddr *)&sin, sizeof(sin)) < 0) {
+                PPanic("Failed to bind sink for group %d replica %d", g, r);
+            }
+            int n = dsnet::SOCKET_BUF_SIZE;
+            setsockopt(s->fd, SOL_SOCKET, SO_RCVBUF, &n, sizeof(n));
+            struct timeval tv = {0, 50000};
+            setsockopt(s->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            s->thread = std::thread(RunSink, s, mode, &sinksStop);
+            sinks.push_back(s);
+        }
+    }
+
+    sockaddr_in seq = Resolve(config.sequencer(0));
+    std::vector<Sender *> senders;
+    uint64_t start = NowNs();
+    for (int i = 0; i < numThreads; i++) {
+        Sender *s = new Sender();
+        s->idx = i;
+        s->thread = std::thread(RunSender, s, mode, seq, config.g,
+                                groupsPerPacket, packetSize, rate, batch,
+                                &sendersStop);
+        senders.push_back(s);
+    }
+
+    sleep(duration);
+    sendersStop = true;
+    uint64_t sent = 0;
+    for (Sender *s : senders) {
+        s->thread.join();
+        sent += s->sent;
+        delete s;
+    }
+    double secs = (NowNs() - start) / 1e9;
+    sinksStop = true;
+
+    uint64_t stamps = 0, missing = 0, reordered = 0, sessionChanges = 0;
+    std::vector<uint64_t> latencies(LATENCY_BUCKETS, 0);
+    for (Sink *s : sinks) {
+        s->thread.join();
+        close(s->fd);
+        missing += s->missing;
+        reordered += s->reordered;
+        sessionChanges += s->sessionChanges;
+        // Every replica of a group sees the same stamps; count them once
+        if (s->replica == 0) {
+            stamps += s->received;
+            for (size_t i = 0; i < LATENCY_BUCKETS; i++) {
+                latencies[i] += s->latencies[i];
+            }
+        }
+        delete s;
+    }
+
+    Notice("Sent %lu packets in %.2f sec (%.0f packets/sec)", sent, secs,
+           sent / secs);
+    Notice("Sequencer stamped %.0f packets/sec (%.0f stamps/sec)",
+           stamps / groupsPerPacket / secs, stamps / secs);
+    Notice("Sinks saw %lu stamps missing and %lu out of order%s", missing,
+           reordered, sessionChanges > 0 ? " across session changes" : "");
+
+    const double percentiles[] = { 50, 90, 99, 99.9 };
+    uint64_t count = 0;
+    size_t p = 0;
+    for (size_t i = 0; i < LATENCY_BUCKETS && p < 4; i++) {
+        count += latencies[i];
+        while (p < 4 && stamps > 0 && count >= stamps * percentiles[p] / 100) {
+            Notice("%g%% latency is %s%zu us", percentiles[p],
+                   i == LATENCY_BUCKETS - 1 ? ">= " : "", i);
+            p++;
+        }
+    }
+
+    return 0;
+}
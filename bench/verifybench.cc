@@ -0,0 +1,153 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * verifybench.cc:
+ *   signature verification throughput of SignaturePipeline, by
+ *   number of workers
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **********************************************************************/
+
+// Checks the same secp256k1-signed request over and over, the way a
+// BFT replica checks client requests: inline first, then through a
+// SignaturePipeline with 1, 2, 4, ... workers up to -w. Every message
+// is submitted at once and completed from the transport's loop, so
+// this is the pipeline's best case, with nothing else for the
+// protocol thread to do.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+
+#include "lib/assert.h"
+#include "lib/sigpipeline.h"
+#include "lib/signature.h"
+#include "lib/simtransport.h"
+
+using namespace dsnet;
+
+namespace {
+
+uint64_t
+NowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Verifications per second with this many workers (0: inline)
+double
+Run(const Verifier &verifier, const std::string &message,
+    const std::string &signature, int workers, int numMessages)
+{
+    SimulatedTransport transport;
+    SignaturePipeline pipeline(&transport, workers);
+    int verified = 0;
+
+    uint64_t start = NowNs();
+    for (int i = 0; i < numMessages; i++) {
+        // Each job gets its own copy, as it would of a received packet
+        auto copy = std::make_shared<std::string>(message);
+        pipeline.Submit(
+            [&verifier, copy, &signature]() {
+                return verifier.Verify(*copy, signature);
+            },
+            [&verified]() { verified++; });
+    }
+    transport.Run();
+    uint64_t elapsed = NowNs() - start;
+
+    if (verified != numMessages) {
+        Panic("Only %d of %d messages verified", verified, numMessages);
+    }
+    return numMessages * 1e9 / elapsed;
+}
+
+void
+Usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-n messages] [-w max-workers]\n", name);
+    exit(1);
+}
+
+} // namespace
+
+int
+main(int argc, char **argv)
+{
+    int numMessages = 2000;
+    int maxWorkers = 8;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:w:")) != -1) {
+        char *strtolPtr;
+        switch (opt) {
+            case 'n':
+                numMessages = strtoul(optarg, &strtolPtr, 10);
+                if ((*optarg == '\0') || (*strtolPtr != '\0') ||
+                    (numMessages < 1)) {
+                    fprintf(stderr, "option -n requires a numeric arg\n");
+                    Usage(argv[0]);
+                }
+                break;
+
+            case 'w':
+                maxWorkers = strtoul(optarg, &strtolPtr, 10);
+                if ((*optarg == '\0') || (*strtolPtr != '\0') ||
+                    (maxWorkers < 1)) {
+                    fprintf(stderr, "option -w requires a numeric arg\n");
+                    Usage(argv[0]);
+                }
+                break;
+
+            default:
+                fprintf(stderr, "Unknown argument %s\n", argv[optind]);
+                Usage(argv[0]);
+                break;
+        }
+    }
+
+    Secp256k1Signer signer;
+    Secp256k1Verifier verifier(signer);
+    // About the size of a serialized client request
+    const std::string message(64, 'x');
+    std::string signature;
+    if (!signer.Sign(message, signature)) {
+        Panic("Failed to sign");
+    }
+
+    double inlineRate = Run(verifier, message, signature, 0, numMessages);
+    printf("%d messages\n", numMessages);
+    printf("inline:     %8.0f verifications/s\n", inlineRate);
+    for (int workers = 1; workers <= maxWorkers; workers *= 2) {
+        double rate = Run(verifier, message, signature, workers,
+                          numMessages);
+        printf("%2d workers: %8.0f verifications/s (%.2fx)\n",
+               workers, rate, rate / inlineRate);
+    }
+    return 0;
+}
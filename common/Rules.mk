@@ -1,7 +1,7 @@
 d := $(dir $(lastword $(MAKEFILE_LIST)))
 
 SRCS += $(addprefix $(d), \
-	client.cc replica.cc log.cc pbmessage.cc)
+	client.cc replica.cc log.cc pbmessage.cc clienttable.cc lease.cc)
 
 PROTOS += $(addprefix $(d), \
 	  request.proto)
@@ -10,10 +10,14 @@ LIB-request := $(o)request.o
 
 LIB-pbmessage := $(o)pbmessage.o
 
+LIB-log := $(o)log.o $(LIB-request) $(LIB-message)
+
+LIB-clienttable := $(o)clienttable.o $(LIB-message)
+
 OBJS-client := $(o)client.o \
 		$(LIB-message) $(LIB-configuration) $(LIB-transport) \
 		$(LIB-request)
 
-OBJS-replica := $(o)replica.o $(o)log.o \
+OBJS-replica := $(o)replica.o $(o)log.o $(o)clienttable.o $(o)lease.o \
 		$(LIB-message) $(LIB-request) \
 		$(LIB-configuration) $(LIB-udptransport)
@@ -77,6 +77,12 @@ Client::Invoke(const std::map<shardnum_t, std::string> &requests,
     Panic("Protocol does not support multi-shard request");
 }
 
+void
+Client::InvokeRead(const string &request, continuation_t continuation)
+{
+    Invoke(request, continuation);
+}
+
 void
 Client::InvokeAsync(const string &request) {
     Panic("Protocol does not support InvokeAsync");
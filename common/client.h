@@ -67,6 +67,11 @@ public:
                                 continuation_t continuation,
                                 timeout_continuation_t timeoutContinuation = nullptr,
                                 uint32_t timeout = DEFAULT_UNLOGGED_OP_TIMEOUT) = 0;
+    // A linearizable read-only request. Protocols whose leader can
+    // answer reads under a lease override this; by default the read
+    // is ordered like any other request.
+    virtual void InvokeRead(const string &request,
+                            continuation_t continuation);
     virtual void InvokeAsync(const string &request); // Asynchronous invoke (do not wait for reply)
     virtual void ReceiveMessage(const TransportAddress &remote,
                                 void *buf, size_t size) override;
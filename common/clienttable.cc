@@ -0,0 +1,245 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * clienttable.cc:
+ *   replica-side table of the last request and reply of each client
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **********************************************************************/
+
+#include "common/clienttable.h"
+#include "lib/assert.h"
+#include "lib/message.h"
+
+#include <algorithm>
+
+namespace dsnet {
+
+// Client ids are often sequential or share low bits, so mix them
+// before using them to index the table
+static inline uint64_t
+Hash(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+ClientTable::ClientTable(size_t maxClients)
+    : maxClients(maxClients), clock(0)
+{
+    ASSERT(maxClients > 0);
+    index.assign(MIN_INDEX_SIZE, 0);
+    mask = MIN_INDEX_SIZE - 1;
+}
+
+ClientTable::Entry *
+ClientTable::Find(uint64_t clientId)
+{
+    uint64_t h = Hash(clientId);
+    for (size_t i = h & mask; index[i] != 0; i = (i + 1) & mask) {
+        if ((index[i] >> 32) != (h >> 32)) {
+            continue;
+        }
+        Entry &entry = entries[(index[i] & 0xffffffff) - 1];
+        if (entry.clientId == clientId) {
+            entry.lastUsed = ++clock;
+            return &entry;
+        }
+    }
+    return NULL;
+}
+
+ClientTable::Entry &
+ClientTable::operator[](uint64_t clientId)
+{
+    Entry *entry = Find(clientId);
+    if (entry != NULL) {
+        return *entry;
+    }
+
+    if (entries.size() >= maxClients) {
+        EvictIdle();
+    }
+    // Keep the index at most half full, so probes stay short
+    if ((entries.size() + 1) * 2 > index.size()) {
+        Rehash(index.size() * 2);
+    }
+
+    entries.emplace_back(clientId);
+    entries.back().lastUsed = ++clock;
+    Index(entries.size() - 1);
+    return entries.back();
+}
+
+void
+ClientTable::SetAddress(uint64_t clientId, const TransportAddress &addr)
+{
+    (*this)[clientId].address.reset(addr.clone());
+}
+
+const TransportAddress *
+ClientTable::Address(uint64_t clientId)
+{
+    Entry *entry = Find(clientId);
+    if (entry == NULL) {
+        return NULL;
+    }
+    return entry->address.get();
+}
+
+void
+ClientTable::Clear()
+{
+    entries.clear();
+    std::fill(index.begin(), index.end(), 0);
+}
+
+bool
+ClientTable::Entry::Accept(uint64_t clientReqId, uint64_t ackedReqId)
+{
+    if (clientReqId <= lastReqId) {
+        uint64_t behind = lastReqId - clientReqId;
+        if (behind == 0 || behind > WINDOW) {
+            return false;
+        }
+        uint64_t bit = 1ULL << (behind - 1);
+        if (seen & bit) {
+            return false;
+        }
+        seen |= bit;
+        return true;
+    }
+
+    uint64_t shift = clientReqId - lastReqId;
+    if (shift > WINDOW) {
+        seen = 0;
+    } else if (shift == WINDOW) {
+        seen = 1ULL << (WINDOW - 1);
+    } else {
+        seen = (seen << shift) | (1ULL << (shift - 1));
+    }
+    if (replied && lastReqId > ackedReqId) {
+        olderReplies.emplace_back(lastReqId, std::move(reply));
+    }
+    lastReqId = clientReqId;
+    ClearReply();
+
+    if (!olderReplies.empty()) {
+        uint64_t oldest = std::max(ackedReqId + 1,
+                                   clientReqId > WINDOW ?
+                                   clientReqId - WINDOW : 0);
+        olderReplies.erase(
+            std::remove_if(olderReplies.begin(), olderReplies.end(),
+                           [oldest](const std::pair<uint64_t,
+                                                    std::string> &r) {
+                               return r.first < oldest;
+                           }),
+            olderReplies.end());
+    }
+    return true;
+}
+
+const std::string *
+ClientTable::Entry::Reply(uint64_t clientReqId) const
+{
+    if (clientReqId == lastReqId) {
+        return replied ? &reply : NULL;
+    }
+    for (const auto &r : olderReplies) {
+        if (r.first == clientReqId) {
+            return &r.second;
+        }
+    }
+    return NULL;
+}
+
+std::string *
+ClientTable::Entry::ReplySlot(uint64_t clientReqId)
+{
+    if (clientReqId > lastReqId) {
+        Accept(clientReqId);
+    }
+    if (clientReqId == lastReqId) {
+        replied = true;
+        return &reply;
+    }
+    if (lastReqId - clientReqId > WINDOW) {
+        // The client has long since moved on
+        return NULL;
+    }
+    for (auto &r : olderReplies) {
+        if (r.first == clientReqId) {
+            return &r.second;
+        }
+    }
+    olderReplies.emplace_back(clientReqId, std::string());
+    return &olderReplies.back().second;
+}
+
+void
+ClientTable::Index(size_t pos)
+{
+    uint64_t h = Hash(entries[pos].clientId);
+    size_t i = h & mask;
+    while (index[i] != 0) {
+        i = (i + 1) & mask;
+    }
+    index[i] = (h & 0xffffffff00000000ULL) | (pos + 1);
+}
+
+void
+ClientTable::Rehash(size_t size)
+{
+    index.assign(size, 0);
+    mask = size - 1;
+    for (size_t pos = 0; pos < entries.size(); pos++) {
+        Index(pos);
+    }
+}
+
+void
+ClientTable::EvictIdle()
+{
+    size_t evict = std::max<size_t>(entries.size() / 4, 1);
+
+    std::vector<uint64_t> used;
+    used.reserve(entries.size());
+    for (const Entry &entry : entries) {
+        used.push_back(entry.lastUsed);
+    }
+    std::nth_element(used.begin(), used.begin() + evict - 1, used.end());
+    uint64_t cutoff = used[evict - 1];
+
+    entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                 [cutoff](const Entry &entry) {
+                                     return entry.lastUsed <= cutoff;
+                                 }),
+                  entries.end());
+    Notice("Client table full; evicted %zu idle clients", evict);
+    Rehash(index.size());
+}
+
+} // namespace dsnet
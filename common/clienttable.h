@@ -0,0 +1,191 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * clienttable.h:
+ *   replica-side table of the last request and reply of each client
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **********************************************************************/
+
+#ifndef _COMMON_CLIENTTABLE_H_
+#define _COMMON_CLIENTTABLE_H_
+
+#include <google/protobuf/message.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "lib/transport.h"
+
+namespace dsnet {
+
+// The last request a replica has seen from each client, the reply to
+// it and the client's address, for detecting and answering duplicate
+// requests. Replies are kept serialized, so a duplicate is answered by
+// resending the bytes (see SerializedMessage).
+//
+// A client may pipeline up to WINDOW requests, which can reach the
+// replica out of order. Besides the highest request id it has seen,
+// each entry remembers which of the WINDOW ids below it it has seen,
+// and the replies to them, so a request that overtook an earlier one
+// neither hides it nor lets it run twice.
+//
+// Entries are stored densely and found through an open-addressing
+// index of client id tags, so a lookup probes a few adjacent words
+// rather than walking a tree. Inserting may move entries, so pointers
+// and references into the table are only good until the next insert.
+// The table holds at most maxClients entries; inserting into a full
+// table evicts the quarter of the clients that have been idle the
+// longest, which then lose duplicate detection for their old requests.
+class ClientTable
+{
+public:
+    static const uint64_t WINDOW = 64;
+
+    struct Entry
+    {
+        explicit Entry(uint64_t clientId)
+            : clientId(clientId), lastReqId(0), seen(0), lastUsed(0),
+              replied(false) { }
+
+        // Record that clientReqId has been seen. False if it had
+        // been already, or is too far behind lastReqId to tell;
+        // either way it must not be executed again. The client has
+        // had the replies to everything up to ackedReqId, so they
+        // need not be kept.
+        bool Accept(uint64_t clientReqId, uint64_t ackedReqId = 0);
+        // The reply to clientReqId, if there is one yet
+        const std::string *Reply(uint64_t clientReqId) const;
+
+        void SetReply(const ::google::protobuf::Message &msg) {
+            msg.SerializePartialToString(&reply);
+            replied = true;
+        }
+        // Save the reply to any request in the window
+        void SetReply(uint64_t clientReqId,
+                      const ::google::protobuf::Message &msg) {
+            std::string *slot = ReplySlot(clientReqId);
+            if (slot != NULL) {
+                msg.SerializePartialToString(slot);
+            }
+        }
+        void SetReply(uint64_t clientReqId, const std::string &msg) {
+            std::string *slot = ReplySlot(clientReqId);
+            if (slot != NULL) {
+                *slot = msg;
+            }
+        }
+        void ClearReply() {
+            reply.clear();
+            replied = false;
+        }
+
+        uint64_t clientId;
+        uint64_t lastReqId;
+        // Bit i is set if request lastReqId-1-i has been seen
+        uint64_t seen;
+        uint64_t lastUsed;
+        bool replied;
+        // The reply to lastReqId, serialized in whatever form the
+        // protocol resends it
+        std::string reply;
+        // Replies to requests in the window below lastReqId
+        std::vector<std::pair<uint64_t, std::string> > olderReplies;
+        std::unique_ptr<TransportAddress> address;
+
+    private:
+        // Where to keep the reply to clientReqId; NULL if it is too
+        // old to bother
+        std::string *ReplySlot(uint64_t clientReqId);
+    };
+
+    typedef std::vector<Entry>::const_iterator const_iterator;
+
+    static const size_t DEFAULT_MAX_CLIENTS = 1 << 20;
+
+    ClientTable(size_t maxClients = DEFAULT_MAX_CLIENTS);
+
+    // NULL if there is no entry for the client
+    Entry *Find(uint64_t clientId);
+    // Find the client's entry, adding an empty one if there is none
+    Entry &operator[](uint64_t clientId);
+    void SetAddress(uint64_t clientId, const TransportAddress &addr);
+    // NULL if the client's address is not known
+    const TransportAddress *Address(uint64_t clientId);
+    void Clear();
+    size_t Size() const { return entries.size(); }
+
+    const_iterator begin() const { return entries.begin(); }
+    const_iterator end() const { return entries.end(); }
+
+private:
+    static const size_t MIN_INDEX_SIZE = 64;
+
+    void Index(size_t pos);
+    void Rehash(size_t size);
+    void EvictIdle();
+
+    size_t maxClients;
+    uint64_t clock;
+    std::vector<Entry> entries;
+    // Each slot is zero, or the high half of the client id's hash and
+    // the entry's position plus one
+    std::vector<uint64_t> index;
+    size_t mask;
+};
+
+// A message that has already been serialized, such as a reply kept in
+// the client table. Sending it copies the bytes without parsing them
+// back into a protobuf first.
+class SerializedMessage : public Message
+{
+public:
+    SerializedMessage(const std::string &data,
+                      const std::string &type = "serialized")
+        : data(&data), type(type) { }
+    SerializedMessage(const SerializedMessage &other)
+        : owned(*other.data), data(&owned), type(other.type) { }
+
+    virtual SerializedMessage *Clone() const override {
+        return new SerializedMessage(*this);
+    }
+    virtual std::string Type() const override { return type; }
+    virtual size_t SerializedSize() const override { return data->size(); }
+    virtual void Parse(const void *buf, size_t size) override {
+        owned.assign(static_cast<const char *>(buf), size);
+        data = &owned;
+    }
+    virtual void Serialize(void *buf) const override {
+        data->copy(static_cast<char *>(buf), data->size());
+    }
+
+private:
+    std::string owned;
+    const std::string *data;
+    std::string type;
+};
+
+} // namespace dsnet
+
+#endif /* _COMMON_CLIENTTABLE_H_ */
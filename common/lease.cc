@@ -0,0 +1,120 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * lease.cc:
+ *   leader read leases, timed on transport timers
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **********************************************************************/
+
+
+#include "common/lease.h"
+#include "lib/assert.h"
+
+namespace dsnet {
+
+Lease::Lease(Transport *transport, int quorumSize, uint64_t duration,
+             uint64_t renewInterval)
+    : quorumSize(quorumSize),
+      rounds(duration / renewInterval + 2),
+      nextRound(1), grantedRound(0), usedRound(0)
+{
+    ASSERT(renewInterval > 0 && renewInterval < duration);
+    // Leave a tenth of the promise for the leader's and replicas'
+    // timers running at slightly different rates
+    uint64_t held = duration - duration / 10;
+    for (size_t i = 0; i < rounds.size(); i++) {
+        rounds[i].id = 0;
+        rounds[i].expiry.reset(new Timeout(transport, held, [this, i]() {
+            rounds[i].expiry->Stop();
+        }));
+    }
+}
+
+uint64_t
+Lease::StartRound()
+{
+    uint64_t id = nextRound++;
+    Round &r = rounds[id % rounds.size()];
+    if (r.id == grantedRound) {
+        // Renewing faster than planned has caught up with the round
+        // the lease rests on; give it up rather than keep it too long
+        grantedRound = 0;
+    }
+    r.id = id;
+    r.acks.clear();
+    r.expiry->Reset();
+    if (quorumSize <= 1) {
+        grantedRound = id;
+    }
+    return id;
+}
+
+const Lease::Round *
+Lease::Find(uint64_t round) const
+{
+    if (round == 0) {
+        return NULL;
+    }
+    const Round &r = rounds[round % rounds.size()];
+    if (r.id != round || !r.expiry->Active()) {
+        return NULL;
+    }
+    return &r;
+}
+
+void
+Lease::Ack(uint64_t round, int replicaIdx)
+{
+    if (Find(round) == NULL) {
+        return;
+    }
+    Round &r = rounds[round % rounds.size()];
+    r.acks.insert(replicaIdx);
+    if ((int)r.acks.size() + 1 >= quorumSize && round > grantedRound) {
+        grantedRound = round;
+    }
+}
+
+bool
+Lease::Valid() const
+{
+    return Find(grantedRound) != NULL;
+}
+
+void
+Lease::Revoke()
+{
+    for (Round &r : rounds) {
+        r.id = 0;
+        r.acks.clear();
+        r.expiry->Stop();
+    }
+    grantedRound = 0;
+}
+
+LeasePromise::LeasePromise(Transport *transport, uint64_t duration)
+    : timeout(transport, duration, [this]() { timeout.Stop(); })
+{
+}
+
+} // namespace dsnet
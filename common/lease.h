@@ -0,0 +1,112 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * lease.h:
+ *   leader read leases, timed on transport timers
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **********************************************************************/
+
+
+#ifndef _COMMON_LEASE_H_
+#define _COMMON_LEASE_H_
+
+#include "lib/transport.h"
+
+#include <memory>
+#include <set>
+#include <vector>
+
+namespace dsnet {
+
+// A leader's lease to serve reads on its own. The leader renews it in
+// numbered rounds; a replica that answers a round promises not to help
+// elect another leader for the following DEFAULT_DURATION ms (see
+// LeasePromise). Once a quorum, the leader included, has answered a
+// round, the lease holds until a little short of DEFAULT_DURATION
+// after the leader sent that round, so it runs out before any of the
+// promises behind it do.
+//
+// Only timers are used, never clocks, so the lease behaves the same on
+// the simulated transport.
+class Lease
+{
+public:
+    static const uint64_t DEFAULT_DURATION = 500;
+    static const uint64_t DEFAULT_RENEW_INTERVAL = 100;
+
+    Lease(Transport *transport, int quorumSize,
+          uint64_t duration = DEFAULT_DURATION,
+          uint64_t renewInterval = DEFAULT_RENEW_INTERVAL);
+
+    // Begin a renewal round; its number goes out to the replicas
+    uint64_t StartRound();
+    // replicaIdx answered round
+    void Ack(uint64_t round, int replicaIdx);
+    bool Valid() const;
+    // Forget every round so far, e.g. on leaving the view
+    void Revoke();
+
+    // Note that a read wanted the lease
+    void Use() { usedRound = nextRound; }
+    // Whether the lease has been used lately enough to keep renewing
+    bool Wanted() const { return nextRound - usedRound <= rounds.size(); }
+
+private:
+    struct Round
+    {
+        uint64_t id;
+        std::set<int> acks;
+        // Runs while a quorum answering this round would be good for
+        // a lease
+        std::unique_ptr<Timeout> expiry;
+    };
+
+    // NULL unless round is still within its lease duration
+    const Round *Find(uint64_t round) const;
+
+    int quorumSize;
+    // Rounds still within their lease duration, by round number
+    std::vector<Round> rounds;
+    uint64_t nextRound;
+    uint64_t grantedRound;
+    uint64_t usedRound;
+};
+
+// A replica's promise to the leader, not to take part in electing
+// another one while it is held
+class LeasePromise
+{
+public:
+    LeasePromise(Transport *transport,
+                 uint64_t duration = Lease::DEFAULT_DURATION);
+
+    void Grant() { timeout.Reset(); }
+    bool Held() const { return timeout.Active(); }
+
+private:
+    Timeout timeout;
+};
+
+} // namespace dsnet
+
+#endif /* _COMMON_LEASE_H_ */
@@ -68,6 +68,10 @@ Log::Install(iter start, iter end)
     // Find the first divergence in the log
     iter it = start;
     for (it = start; it != end; it++) {
+        if (it->opnum() < this->start) {
+            // Covered by our checkpoint
+            continue;
+        }
         const LogEntry *oldEntry = Find(it->opnum());
         if (oldEntry == NULL) {
             break;
@@ -34,46 +34,257 @@
 
 #include <openssl/sha.h>
 
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
 namespace dsnet {
 
 const string EMPTY_HASH = string(SHA_DIGEST_LENGTH, '\0');
 
+namespace {
+
+// Log entries are carved out of 64 KB slabs in 64-byte size classes,
+// and freed ones are kept on a free list per class for the entries that
+// replace them. Slabs are never returned, so the pool stays at the high
+// water mark of live entries; it is also never destroyed, since static
+// logs may outlive it.
+class LogEntryPool
+{
+public:
+    LogEntryPool() : slabLeft(0) {
+        for (size_t i = 0; i < CLASSES; i++) {
+            freeLists[i] = nullptr;
+        }
+    }
+
+    void *Alloc(size_t size) {
+        if (size > GRAIN * CLASSES) {
+            return ::operator new(size);
+        }
+        size_t c = (size - 1) / GRAIN;
+        std::lock_guard<std::mutex> l(lock);
+        if (freeLists[c] != nullptr) {
+            FreeBlock *b = freeLists[c];
+            freeLists[c] = b->next;
+            return b;
+        }
+        size_t bytes = (c + 1) * GRAIN;
+        if (slabLeft < bytes) {
+            slab = static_cast<char *>(::operator new(SLAB_SIZE));
+            slabLeft = SLAB_SIZE;
+        }
+        void *p = slab;
+        slab += bytes;
+        slabLeft -= bytes;
+        return p;
+    }
+
+    void Free(void *p, size_t size) {
+        if (size > GRAIN * CLASSES) {
+            ::operator delete(p);
+            return;
+        }
+        size_t c = (size - 1) / GRAIN;
+        FreeBlock *b = static_cast<FreeBlock *>(p);
+        std::lock_guard<std::mutex> l(lock);
+        b->next = freeLists[c];
+        freeLists[c] = b;
+    }
+
+private:
+    static const size_t GRAIN = 64;
+    static const size_t CLASSES = 16;
+    static const size_t SLAB_SIZE = 64 * 1024;
+    struct FreeBlock
+    {
+        FreeBlock *next;
+    };
+
+    std::mutex lock;
+    FreeBlock *freeLists[CLASSES];
+    char *slab;
+    size_t slabLeft;
+};
+
+LogEntryPool &
+Pool()
+{
+    static LogEntryPool *pool = new LogEntryPool();
+    return *pool;
+}
+
+// Each link of the hash chain is SHA-1 over the previous digest and the
+// entry's client id and request id. That input is 36 bytes, which pads
+// to a single block, so HashChain lays the block out once and runs just
+// the compression function per entry, writing each digest back into the
+// block as the next entry's input. OpenSSL picks its SHA-NI or AVX2
+// block function when the CPU has one. The result matches ComputeHash.
+//
+// OpenSSL 3 deprecates the low-level SHA1 calls in favour of EVP, which
+// has no way to run the compression function alone, so the warnings are
+// silenced here and in ComputeHash rather than giving that up.
+const size_t CHAIN_INPUT = SHA_DIGEST_LENGTH + 2*sizeof(uint64_t);
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+void
+HashChain(const string &prev, LogEntry *const *entries, size_t n)
+{
+    static const uint32_t SHA1_IV[5] = {
+        0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+    };
+    unsigned char block[SHA_CBLOCK];
+    memset(block, 0, sizeof(block));
+    block[CHAIN_INPUT] = 0x80;
+    block[SHA_CBLOCK-2] = (CHAIN_INPUT * 8) >> 8;
+    block[SHA_CBLOCK-1] = (CHAIN_INPUT * 8) & 0xff;
+    memcpy(block, prev.data(), SHA_DIGEST_LENGTH);
+
+    for (size_t i = 0; i < n; i++) {
+        LogEntry *entry = entries[i];
+        uint64_t x[2];
+        x[0] = entry->request.clientid();
+        x[1] = entry->request.clientreqid();
+        memcpy(block + SHA_DIGEST_LENGTH, x, sizeof(x));
+
+        SHA_CTX ctx;
+        ctx.h0 = SHA1_IV[0];
+        ctx.h1 = SHA1_IV[1];
+        ctx.h2 = SHA1_IV[2];
+        ctx.h3 = SHA1_IV[3];
+        ctx.h4 = SHA1_IV[4];
+        SHA1_Transform(&ctx, block);
+
+        const uint32_t h[5] = { ctx.h0, ctx.h1, ctx.h2, ctx.h3, ctx.h4 };
+        for (int j = 0; j < 5; j++) {
+            block[4*j]   = h[j] >> 24;
+            block[4*j+1] = h[j] >> 16;
+            block[4*j+2] = h[j] >> 8;
+            block[4*j+3] = h[j];
+        }
+        entry->hash.assign(reinterpret_cast<char *>(block),
+                           SHA_DIGEST_LENGTH);
+    }
+}
+
+#pragma GCC diagnostic pop
+
+} // namespace
+
+void *
+LogEntry::operator new(size_t size)
+{
+    return Pool().Alloc(size);
+}
+
+void
+LogEntry::operator delete(void *p, size_t size)
+{
+    Pool().Free(p, size);
+}
+
 Log::Log(bool useHash, opnum_t start, string initialHash)
     : useHash(useHash)
 {
     this->initialHash = initialHash;
+    this->initialViewstamp = viewstamp_t(0, start-1);
     this->start = start;
     if (start == 1) {
         ASSERT(initialHash == EMPTY_HASH);
     }
+    this->head = 0;
+    this->count = 0;
+    this->hashed = 0;
+}
 
-    // reserve enough space to reduce reallocation overhead
-    entries.reserve(10000000);
+Log::~Log()
+{
+    while (count > 0) {
+        PopBack();
+    }
 }
 
 LogEntry &
 Log::Append(LogEntry *entry)
 {
-    if (entries.empty()) {
-        ASSERT(entry->viewstamp.opnum == start);
-    } else {
-        ASSERT(entry->viewstamp.opnum == LastOpnum()+1);
+    ASSERT(entry->viewstamp.opnum == start+count);
+
+    if ((head + count) % SEGMENT_SIZE == 0 &&
+        (head + count) / SEGMENT_SIZE == segments.size()) {
+        segments.emplace_back(new LogEntry *[SEGMENT_SIZE]);
     }
+    Slot(count++) = entry;
 
-    string prevHash = LastHash();
-    entries.push_back(std::unique_ptr<LogEntry>(entry));
-    if (useHash) {
-        entries.back().get()->hash = ComputeHash(prevHash, entries.back().get());
+    return *entry;
+}
+
+// Destroy the last entry, and its segment if it was the only one left
+// in it
+void
+Log::PopBack()
+{
+    delete Slot(--count);
+    if (hashed > count) {
+        hashed = count;
     }
+    if ((head + count) % SEGMENT_SIZE == 0 &&
+        (head + count) / SEGMENT_SIZE < segments.size()) {
+        segments.pop_back();
+    }
+    if (count == 0) {
+        segments.clear();
+        head = 0;
+    }
+}
+
+// Destroy the first entry, and its segment if it was the last one in it
+void
+Log::PopFront()
+{
+    delete Slot(0);
+    start++;
+    count--;
+    if (hashed > 0) {
+        hashed--;
+    }
+    if (++head == SEGMENT_SIZE) {
+        segments.pop_front();
+        head = 0;
+    }
+    if (count == 0) {
+        segments.clear();
+        head = 0;
+    }
+}
 
-    return *entries.back().get();
+// Extend the hash chain over the first n entries. The entries are
+// contiguous within each segment, so hash them a segment's run at a time.
+void
+Log::HashUpTo(size_t n) const
+{
+    while (hashed < n) {
+        const string &prev = hashed == 0 ? initialHash : Slot(hashed-1)->hash;
+        size_t run = std::min(n - hashed,
+                              SEGMENT_SIZE - (head + hashed) % SEGMENT_SIZE);
+        if (prev.size() == SHA_DIGEST_LENGTH) {
+            HashChain(prev, &Slot(hashed), run);
+        } else {
+            // Only an initial hash handed to us can be oddly sized
+            LogEntry *entry = Slot(hashed);
+            entry->hash = ComputeHash(prev, entry);
+            run = 1;
+        }
+        hashed += run;
+    }
 }
 
 // This really ought to be const
 LogEntry *
 Log::Find(opnum_t opnum)
 {
-    if (entries.empty()) {
+    if (count == 0) {
         return nullptr;
     }
 
@@ -81,11 +292,14 @@ Log::Find(opnum_t opnum)
         return nullptr;
     }
 
-    if (opnum-start > entries.size()-1) {
+    if (opnum-start > count-1) {
         return nullptr;
     }
 
-    LogEntry *entry = entries[opnum-start].get();
+    if (useHash && opnum-start >= hashed) {
+        HashUpTo(opnum-start+1);
+    }
+    LogEntry *entry = Slot(opnum-start);
     ASSERT(entry->viewstamp.opnum == opnum);
     return entry;
 }
@@ -134,40 +348,77 @@ Log::RemoveAfter(opnum_t op)
 
     Debug("Removing log entries after " FMT_OPNUM, op);
 
-    ASSERT(op-start < entries.size());
-    entries.resize(op-start);
+    ASSERT(op-start < count);
+    while (count > op-start) {
+        PopBack();
+    }
 
     ASSERT(LastOpnum() == op-1);
 }
 
+// Release the entries before opnum, which must already be covered by a
+// checkpoint. The log then starts at opnum.
+void
+Log::TruncateBefore(opnum_t op)
+{
+    if (op <= start) {
+        return;
+    }
+    ASSERT(op <= LastOpnum()+1);
+
+    Debug("Truncating log entries before " FMT_OPNUM, op);
+
+    const LogEntry *last = Find(op-1);
+    initialHash = last->hash;
+    initialViewstamp = last->viewstamp;
+    while (start < op) {
+        PopFront();
+    }
+}
+
+// Drop every entry and start over after the operation with viewstamp
+// last, e.g. after installing a checkpoint that ends with it
+void
+Log::Reset(viewstamp_t last, const string &lastHash)
+{
+    Debug("Resetting log to start after " FMT_VIEWSTAMP,
+          VA_VIEWSTAMP(last));
+
+    while (count > 0) {
+        PopBack();
+    }
+    start = last.opnum+1;
+    initialHash = lastHash;
+    initialViewstamp = last;
+}
+
 LogEntry *
 Log::Last()
 {
-    if (entries.empty()) {
+    if (count == 0) {
         return NULL;
     }
 
-    return entries.back().get();
+    if (useHash) {
+        HashUpTo(count);
+    }
+    return Slot(count-1);
 }
 
 viewstamp_t
 Log::LastViewstamp() const
 {
-    if (entries.empty()) {
-        return viewstamp_t(0, start-1);
+    if (count == 0) {
+        return initialViewstamp;
     } else {
-        return entries.back().get()->viewstamp;
+        return Slot(count-1)->viewstamp;
     }
 }
 
 opnum_t
 Log::LastOpnum() const
 {
-    if (entries.empty()) {
-        return start-1;
-    } else {
-        return entries.back().get()->viewstamp.opnum;
-    }
+    return start+count-1;
 }
 
 opnum_t
@@ -181,21 +432,27 @@ Log::FirstOpnum() const
 bool
 Log::Empty() const
 {
-    return entries.empty();
+    return count == 0;
 }
 
 const string &
 Log::LastHash() const
 {
-    if (entries.empty()) {
+    if (count == 0) {
         return initialHash;
     } else {
-        return entries.back().get()->hash;
+        if (useHash) {
+            HashUpTo(count);
+        }
+        return Slot(count-1)->hash;
     }
 }
 
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
 string
-Log::ComputeHash(string lastHash, const LogEntry *entry)
+Log::ComputeHash(const string &lastHash, const LogEntry *entry)
 {
     SHA_CTX ctx;
     unsigned char out[SHA_DIGEST_LENGTH];
@@ -216,4 +473,6 @@ Log::ComputeHash(string lastHash, const LogEntry *entry)
     return string((char *)out, SHA_DIGEST_LENGTH);
 }
 
+#pragma GCC diagnostic pop
+
 } // namespace dsnet
@@ -34,6 +34,7 @@
 #include <google/protobuf/message.h>
 #include <openssl/sha.h>
 
+#include <deque>
 #include <map>
 #include <memory>
 
@@ -91,6 +92,11 @@ class LogEntry {
     }
   }
 
+  // Entries, including those of protocol subclasses, come from a slab
+  // of same-sized blocks rather than one malloc each
+  static void *operator new(size_t size);
+  static void operator delete(void *p, size_t size);
+
   template <typename EntryTy>
   const EntryTy &As() const {
     return static_cast<const EntryTy &>(*this);
@@ -110,14 +116,28 @@ class LogEntry {
   ::google::protobuf::Message *replyMessage;
 };
 
+// Entries are kept in fixed-size segments of pointers, so Find and
+// Append are O(1) and neither copies nor reserves space for the rest of
+// the log. Truncating a prefix frees whole segments, and removing a
+// suffix only destroys the removed entries.
+//
+// With useHash, Append leaves the new entry's hash unset and the chain
+// is extended in one pass the next time a digest is looked at, through
+// Find, Last, LastHash or Dump. Entries handed out by those always carry
+// their hash; the reference returned by Append does not.
 class Log {
  public:
   Log(bool useHash, opnum_t start = 1, string initialHash = EMPTY_HASH);
+  Log(const Log &) = delete;
+  Log &operator=(const Log &) = delete;
+  virtual ~Log();
   virtual LogEntry &Append(LogEntry *entry);
   LogEntry *Find(opnum_t opnum);
   bool SetStatus(opnum_t opnum, LogEntryState state);
   bool SetRequest(opnum_t op, const Request &req, const string &signature = "");
   void RemoveAfter(opnum_t opnum);
+  void TruncateBefore(opnum_t opnum);
+  void Reset(viewstamp_t last, const string &lastHash = EMPTY_HASH);
   LogEntry *Last();
   viewstamp_t LastViewstamp() const;  // deprecated
   opnum_t LastOpnum() const;
@@ -131,11 +151,28 @@ class Log {
   void Install(iter start, iter end);
   const string &LastHash() const;
 
-  static string ComputeHash(string lastHash, const LogEntry *entry);
+  static string ComputeHash(const string &lastHash, const LogEntry *entry);
 
  private:
-  std::vector<std::unique_ptr<LogEntry>> entries;
+  LogEntry *&Slot(size_t i) const {
+    i += head;
+    return segments[i / SEGMENT_SIZE][i % SEGMENT_SIZE];
+  }
+  void PopBack();
+  void PopFront();
+  void HashUpTo(size_t n) const;
+
+  static const size_t SEGMENT_SIZE = 4096;
+  typedef std::unique_ptr<LogEntry *[]> Segment;
+
+  // Entry start is at index head of the first segment
+  std::deque<Segment> segments;
+  size_t head;
+  size_t count;
+  // Entries [0, hashed) have their hash set
+  mutable size_t hashed;
   string initialHash;
+  viewstamp_t initialViewstamp;
   opnum_t start;
   bool useHash;
 };
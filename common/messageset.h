@@ -32,6 +32,8 @@
 #ifndef _COMMON_MESSAGESET_H_
 #define _COMMON_MESSAGESET_H_
 
+#include "common/quorumset.h"
+
 #include <map>
 #include <vector>
 
@@ -137,6 +139,111 @@ private:
     std::map<IDTYPE, std::pair<std::map<int, std::map<int, MSGTYPE> >, uint32_t> > messages;
 };
 
+// MessageSet for opnum-like IDs over a sliding window (see QuorumWindow).
+// Replies are counted with a bitmap of replica indices (below 64) per
+// shard, and the bodies are only kept with keepMessages.
+template <class MSGTYPE>
+class WindowedMessageSet
+{
+public:
+    static const size_t DEFAULT_WINDOW = 1024;
+
+    WindowedMessageSet(uint32_t replicaRequired, bool keepMessages = false,
+                       size_t window = DEFAULT_WINDOW)
+        : replicaRequired(replicaRequired), keepMessages(keepMessages),
+          window(window)
+    {
+
+    }
+
+    void
+    Clear()
+    {
+        window.Clear();
+    }
+
+    void
+    Clear(uint64_t id)
+    {
+        window.Clear(id);
+    }
+
+    void
+    Advance(uint64_t watermark)
+    {
+        window.Advance(watermark);
+    }
+
+    void
+    SetShardRequired(uint64_t id, uint32_t num)
+    {
+        Slot *slot = window.Get(id);
+        if (slot != NULL) {
+            slot->shardRequired = num;
+            slot->expected = true;
+        }
+    }
+
+    // Replies are only accepted for IDs with SetShardRequired
+    bool
+    AddAndCheckForQuorum(uint64_t id, int shard, int replica,
+                         const MSGTYPE &msg)
+    {
+        ASSERT(replica >= 0 && replica < 64);
+        Slot *slot = window.Get(id);
+        if (slot == NULL || !slot->expected) {
+            return false;
+        }
+        slot->voters[shard] |= uint64_t(1) << replica;
+        if (keepMessages) {
+            (slot->messages[shard])[replica] = msg;
+        }
+        return CheckForQuorum(id);
+    }
+
+    bool
+    CheckForQuorum(uint64_t id) const
+    {
+        const Slot *slot = window.Find(id);
+        if (slot == NULL || !slot->expected ||
+            slot->voters.size() < slot->shardRequired) {
+            return false;
+        }
+        for (auto &shard : slot->voters) {
+            if ((uint32_t)__builtin_popcountll(shard.second) <
+                replicaRequired) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // NULL unless constructed with keepMessages
+    const std::map<int, std::map<int, MSGTYPE> > *
+    GetMessages(uint64_t id) const
+    {
+        const Slot *slot = window.Find(id);
+        if (!keepMessages || slot == NULL || !slot->expected) {
+            return NULL;
+        }
+        return &slot->messages;
+    }
+
+public:
+    uint32_t replicaRequired;
+private:
+    struct Slot
+    {
+        bool expected = false;
+        uint32_t shardRequired = 0;
+        std::map<int, uint64_t> voters;
+        std::map<int, std::map<int, MSGTYPE> > messages;
+    };
+
+    bool keepMessages;
+    QuorumWindow<Slot> window;
+};
+
 }      // namespace dsnet
 
 #endif  // _COMMON_MESSAGESET_H_
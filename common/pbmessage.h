@@ -1,7 +1,10 @@
 #pragma once
 
+#include <google/protobuf/arena.h>
 #include <google/protobuf/message.h>
 
+#include <memory>
+
 #include "lib/transport.h"
 
 namespace dsnet {
@@ -24,4 +27,38 @@ protected:
     ::google::protobuf::Message *msg_;
 };
 
+// Receive-side storage for messages of type MSG. New() resets an arena
+// and allocates an empty MSG in it for the next packet to be parsed
+// into. The arena's first block is owned here and survives the reset,
+// so decoding a packet builds the whole message tree without touching
+// the heap unless it outgrows the block; only string contents too long
+// for the small-string buffer are still allocated. The message from the
+// previous call, and every reference into it, is gone after New().
+template <typename MSG>
+class PBArena
+{
+public:
+    PBArena(size_t blockSize = 64 * 1024)
+        : block_(new char[blockSize]),
+          arena_(Options(block_.get(), blockSize)) { }
+
+    MSG &New()
+    {
+        arena_.Reset();
+        return *::google::protobuf::Arena::CreateMessage<MSG>(&arena_);
+    }
+
+private:
+    std::unique_ptr<char[]> block_;
+    ::google::protobuf::Arena arena_;
+
+    static ::google::protobuf::ArenaOptions Options(char *block, size_t size)
+    {
+        ::google::protobuf::ArenaOptions options;
+        options.initial_block = block;
+        options.initial_block_size = size;
+        return options;
+    }
+};
+
 } // namespace dsnet
@@ -34,12 +34,17 @@
 
 #include <google/protobuf/message.h>
 
+#include <algorithm>
+#include <cstdint>
 #include <map>
 #include <type_traits>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "lib/assert.h"
+#include "lib/message.h"
 
 namespace dsnet {
 
@@ -55,6 +60,8 @@ class QuorumSet {
     vsmessages.clear();
   }
 
+  void Remove(IDTYPE vs) { messages.erase(vs); }
+
   int NumRequired() const { return numRequired; }
 
   const std::map<int, MSGTYPE> &GetMessages(IDTYPE vs) { return messages[vs]; }
@@ -98,6 +105,186 @@ class QuorumSet {
   std::map<IDTYPE, std::map<int, MSGTYPE>> messages;
 };
 
+// Slots for a sliding window of numeric IDs (opnums), the storage behind
+// the windowed trackers below. The slots for IDs [base, base + size) live
+// in a ring, and Advance drops every ID below a watermark, so memory stays
+// bounded as long as the owner advances it. Adding an ID past the end
+// grows the ring rather than dropping quorums still being collected, up
+// to MAX_GROWTH times the initial size.
+template <class SLOT>
+class QuorumWindow {
+ public:
+  static const size_t MAX_GROWTH = 64;
+
+  explicit QuorumWindow(size_t size) : base(0), slots(RoundUp(size)) {
+    mask = slots.size() - 1;
+    maxSize = slots.size() * MAX_GROWTH;
+  }
+
+  // The slot for id, growing the window to cover it if need be; NULL if
+  // id is below the watermark or too far past it
+  SLOT *Get(uint64_t id) {
+    if (id < base) {
+      return NULL;
+    }
+    if (id - base >= slots.size()) {
+      if (id - base >= maxSize) {
+        Warning("Ignoring ID %lu, too far past the window at %lu",
+                id, base);
+        return NULL;
+      }
+      Grow(id - base + 1);
+    }
+    return &slots[id & mask];
+  }
+
+  const SLOT *Find(uint64_t id) const {
+    if (id < base || id - base >= slots.size()) {
+      return NULL;
+    }
+    return &slots[id & mask];
+  }
+
+  void Advance(uint64_t watermark) {
+    if (watermark <= base) {
+      return;
+    }
+    uint64_t dropped = std::min<uint64_t>(watermark - base, slots.size());
+    for (uint64_t i = 0; i < dropped; i++) {
+      slots[(base + i) & mask] = SLOT();
+    }
+    base = watermark;
+  }
+
+  // Start the window at watermark, dropping everything if it moves;
+  // unlike Advance, it may move back
+  void Rebase(uint64_t watermark) {
+    if (watermark != base) {
+      Clear();
+      base = watermark;
+    }
+  }
+
+  void Clear() {
+    for (SLOT &slot : slots) {
+      slot = SLOT();
+    }
+  }
+
+  void Clear(uint64_t id) {
+    if (Find(id) != NULL) {
+      slots[id & mask] = SLOT();
+    }
+  }
+
+  uint64_t Watermark() const { return base; }
+
+ private:
+  void Grow(uint64_t span) {
+    std::vector<SLOT> grown(RoundUp(span));
+    uint64_t grownMask = grown.size() - 1;
+    for (uint64_t id = base; id < base + slots.size(); id++) {
+      grown[id & grownMask] = std::move(slots[id & mask]);
+    }
+    slots.swap(grown);
+    mask = grownMask;
+  }
+
+  static size_t RoundUp(size_t n) {
+    size_t size = 1;
+    while (size < n) {
+      size <<= 1;
+    }
+    return size;
+  }
+
+  uint64_t base;
+  std::vector<SLOT> slots;
+  uint64_t mask;
+  uint64_t maxSize;
+};
+
+// QuorumSet for opnum-like IDs, where each ID's votes are a bitmap of
+// replica indices (which must be below 64). Message bodies are only kept
+// when constructed with keepMessages. Viewstamp-indexed callers key by
+// opnum and Clear on view change.
+template <class MSGTYPE>
+class WindowedQuorumSet {
+ public:
+  static const size_t DEFAULT_WINDOW = 1024;
+
+  WindowedQuorumSet(int numRequired, bool keepMessages = false,
+                    size_t window = DEFAULT_WINDOW)
+      : numRequired(numRequired), keepMessages(keepMessages), window(window) {}
+
+  void Clear() { window.Clear(); }
+  void Clear(uint64_t id) { window.Clear(id); }
+
+  // Drop everything below watermark; later votes for those IDs are
+  // ignored
+  void Advance(uint64_t watermark) { window.Advance(watermark); }
+  // For callers that only ever count votes for one ID at a time, e.g.
+  // the current op: start the window there, wherever the last one was
+  void Rebase(uint64_t watermark) { window.Rebase(watermark); }
+  uint64_t Watermark() const { return window.Watermark(); }
+
+  int NumRequired() const { return numRequired; }
+
+  int Count(uint64_t id) const {
+    const Slot *slot = window.Find(id);
+    return slot == NULL ? 0 : __builtin_popcountll(slot->voters);
+  }
+
+  bool CheckForQuorum(uint64_t id) const { return Count(id) >= numRequired; }
+
+  bool AddAndCheckForQuorum(uint64_t id, int replicaIdx) {
+    return Insert(id, replicaIdx) != NULL && CheckForQuorum(id);
+  }
+
+  bool AddAndCheckForQuorum(uint64_t id, int replicaIdx, const MSGTYPE &msg) {
+    Slot *slot = Insert(id, replicaIdx);
+    if (slot == NULL) {
+      return false;
+    }
+    if (keepMessages) {
+      slot->messages[replicaIdx] = msg;
+    }
+    return CheckForQuorum(id);
+  }
+
+  void Add(uint64_t id, int replicaIdx, const MSGTYPE &msg) {
+    AddAndCheckForQuorum(id, replicaIdx, msg);
+  }
+
+  // NULL unless constructed with keepMessages
+  const std::map<int, MSGTYPE> *GetMessages(uint64_t id) const {
+    const Slot *slot = window.Find(id);
+    if (!keepMessages || slot == NULL) {
+      return NULL;
+    }
+    return &slot->messages;
+  }
+
+ private:
+  struct Slot {
+    uint64_t voters = 0;
+    std::map<int, MSGTYPE> messages;
+  };
+
+  Slot *Insert(uint64_t id, int replicaIdx) {
+    ASSERT(replicaIdx >= 0 && replicaIdx < 64);
+    Slot *slot = window.Get(id);
+    if (slot != NULL) {
+      slot->voters |= uint64_t(1) << replicaIdx;
+    }
+    return slot;
+  }
+
+  int numRequired;
+  bool keepMessages;
+  QuorumWindow<Slot> window;
+};
+
 template <typename SeqNumType, typename MsgType>
 class ByzantineQuorumSet {
  private:
@@ -143,6 +330,82 @@ class ByzantineProtoQuorumSet {
   }
 };
 
+// ByzantineQuorumSet over a sliding window of sequence numbers. Each
+// sequence number keeps the distinct messages seen for it, each with a
+// bitmap of the replicas (below 64) that sent it.
+template <typename MsgType>
+class WindowedByzantineQuorumSet {
+ public:
+  static const size_t DEFAULT_WINDOW = 1024;
+
+  WindowedByzantineQuorumSet(int numRequired, size_t window = DEFAULT_WINDOW)
+      : numRequired(numRequired), window(window) {}
+  void Clear() { window.Clear(); }
+  void Clear(uint64_t seqNum) { window.Clear(seqNum); }
+  void Advance(uint64_t watermark) { window.Advance(watermark); }
+  uint64_t Watermark() const { return window.Watermark(); }
+
+  bool CheckForQuorum(uint64_t seqNum, const MsgType &msg) const {
+    const Slot *slot = window.Find(seqNum);
+    if (slot == NULL) {
+      return numRequired <= 0;
+    }
+    for (const auto &votes : *slot) {
+      if (votes.first == msg) {
+        return __builtin_popcountll(votes.second) >= numRequired;
+      }
+    }
+    return numRequired <= 0;
+  }
+
+  bool Add(uint64_t seqNum, int replicaId, const MsgType &msg) {
+    ASSERT(replicaId >= 0 && replicaId < 64);
+    Slot *slot = window.Get(seqNum);
+    if (slot == NULL) {
+      return false;
+    }
+    auto votes = slot->begin();
+    while (votes != slot->end() && !(votes->first == msg)) {
+      votes++;
+    }
+    if (votes == slot->end()) {
+      slot->emplace_back(msg, 0);
+      votes = slot->end() - 1;
+    }
+    votes->second |= uint64_t(1) << replicaId;
+    return __builtin_popcountll(votes->second) >= numRequired;
+  }
+
+ private:
+  typedef std::vector<std::pair<MsgType, uint64_t>> Slot;
+
+  int numRequired;
+  QuorumWindow<Slot> window;
+};
+
+template <typename MsgType,
+          typename = typename std::enable_if<
+              std::is_base_of<google::protobuf::Message, MsgType>::value>::type>
+class WindowedByzantineProtoQuorumSet {
+ private:
+  WindowedByzantineQuorumSet<std::string> inner;
+
+ public:
+  WindowedByzantineProtoQuorumSet(
+      int numRequired,
+      size_t window = WindowedByzantineQuorumSet<std::string>::DEFAULT_WINDOW)
+      : inner(numRequired, window) {}
+  void Clear() { inner.Clear(); }
+  void Clear(uint64_t seqNum) { inner.Clear(seqNum); }
+  void Advance(uint64_t watermark) { inner.Advance(watermark); }
+  bool CheckForQuorum(uint64_t seqNum, const MsgType &msg) const {
+    return inner.CheckForQuorum(seqNum, msg.SerializeAsString());
+  }
+  bool Add(uint64_t seqNum, int replicaId, const MsgType &msg) {
+    return inner.Add(seqNum, replicaId, msg.SerializeAsString());
+  }
+};
+
 }  // namespace dsnet
 
 #endif  // _COMMON_QUORUMSET_H_
@@ -92,4 +92,17 @@ Replica::UnloggedUpcall(const string &op, string &res)
     app->UnloggedUpcall(op, res);
 }
 
+bool
+Replica::Snapshot(string &snapshot)
+{
+    return app->SnapshotUpcall(snapshot);
+}
+
+void
+Replica::Restore(const string &snapshot)
+{
+    Debug("Restoring %zu byte snapshot", snapshot.size());
+    app->RestoreUpcall(snapshot);
+}
+
 } // namespace dsnet
@@ -70,6 +70,11 @@ public:
     virtual void CommitUpcall(opnum_t) { };
     // Invoke call back for unreplicated operations run on only one replica
     virtual void UnloggedUpcall(const string &str1, string &str2) { };
+    // Serialize the state left by every operation executed so far;
+    // returning false keeps the replica from truncating its log
+    virtual bool SnapshotUpcall(string &snapshot) { return false; };
+    // Replace the state with one serialized by SnapshotUpcall
+    virtual void RestoreUpcall(const string &snapshot) { };
 };
 
 class Replica : public TransportReceiver
@@ -79,6 +84,10 @@ public:
             bool initialize, Transport *transport, AppReplica *app);
     virtual ~Replica();
 
+    // Committed operations between checkpoints, for applications
+    // that implement SnapshotUpcall
+    static const opnum_t DEFAULT_CHECKPOINT_INTERVAL = 100000;
+
 protected:
     void LeaderUpcall(opnum_t opnum, const string &op, bool &replicate, string &res);
     void ReplicaUpcall(opnum_t opnum, const string &op, string &res,
@@ -97,6 +106,8 @@ protected:
     void Rollback(opnum_t current, opnum_t to, Log &log);
     void Commit(opnum_t op);
     void UnloggedUpcall(const string &op, string &res);
+    bool Snapshot(string &snapshot);
+    void Restore(const string &snapshot);
     template<class MSG> void ExecuteUnlogged(const UnloggedRequest & msg,
                                                MSG &reply);
 
@@ -2,7 +2,9 @@ d := $(dir $(lastword $(MAKEFILE_LIST)))
 
 SRCS += $(addprefix $(d), \
 	lookup3.cc message.cc memory.cc \
-	latency.cc configuration.cc transport.cc udptransport.cc simtransport.cc)
+	latency.cc configuration.cc transport.cc udptransport.cc simtransport.cc \
+	iouringtransport.cc timerwheel.cc shmtransport.cc sigpipeline.cc \
+	signature.cc)
 
 PROTOS += $(addprefix $(d), \
           latency-format.proto)
@@ -19,8 +21,16 @@ LIB-latency := $(o)latency.o $(o)latency-format.o $(LIB-message)
 
 LIB-configuration := $(o)configuration.o $(LIB-message)
 
-LIB-transport := $(o)transport.o $(LIB-message) $(LIB-configuration)
+LIB-transport := $(o)transport.o $(o)timerwheel.o $(LIB-message) $(LIB-configuration)
+
+LIB-sigpipeline := $(o)sigpipeline.o $(LIB-message)
+
+LIB-signature := $(o)signature.o $(LIB-message)
 
 LIB-simtransport := $(o)simtransport.o $(LIB-transport)
 
 LIB-udptransport := $(o)udptransport.o $(LIB-transport)
+
+LIB-iouringtransport := $(o)iouringtransport.o $(LIB-udptransport)
+
+LIB-shmtransport := $(o)shmtransport.o $(LIB-transport)
@@ -4,6 +4,7 @@
 #include <rte_lcore.h>
 #include <rte_ethdev.h>
 #include <rte_mbuf.h>
+#include <rte_cycles.h>
 #include <rte_malloc.h>
 
 #include "lib/dpdktransport.h"
@@ -86,7 +87,7 @@ ConstructArguments(int argc, char **argv, const std::string &cmdline)
 
 DPDKTransport::DPDKTransport(int dev_port, double drop_rate, const std::string &cmdline)
     : dev_port_(dev_port), drop_rate_(drop_rate), status_(STOPPED),
-    multicast_addr_(nullptr), last_timer_id_(0)
+    multicast_addr_(nullptr)
 {
     // Initialize DPDK
     int argc = 4;
@@ -116,9 +117,11 @@ DPDKTransport::DPDKTransport(int dev_port, double drop_rate, const std::string &
     if (pktmbuf_pool_ == nullptr) {
         Panic("rte_pktmbuf_pool_create failed");
     }
-    // Initialize timer library
-    if (rte_timer_subsystem_init() != 0) {
-        Panic("rte_timer_subsystem_init failed");
+    // Timers are polled from the receive loop
+    timer_epoch_ = rte_get_timer_cycles();
+    cycles_per_us_ = rte_get_timer_hz() / 1000000;
+    if (cycles_per_us_ == 0) {
+        cycles_per_us_ = 1;
     }
 
     // Initialize port
@@ -232,53 +235,38 @@ DPDKTransport::Stop()
     status_ = STOPPED;
 }
 
+uint64_t
+DPDKTransport::TimerNow() const
+{
+    return (rte_get_timer_cycles() - timer_epoch_) / cycles_per_us_;
+}
+
 int
 DPDKTransport::Timer(uint64_t ms, timer_callback_t cb)
 {
-    static const double hz = rte_get_timer_hz();
     std::lock_guard<std::mutex> lck(timers_lock_);
-    DPDKTransportTimerInfo *info = new DPDKTransportTimerInfo();
-
-    info->transport = this;
-    info->cb = cb;
-    rte_timer_init(&info->timer);
-    info->id = ++last_timer_id_;
-    timers_[info->id] = info;
-
-    uint64_t ticks = hz / (1000 / (double)ms);
-    rte_timer_reset(&info->timer, ticks, SINGLE, rte_lcore_id(), TimerCallback, info);
-
-    return info->id;
+    return timers_.Add(TimerNow() + ms * 1000, std::move(cb));
 }
 
 bool
 DPDKTransport::CancelTimer(int id)
 {
     std::lock_guard<std::mutex> lck(timers_lock_);
+    return timers_.Cancel(id);
+}
 
-    if (timers_.find(id) == timers_.end()) {
-        return false;
-    }
-
-    DPDKTransportTimerInfo *info = timers_.at(id);
-    if (info == nullptr) {
-        return false;
-    }
-
-    rte_timer_stop(&info->timer);
-    timers_.erase(info->id);
-    delete info;
-
-    return true;
+bool
+DPDKTransport::RearmTimer(int id, uint64_t ms)
+{
+    std::lock_guard<std::mutex> lck(timers_lock_);
+    return timers_.Rearm(id, TimerNow() + ms * 1000);
 }
 
 void
 DPDKTransport::CancelAllTimers()
 {
-    while (!timers_.empty()) {
-        auto kv = timers_.begin();
-        CancelTimer(kv->first);
-    }
+    std::lock_guard<std::mutex> lck(timers_lock_);
+    timers_.Clear();
 }
 
 bool
@@ -400,7 +388,7 @@ DPDKTransport::RunTransport(int tid)
     while (status_ == RUNNING) {
         cur_tsc = rte_rdtsc();
         if (cur_tsc - prev_tsc > timer_resolution_cycles) {
-            rte_timer_manage();
+            OnTimers();
             prev_tsc = cur_tsc;
         }
         n_rx = rte_eth_rx_burst(dev_port_,
@@ -469,23 +457,16 @@ DPDKTransport::RouteToReceiver(const DPDKTransportAddress &addr)
 }
 
 void
-DPDKTransport::TimerCallback(struct rte_timer *timer, void *arg)
-{
-    DPDKTransport::DPDKTransportTimerInfo *info =
-        (DPDKTransport::DPDKTransportTimerInfo *)arg;
-    info->transport->OnTimer(info);
-}
-
-void
-DPDKTransport::OnTimer(DPDKTransportTimerInfo *info)
+DPDKTransport::OnTimers()
 {
-    {
-        std::lock_guard<std::mutex> lck(timers_lock_);
-        timers_.erase(info->id);
+    timer_callback_t cb;
+    std::unique_lock<std::mutex> lck(timers_lock_);
+    uint64_t now = TimerNow();
+    while (timers_.PopExpired(now, cb)) {
+        lck.unlock();
+        cb();
+        lck.lock();
     }
-
-    info->cb();
-    delete info;
 }
 
 } // namespace dsnet
@@ -2,9 +2,9 @@
 
 #include <rte_ether.h>
 #include <rte_byteorder.h>
-#include <rte_timer.h>
 
 #include "lib/configuration.h"
+#include "lib/timerwheel.h"
 #include "lib/transport.h"
 #include "lib/transportcommon.h"
 
@@ -47,19 +47,12 @@ public:
     virtual void Stop() override;
     virtual int Timer(uint64_t ms, timer_callback_t cb) override;
     virtual bool CancelTimer(int id) override;
+    virtual bool RearmTimer(int id, uint64_t ms) override;
     virtual void CancelAllTimers() override;
     virtual ReplicaAddress
     ReverseLookupAddress(const TransportAddress &addr) const override;
 
 private:
-    struct DPDKTransportTimerInfo
-    {
-        DPDKTransport *transport;
-        timer_callback_t cb;
-        struct rte_timer timer;
-        int id;
-    };
-
     int dev_port_;
     double drop_rate_;
     volatile enum {
@@ -69,9 +62,11 @@ private:
     std::unordered_map<uint16_t, TransportReceiver *> receivers_;
     DPDKTransportAddress *multicast_addr_;
     std::vector<TransportReceiver *> multicast_receivers_;
-    std::unordered_map<int, DPDKTransportTimerInfo *> timers_;
+    // Ticks are microseconds of the TSC since construction
+    TimerWheel timers_;
     std::mutex timers_lock_;
-    int last_timer_id_;
+    uint64_t timer_epoch_;
+    uint64_t cycles_per_us_;
     struct rte_mempool *pktmbuf_pool_;
 
     virtual bool SendMessageInternal(TransportReceiver *src,
@@ -81,8 +76,8 @@ private:
     LookupAddressInternal(const ReplicaAddress &addr) const override;
     void RunTransport(int tid);
     TransportReceiver *RouteToReceiver(const DPDKTransportAddress &addr);
-    static void TimerCallback(struct rte_timer *timer, void *arg);
-    void OnTimer(DPDKTransportTimerInfo *info);
+    uint64_t TimerNow() const;
+    void OnTimers();
 };
 
 } // namespace dsnet
@@ -0,0 +1,175 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * fragmentreassembler.h:
+ *   reassembly of messages sent as several datagrams
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **********************************************************************/
+
+#pragma once
+
+#include "lib/message.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace dsnet {
+
+// Fragments are fixed-size slices of a message (the last one may be
+// shorter), identified by sender, message id and offset. They may
+// arrive in any order, interleaved with fragments of other messages,
+// and duplicates are ignored. The whole message buffer is allocated
+// when its first fragment arrives; the total held by partial messages
+// is capped, the least recently active ones making room for new
+// ones. Not thread safe.
+template <typename ADDR>
+class FragmentReassembler
+{
+public:
+    FragmentReassembler(size_t fragSize, size_t maxBytes)
+        : fragSize(fragSize), maxBytes(maxBytes), bytes(0) { }
+
+    // Returns true when this fragment completes its message; msg
+    // then holds all msgLen bytes of it. now is only used to order
+    // and expire partial messages.
+    bool Add(const ADDR &src, uint64_t msgId,
+             size_t fragStart, size_t msgLen,
+             const char *data, size_t len, uint64_t now,
+             std::unique_ptr<char[]> &msg)
+    {
+        if (msgLen == 0 || fragStart >= msgLen ||
+            fragStart % fragSize != 0 ||
+            len != std::min(msgLen - fragStart, fragSize)) {
+            Warning("Dropping malformed fragment of message %lx "
+                    "(offset %zu, %zu of %zu bytes)",
+                    msgId, fragStart, len, msgLen);
+            return false;
+        }
+
+        Key key(src, msgId);
+        auto it = partials.find(key);
+        if (it == partials.end()) {
+            if (msgLen > maxBytes) {
+                Warning("Dropping fragment of %zu byte message %lx; "
+                        "reassembly is limited to %zu bytes",
+                        msgLen, msgId, maxBytes);
+                return false;
+            }
+            while (bytes + msgLen > maxBytes) {
+                EvictOldest();
+            }
+            size_t frags = (msgLen + fragSize - 1) / fragSize;
+            it = partials.insert(std::make_pair(key, Partial())).first;
+            Partial &p = it->second;
+            p.buf.reset(new char[msgLen]);
+            p.len = msgLen;
+            p.received.assign((frags + 63) / 64, 0);
+            p.missing = frags;
+            bytes += msgLen;
+        } else if (it->second.len != msgLen) {
+            Warning("Dropping fragment of message %lx with "
+                    "inconsistent length %zu (expected %zu)",
+                    msgId, msgLen, it->second.len);
+            return false;
+        }
+
+        Partial &p = it->second;
+        p.lastActive = now;
+        size_t frag = fragStart / fragSize;
+        uint64_t bit = 1ULL << (frag % 64);
+        if (p.received[frag / 64] & bit) {
+            return false;
+        }
+        p.received[frag / 64] |= bit;
+        memcpy(&p.buf[fragStart], data, len);
+        if (--p.missing > 0) {
+            return false;
+        }
+
+        msg = std::move(p.buf);
+        bytes -= p.len;
+        partials.erase(it);
+        return true;
+    }
+
+    // Drop partial messages that have not received a fragment since
+    // the given time. Returns how many were dropped.
+    size_t Expire(uint64_t before)
+    {
+        size_t n = 0;
+        for (auto it = partials.begin(); it != partials.end(); ) {
+            if (it->second.lastActive < before) {
+                Warning("Timed out reassembling %zu byte message %lx",
+                        it->second.len, it->first.second);
+                bytes -= it->second.len;
+                it = partials.erase(it);
+                n++;
+            } else {
+                ++it;
+            }
+        }
+        return n;
+    }
+
+    bool Empty() const { return partials.empty(); }
+    size_t Pending() const { return partials.size(); }
+    size_t Bytes() const { return bytes; }
+
+private:
+    typedef std::pair<ADDR, uint64_t> Key;
+    struct Partial
+    {
+        std::unique_ptr<char[]> buf;
+        size_t len;
+        std::vector<uint64_t> received; // one bit per fragment
+        size_t missing;
+        uint64_t lastActive;
+    };
+
+    const size_t fragSize;
+    const size_t maxBytes;
+    size_t bytes;
+    std::map<Key, Partial> partials;
+
+    void EvictOldest()
+    {
+        auto oldest = partials.begin();
+        for (auto it = partials.begin(); it != partials.end(); ++it) {
+            if (it->second.lastActive < oldest->second.lastActive) {
+                oldest = it;
+            }
+        }
+        Warning("Evicting partial %zu byte message %lx to make room",
+                oldest->second.len, oldest->first.second);
+        bytes -= oldest->second.len;
+        partials.erase(oldest);
+    }
+};
+
+} // namespace dsnet
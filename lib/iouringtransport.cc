@@ -0,0 +1,968 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * iouringtransport.cc:
+ *   message-passing network interface that uses UDP message delivery
+ *   driven by io_uring
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **********************************************************************/
+
+#include "lib/assert.h"
+#include "lib/configuration.h"
+#include "lib/message.h"
+#include "lib/iouringtransport.h"
+#include "lib/udptransport-wire.h"
+
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+namespace dsnet {
+
+static const size_t CACHE_LINE_SIZE = 64;
+// A provided receive buffer holds the recvmsg header the kernel
+// writes, the sender address and one datagram.
+static const size_t RECV_SLOT_SIZE =
+    (sizeof(struct io_uring_recvmsg_out) + sizeof(sockaddr_in) +
+     MAX_UDP_MESSAGE_SIZE + FRAG_HEADER_LEN + CACHE_LINE_SIZE - 1) &
+    ~(CACHE_LINE_SIZE - 1);
+static const unsigned RECV_BUF_COUNT = 1024;    // power of two
+static const unsigned short RECV_BUF_GROUP = 0;
+static const size_t SEND_SLOT_SIZE =
+    (MAX_UDP_MESSAGE_SIZE + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1);
+
+// The low bits of user_data say what kind of request completed; the
+// rest is a pointer to its state.
+enum {
+    OP_RECV = 0,
+    OP_SEND = 1,
+    OP_OTHER = 2,
+};
+static const uint64_t OP_MASK = 3;
+
+static inline uint64_t
+Tag(const void *p, int op)
+{
+    return (uint64_t)(uintptr_t)p | op;
+}
+
+template <typename T>
+static inline T *
+Untag(uint64_t data)
+{
+    return (T *)(uintptr_t)(data & ~OP_MASK);
+}
+
+// Transport whose Run() loop is on this thread. Requests prepared
+// from inside the loop are submitted together on the next pass;
+// anything prepared elsewhere is submitted right away.
+static thread_local IOUringTransport *loopTransport = nullptr;
+
+// Serialization buffer for messages too large for a send slot
+static thread_local std::vector<char> largeSendBuffer;
+
+static int
+io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int
+io_uring_enter(int fd, unsigned toSubmit, unsigned minComplete,
+               unsigned flags, const void *arg = nullptr,
+               size_t argSize = 0)
+{
+    return syscall(__NR_io_uring_enter, fd, toSubmit, minComplete,
+                   flags, arg, argSize);
+}
+
+static int
+io_uring_register(int fd, unsigned opcode, void *arg, unsigned nrArgs)
+{
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs);
+}
+
+IOUringTransport::IOUringTransport(double dropRate, int queueDepth)
+    : dropRate(dropRate),
+      reassembler(MAX_UDP_MESSAGE_SIZE, MAX_REASSEMBLY_BYTES),
+      fragSweepPending(false)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    // Leave room for receive completions on top of a full SQ
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = queueDepth * 4;
+    if ((ringFd = io_uring_setup(queueDepth, &params)) < 0) {
+        PPanic("Failed to set up io_uring");
+    }
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes +
+        params.cq_entries * sizeof(struct io_uring_cqe);
+    bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap) {
+        sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+    }
+    sqRingPtr = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if (sqRingPtr == MAP_FAILED) {
+        PPanic("Failed to map io_uring submission ring");
+    }
+    if (singleMmap) {
+        cqRingPtr = sqRingPtr;
+    } else {
+        cqRingPtr = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ringFd,
+                         IORING_OFF_CQ_RING);
+        if (cqRingPtr == MAP_FAILED) {
+            PPanic("Failed to map io_uring completion ring");
+        }
+    }
+    sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes = (struct io_uring_sqe *)mmap(nullptr, sqesSize,
+                                       PROT_READ | PROT_WRITE,
+                                       MAP_SHARED | MAP_POPULATE,
+                                       ringFd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        PPanic("Failed to map io_uring SQEs");
+    }
+
+    char *sq = (char *)sqRingPtr;
+    sqHead = (unsigned *)(sq + params.sq_off.head);
+    sqTail = (unsigned *)(sq + params.sq_off.tail);
+    sqMask = *(unsigned *)(sq + params.sq_off.ring_mask);
+    sqEntries = params.sq_entries;
+    unsigned *sqArray = (unsigned *)(sq + params.sq_off.array);
+    for (unsigned i = 0; i < sqEntries; i++) {
+        sqArray[i] = i;
+    }
+    sqLocalTail = *sqTail;
+
+    char *cq = (char *)cqRingPtr;
+    cqHead = (unsigned *)(cq + params.cq_off.head);
+    cqTail = (unsigned *)(cq + params.cq_off.tail);
+    cqMask = *(unsigned *)(cq + params.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    // Register the provided buffer ring receives are filled from
+    recvBufCount = RECV_BUF_COUNT;
+    bufRingSize = recvBufCount * sizeof(struct io_uring_buf);
+    bufRing = (struct io_uring_buf_ring *)mmap(nullptr, bufRingSize,
+                                               PROT_READ | PROT_WRITE,
+                                               MAP_PRIVATE | MAP_ANONYMOUS,
+                                               -1, 0);
+    if (bufRing == MAP_FAILED) {
+        PPanic("Failed to allocate io_uring buffer ring");
+    }
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)bufRing;
+    reg.ring_entries = recvBufCount;
+    reg.bgid = RECV_BUF_GROUP;
+    if (io_uring_register(ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        PPanic("Failed to register io_uring buffer ring");
+    }
+    recvBuffers = (char *)aligned_alloc(CACHE_LINE_SIZE,
+                                        recvBufCount * RECV_SLOT_SIZE);
+    if (recvBuffers == nullptr) {
+        Panic("Failed to allocate receive buffers");
+    }
+    bufRingTail = 0;
+    for (unsigned i = 0; i < recvBufCount; i++) {
+        RecycleBuffer(i);
+    }
+
+    // Send slots, each with its own buffer and msghdr
+    sendBuffers = (char *)aligned_alloc(CACHE_LINE_SIZE,
+                                        queueDepth * SEND_SLOT_SIZE);
+    if (sendBuffers == nullptr) {
+        Panic("Failed to allocate send buffers");
+    }
+    sendSlots.resize(queueDepth);
+    for (int i = 0; i < queueDepth; i++) {
+        sendSlots[i].buf = &sendBuffers[i * SEND_SLOT_SIZE];
+        freeSendSlots.push_back(&sendSlots[i]);
+    }
+
+    lastFragMsgId = 0;
+    clock_gettime(CLOCK_MONOTONIC, &timerEpoch);
+    waitDeadline = UINT64_MAX;
+    stopped = false;
+    memset(&stats, 0, sizeof(stats));
+
+    struct timeval tv;
+    uniformDist = std::uniform_real_distribution<double>(0.0, 1.0);
+    gettimeofday(&tv, NULL);
+    randomEngine.seed(tv.tv_usec);
+    if (dropRate > 0) {
+        Warning("Dropping packets with probability %g", dropRate);
+    }
+
+    // Handle SIGTERM/SIGINT on the loop like the libevent transport
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGINT);
+    if (pthread_sigmask(SIG_BLOCK, &mask, nullptr) != 0) {
+        Warning("Failed to block SIGTERM/SIGINT");
+    }
+    if ((signalFd = signalfd(-1, &mask, SFD_CLOEXEC)) < 0) {
+        PPanic("Failed to create signalfd");
+    }
+    ArmSignalRead();
+
+    Notice("Using io_uring with %u SQEs, %u receive buffers",
+           sqEntries, recvBufCount);
+}
+
+IOUringTransport::~IOUringTransport()
+{
+    // Closing the ring cancels everything still in flight
+    close(ringFd);
+    close(signalFd);
+    for (Listener *l : listeners) {
+        close(l->fd);
+        delete l;
+    }
+    munmap(sqes, sqesSize);
+    if (cqRingPtr != sqRingPtr) {
+        munmap(cqRingPtr, cqRingSize);
+    }
+    munmap(sqRingPtr, sqRingSize);
+    munmap(bufRing, bufRingSize);
+    free(recvBuffers);
+    free(sendBuffers);
+}
+
+UDPTransportAddress
+IOUringTransport::LookupAddressInternal(const dsnet::ReplicaAddress &addr) const
+{
+    int res;
+    struct addrinfo hints;
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_protocol = 0;
+    hints.ai_flags    = 0;
+    struct addrinfo *ai;
+    if ((res = getaddrinfo(addr.host.c_str(), addr.port.c_str(), &hints, &ai))) {
+        Panic("Failed to resolve %s:%s: %s",
+              addr.host.c_str(), addr.port.c_str(), gai_strerror(res));
+    }
+    if (ai->ai_addr->sa_family != AF_INET) {
+        Panic("getaddrinfo returned a non IPv4 address");
+    }
+    UDPTransportAddress out =
+        UDPTransportAddress(*((sockaddr_in *)ai->ai_addr));
+    freeaddrinfo(ai);
+    return out;
+}
+
+ReplicaAddress
+IOUringTransport::ReverseLookupAddress(const TransportAddress &addr) const
+{
+    const UDPTransportAddress *ua = dynamic_cast<const UDPTransportAddress *>(&addr);
+    char buf[16];
+    inet_ntop(AF_INET, &(ua->addr.sin_addr), buf, 16);
+    return ReplicaAddress(std::string(buf), std::to_string(ntohs(ua->addr.sin_port)));
+}
+
+int
+IOUringTransport::NewSocket(const sockaddr_in &sin, bool reuseAddr)
+{
+    int fd;
+    if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+        PPanic("Failed to create socket to listen");
+    }
+
+    // Completion-based I/O never blocks on the socket itself, but
+    // the sendto fallback must not either
+    if (fcntl(fd, F_SETFL, O_NONBLOCK, 1)) {
+        PWarning("Failed to set O_NONBLOCK");
+    }
+
+    int n = 1;
+    if (setsockopt(fd, SOL_SOCKET,
+                   SO_BROADCAST, (char *)&n, sizeof(n)) < 0) {
+        PWarning("Failed to set SO_BROADCAST on socket");
+    }
+    if (reuseAddr && setsockopt(fd, SOL_SOCKET,
+                                SO_REUSEADDR, (char *)&n, sizeof(n)) < 0) {
+        PWarning("Failed to set SO_REUSEADDR on socket");
+    }
+
+    n = SOCKET_BUF_SIZE;
+    if (setsockopt(fd, SOL_SOCKET,
+                   SO_RCVBUF, (char *)&n, sizeof(n)) < 0) {
+        PWarning("Failed to set SO_RCVBUF on socket");
+    }
+    if (setsockopt(fd, SOL_SOCKET,
+                   SO_SNDBUF, (char *)&n, sizeof(n)) < 0) {
+        PWarning("Failed to set SO_SNDBUF on socket");
+    }
+
+    Notice("Binding to %s:%d", inet_ntoa(sin.sin_addr), htons(sin.sin_port));
+    if (bind(fd, (const sockaddr *)&sin, sizeof(sin)) < 0) {
+        PPanic("Failed to bind to socket");
+    }
+    return fd;
+}
+
+void
+IOUringTransport::RegisterInternal(TransportReceiver *receiver,
+                                   const dsnet::ReplicaAddress *addr,
+                                   int groupIdx, int replicaIdx)
+{
+    struct sockaddr_in sin;
+    if (addr != nullptr) {
+        sin = LookupAddressInternal(*addr).addr;
+    } else {
+        memset(&sin, 0, sizeof(sin));
+        sin.sin_family = AF_INET;
+        sin.sin_port = 0;
+    }
+    int fd = NewSocket(sin, false);
+
+    // Tell the receiver its address
+    socklen_t sinsize = sizeof(sin);
+    if (getsockname(fd, (sockaddr *) &sin, &sinsize) < 0) {
+        PPanic("Failed to get socket name");
+    }
+    UDPTransportAddress *uaddr = new UDPTransportAddress(sin);
+    receiver->SetAddress(uaddr);
+
+    // Update mappings
+    receivers[fd] = receiver;
+    fds[receiver] = fd;
+
+    AddListener(fd);
+
+    Notice("Listening on UDP port %hu", ntohs(sin.sin_port));
+}
+
+void
+IOUringTransport::ListenOnMulticast(TransportReceiver *src,
+                                    const dsnet::Configuration &config)
+{
+    if (configurations.find(src) == configurations.end()) {
+        Panic("Register address first before listening on multicast");
+    }
+    dsnet::Configuration *canonical = configurations.at(src);
+
+    if (!canonical->multicast()) {
+        // No multicast address specified
+        return;
+    }
+
+    if (multicastFds.find(canonical) != multicastFds.end()) {
+        // We're already listening
+        return;
+    }
+
+    int fd = NewSocket(LookupAddressInternal(*canonical->multicast()).addr,
+                       true);
+    multicastFds[canonical] = fd;
+    multicastConfigs[fd] = canonical;
+    AddListener(fd);
+
+    Notice("Listening for multicast requests on %s:%s",
+           canonical->multicast()->host.c_str(),
+           canonical->multicast()->port.c_str());
+}
+
+void
+IOUringTransport::AddListener(int fd)
+{
+    Listener *listener = new Listener();
+    listener->fd = fd;
+    memset(&listener->hdr, 0, sizeof(listener->hdr));
+    listener->hdr.msg_namelen = sizeof(sockaddr_in);
+    listeners.push_back(listener);
+    ArmReceive(listener);
+}
+
+void
+IOUringTransport::ArmReceive(Listener *listener)
+{
+    std::lock_guard<std::mutex> l(sqLock);
+    struct io_uring_sqe *sqe = GetSQE();
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = listener->fd;
+    sqe->addr = (uint64_t)(uintptr_t)&listener->hdr;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = RECV_BUF_GROUP;
+    sqe->user_data = Tag(listener, OP_RECV);
+    if (!OnLoopThread()) {
+        SubmitLocked();
+    }
+}
+
+void
+IOUringTransport::RecycleBuffer(unsigned short bid)
+{
+    // Index the entries by hand: in C++ the kernel header's flexible
+    // array member does not start at offset 0 as it does in C.
+    struct io_uring_buf *buf = &((struct io_uring_buf *)bufRing)[
+        bufRingTail & (recvBufCount - 1)];
+    buf->addr = (uint64_t)(uintptr_t)&recvBuffers[bid * RECV_SLOT_SIZE];
+    buf->len = RECV_SLOT_SIZE;
+    buf->bid = bid;
+    bufRingTail++;
+    __atomic_store_n(&bufRing->tail, bufRingTail, __ATOMIC_RELEASE);
+}
+
+bool
+IOUringTransport::OnLoopThread() const
+{
+    return loopTransport == this;
+}
+
+// Requires sqLock
+struct io_uring_sqe *
+IOUringTransport::GetSQE()
+{
+    while (sqLocalTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) ==
+           sqEntries) {
+        // Full: hand what we have to the kernel
+        SubmitLocked();
+    }
+    struct io_uring_sqe *sqe = &sqes[sqLocalTail & sqMask];
+    memset(sqe, 0, sizeof(*sqe));
+    sqLocalTail++;
+    stats.sqes++;
+    return sqe;
+}
+
+// Requires sqLock. Makes prepared SQEs visible to the kernel and
+// returns how many it has not consumed yet.
+unsigned
+IOUringTransport::Publish()
+{
+    __atomic_store_n(sqTail, sqLocalTail, __ATOMIC_RELEASE);
+    return sqLocalTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+}
+
+// Requires sqLock
+void
+IOUringTransport::SubmitLocked()
+{
+    unsigned toSubmit = Publish();
+    if (toSubmit == 0) {
+        return;
+    }
+    stats.enters++;
+    if (io_uring_enter(ringFd, toSubmit, 0, 0) < 0 &&
+        errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        PWarning("Failed to submit io_uring requests");
+    }
+}
+
+void
+IOUringTransport::Run()
+{
+    IOUringTransport *prev = loopTransport;
+    loopTransport = this;
+    stopped = false;
+
+    while (!stopped) {
+        // One io_uring_enter both submits everything the last pass
+        // prepared and waits for the next completion, or until the
+        // next timer is due.
+        unsigned toSubmit;
+        {
+            std::lock_guard<std::mutex> l(sqLock);
+            toSubmit = Publish();
+            stats.enters++;
+        }
+        struct io_uring_getevents_arg arg;
+        struct __kernel_timespec ts;
+        unsigned flags = IORING_ENTER_GETEVENTS;
+        const void *argp = nullptr;
+        size_t argSize = 0;
+        {
+            std::lock_guard<std::mutex> l(timersLock);
+            waitDeadline = timers.NextExpiry();
+            if (waitDeadline != UINT64_MAX) {
+                uint64_t now = TimerNow();
+                uint64_t delay = waitDeadline > now ? waitDeadline - now : 0;
+                ts.tv_sec = delay / 1000000;
+                ts.tv_nsec = (delay % 1000000) * 1000;
+                memset(&arg, 0, sizeof(arg));
+                arg.ts = (uint64_t)(uintptr_t)&ts;
+                flags |= IORING_ENTER_EXT_ARG;
+                argp = &arg;
+                argSize = sizeof(arg);
+            }
+        }
+        if (io_uring_enter(ringFd, toSubmit, 1, flags, argp, argSize) < 0 &&
+            errno != EINTR && errno != EAGAIN && errno != EBUSY &&
+            errno != ETIME) {
+            PPanic("Failed to wait for io_uring completions");
+        }
+        ReapCompletions();
+        OnTimers();
+    }
+
+    {
+        std::lock_guard<std::mutex> l(sqLock);
+        SubmitLocked();
+    }
+    loopTransport = prev;
+}
+
+void
+IOUringTransport::Stop()
+{
+    stopped = true;
+    if (!OnLoopThread()) {
+        Wake();
+    }
+}
+
+void
+IOUringTransport::Wake()
+{
+    // A no-op completion ends the loop's wait
+    std::lock_guard<std::mutex> l(sqLock);
+    struct io_uring_sqe *sqe = GetSQE();
+    sqe->opcode = IORING_OP_NOP;
+    sqe->user_data = Tag(nullptr, OP_OTHER);
+    SubmitLocked();
+}
+
+void
+IOUringTransport::ReapCompletions()
+{
+    unsigned head = *cqHead;
+    unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        // Copy the CQE out and release its slot before running any
+        // handler, which may well generate more completions.
+        struct io_uring_cqe cqe = cqes[head & cqMask];
+        __atomic_store_n(cqHead, ++head, __ATOMIC_RELEASE);
+        stats.cqes++;
+
+        switch (cqe.user_data & OP_MASK) {
+        case OP_RECV:
+            OnReceive(Untag<Listener>(cqe.user_data), cqe);
+            break;
+        case OP_SEND:
+            OnSendComplete(Untag<SendSlot>(cqe.user_data), cqe.res);
+            break;
+        default:
+            if (Untag<void>(cqe.user_data) == &sigInfo) {
+                OnSignal();
+            }
+            break;
+        }
+
+        if (head == tail) {
+            tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        }
+    }
+}
+
+void
+IOUringTransport::OnReceive(Listener *listener,
+                            const struct io_uring_cqe &cqe)
+{
+    if (cqe.res >= 0) {
+        ASSERT(cqe.flags & IORING_CQE_F_BUFFER);
+        unsigned short bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+        char *buf = &recvBuffers[bid * RECV_SLOT_SIZE];
+        struct io_uring_recvmsg_out *out =
+            (struct io_uring_recvmsg_out *)buf;
+        if (out->flags & MSG_TRUNC) {
+            Warning("Dropping oversized %u byte packet", out->payloadlen);
+        } else {
+            sockaddr_in *sender = (sockaddr_in *)(buf + sizeof(*out));
+            char *payload = buf + sizeof(*out) +
+                listener->hdr.msg_namelen + listener->hdr.msg_controllen;
+            stats.rxPackets++;
+            ProcessPacket(listener->fd, *sender, payload, out->payloadlen);
+        }
+        RecycleBuffer(bid);
+    } else if (cqe.res == -EBADF || cqe.res == -ECANCELED) {
+        return;
+    } else if (cqe.res != -ENOBUFS) {
+        errno = -cqe.res;
+        PWarning("Failed to receive message from socket");
+    }
+
+    // The kernel stops a multishot receive when it runs out of
+    // buffers or hits an error; start it again.
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+        stats.rxRearms++;
+        ArmReceive(listener);
+    }
+}
+
+bool
+IOUringTransport::SendMessageInternal(TransportReceiver *src,
+                                      const UDPTransportAddress &dst,
+                                      const Message &m)
+{
+    int fd = fds[src];
+    size_t msg_len = sizeof(Preamble) + m.SerializedSize();
+
+    if (msg_len > MAX_UDP_MESSAGE_SIZE) {
+        // Large messages are rare; send their fragments directly
+        // once everything queued ahead of them has been submitted.
+        if (largeSendBuffer.size() < msg_len) {
+            largeSendBuffer.resize(msg_len);
+        }
+        char *buf = largeSendBuffer.data();
+        *(Preamble *)buf = NONFRAG_MAGIC;
+        m.Serialize(buf + sizeof(Preamble));
+        {
+            std::lock_guard<std::mutex> l(sqLock);
+            SubmitLocked();
+        }
+        Debug("Sending large %s message in %zu fragments",
+              m.Type().c_str(),
+              ((msg_len - sizeof(Preamble) - 1) / MAX_UDP_MESSAGE_SIZE) + 1);
+        return SendFragments(fd, dst.addr, buf + sizeof(Preamble),
+                             msg_len - sizeof(Preamble));
+    }
+
+    SendSlot *slot = nullptr;
+    {
+        std::lock_guard<std::mutex> l(sqLock);
+        if (!freeSendSlots.empty()) {
+            slot = freeSendSlots.back();
+            freeSendSlots.pop_back();
+        } else {
+            // Sending directly below must not overtake the sends
+            // still queued, as with large messages
+            stats.txFallbacks++;
+            SubmitLocked();
+        }
+    }
+
+    if (slot == nullptr) {
+        // Every slot is in flight; don't wait for completions
+        static thread_local char buf[MAX_UDP_MESSAGE_SIZE];
+        *(Preamble *)buf = NONFRAG_MAGIC;
+        m.Serialize(buf + sizeof(Preamble));
+        if (sendto(fd, buf, msg_len, 0,
+                   (const sockaddr *)&dst.addr, sizeof(dst.addr)) < 0) {
+            PWarning("Failed to send message");
+            return false;
+        }
+        return true;
+    }
+
+    *(Preamble *)slot->buf = NONFRAG_MAGIC;
+    m.Serialize(slot->buf + sizeof(Preamble));
+    slot->addr = dst.addr;
+    slot->iov.iov_base = slot->buf;
+    slot->iov.iov_len = msg_len;
+    memset(&slot->hdr, 0, sizeof(slot->hdr));
+    slot->hdr.msg_name = &slot->addr;
+    slot->hdr.msg_namelen = sizeof(slot->addr);
+    slot->hdr.msg_iov = &slot->iov;
+    slot->hdr.msg_iovlen = 1;
+
+    std::lock_guard<std::mutex> l(sqLock);
+    struct io_uring_sqe *sqe = GetSQE();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)&slot->hdr;
+    sqe->len = 1;
+    sqe->user_data = Tag(slot, OP_SEND);
+    stats.txPackets++;
+    if (!OnLoopThread()) {
+        SubmitLocked();
+    }
+    return true;
+}
+
+void
+IOUringTransport::OnSendComplete(SendSlot *slot, int res)
+{
+    if (res < 0) {
+        errno = -res;
+        PWarning("Failed to send message");
+    }
+    std::lock_guard<std::mutex> l(sqLock);
+    freeSendSlots.push_back(slot);
+}
+
+bool
+IOUringTransport::SendFragments(int fd, const sockaddr_in &dst,
+                                const char *body, size_t len)
+{
+    uint64_t msg_id = ++lastFragMsgId;
+    char frag_header[FRAG_HEADER_LEN];
+    struct iovec iov[2];
+    iov[0].iov_base = frag_header;
+    iov[0].iov_len = FRAG_HEADER_LEN;
+    struct msghdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_name = const_cast<sockaddr_in *>(&dst);
+    hdr.msg_namelen = sizeof(dst);
+    hdr.msg_iov = iov;
+    hdr.msg_iovlen = 2;
+
+    for (size_t frag_start = 0; frag_start < len;
+            frag_start += MAX_UDP_MESSAGE_SIZE) {
+        size_t frag_len = std::min(len - frag_start, MAX_UDP_MESSAGE_SIZE);
+        char *ptr = frag_header;
+        *((Preamble *)ptr) = FRAG_MAGIC;
+        ptr += sizeof(Preamble);
+        *((uint64_t *)ptr) = msg_id;
+        ptr += sizeof(uint64_t);
+        *((size_t *)ptr) = frag_start;
+        ptr += sizeof(size_t);
+        *((size_t *)ptr) = len;
+        iov[1].iov_base = const_cast<char *>(&body[frag_start]);
+        iov[1].iov_len = frag_len;
+
+        if (sendmsg(fd, &hdr, 0) < 0) {
+            PWarning("Failed to send message fragment %ld", frag_start);
+            return false;
+        }
+    }
+    return true;
+}
+
+void
+IOUringTransport::ProcessPacket(int fd, const sockaddr_in &sender,
+                                char *buf, size_t sz)
+{
+    UDPTransportAddress sender_addr(sender);
+    std::unique_ptr<char[]> assembled;
+    void *msg_buf;
+    size_t msg_size;
+
+    if (sz <= sizeof(Preamble)) {
+        Warning("Received runt packet");
+        return;
+    }
+    Preamble magic = *(Preamble *)buf;
+    if (magic == NONFRAG_MAGIC) {
+        msg_buf = buf + sizeof(Preamble);
+        msg_size = sz - sizeof(Preamble);
+    } else if (magic == FRAG_MAGIC) {
+        if (sz <= FRAG_HEADER_LEN) {
+            Warning("Received runt fragment");
+            return;
+        }
+        const char *ptr = buf + sizeof(Preamble);
+        uint64_t msg_id = *((uint64_t *)ptr);
+        ptr += sizeof(uint64_t);
+        size_t frag_start = *((size_t *)ptr);
+        ptr += sizeof(size_t);
+        size_t msg_len = *((size_t *)ptr);
+        ptr += sizeof(size_t);
+
+        if (!reassembler.Add(sender_addr, msg_id, frag_start, msg_len,
+                             ptr, buf + sz - ptr, TimerNow(), assembled)) {
+            ScheduleFragmentSweep();
+            return;
+        }
+        msg_buf = assembled.get();
+        msg_size = msg_len;
+    } else {
+        Warning("Received packet with bad magic number");
+        return;
+    }
+
+    if (dropRate > 0.0) {
+        double roll = uniformDist(randomEngine);
+        if (roll < dropRate) {
+            Debug("Simulating packet drop of message");
+            return;
+        }
+    }
+
+    // Was this received on a multicast fd?
+    auto it = multicastConfigs.find(fd);
+    if (it != multicastConfigs.end()) {
+        // If so, deliver the message to all replicas for that
+        // config, *except* if that replica was the sender of the
+        // message.
+        const dsnet::Configuration *cfg = it->second;
+        for (auto &kv : replicaReceivers[cfg]) {
+            shardnum_t groupIdx = kv.first;
+            for (auto &kv2 : kv.second) {
+                uint32_t replicaIdx = kv2.first;
+                TransportReceiver *receiver = kv2.second;
+                const UDPTransportAddress &raddr =
+                    replicaAddresses[cfg][groupIdx].find(replicaIdx)->second;
+                if (raddr != sender_addr) {
+                    receiver->ReceiveMessage(sender_addr, msg_buf, msg_size);
+                }
+            }
+        }
+    } else {
+        TransportReceiver *receiver = receivers[fd];
+        receiver->ReceiveMessage(sender_addr, msg_buf, msg_size);
+    }
+}
+
+void
+IOUringTransport::ScheduleFragmentSweep()
+{
+    if (fragSweepPending || reassembler.Empty()) {
+        return;
+    }
+    fragSweepPending = true;
+    Timer(FRAG_TIMEOUT_MS, [this]() { SweepFragments(); });
+}
+
+void
+IOUringTransport::SweepFragments()
+{
+    fragSweepPending = false;
+    uint64_t now = TimerNow();
+    if (now > FRAG_TIMEOUT_MS * 1000) {
+        reassembler.Expire(now - FRAG_TIMEOUT_MS * 1000);
+    }
+    ScheduleFragmentSweep();
+}
+
+uint64_t
+IOUringTransport::TimerNow() const
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec - timerEpoch.tv_sec) * 1000000 +
+        (ts.tv_nsec - timerEpoch.tv_nsec) / 1000;
+}
+
+// Requires timersLock. The loop picks up new expiries on its next
+// pass by itself; only another thread has to cut its wait short.
+void
+IOUringTransport::WakeIfSleepingPast(uint64_t when)
+{
+    if (when < waitDeadline && !OnLoopThread()) {
+        waitDeadline = when;
+        Wake();
+    }
+}
+
+int
+IOUringTransport::Timer(uint64_t ms, timer_callback_t cb)
+{
+    std::lock_guard<std::mutex> l(timersLock);
+    uint64_t when = TimerNow() + ms * 1000;
+    int id = timers.Add(when, std::move(cb));
+    WakeIfSleepingPast(when);
+    return id;
+}
+
+bool
+IOUringTransport::CancelTimer(int id)
+{
+    std::lock_guard<std::mutex> l(timersLock);
+    return timers.Cancel(id);
+}
+
+bool
+IOUringTransport::RearmTimer(int id, uint64_t ms)
+{
+    std::lock_guard<std::mutex> l(timersLock);
+    uint64_t when = TimerNow() + ms * 1000;
+    if (!timers.Rearm(id, when)) {
+        return false;
+    }
+    WakeIfSleepingPast(when);
+    return true;
+}
+
+void
+IOUringTransport::CancelAllTimers()
+{
+    {
+        std::lock_guard<std::mutex> l(timersLock);
+        timers.Clear();
+    }
+    // That included the fragment sweep
+    fragSweepPending = false;
+    ScheduleFragmentSweep();
+}
+
+void
+IOUringTransport::OnTimers()
+{
+    timer_callback_t cb;
+    std::unique_lock<std::mutex> l(timersLock);
+    uint64_t now = TimerNow();
+    while (timers.PopExpired(now, cb)) {
+        l.unlock();
+        cb();
+        l.lock();
+    }
+}
+
+void
+IOUringTransport::ArmSignalRead()
+{
+    std::lock_guard<std::mutex> l(sqLock);
+    struct io_uring_sqe *sqe = GetSQE();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = signalFd;
+    sqe->addr = (uint64_t)(uintptr_t)&sigInfo;
+    sqe->len = sizeof(sigInfo);
+    sqe->user_data = Tag(&sigInfo, OP_OTHER);
+}
+
+void
+IOUringTransport::OnSignal()
+{
+    Notice("Terminating on SIGTERM/SIGINT");
+    PrintStats();
+    Stop();
+    exit(1);
+}
+
+IOUringTransport::Stats
+IOUringTransport::GetStats() const
+{
+    return stats;
+}
+
+void
+IOUringTransport::PrintStats() const
+{
+    Notice("io_uring: %lu SQEs in %lu io_uring_enter calls (avg %.2f), "
+           "%lu completions",
+           stats.sqes, stats.enters,
+           stats.enters == 0 ? 0.0 : (double)stats.sqes / stats.enters,
+           stats.cqes);
+    Notice("io_uring: %lu packets received, %lu sent, "
+           "%lu sendto fallbacks, %lu receive re-arms",
+           stats.rxPackets, stats.txPackets,
+           stats.txFallbacks, stats.rxRearms);
+}
+
+} // namespace dsnet
@@ -0,0 +1,198 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * iouringtransport.h:
+ *   message-passing network interface that uses UDP message delivery
+ *   driven by io_uring
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **********************************************************************/
+
+#pragma once
+
+#include "lib/configuration.h"
+#include "lib/transport.h"
+#include "lib/transportcommon.h"
+#include "lib/fragmentreassembler.h"
+#include "lib/timerwheel.h"
+#include "lib/udptransport.h"
+
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace dsnet {
+
+// Same addressing and wire format as UDPTransport, so the two
+// interoperate; only the way packets reach the kernel differs. The
+// ring is driven through the raw io_uring system calls (multishot
+// recvmsg needs Linux 6.0 or later):
+//  - each socket has one multishot recvmsg armed, filling buffers
+//    from a provided buffer ring registered with the kernel;
+//  - sends are prepared as SQEs in preallocated slots and submitted
+//    in one io_uring_enter per event loop pass;
+//  - timers live in a TimerWheel, and the loop's io_uring_enter
+//    waits no longer than the wheel's next expiry.
+class IOUringTransport : public TransportCommon<UDPTransportAddress>
+{
+public:
+    IOUringTransport(double dropRate = 0.0, int queueDepth = 1024);
+    virtual ~IOUringTransport();
+    virtual void RegisterInternal(TransportReceiver *receiver,
+                                  const dsnet::ReplicaAddress *addr,
+                                  int groupIdx, int replicaIdx) override;
+    virtual void ListenOnMulticast(TransportReceiver *receiver,
+                                   const dsnet::Configuration &config) override;
+    void Run() override;
+    void Stop() override;
+    int Timer(uint64_t ms, timer_callback_t cb) override;
+    bool CancelTimer(int id) override;
+    bool RearmTimer(int id, uint64_t ms) override;
+    void CancelAllTimers() override;
+    virtual ReplicaAddress
+    ReverseLookupAddress(const TransportAddress &addr) const override;
+
+    struct Stats
+    {
+        uint64_t enters;        // io_uring_enter calls
+        uint64_t sqes;          // SQEs submitted
+        uint64_t cqes;          // completions reaped
+        uint64_t rxPackets;
+        uint64_t txPackets;
+        uint64_t txFallbacks;   // sends done with sendto, no free slot
+        uint64_t rxRearms;      // multishot receives re-armed
+    };
+    Stats GetStats() const;
+    void PrintStats() const;
+
+private:
+    struct Listener
+    {
+        int fd;
+        // Template for the multishot recvmsg; must outlive it
+        struct msghdr hdr;
+    };
+    struct SendSlot
+    {
+        struct msghdr hdr;
+        struct iovec iov;
+        sockaddr_in addr;
+        char *buf;
+    };
+
+    double dropRate;
+    std::uniform_real_distribution<double> uniformDist;
+    std::default_random_engine randomEngine;
+
+    /* Ring state, mapped from the kernel */
+    int ringFd;
+    unsigned sqEntries;
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned sqMask;
+    struct io_uring_sqe *sqes;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned cqMask;
+    struct io_uring_cqe *cqes;
+    void *sqRingPtr;
+    size_t sqRingSize;
+    void *cqRingPtr;
+    size_t cqRingSize;
+    size_t sqesSize;
+    unsigned sqLocalTail;       // prepared, not yet published
+    std::mutex sqLock;
+
+    /* Provided receive buffers */
+    struct io_uring_buf_ring *bufRing;
+    size_t bufRingSize;
+    char *recvBuffers;
+    unsigned recvBufCount;
+    unsigned short bufRingTail;
+
+    /* Preallocated send slots */
+    std::vector<SendSlot> sendSlots;
+    std::vector<SendSlot *> freeSendSlots;
+    char *sendBuffers;
+
+    std::vector<Listener *> listeners;
+    std::map<int, TransportReceiver *> receivers; // fd -> receiver
+    std::map<TransportReceiver *, int> fds; // receiver -> fd
+    std::map<int, const dsnet::Configuration *> multicastConfigs;
+    std::map<const dsnet::Configuration *, int> multicastFds;
+    FragmentReassembler<UDPTransportAddress> reassembler;
+    bool fragSweepPending;
+    std::atomic<uint64_t> lastFragMsgId;
+
+    // Ticks are microseconds since construction
+    TimerWheel timers;
+    std::mutex timersLock;
+    struct timespec timerEpoch;
+    uint64_t waitDeadline;      // expiry the loop is sleeping until
+
+    std::atomic<bool> stopped;
+    Stats stats;
+
+    /* SIGTERM/SIGINT arrive as reads on a signalfd */
+    int signalFd;
+    struct signalfd_siginfo sigInfo;
+
+    bool SendMessageInternal(TransportReceiver *src,
+                             const UDPTransportAddress &dst,
+                             const Message &m) override;
+    UDPTransportAddress
+    LookupAddressInternal(const dsnet::ReplicaAddress &addr) const override;
+    int NewSocket(const sockaddr_in &sin, bool reuseAddr);
+    void AddListener(int fd);
+    void ArmReceive(Listener *listener);
+    struct io_uring_sqe *GetSQE();
+    unsigned Publish();
+    void SubmitLocked();
+    bool OnLoopThread() const;
+    void ReapCompletions();
+    void RecycleBuffer(unsigned short bid);
+    void OnReceive(Listener *listener, const struct io_uring_cqe &cqe);
+    void OnSendComplete(SendSlot *slot, int res);
+    void ScheduleFragmentSweep();
+    void SweepFragments();
+    uint64_t TimerNow() const;
+    void WakeIfSleepingPast(uint64_t when);
+    void OnTimers();
+    void Wake();
+    void ArmSignalRead();
+    void OnSignal();
+    void ProcessPacket(int fd, const sockaddr_in &sender,
+                       char *buf, size_t sz);
+    bool SendFragments(int fd, const sockaddr_in &dst,
+                       const char *body, size_t len);
+};
+
+} // namespace dsnet
@@ -155,6 +155,12 @@ Latency_EndRecType(Latency_t *l, Latency_Frame_t *fr, char type)
     return fr->accum;
 }
 
+void
+Latency_AddSample(Latency_t *l, char type, uint64_t ns)
+{
+    LatencyAdd(l, type, ns);
+}
+
 void
 Latency_Pause(Latency_t *l)
 {
@@ -95,6 +95,9 @@ void _Latency_Init(Latency_t *l, const char *name);
 
 void Latency_StartRec(Latency_t *l, Latency_Frame_t *fr);
 uint64_t Latency_EndRecType(Latency_t *l, Latency_Frame_t *fr, char type);
+// Record a latency timed by the caller, for operations that overlap
+// and so cannot be timed with frames
+void Latency_AddSample(Latency_t *l, char type, uint64_t ns);
 void Latency_Pause(Latency_t *l);
 void Latency_Resume(Latency_t *l);
 
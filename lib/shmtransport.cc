@@ -0,0 +1,945 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * shmtransport.cc:
+ *   message-passing over shared memory rings between processes on
+ *   the same host
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **********************************************************************/
+
+#include "lib/assert.h"
+#include "lib/configuration.h"
+#include "lib/message.h"
+#include "lib/shmtransport.h"
+#include "lib/udptransport-wire.h"
+
+#include <climits>
+#include <cstring>
+#include <set>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace dsnet {
+
+static const size_t SHM_NAME_LEN = 64;
+static const uint32_t SHM_MAGIC = 0x64736d72;
+static const uint64_t SHM_RING_SLOTS = 1024;
+static const size_t SHM_SLOT_SIZE = 8192;
+static const size_t SHM_RING_HEADER = 4096;
+static const int SHM_GROUP_MAX = 64;
+// Messages taken from one ring before moving on to the next
+static const int SHM_POLL_BATCH = 64;
+// Empty polls before Run() blocks on its doorbell. Each one yields
+// the CPU, so spinning cannot starve the peers it is waiting on when
+// they share a core.
+static const int SHM_SPIN_POLLS = 256;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+              "shared memory rings need lock-free atomics");
+
+// The segments below are shared between processes, so they hold
+// nothing but plain data and lock-free atomics, and are laid out the
+// same by every process built from this file.
+
+// A slot carries one message, or one fragment of a message too big for
+// a slot. seq is the usual bounded MPMC queue sequence number: a
+// producer may fill the slot at position pos when seq == pos, and the
+// consumer may read it once seq == pos + 1.
+struct ShmSlot
+{
+    std::atomic<uint64_t> seq;
+    uint32_t len;
+    uint32_t reserved;
+    uint64_t msgId;             // fragments only
+    uint64_t fragStart;
+    uint64_t msgLen;            // zero unless this is a fragment
+    char src[SHM_NAME_LEN];     // sender's host:port
+    char data[SHM_SLOT_SIZE - 104];
+};
+static_assert(sizeof(ShmSlot) == SHM_SLOT_SIZE, "bad ShmSlot layout");
+static const size_t SHM_SLOT_DATA = sizeof(ShmSlot::data);
+
+struct ShmRing
+{
+    std::atomic<uint32_t> magic;    // set once the ring is initialized
+    uint32_t slots;
+    std::atomic<uint32_t> closed;   // owner has gone; remap by name
+    char bell[SHM_NAME_LEN];        // owner's doorbell segment
+    char pad0[128 - 12 - SHM_NAME_LEN];
+    std::atomic<uint64_t> tail;     // next position to claim
+    char pad1[64 - sizeof(uint64_t)];
+    std::atomic<uint64_t> head;     // next position to consume
+    char pad2[64 - sizeof(uint64_t)];
+
+    ShmSlot *Slot(uint64_t pos)
+    {
+        return (ShmSlot *)((char *)this + SHM_RING_HEADER) +
+            (pos & (slots - 1));
+    }
+};
+static_assert(sizeof(ShmRing) <= SHM_RING_HEADER, "bad ShmRing layout");
+static const size_t SHM_RING_SIZE =
+    SHM_RING_HEADER + SHM_RING_SLOTS * SHM_SLOT_SIZE;
+
+// seq is the futex word; producers bump it when they see the owner
+// asleep.
+struct ShmBell
+{
+    std::atomic<uint32_t> seq;
+    std::atomic<uint32_t> sleeping;
+};
+
+struct ShmGroup
+{
+    std::atomic<uint32_t> count;
+    struct
+    {
+        std::atomic<uint32_t> ready;
+        char name[SHM_NAME_LEN];    // member's host:port
+    } members[SHM_GROUP_MAX];
+};
+
+static volatile sig_atomic_t signalled = 0;
+static std::atomic<uint32_t> lastSegmentId(0);
+
+// Binaries tend to exit() without deleting their transport, so names
+// are also unlinked at exit
+static std::mutex liveLock;
+static std::set<ShmTransport *> live;
+
+static std::string
+SegmentName(const char *kind, const std::string &host,
+            const std::string &port)
+{
+    std::string name = "/dsnet." + std::string(kind) + "." +
+        host + "." + port;
+    for (size_t i = 1; i < name.size(); i++) {
+        if (name[i] == '/') {
+            name[i] = '_';
+        }
+    }
+    if (name.size() >= SHM_NAME_LEN) {
+        Panic("Shared memory segment name %s is too long", name.c_str());
+    }
+    return name;
+}
+
+// Map a segment of at least size bytes. With exclusive set any stale
+// segment of the same name is replaced by a fresh, zeroed one.
+static void *
+MapSegment(const std::string &name, size_t size, bool create,
+           bool exclusive)
+{
+    if (exclusive) {
+        shm_unlink(name.c_str());
+    }
+    int flags = O_RDWR;
+    if (create) {
+        flags |= O_CREAT | (exclusive ? O_EXCL : 0);
+    }
+    int fd = shm_open(name.c_str(), flags, 0600);
+    if (fd < 0) {
+        if (create) {
+            PPanic("Failed to open shared memory segment %s",
+                   name.c_str());
+        }
+        return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        PPanic("Failed to stat shared memory segment %s", name.c_str());
+    }
+    if ((size_t)st.st_size < size) {
+        if (!create) {
+            close(fd);
+            return nullptr;
+        }
+        if (ftruncate(fd, size) < 0) {
+            PPanic("Failed to size shared memory segment %s",
+                   name.c_str());
+        }
+    }
+
+    void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        PPanic("Failed to map shared memory segment %s", name.c_str());
+    }
+    return p;
+}
+
+static int
+Futex(std::atomic<uint32_t> *word, int op, uint32_t val,
+      const struct timespec *timeout)
+{
+    return syscall(SYS_futex, (uint32_t *)word, op, val, timeout,
+                   nullptr, 0);
+}
+
+ShmTransportAddress::ShmTransportAddress(const std::string &host,
+                                         const std::string &port)
+    : host(host), port(port) { }
+
+ShmTransportAddress *
+ShmTransportAddress::clone() const
+{
+    ShmTransportAddress *c = new ShmTransportAddress(*this);
+    return c;
+}
+
+std::string
+ShmTransportAddress::RingName() const
+{
+    return SegmentName("ring", host, port);
+}
+
+std::string
+ShmTransportAddress::GroupName() const
+{
+    return SegmentName("group", host, port);
+}
+
+bool operator==(const ShmTransportAddress &a, const ShmTransportAddress &b)
+{
+    return a.host == b.host && a.port == b.port;
+}
+
+bool operator!=(const ShmTransportAddress &a, const ShmTransportAddress &b)
+{
+    return !(a == b);
+}
+
+bool operator<(const ShmTransportAddress &a, const ShmTransportAddress &b)
+{
+    return a.host < b.host || (a.host == b.host && a.port < b.port);
+}
+
+ShmTransportAddress
+ShmTransport::LookupAddressInternal(const dsnet::ReplicaAddress &addr) const
+{
+    return ShmTransportAddress(addr.host, addr.port);
+}
+
+ReplicaAddress
+ShmTransport::ReverseLookupAddress(const TransportAddress &addr) const
+{
+    const ShmTransportAddress *sa =
+        dynamic_cast<const ShmTransportAddress *>(&addr);
+    return ReplicaAddress(sa->host, sa->port);
+}
+
+ShmTransport::ShmTransport(double dropRate)
+    : dropRate(dropRate), uniformDist(0.0, 1.0),
+      reassembler(SHM_SLOT_DATA, MAX_REASSEMBLY_BYTES),
+      fragSweepPending(false), lastFragMsgId(0), stopped(false)
+{
+    memset(&stats, 0, sizeof(stats));
+    clock_gettime(CLOCK_MONOTONIC, &timerEpoch);
+
+    std::random_device rd;
+    randomEngine = std::default_random_engine(rd());
+
+    bellName = SegmentName("bell", std::to_string(getpid()),
+                           std::to_string(lastSegmentId++));
+    bell = (ShmBell *)MapSegment(bellName, sizeof(ShmBell), true, true);
+
+    // No SA_RESTART, so that a blocked futex wait returns to Run()
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = SignalHandler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGTERM, &sa, nullptr);
+    sigaction(SIGINT, &sa, nullptr);
+
+    std::lock_guard<std::mutex> l(liveLock);
+    static bool registered = false;
+    if (!registered) {
+        atexit(CleanupAll);
+        registered = true;
+    }
+    live.insert(this);
+}
+
+ShmTransport::~ShmTransport()
+{
+    {
+        std::lock_guard<std::mutex> l(liveLock);
+        live.erase(this);
+    }
+    Cleanup();
+    for (auto &kv : peers) {
+        munmap(kv.second.ring, SHM_RING_SIZE);
+    }
+    for (auto &kv : bells) {
+        munmap(kv.second, sizeof(ShmBell));
+    }
+    for (auto &kv : groups) {
+        munmap(kv.second, sizeof(ShmGroup));
+    }
+    for (Endpoint &ep : endpoints) {
+        munmap(ep.ring, SHM_RING_SIZE);
+    }
+    munmap(bell, sizeof(ShmBell));
+    // Receivers own the addresses we gave them
+}
+
+void
+ShmTransport::Cleanup()
+{
+    // Senders that still have a ring mapped see it closed and look
+    // the name up again, which finds a restarted receiver's new ring.
+    for (Endpoint &ep : endpoints) {
+        if (ep.ring->closed.exchange(1) == 0) {
+            shm_unlink(ep.addr.RingName().c_str());
+        }
+    }
+    shm_unlink(bellName.c_str());
+}
+
+void
+ShmTransport::CleanupAll()
+{
+    std::lock_guard<std::mutex> l(liveLock);
+    for (ShmTransport *t : live) {
+        t->Cleanup();
+    }
+}
+
+void
+ShmTransport::RegisterInternal(TransportReceiver *receiver,
+                               const dsnet::ReplicaAddress *addr,
+                               int groupIdx, int replicaIdx)
+{
+    // Where UDP would bind an ephemeral port, make up a name of our own
+    ShmTransportAddress saddr("localhost", "any");
+    if (addr != nullptr) {
+        saddr = LookupAddressInternal(*addr);
+    }
+    if (saddr.port == "any" || saddr.port == "0") {
+        saddr.port = "c" + std::to_string(getpid()) + "." +
+            std::to_string(lastSegmentId++);
+    }
+
+    std::string ringName = saddr.RingName();
+    ShmRing *ring = (ShmRing *)MapSegment(ringName, SHM_RING_SIZE,
+                                          true, true);
+    ring->slots = SHM_RING_SLOTS;
+    strncpy(ring->bell, bellName.c_str(), SHM_NAME_LEN - 1);
+    for (uint64_t i = 0; i < SHM_RING_SLOTS; i++) {
+        ring->Slot(i)->seq.store(i, std::memory_order_relaxed);
+    }
+    ring->magic.store(SHM_MAGIC, std::memory_order_release);
+
+    endpoints.push_back(Endpoint{ receiver, saddr,
+                                  saddr.host + ":" + saddr.port, ring });
+    receiver->SetAddress(new ShmTransportAddress(saddr));
+
+    Notice("Listening on shared memory ring %s", ringName.c_str());
+}
+
+void
+ShmTransport::ListenOnMulticast(TransportReceiver *receiver,
+                                const dsnet::Configuration &config)
+{
+    if (configurations.find(receiver) == configurations.end()) {
+        Panic("Register address first before listening on multicast");
+    }
+    dsnet::Configuration *canonical = configurations.at(receiver);
+
+    if (!canonical->multicast()) {
+        // No multicast address specified
+        return;
+    }
+
+    ShmTransportAddress group = LookupAddressInternal(*canonical->multicast());
+    const std::string &name = SourceName(receiver);
+    std::lock_guard<std::mutex> l(peersLock);
+    ShmGroup *g = GetGroup(group.GroupName(), true);
+
+    // Members are never removed, so a restarted receiver finds its
+    // old entry
+    uint32_t n = std::min(g->count.load(), (uint32_t)SHM_GROUP_MAX);
+    for (uint32_t i = 0; i < n; i++) {
+        if (g->members[i].ready.load(std::memory_order_acquire) &&
+            name == g->members[i].name) {
+            return;
+        }
+    }
+    uint32_t i = g->count.fetch_add(1);
+    if (i >= SHM_GROUP_MAX) {
+        Panic("Too many members in multicast group %s",
+              group.GroupName().c_str());
+    }
+    strncpy(g->members[i].name, name.c_str(), SHM_NAME_LEN - 1);
+    g->members[i].ready.store(1, std::memory_order_release);
+
+    Notice("Listening for multicast requests on %s:%s",
+           canonical->multicast()->host.c_str(),
+           canonical->multicast()->port.c_str());
+}
+
+bool
+ShmTransport::IsMulticast(const ShmTransportAddress &addr) const
+{
+    for (auto &kv : multicastAddresses) {
+        if (kv.second == addr) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const std::string &
+ShmTransport::SourceName(TransportReceiver *src) const
+{
+    for (const Endpoint &ep : endpoints) {
+        if (ep.receiver == src) {
+            return ep.name;
+        }
+    }
+    Panic("Sending from an unregistered receiver");
+}
+
+// Requires peersLock
+ShmTransport::Peer *
+ShmTransport::GetPeer(const ShmTransportAddress &dst)
+{
+    auto it = peers.find(dst);
+    if (it != peers.end()) {
+        if (!it->second.ring->closed.load(std::memory_order_relaxed)) {
+            return &it->second;
+        }
+        munmap(it->second.ring, SHM_RING_SIZE);
+        peers.erase(it);
+    }
+
+    ShmRing *ring = (ShmRing *)MapSegment(dst.RingName(), SHM_RING_SIZE,
+                                          false, false);
+    if (ring == nullptr) {
+        Debug("No receiver at %s:%s", dst.host.c_str(), dst.port.c_str());
+        return nullptr;
+    }
+    if (ring->magic.load(std::memory_order_acquire) != SHM_MAGIC ||
+        ring->slots != SHM_RING_SLOTS) {
+        Debug("Ring of %s:%s is not ready", dst.host.c_str(),
+              dst.port.c_str());
+        munmap(ring, SHM_RING_SIZE);
+        return nullptr;
+    }
+    ShmBell *b = GetBell(std::string(ring->bell, strnlen(ring->bell,
+                                                         SHM_NAME_LEN)));
+    if (b == nullptr) {
+        munmap(ring, SHM_RING_SIZE);
+        return nullptr;
+    }
+    Peer &peer = peers[dst];
+    peer.ring = ring;
+    peer.bell = b;
+    return &peer;
+}
+
+// Requires peersLock
+ShmBell *
+ShmTransport::GetBell(const std::string &name)
+{
+    auto it = bells.find(name);
+    if (it != bells.end()) {
+        return it->second;
+    }
+    ShmBell *b = (ShmBell *)MapSegment(name, sizeof(ShmBell), false, false);
+    if (b != nullptr) {
+        bells[name] = b;
+    }
+    return b;
+}
+
+// Requires peersLock
+ShmGroup *
+ShmTransport::GetGroup(const std::string &name, bool create)
+{
+    auto it = groups.find(name);
+    if (it != groups.end()) {
+        return it->second;
+    }
+    ShmGroup *g = (ShmGroup *)MapSegment(name, sizeof(ShmGroup),
+                                         create, false);
+    if (g != nullptr) {
+        groups[name] = g;
+    }
+    return g;
+}
+
+// Requires peersLock. Returns nullptr, and counts a drop, if the ring
+// is full.
+ShmSlot *
+ShmTransport::ClaimSlot(Peer *peer, const std::string &src, uint64_t &pos)
+{
+    ShmRing *ring = peer->ring;
+    pos = ring->tail.load(std::memory_order_relaxed);
+    for (;;) {
+        ShmSlot *slot = ring->Slot(pos);
+        uint64_t seq = slot->seq.load(std::memory_order_acquire);
+        int64_t diff = (int64_t)seq - (int64_t)pos;
+        if (diff == 0) {
+            if (ring->tail.compare_exchange_weak(pos, pos + 1,
+                                                 std::memory_order_relaxed)) {
+                memcpy(slot->src, src.c_str(), src.size() + 1);
+                slot->msgLen = 0;
+                return slot;
+            }
+        } else if (diff < 0) {
+            stats.txRingFull++;
+            return nullptr;
+        } else {
+            pos = ring->tail.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void
+ShmTransport::Publish(Peer *peer, ShmSlot *slot, uint64_t pos)
+{
+    slot->seq.store(pos + 1, std::memory_order_release);
+    stats.txMessages++;
+    // Pairs with the fence in Sleep(): either the owner sees this
+    // slot before blocking or we see it asleep.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (peer->bell->sleeping.load(std::memory_order_relaxed)) {
+        peer->bell->seq.fetch_add(1);
+        Futex(&peer->bell->seq, FUTEX_WAKE, INT_MAX, nullptr);
+    }
+}
+
+// Requires peersLock
+bool
+ShmTransport::Deliver(Peer *peer, const std::string &src,
+                      const char *buf, size_t len)
+{
+    uint64_t pos;
+    ShmSlot *slot;
+    if (len <= SHM_SLOT_DATA) {
+        if ((slot = ClaimSlot(peer, src, pos)) == nullptr) {
+            return false;
+        }
+        slot->len = len;
+        memcpy(slot->data, buf, len);
+        Publish(peer, slot, pos);
+        return true;
+    }
+
+    uint64_t msgId = ++lastFragMsgId;
+    for (size_t start = 0; start < len; start += SHM_SLOT_DATA) {
+        if ((slot = ClaimSlot(peer, src, pos)) == nullptr) {
+            return false;
+        }
+        slot->len = std::min(len - start, SHM_SLOT_DATA);
+        slot->msgId = msgId;
+        slot->fragStart = start;
+        slot->msgLen = len;
+        memcpy(slot->data, buf + start, slot->len);
+        Publish(peer, slot, pos);
+    }
+    return true;
+}
+
+// Requires peersLock
+bool
+ShmTransport::SendToGroup(const std::string &src,
+                          const ShmTransportAddress &group,
+                          const char *buf, size_t len)
+{
+    ShmGroup *g = GetGroup(group.GroupName(), false);
+    if (g == nullptr) {
+        // Nobody listening yet
+        return true;
+    }
+
+    bool ok = true;
+    uint32_t n = std::min(g->count.load(), (uint32_t)SHM_GROUP_MAX);
+    for (uint32_t i = 0; i < n; i++) {
+        if (!g->members[i].ready.load(std::memory_order_acquire) ||
+            src == g->members[i].name) {
+            continue;
+        }
+        std::string member(g->members[i].name);
+        size_t colon = member.rfind(':');
+        ShmTransportAddress dst(member.substr(0, colon),
+                                member.substr(colon + 1));
+        Peer *peer = GetPeer(dst);
+        if (peer != nullptr) {
+            ok &= Deliver(peer, src, buf, len);
+        }
+    }
+    return ok;
+}
+
+// Serialization buffer for messages that are copied more than once or
+// do not fit in a slot. It only grows.
+static std::vector<char> &
+SendScratch(size_t len)
+{
+    static thread_local std::vector<char> buf;
+    if (buf.size() < len) {
+        buf.resize(len);
+    }
+    return buf;
+}
+
+bool
+ShmTransport::SendMessageInternal(TransportReceiver *src,
+                                  const ShmTransportAddress &dst,
+                                  const Message &m)
+{
+    const std::string &srcName = SourceName(src);
+    size_t len = m.SerializedSize();
+    std::lock_guard<std::mutex> l(peersLock);
+
+    if (IsMulticast(dst)) {
+        std::vector<char> &buf = SendScratch(len);
+        m.Serialize(buf.data());
+        return SendToGroup(srcName, dst, buf.data(), len);
+    }
+
+    Peer *peer = GetPeer(dst);
+    if (peer == nullptr) {
+        return false;
+    }
+    if (len > SHM_SLOT_DATA) {
+        std::vector<char> &buf = SendScratch(len);
+        m.Serialize(buf.data());
+        return Deliver(peer, srcName, buf.data(), len);
+    }
+
+    // Serialize straight into the destination's ring
+    uint64_t pos;
+    ShmSlot *slot = ClaimSlot(peer, srcName, pos);
+    if (slot == nullptr) {
+        return false;
+    }
+    slot->len = len;
+    m.Serialize(slot->data);
+    Publish(peer, slot, pos);
+    return true;
+}
+
+bool
+ShmTransport::SendMessageToAddresses(
+    TransportReceiver *src,
+    const std::vector<const ShmTransportAddress *> &dsts,
+    const Message &m)
+{
+    if (dsts.size() <= 1) {
+        return TransportCommon::SendMessageToAddresses(src, dsts, m);
+    }
+
+    // Serialize once and copy the bytes into every ring
+    const std::string &srcName = SourceName(src);
+    size_t len = m.SerializedSize();
+    std::vector<char> &buf = SendScratch(len);
+    m.Serialize(buf.data());
+
+    std::lock_guard<std::mutex> l(peersLock);
+    bool ok = true;
+    for (const ShmTransportAddress *dst : dsts) {
+        if (IsMulticast(*dst)) {
+            ok &= SendToGroup(srcName, *dst, buf.data(), len);
+            continue;
+        }
+        Peer *peer = GetPeer(*dst);
+        ok &= peer != nullptr && Deliver(peer, srcName, buf.data(), len);
+    }
+    return ok;
+}
+
+void
+ShmTransport::ProcessSlot(TransportReceiver *receiver, ShmSlot *slot)
+{
+    size_t nameLen = strnlen(slot->src, SHM_NAME_LEN);
+    const char *colon = (const char *)memrchr(slot->src, ':', nameLen);
+    if (colon == nullptr || slot->len > SHM_SLOT_DATA) {
+        Warning("Received malformed shared memory slot");
+        return;
+    }
+    ShmTransportAddress src(std::string(slot->src, colon - slot->src),
+                            std::string(colon + 1,
+                                        slot->src + nameLen - colon - 1));
+
+    std::unique_ptr<char[]> copy_buf;
+    void *msg_buf = slot->data;
+    size_t msg_size = slot->len;
+    if (slot->msgLen != 0) {
+        if (!reassembler.Add(src, slot->msgId, slot->fragStart,
+                             slot->msgLen, slot->data, slot->len,
+                             TimerNow(), copy_buf)) {
+            ScheduleFragmentSweep();
+            return;
+        }
+        msg_buf = copy_buf.get();
+        msg_size = slot->msgLen;
+    }
+
+    if (dropRate > 0.0) {
+        double roll = uniformDist(randomEngine);
+        if (roll < dropRate) {
+            Debug("Simulating packet drop of message");
+            return;
+        }
+    }
+
+    stats.rxMessages++;
+    receiver->ReceiveMessage(src, msg_buf, msg_size);
+}
+
+bool
+ShmTransport::Poll()
+{
+    bool busy = false;
+    // Receivers may register new endpoints from their callbacks
+    for (size_t i = 0; i < endpoints.size(); i++) {
+        ShmRing *ring = endpoints[i].ring;
+        TransportReceiver *receiver = endpoints[i].receiver;
+        uint64_t head = ring->head.load(std::memory_order_relaxed);
+        for (int n = 0; n < SHM_POLL_BATCH; n++) {
+            ShmSlot *slot = ring->Slot(head);
+            if (slot->seq.load(std::memory_order_acquire) != head + 1) {
+                break;
+            }
+            // The message is read in place; the slot is only handed
+            // back to producers once the receiver is done with it.
+            ProcessSlot(receiver, slot);
+            slot->seq.store(head + ring->slots, std::memory_order_release);
+            ring->head.store(++head, std::memory_order_relaxed);
+            busy = true;
+        }
+    }
+    return busy;
+}
+
+bool
+ShmTransport::Pending() const
+{
+    for (const Endpoint &ep : endpoints) {
+        uint64_t head = ep.ring->head.load(std::memory_order_relaxed);
+        if (ep.ring->Slot(head)->seq.load(std::memory_order_acquire) ==
+            head + 1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+ShmTransport::Sleep()
+{
+    bell->sleeping.store(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint32_t seq = bell->seq.load();
+    if (Pending() || stopped || signalled) {
+        bell->sleeping.store(0);
+        return;
+    }
+
+    struct timespec ts, *timeout = nullptr;
+    {
+        std::lock_guard<std::mutex> l(timersLock);
+        uint64_t next = timers.NextExpiry();
+        if (next != UINT64_MAX) {
+            uint64_t now = TimerNow();
+            if (next <= now) {
+                bell->sleeping.store(0);
+                return;
+            }
+            ts.tv_sec = (next - now) / 1000000;
+            ts.tv_nsec = ((next - now) % 1000000) * 1000;
+            timeout = &ts;
+        }
+    }
+
+    stats.sleeps++;
+    Futex(&bell->seq, FUTEX_WAIT, seq, timeout);
+    bell->sleeping.store(0);
+}
+
+void
+ShmTransport::Wake()
+{
+    bell->seq.fetch_add(1);
+    Futex(&bell->seq, FUTEX_WAKE, INT_MAX, nullptr);
+}
+
+void
+ShmTransport::Run()
+{
+    int idle = 0;
+    while (!stopped) {
+        if (signalled) {
+            Notice("Terminating on SIGTERM/SIGINT");
+            PrintStats();
+            Cleanup();
+            exit(1);
+        }
+        bool busy = Poll();
+        OnTimers();
+        if (busy) {
+            idle = 0;
+        } else if (++idle >= SHM_SPIN_POLLS) {
+            Sleep();
+            idle = 0;
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+void
+ShmTransport::Stop()
+{
+    stopped = true;
+    Wake();
+}
+
+void
+ShmTransport::SignalHandler(int signal)
+{
+    signalled = 1;
+}
+
+ShmTransport::Stats
+ShmTransport::GetStats() const
+{
+    return stats;
+}
+
+void
+ShmTransport::PrintStats() const
+{
+    Notice("Shared memory: %lu messages received, %lu sent, "
+           "%lu dropped on full rings, %lu sleeps",
+           stats.rxMessages, stats.txMessages, stats.txRingFull,
+           stats.sleeps);
+}
+
+// One timer at a time is enough: partial messages only need to be
+// looked at once they could have gone stale.
+void
+ShmTransport::ScheduleFragmentSweep()
+{
+    if (fragSweepPending || reassembler.Empty()) {
+        return;
+    }
+    fragSweepPending = true;
+    Timer(FRAG_TIMEOUT_MS, [this]() { SweepFragments(); });
+}
+
+void
+ShmTransport::SweepFragments()
+{
+    fragSweepPending = false;
+    uint64_t now = TimerNow();
+    if (now > FRAG_TIMEOUT_MS * 1000) {
+        reassembler.Expire(now - FRAG_TIMEOUT_MS * 1000);
+    }
+    ScheduleFragmentSweep();
+}
+
+uint64_t
+ShmTransport::TimerNow() const
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec - timerEpoch.tv_sec) * 1000000 +
+        (ts.tv_nsec - timerEpoch.tv_nsec) / 1000;
+}
+
+int
+ShmTransport::Timer(uint64_t ms, timer_callback_t cb)
+{
+    int id;
+    {
+        std::lock_guard<std::mutex> l(this->timersLock);
+        id = timers.Add(TimerNow() + ms * 1000, std::move(cb));
+    }
+    // A sleeping loop may be waiting for a later timer
+    if (bell->sleeping.load()) {
+        Wake();
+    }
+    return id;
+}
+
+bool
+ShmTransport::CancelTimer(int id)
+{
+    std::lock_guard<std::mutex> l(this->timersLock);
+    return timers.Cancel(id);
+}
+
+bool
+ShmTransport::RearmTimer(int id, uint64_t ms)
+{
+    {
+        std::lock_guard<std::mutex> l(this->timersLock);
+        if (!timers.Rearm(id, TimerNow() + ms * 1000)) {
+            return false;
+        }
+    }
+    if (bell->sleeping.load()) {
+        Wake();
+    }
+    return true;
+}
+
+void
+ShmTransport::CancelAllTimers()
+{
+    {
+        std::lock_guard<std::mutex> l(this->timersLock);
+        timers.Clear();
+    }
+    // That included the fragment sweep
+    fragSweepPending = false;
+    ScheduleFragmentSweep();
+}
+
+void
+ShmTransport::OnTimers()
+{
+    // Callbacks run without the lock: they usually set new timers
+    timer_callback_t cb;
+    std::unique_lock<std::mutex> l(this->timersLock);
+    uint64_t now = TimerNow();
+    while (timers.PopExpired(now, cb)) {
+        l.unlock();
+        cb();
+        l.lock();
+    }
+}
+
+} // namespace dsnet
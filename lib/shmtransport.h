@@ -0,0 +1,195 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * shmtransport.h:
+ *   message-passing over shared memory rings between processes on
+ *   the same host
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **********************************************************************/
+
+#pragma once
+
+#include "lib/configuration.h"
+#include "lib/fragmentreassembler.h"
+#include "lib/timerwheel.h"
+#include "lib/transport.h"
+#include "lib/transportcommon.h"
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <time.h>
+
+namespace dsnet {
+
+class ShmTransportAddress : public TransportAddress
+{
+public:
+    ShmTransportAddress(const std::string &host, const std::string &port);
+    virtual ShmTransportAddress *clone() const override;
+
+private:
+    std::string host;
+    std::string port;
+
+    // Names of the segments in /dev/shm behind this address: the ring
+    // of the receiver bound to it, or the member list of a multicast
+    // group
+    std::string RingName() const;
+    std::string GroupName() const;
+    friend class ShmTransport;
+    friend bool operator==(const ShmTransportAddress &a,
+                           const ShmTransportAddress &b);
+    friend bool operator!=(const ShmTransportAddress &a,
+                           const ShmTransportAddress &b);
+    friend bool operator<(const ShmTransportAddress &a,
+                          const ShmTransportAddress &b);
+};
+
+struct ShmSlot;
+struct ShmRing;
+struct ShmBell;
+struct ShmGroup;
+
+// Transport for processes that share a host. Addresses are the
+// host:port pairs from the configuration, but nothing touches the
+// network:
+//  - every registered receiver owns a bounded multi-producer ring in
+//    a POSIX shared memory segment named after its address, which
+//    senders map on first use and write messages straight into;
+//  - a sleeping Run() loop is woken through a futex in a per-process
+//    doorbell segment named in each of its rings;
+//  - a configuration's multicast address is a segment listing the
+//    rings of the receivers that called ListenOnMulticast, and sends
+//    to it are copied into each of them;
+//  - messages larger than a slot are split and reassembled like UDP
+//    fragments.
+// A full ring drops the message, as a full socket buffer would.
+class ShmTransport : public TransportCommon<ShmTransportAddress>
+{
+public:
+    ShmTransport(double dropRate = 0.0);
+    virtual ~ShmTransport();
+    virtual void RegisterInternal(TransportReceiver *receiver,
+                                  const dsnet::ReplicaAddress *addr,
+                                  int groupIdx, int replicaIdx) override;
+    virtual void ListenOnMulticast(TransportReceiver *receiver,
+                                   const dsnet::Configuration &config) override;
+    void Run() override;
+    void Stop() override;
+    int Timer(uint64_t ms, timer_callback_t cb) override;
+    bool CancelTimer(int id) override;
+    bool RearmTimer(int id, uint64_t ms) override;
+    void CancelAllTimers() override;
+    virtual ReplicaAddress
+    ReverseLookupAddress(const TransportAddress &addr) const override;
+
+    struct Stats
+    {
+        uint64_t rxMessages;
+        uint64_t txMessages;
+        uint64_t txRingFull;    // dropped, destination ring full
+        uint64_t sleeps;        // times Run() blocked on its doorbell
+    };
+    Stats GetStats() const;
+    void PrintStats() const;
+
+private:
+    struct Endpoint
+    {
+        TransportReceiver *receiver;
+        ShmTransportAddress addr;
+        std::string name;       // host:port, as written in slots
+        ShmRing *ring;
+    };
+    struct Peer
+    {
+        ShmRing *ring;
+        ShmBell *bell;
+    };
+
+    double dropRate;
+    std::uniform_real_distribution<double> uniformDist;
+    std::default_random_engine randomEngine;
+
+    std::vector<Endpoint> endpoints;
+    std::string bellName;
+    ShmBell *bell;
+
+    // Rings, doorbells and groups of destinations, mapped on first use
+    std::map<ShmTransportAddress, Peer> peers;
+    std::map<std::string, ShmBell *> bells;
+    std::map<std::string, ShmGroup *> groups;
+    std::mutex peersLock;
+
+    FragmentReassembler<ShmTransportAddress> reassembler;
+    bool fragSweepPending;
+    std::atomic<uint64_t> lastFragMsgId;
+
+    // Ticks are microseconds since construction
+    TimerWheel timers;
+    std::mutex timersLock;
+    struct timespec timerEpoch;
+
+    std::atomic<bool> stopped;
+    Stats stats;
+
+    bool SendMessageInternal(TransportReceiver *src,
+                             const ShmTransportAddress &dst,
+                             const Message &m) override;
+    bool SendMessageToAddresses(TransportReceiver *src,
+                                const std::vector<const ShmTransportAddress *> &dsts,
+                                const Message &m) override;
+    ShmTransportAddress
+    LookupAddressInternal(const dsnet::ReplicaAddress &addr) const override;
+    bool IsMulticast(const ShmTransportAddress &addr) const;
+    Peer *GetPeer(const ShmTransportAddress &dst);
+    ShmBell *GetBell(const std::string &name);
+    ShmGroup *GetGroup(const std::string &name, bool create);
+    bool Deliver(Peer *peer, const std::string &src,
+                 const char *buf, size_t len);
+    bool SendToGroup(const std::string &src,
+                     const ShmTransportAddress &group,
+                     const char *buf, size_t len);
+    ShmSlot *ClaimSlot(Peer *peer, const std::string &src, uint64_t &pos);
+    void Publish(Peer *peer, ShmSlot *slot, uint64_t pos);
+    const std::string &SourceName(TransportReceiver *src) const;
+    bool Poll();
+    bool Pending() const;
+    void Sleep();
+    void Wake();
+    void ProcessSlot(TransportReceiver *receiver, ShmSlot *slot);
+    void ScheduleFragmentSweep();
+    void SweepFragments();
+    uint64_t TimerNow() const;
+    void OnTimers();
+    void Cleanup();
+    static void CleanupAll();
+    static void SignalHandler(int signal);
+};
+
+} // namespace dsnet
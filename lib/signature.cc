@@ -10,6 +10,7 @@
 
 #include <openssl/aes.h>
 #include <openssl/bio.h>
+#include <openssl/crypto.h>
 #include <openssl/err.h>
 #include <openssl/evp.h>
 #include <openssl/pem.h>
@@ -196,4 +197,67 @@ bool dsnet::Secp256k1Verifier::Verify(const std::string &message,
           reinterpret_cast<const unsigned char *>(signature.c_str())))
     return false;
   return secp256k1_ecdsa_verify(ctx, &data, hash, pubKey);
-}
\ No newline at end of file
+}
+
+dsnet::HmacSigner::HmacSigner(const std::string &key) {
+  // keys longer than a block are hashed first (RFC 2104)
+  unsigned char block[SHA256_CBLOCK] = {0};
+  if (key.size() > SHA256_CBLOCK) {
+    SHA256(reinterpret_cast<const unsigned char *>(key.data()), key.size(),
+           block);
+  } else {
+    std::memcpy(block, key.data(), key.size());
+  }
+
+  unsigned char pad[SHA256_CBLOCK];
+  for (int i = 0; i < SHA256_CBLOCK; i += 1) {
+    pad[i] = block[i] ^ 0x36;
+  }
+  SHA256_Init(&inner);
+  SHA256_Update(&inner, pad, sizeof(pad));
+  for (int i = 0; i < SHA256_CBLOCK; i += 1) {
+    pad[i] = block[i] ^ 0x5c;
+  }
+  SHA256_Init(&outer);
+  SHA256_Update(&outer, pad, sizeof(pad));
+}
+
+void dsnet::HmacSigner::Sign(const struct iovec *pieces, int count,
+                             unsigned char *mac) const {
+  SHA256_CTX ctx = inner;
+  for (int i = 0; i < count; i += 1) {
+    SHA256_Update(&ctx, pieces[i].iov_base, pieces[i].iov_len);
+  }
+  unsigned char digest[SHA256_DIGEST_LENGTH];
+  SHA256_Final(digest, &ctx);
+
+  ctx = outer;
+  SHA256_Update(&ctx, digest, sizeof(digest));
+  SHA256_Final(mac, &ctx);
+}
+
+bool dsnet::HmacSigner::Sign(const std::string &message,
+                             std::string &signature) const {
+  struct iovec piece = {const_cast<char *>(message.data()), message.size()};
+  unsigned char mac[kMacSize];
+  Sign(&piece, 1, mac);
+  signature.assign(reinterpret_cast<const char *>(mac), kMacSize);
+  return true;
+}
+
+bool dsnet::HmacVerifier::Verify(const struct iovec *pieces, int count,
+                                 const unsigned char *mac) const {
+  unsigned char expected[HmacSigner::kMacSize];
+  signer.Sign(pieces, count, expected);
+  return CRYPTO_memcmp(expected, mac, sizeof(expected)) == 0;
+}
+
+bool dsnet::HmacVerifier::Verify(const std::string &message,
+                                 const std::string &signature) const {
+  if (signature.size() != HmacSigner::kMacSize) {
+    return false;
+  }
+  struct iovec piece = {const_cast<char *>(message.data()), message.size()};
+  return Verify(&piece, 1,
+                reinterpret_cast<const unsigned char *>(signature.data()));
+}
@@ -5,7 +5,9 @@
 #define DSNET_COMMON_SIGNATURE_H_
 
 #include <openssl/evp.h>
+#include <openssl/sha.h>
 #include <secp256k1.h>
+#include <sys/uio.h>
 
 #include <string>
 
@@ -81,6 +83,36 @@ class Secp256k1Verifier : public Verifier {
               const std::string &signature) const override;
 };
 
+// HMAC-SHA256 under a key shared by the two ends, e.g. a sequencer and
+// one replica. The hash states after the padded key are computed once,
+// so a MAC costs the message plus two blocks rather than four more.
+class HmacSigner : public Signer {
+ private:
+  SHA256_CTX inner, outer;
+  friend class HmacVerifier;
+
+ public:
+  static const size_t kMacSize = SHA256_DIGEST_LENGTH;
+
+  HmacSigner(const std::string &key);
+  bool Sign(const std::string &message, std::string &signature) const override;
+  // MAC of the pieces one after another, written to mac (kMacSize
+  // bytes), so a message need not be gathered into a string first
+  void Sign(const struct iovec *pieces, int count, unsigned char *mac) const;
+};
+
+class HmacVerifier : public Verifier {
+ private:
+  HmacSigner signer;
+
+ public:
+  HmacVerifier(const HmacSigner &signer) : signer(signer) {}
+  bool Verify(const std::string &message,
+              const std::string &signature) const override;
+  bool Verify(const struct iovec *pieces, int count,
+              const unsigned char *mac) const;
+};
+
 // each BFT replica/client should accept a &Security in its constructor so
 // proper signature impl can be injected
 class Security {
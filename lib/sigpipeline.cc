@@ -0,0 +1,129 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * sigpipeline.cc:
+ *   worker threads that check and make signatures off the protocol
+ *   thread, completing in submission order
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **********************************************************************/
+
+#include "lib/sigpipeline.h"
+
+#include "lib/assert.h"
+#include "lib/message.h"
+
+namespace dsnet {
+
+SignaturePipeline::SignaturePipeline(Transport *transport, int workers)
+    : transport(transport), stopping(false), drainTimer(0)
+{
+    ASSERT(workers >= 0);
+    for (int i = 0; i < workers; i++) {
+        threads.emplace_back(&SignaturePipeline::RunWorker, this);
+    }
+}
+
+SignaturePipeline::~SignaturePipeline()
+{
+    if (drainTimer != 0) {
+        transport->CancelTimer(drainTimer);
+    }
+    {
+        std::lock_guard<std::mutex> l(lock);
+        stopping = true;
+    }
+    queued.notify_all();
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    // Whatever was still pending is dropped without completing
+}
+
+void
+SignaturePipeline::Submit(work_t work, done_t done)
+{
+    if (threads.empty()) {
+        if (work()) {
+            done();
+        }
+        return;
+    }
+
+    Job *job = new Job{ std::move(work), std::move(done), false, false };
+    pending.emplace_back(job);
+    {
+        std::lock_guard<std::mutex> l(lock);
+        ready.push_back(job);
+    }
+    queued.notify_one();
+
+    if (drainTimer == 0) {
+        drainTimer = transport->Timer(0, [this]() {
+            drainTimer = 0;
+            Drain();
+        });
+    }
+}
+
+void
+SignaturePipeline::Drain()
+{
+    // Completions may submit more jobs (a reply to sign, say); those
+    // are picked up by this same loop. The event loop is blocked
+    // throughout; see the class comment.
+    while (!pending.empty()) {
+        std::unique_ptr<Job> job = std::move(pending.front());
+        pending.pop_front();
+        {
+            std::unique_lock<std::mutex> l(lock);
+            finished.wait(l, [&job]() { return job->finished; });
+        }
+        if (job->ok) {
+            job->done();
+        }
+    }
+}
+
+void
+SignaturePipeline::RunWorker()
+{
+    std::unique_lock<std::mutex> l(lock);
+    for (;;) {
+        queued.wait(l, [this]() { return stopping || !ready.empty(); });
+        if (stopping) {
+            return;
+        }
+        Job *job = ready.front();
+        ready.pop_front();
+
+        l.unlock();
+        bool ok = job->work();
+        l.lock();
+
+        job->ok = ok;
+        job->finished = true;
+        finished.notify_one();
+    }
+}
+
+} // namespace dsnet
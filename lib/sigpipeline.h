@@ -0,0 +1,110 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * sigpipeline.h:
+ *   worker threads that check and make signatures off the protocol
+ *   thread, completing in submission order
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **********************************************************************/
+
+#pragma once
+
+#include "lib/transport.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dsnet {
+
+// Runs the expensive half of a message -- checking its signatures, or
+// signing a reply -- on a pool of worker threads, and the rest back on
+// the transport's thread, one message at a time and in the order they
+// were submitted, so protocol code stays single-threaded and sees
+// messages in arrival order.
+//
+// Submit queues work for the workers. Completions run from a
+// zero-delay transport timer, so everything submitted while handling
+// one batch of packets is checked in parallel before the first of them
+// is delivered; the timer waits for each job in turn, so a slow job
+// holds back the ones behind it but never lets them overtake it. A job
+// whose work returns false is dropped without its completion running.
+//
+// That wait stalls the whole event loop on purpose: until every job
+// submitted so far has completed, the transport's thread receives no
+// packets and fires no other timers. A worker has no way to wake the
+// event loop, and re-arming the timer to poll would spin the protocol
+// thread against the workers for the cores. So work must be bounded,
+// pure computation -- a signature check or a signature, never anything
+// that waits on the network.
+//
+// With no workers, Submit runs the work and the completion right away,
+// which is the same as doing both inline.
+class SignaturePipeline
+{
+public:
+    typedef std::function<bool()> work_t;
+    typedef std::function<void()> done_t;
+
+    SignaturePipeline(Transport *transport, int workers = 0);
+    ~SignaturePipeline();
+
+    // Called only on the transport's thread, which is also where done
+    // runs; work runs on some worker, and must not touch state that
+    // the transport's thread changes.
+    void Submit(work_t work, done_t done);
+    // Run the completions of everything submitted so far
+    void Drain();
+    int Workers() const { return threads.size(); }
+    // Jobs submitted and not yet completed
+    size_t Pending() const { return pending.size(); }
+
+private:
+    struct Job
+    {
+        work_t work;
+        done_t done;
+        bool finished;
+        bool ok;
+    };
+
+    void RunWorker();
+
+    Transport *transport;
+    std::vector<std::thread> threads;
+    std::mutex lock;
+    std::condition_variable queued;     // workers: ready is non-empty
+    std::condition_variable finished;   // transport thread: a job is done
+    std::deque<Job *> ready;            // not yet picked up by a worker
+    bool stopping;
+    // Every job not yet completed, in submission order; only the
+    // transport's thread touches it
+    std::deque<std::unique_ptr<Job> > pending;
+    int drainTimer;                     // 0 when none is armed
+};
+
+} // namespace dsnet
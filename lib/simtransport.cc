@@ -34,6 +34,9 @@
 #include "lib/simtransport.h"
 #include <google/protobuf/message.h>
 
+#include <algorithm>
+#include <functional>
+
 namespace dsnet {
 
 SimulatedTransportAddress::SimulatedTransportAddress(int addr)
@@ -62,10 +65,9 @@ SimulatedTransportAddress::operator==(const SimulatedTransportAddress &other) co
 }
 
 SimulatedTransport::SimulatedTransport(bool continuous)
-    : continuous(continuous)
+    : lastSeq(0), lossDist(0.0, 1.0), continuous(continuous)
 {
     lastAddr = -1;
-    lastTimerId = 0;
     vtime = 0;
     processTimers = true;
 
@@ -129,23 +131,76 @@ SimulatedTransport::SendMessageInternal(TransportReceiver *src,
         }
     }
 
-    char buf[copied_msg->SerializedSize()];
+    size_t size = copied_msg->SerializedSize();
+    char buf[size];
     copied_msg->Serialize(buf);
-    std::string msg(buf, copied_msg->SerializedSize());
+    std::string msg(buf, size);
     delete copied_msg;
 
+    const LinkModel &link = GetLinkModel(replicaIdxs[srcAddr],
+                                         replicaIdxs[dst]);
+    if (link.loss > 0.0 && lossDist(linkRandom) < link.loss) {
+        // Lost on the wire
+        return true;
+    }
+
+    uint64_t arrival = vtime + delay * 1000;
+    if (link.bandwidth > 0) {
+        // Wait for whatever is ahead on the link to go out
+        uint64_t &busy = linkBusyUntil[std::make_pair(srcAddr, dst)];
+        busy = std::max(busy, vtime) + size * 1000000 / link.bandwidth;
+        arrival += busy - vtime;
+    }
+    arrival += link.latency;
+    if (link.jitter > 0) {
+        arrival += linkRandom() % (link.jitter + 1);
+    }
+
     QueuedMessage q(dst, srcAddr, msg);
 
-    if (delay == 0) {
+    if (arrival == vtime) {
         queue.push_back(q);
     } else {
-        Timer(delay, [ = ]() {
-            queue.push_back(q);
-        });
+        inFlight.push_back(InFlightMessage{ arrival, ++lastSeq, q });
+        std::push_heap(inFlight.begin(), inFlight.end(),
+                       std::greater<InFlightMessage>());
     }
     return true;
 }
 
+void
+SimulatedTransport::SetLinkModel(const LinkModel &model)
+{
+    defaultLink = model;
+}
+
+void
+SimulatedTransport::SetLinkModel(std::pair<int, int> srcIdx,
+                                 std::pair<int, int> dstIdx,
+                                 const LinkModel &model)
+{
+    links[std::make_pair(srcIdx, dstIdx)] = model;
+}
+
+const SimulatedTransport::LinkModel &
+SimulatedTransport::GetLinkModel(std::pair<int, int> srcIdx,
+                                 std::pair<int, int> dstIdx) const
+{
+    auto it = links.find(std::make_pair(srcIdx, dstIdx));
+    return it != links.end() ? it->second : defaultLink;
+}
+
+void
+SimulatedTransport::Deliver(const QueuedMessage &q)
+{
+    TransportReceiver *dst = endpoints[q.dst];
+    char buf[q.msg.size()];
+    memcpy(buf, q.msg.data(), q.msg.size());
+    dst->ReceiveMessage(SimulatedTransportAddress(q.src),
+                        buf,
+                        q.msg.size());
+}
+
 SimulatedTransportAddress
 SimulatedTransport::LookupAddressInternal(const dsnet::ReplicaAddress &addr) const
 {
@@ -179,37 +234,44 @@ SimulatedTransport::Run()
     do {
         // Process queue
         while (!queue.empty()) {
-            QueuedMessage &q = queue.front();
-            TransportReceiver *dst = endpoints[q.dst];
-            char buf[q.msg.size()];
-            memcpy(buf, q.msg.data(), q.msg.size());
-            dst->ReceiveMessage(SimulatedTransportAddress(q.src),
-                                buf,
-                                q.msg.size());
+            Deliver(queue.front());
             queue.pop_front();
         }
 
-        // If there's a timer, deliver the earliest one only
+        // Then take the next event only: the earliest timer, unless a
+        // message arrives first (messages win ties)
+        uint64_t arrival = inFlight.empty() ?
+            UINT64_MAX : inFlight.front().arrival;
+        timer_callback_t cb;
+        uint64_t when;
+        bool fire = false;
         if (processTimers) {
-            this->timersLock.lock();
-            if (!timers.empty()) {
-                auto iter = timers.begin();
-                ASSERT(iter->second.when >= vtime);
-                vtime = iter->second.when;
-                timer_callback_t cb = iter->second.cb;
-                timers.erase(iter);
-                this->timersLock.unlock();
-                cb();
-            } else {
-                this->timersLock.unlock();
+            std::lock_guard<std::mutex> l(this->timersLock);
+            if (arrival == UINT64_MAX) {
+                fire = timers.PopEarliest(when, cb);
+            } else if (arrival > vtime) {
+                fire = timers.PopEarliest(arrival - 1, when, cb);
             }
         }
+        if (fire) {
+            ASSERT(when >= vtime);
+            vtime = when;
+            cb();
+        } else if (arrival != UINT64_MAX) {
+            std::pop_heap(inFlight.begin(), inFlight.end(),
+                          std::greater<InFlightMessage>());
+            QueuedMessage q = std::move(inFlight.back().msg);
+            inFlight.pop_back();
+            vtime = arrival;
+            Deliver(q);
+        }
 
         // ...then retry to see if there are more queued messages to
         // deliver first
     } while (continuous ?
              running :
-             (!queue.empty() || (processTimers && !timers.empty())));
+             (!queue.empty() || !inFlight.empty() ||
+              (processTimers && !timers.Empty())));
     running = false;
 }
 
@@ -236,37 +298,28 @@ int
 SimulatedTransport::Timer(uint64_t ms, timer_callback_t cb)
 {
     std::lock_guard<std::mutex> l(this->timersLock);
-    ++lastTimerId;
-    int id = lastTimerId;
-    PendingTimer t;
-    t.when = vtime + ms;
-    t.cb = cb;
-    t.id = id;
-    timers.insert(std::pair<uint64_t, PendingTimer>(t.when, t));
-    return id;
+    return timers.Add(vtime + ms * 1000, std::move(cb));
 }
 
 bool
 SimulatedTransport::CancelTimer(int id)
 {
     std::lock_guard<std::mutex> l(this->timersLock);
-    bool found = false;
-    for (auto iter = timers.begin(); iter != timers.end();) {
-        if (iter->second.id == id) {
-            found = true;
-            iter = timers.erase(iter);
-        } else {
-            iter++;
-        }
-    }
+    return timers.Cancel(id);
+}
 
-    return found;
+bool
+SimulatedTransport::RearmTimer(int id, uint64_t ms)
+{
+    std::lock_guard<std::mutex> l(this->timersLock);
+    return timers.Rearm(id, vtime + ms * 1000);
 }
 
 void
 SimulatedTransport::CancelAllTimers()
 {
-    timers.clear();
+    std::lock_guard<std::mutex> l(this->timersLock);
+    timers.Clear();
     processTimers = false;
 }
 
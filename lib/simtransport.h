@@ -33,12 +33,15 @@
 
 #include "lib/transport.h"
 #include "lib/transportcommon.h"
+#include "lib/timerwheel.h"
 
 #include <deque>
 #include <map>
 #include <unordered_map>
 #include <functional>
 #include <mutex>
+#include <random>
+#include <vector>
 
 namespace dsnet {
 
@@ -59,13 +62,29 @@ private:
     friend class SimulatedTransport;
 };
 
+// Discrete-event simulation of the network. Virtual time only moves
+// when the next event -- a message arriving or a timer firing -- is
+// taken off the queue, so Run() goes as fast as the receivers can
+// process events. By default links are ideal and every message is
+// delivered, in send order, before virtual time moves on; a
+// LinkModel adds latency, jitter, serialization delay and loss, per
+// (group, replica) pair of endpoints. Clients are (-1, -1).
 class SimulatedTransport :
     public TransportCommon<SimulatedTransportAddress>
 {
+    // delay is in milliseconds, on top of the link's own
     typedef std::function<bool (TransportReceiver*, std::pair<int, int>,
                                 TransportReceiver*, std::pair<int, int>,
                                 Message &, uint64_t &delay)> filter_t;
 public:
+    struct LinkModel
+    {
+        uint64_t latency = 0;       // us, one way
+        uint64_t jitter = 0;        // us, uniform on top of latency
+        uint64_t bandwidth = 0;     // bytes per second; 0 is unlimited
+        double loss = 0.0;          // probability of dropping a message
+    };
+
     SimulatedTransport(bool continuous = false);
     ~SimulatedTransport();
     void RegisterInternal(TransportReceiver *receiver,
@@ -77,13 +96,21 @@ public:
     void RemoveFilter(int id);
     int Timer(uint64_t ms, timer_callback_t cb) override;
     bool CancelTimer(int id) override;
+    bool RearmTimer(int id, uint64_t ms) override;
     void CancelAllTimers() override;
     virtual ReplicaAddress
     ReverseLookupAddress(const TransportAddress &addr) const override;
 
+    // Model for every link without one of its own
+    void SetLinkModel(const LinkModel &model);
+    void SetLinkModel(std::pair<int, int> srcIdx, std::pair<int, int> dstIdx,
+                      const LinkModel &model);
+    // Virtual time in microseconds
+    uint64_t Now() const { return vtime; }
+
     // Returns if simtransport still have timers
     bool HasTimers() {
-        return !timers.empty();
+        return !timers.Empty();
     }
 
 protected:
@@ -103,22 +130,43 @@ private:
                              const string &msg) :
             dst(dst), src(src), msg(msg) { }
     };
-    struct PendingTimer {
-        uint64_t when;
-        int id;
-        timer_callback_t cb;
+    // A message on the wire, ordered by arrival and then send order
+    struct InFlightMessage {
+        uint64_t arrival;
+        uint64_t seq;
+        QueuedMessage msg;
+        bool operator>(const InFlightMessage &other) const {
+            return arrival != other.arrival ?
+                arrival > other.arrival : seq > other.seq;
+        }
     };
 
+    // Messages due now, in send order
     std::deque<QueuedMessage> queue;
+    // Min-heap of messages due later
+    std::vector<InFlightMessage> inFlight;
+    uint64_t lastSeq;
+    LinkModel defaultLink;
+    std::map<std::pair<std::pair<int, int>, std::pair<int, int> >,
+             LinkModel> links;
+    // Time each link (by endpoint) finishes sending what it has queued
+    std::map<std::pair<int, int>, uint64_t> linkBusyUntil;
+    std::default_random_engine linkRandom;
+    std::uniform_real_distribution<double> lossDist;
+
+    const LinkModel &GetLinkModel(std::pair<int, int> srcIdx,
+                                  std::pair<int, int> dstIdx) const;
+    void Deliver(const QueuedMessage &q);
+
     std::map<int, TransportReceiver *> endpoints;
     int lastAddr;
     std::map<int, std::pair<int, int> > replicaIdxs; // address to <groupIdx, replicaIdx>
     std::unordered_map<dsnet::ReplicaAddress, SimulatedTransportAddress> addrLookupMap;
     std::unordered_map<int, dsnet::ReplicaAddress> reverseAddrLookupMap;
     std::multimap<int, filter_t> filters;
-    std::multimap<uint64_t, PendingTimer> timers;
+    // Ticks are microseconds of virtual time
+    TimerWheel timers;
     std::mutex timersLock;
-    int lastTimerId;
     uint64_t vtime;
     bool processTimers;
     bool running;
@@ -0,0 +1,97 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * spscring.h:
+ *   bounded lock-free single-producer/single-consumer ring
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **********************************************************************/
+
+#pragma once
+
+#include "lib/assert.h"
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace dsnet {
+
+// Slots are written in place: the producer fills WriteSlot(0..k-1)
+// and then publishes them with Push(k); the consumer reads
+// ReadSlot(0..k-1) and releases them with Pop(k). Capacity must be a
+// power of two.
+template <typename T>
+class SPSCRing
+{
+public:
+    explicit SPSCRing(size_t capacity)
+        : slots(capacity), mask(capacity - 1), head(0), tail(0)
+    {
+        ASSERT(capacity > 0 && (capacity & mask) == 0);
+    }
+
+    // Producer side
+    size_t Writable() const
+    {
+        return slots.size() - (tail.load(std::memory_order_relaxed) -
+                               head.load(std::memory_order_acquire));
+    }
+    T &WriteSlot(size_t i)
+    {
+        return slots[(tail.load(std::memory_order_relaxed) + i) & mask];
+    }
+    void Push(size_t n)
+    {
+        tail.store(tail.load(std::memory_order_relaxed) + n,
+                   std::memory_order_release);
+    }
+
+    // Consumer side
+    size_t Readable() const
+    {
+        return tail.load(std::memory_order_acquire) -
+            head.load(std::memory_order_relaxed);
+    }
+    T &ReadSlot(size_t i)
+    {
+        return slots[(head.load(std::memory_order_relaxed) + i) & mask];
+    }
+    void Pop(size_t n)
+    {
+        head.store(head.load(std::memory_order_relaxed) + n,
+                   std::memory_order_release);
+    }
+
+private:
+    std::vector<T> slots;
+    const size_t mask;
+    // Keep the two indices on separate cache lines. Padding rather
+    // than alignas so the ring can live in plain heap allocations.
+    char pad0[64];
+    std::atomic<size_t> head;
+    char pad1[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> tail;
+    char pad2[64 - sizeof(std::atomic<size_t>)];
+};
+
+} // namespace dsnet
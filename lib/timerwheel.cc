@@ -0,0 +1,311 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * timerwheel.cc:
+ *   hierarchical timing wheel backing the transport timers
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **********************************************************************/
+
+#include "lib/timerwheel.h"
+#include "lib/assert.h"
+#include "lib/message.h"
+
+#include <cstring>
+
+namespace dsnet {
+
+// Ids carry the entry index (plus one, so they are never zero) and a
+// generation count, so that cancelling a timer that has already fired
+// cannot hit whichever timer reused its entry.
+static const uint32_t INDEX_MASK = (1u << 20) - 1;
+static const uint32_t GEN_MASK = (1u << 11) - 1;
+static const uint64_t SLOT_MASK = 0xff;
+
+TimerWheel::TimerWheel()
+    : freeHead(NIL), freeTail(NIL), current(0), live(0)
+{
+    for (int l = 0; l < LEVELS; l++) {
+        for (int s = 0; s < SLOTS; s++) {
+            slots[l][s].head = slots[l][s].tail = NIL;
+        }
+    }
+    memset(occupied, 0, sizeof(occupied));
+}
+
+int
+TimerWheel::Add(uint64_t when, timer_callback_t cb)
+{
+    uint32_t index;
+    if (freeHead != NIL) {
+        index = freeHead;
+        freeHead = entries[index].next;
+        if (freeHead == NIL) {
+            freeTail = NIL;
+        }
+    } else {
+        if (entries.size() >= INDEX_MASK) {
+            Panic("Too many pending timers");
+        }
+        index = entries.size();
+        entries.emplace_back();
+        entries.back().gen = 0;
+    }
+
+    Entry &e = entries[index];
+    e.when = Clamp(when);
+    e.cb = std::move(cb);
+    Place(index);
+    live++;
+    return (int)(((e.gen & GEN_MASK) << INDEX_BITS) | (index + 1));
+}
+
+bool
+TimerWheel::Cancel(int id)
+{
+    uint32_t index;
+    if (!Lookup(id, index)) {
+        return false;
+    }
+    Unlink(index);
+    Release(index);
+    return true;
+}
+
+bool
+TimerWheel::Rearm(int id, uint64_t when)
+{
+    uint32_t index;
+    if (!Lookup(id, index)) {
+        return false;
+    }
+    Unlink(index);
+    entries[index].when = Clamp(when);
+    Place(index);
+    return true;
+}
+
+void
+TimerWheel::Clear()
+{
+    for (uint32_t i = 0; i < entries.size(); i++) {
+        if (entries[i].level != FREE) {
+            Unlink(i);
+            Release(i);
+        }
+    }
+}
+
+uint64_t
+TimerWheel::NextExpiry() const
+{
+    // Level 0 slots map to single ticks; a slot at level L > 0 holds
+    // timers from its start onwards. Every timer at level L expires
+    // before anything at level L + 1, so the first hit is the answer.
+    for (int l = 0; l < LEVELS; l++) {
+        int shift = l * LEVEL_BITS;
+        int index = (current >> shift) & SLOT_MASK;
+        int s = FindSlot(l, l == 0 ? index : index + 1);
+        if (s >= 0) {
+            uint64_t base = (current >> (shift + LEVEL_BITS))
+                << (shift + LEVEL_BITS);
+            return base + ((uint64_t)s << shift);
+        }
+    }
+    return UINT64_MAX;
+}
+
+bool
+TimerWheel::PopExpired(uint64_t now, timer_callback_t &cb)
+{
+    uint64_t when;
+    if (Pop(now, when, cb)) {
+        return true;
+    }
+    // Nothing is due before now, so no occupied slot is skipped
+    if (now > current) {
+        current = now;
+    }
+    return false;
+}
+
+bool
+TimerWheel::PopEarliest(uint64_t &when, timer_callback_t &cb)
+{
+    return Pop(UINT64_MAX, when, cb);
+}
+
+bool
+TimerWheel::PopEarliest(uint64_t limit, uint64_t &when, timer_callback_t &cb)
+{
+    return Pop(limit, when, cb);
+}
+
+bool
+TimerWheel::Pop(uint64_t limit, uint64_t &when, timer_callback_t &cb)
+{
+    for (;;) {
+        Slot &due = slots[0][current & SLOT_MASK];
+        if (due.head != NIL) {
+            uint32_t index = due.head;
+            Entry &e = entries[index];
+            Unlink(index);
+            when = e.when;
+            cb = std::move(e.cb);
+            Release(index);
+            return true;
+        }
+
+        uint64_t next = NextExpiry();
+        if (next == UINT64_MAX || next > limit) {
+            return false;
+        }
+        current = next;
+        Cascade();
+    }
+}
+
+void
+TimerWheel::Cascade()
+{
+    // Redistribute every upper-level slot that starts at the current
+    // tick, outermost first so its timers can cascade again below.
+    for (int l = LEVELS - 1; l > 0; l--) {
+        int shift = l * LEVEL_BITS;
+        if ((current & ((1ULL << shift) - 1)) != 0) {
+            continue;
+        }
+        int s = (current >> shift) & SLOT_MASK;
+        uint32_t index = slots[l][s].head;
+        slots[l][s].head = slots[l][s].tail = NIL;
+        occupied[l][s / 64] &= ~(1ULL << (s % 64));
+        while (index != NIL) {
+            uint32_t next = entries[index].next;
+            Place(index);
+            index = next;
+        }
+    }
+}
+
+bool
+TimerWheel::Lookup(int id, uint32_t &index) const
+{
+    if (id <= 0) {
+        return false;
+    }
+    index = ((uint32_t)id & INDEX_MASK) - 1;
+    if (index >= entries.size()) {
+        return false;
+    }
+    const Entry &e = entries[index];
+    return e.level != FREE &&
+        (e.gen & GEN_MASK) == ((uint32_t)id >> INDEX_BITS);
+}
+
+uint64_t
+TimerWheel::Clamp(uint64_t when) const
+{
+    // Keep every timer within reach of the top level
+    uint64_t horizon = current | ((1ULL << (LEVELS * LEVEL_BITS)) - 1);
+    return when > horizon ? horizon : when;
+}
+
+void
+TimerWheel::Place(uint32_t index)
+{
+    Entry &e = entries[index];
+    // Overdue timers go in the slot being drained
+    uint64_t when = e.when < current ? current : e.when;
+    uint64_t diff = when ^ current;
+    int level = diff == 0 ? 0 : (63 - __builtin_clzll(diff)) / LEVEL_BITS;
+    ASSERT(level < LEVELS);
+    int s = (when >> (level * LEVEL_BITS)) & SLOT_MASK;
+
+    Slot &slot = slots[level][s];
+    e.level = level;
+    e.slot = s;
+    e.next = NIL;
+    e.prev = slot.tail;
+    if (slot.tail != NIL) {
+        entries[slot.tail].next = index;
+    } else {
+        slot.head = index;
+    }
+    slot.tail = index;
+    occupied[level][s / 64] |= 1ULL << (s % 64);
+}
+
+void
+TimerWheel::Unlink(uint32_t index)
+{
+    Entry &e = entries[index];
+    Slot &slot = slots[e.level][e.slot];
+    if (e.prev != NIL) {
+        entries[e.prev].next = e.next;
+    } else {
+        slot.head = e.next;
+    }
+    if (e.next != NIL) {
+        entries[e.next].prev = e.prev;
+    } else {
+        slot.tail = e.prev;
+    }
+    if (slot.head == NIL) {
+        occupied[e.level][e.slot / 64] &= ~(1ULL << (e.slot % 64));
+    }
+}
+
+void
+TimerWheel::Release(uint32_t index)
+{
+    // Entries are reused oldest-first, which stretches the time before
+    // a stale id's generation comes round again.
+    Entry &e = entries[index];
+    e.cb = nullptr;
+    e.level = FREE;
+    e.gen++;
+    e.next = NIL;
+    if (freeTail != NIL) {
+        entries[freeTail].next = index;
+    } else {
+        freeHead = index;
+    }
+    freeTail = index;
+    live--;
+}
+
+int
+TimerWheel::FindSlot(int level, int start) const
+{
+    for (int w = start / 64; w < SLOTS / 64; w++) {
+        uint64_t bits = occupied[level][w];
+        if (w == start / 64) {
+            bits &= ~0ULL << (start % 64);
+        }
+        if (bits != 0) {
+            return w * 64 + __builtin_ctzll(bits);
+        }
+    }
+    return -1;
+}
+
+} // namespace dsnet
@@ -0,0 +1,123 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * timerwheel.h:
+ *   hierarchical timing wheel backing the transport timers
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **********************************************************************/
+
+#pragma once
+
+#include "lib/transport.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+namespace dsnet {
+
+// Timers are kept in LEVELS wheels of 256 slots. Level L holds the
+// timers that fall in the wheel's current 2^(8(L+1))-tick window but
+// not in its current 2^(8L)-tick one; a slot is cascaded one level
+// down when the clock reaches it. Add, Cancel and Rearm are O(1), and
+// once the entry pool has grown to the peak number of live timers
+// none of them allocate.
+//
+// Ticks are whatever unit the owner uses (microseconds, of real time
+// for the real transports and of virtual time for the simulated one).
+// Timers with the same expiry fire in the order they were added.
+// Timers more than 2^48 ticks out are clamped. Not thread safe.
+class TimerWheel
+{
+public:
+    TimerWheel();
+
+    // Returns a positive id
+    int Add(uint64_t when, timer_callback_t cb);
+    bool Cancel(int id);
+    // Move a pending timer to a new expiry, keeping its id and
+    // callback. Returns false if the timer is no longer pending.
+    bool Rearm(int id, uint64_t when);
+    void Clear();
+
+    bool Empty() const { return live == 0; }
+    size_t Size() const { return live; }
+    uint64_t Now() const { return current; }
+    // Earliest tick at which a timer may be due; for timers still
+    // in the upper levels this is the start of their slot. Returns
+    // UINT64_MAX if there are no timers.
+    uint64_t NextExpiry() const;
+    // Remove one timer due at or before now and hand back its
+    // callback, advancing the clock towards now. Returns false once
+    // nothing more is due.
+    bool PopExpired(uint64_t now, timer_callback_t &cb);
+    // Remove the earliest timer, however far out, and move the clock
+    // to its expiry.
+    bool PopEarliest(uint64_t &when, timer_callback_t &cb);
+    // Same, but only if that timer is due at or before limit
+    bool PopEarliest(uint64_t limit, uint64_t &when, timer_callback_t &cb);
+
+private:
+    static const int LEVEL_BITS = 8;
+    static const int SLOTS = 1 << LEVEL_BITS;
+    static const int LEVELS = 6;
+    static const int INDEX_BITS = 20;
+    static const uint32_t NIL = UINT32_MAX;
+    static const uint8_t FREE = 0xff;
+
+    struct Entry
+    {
+        uint64_t when;
+        timer_callback_t cb;
+        uint32_t prev;
+        uint32_t next;
+        uint16_t gen;
+        uint8_t level;
+        uint8_t slot;
+    };
+    struct Slot
+    {
+        uint32_t head;
+        uint32_t tail;
+    };
+
+    // Entries are addressed by index; a deque never moves them
+    std::deque<Entry> entries;
+    uint32_t freeHead;
+    uint32_t freeTail;
+    Slot slots[LEVELS][SLOTS];
+    uint64_t occupied[LEVELS][SLOTS / 64];
+    uint64_t current;
+    size_t live;
+
+    bool Lookup(int id, uint32_t &index) const;
+    uint64_t Clamp(uint64_t when) const;
+    void Place(uint32_t index);
+    void Unlink(uint32_t index);
+    void Release(uint32_t index);
+    void Cascade();
+    int FindSlot(int level, int start) const;
+    bool Pop(uint64_t limit, uint64_t &when, timer_callback_t &cb);
+};
+
+} // namespace dsnet
@@ -78,6 +78,11 @@ Timeout::Start()
 uint64_t
 Timeout::Reset()
 {
+    // Re-arming a pending timer in place avoids a cancel and a new
+    // registration on every reset
+    if (timerId > 0 && transport->RearmTimer(timerId, ms)) {
+        return ms;
+    }
     Stop();
 
     timerId = transport->Timer(ms, [this]() {
@@ -130,6 +130,9 @@ public:
                                         const Message &m) = 0;
     virtual int Timer(uint64_t ms, timer_callback_t cb) = 0;
     virtual bool CancelTimer(int id) = 0;
+    /* Push a pending timer back to fire ms from now, keeping its id and
+     * callback. Returns false if the timer is no longer pending. */
+    virtual bool RearmTimer(int id, uint64_t ms) = 0;
     virtual void CancelAllTimers() = 0;
     virtual void Run() = 0;
     virtual void Stop() = 0;
@@ -35,8 +35,10 @@
 #include "lib/configuration.h"
 #include "lib/transport.h"
 
+#include <deque>
 #include <map>
 #include <unordered_map>
+#include <vector>
 
 namespace dsnet {
 
@@ -146,18 +148,18 @@ public:
             LookupAddresses();
         }
 
+        FanOutList list;
+        std::vector<const ADDR *> &dsts = list.dsts;
         const ADDR &srcAddr = dynamic_cast<const ADDR &>(src->GetAddress());
         for (auto & kv : replicaAddresses[cfg]) {
             for (auto & kv2 : kv.second) {
                 if (srcAddr == kv2.second) {
                     continue;
                 }
-                if (!SendMessageInternal(src, kv2.second, m)) {
-                    return false;
-                }
+                dsts.push_back(&kv2.second);
             }
         }
-        return true;
+        return SendMessageToAddresses(src, dsts, m);
     }
 
     virtual bool
@@ -165,7 +167,23 @@ public:
                        int groupIdx,
                        const Message &m) override
     {
-        return SendMessageToGroups(src, std::vector<int>{groupIdx}, m);
+        const dsnet::Configuration *cfg = configurations[src];
+        ASSERT(cfg != NULL);
+
+        if (!replicaAddressesInitialized) {
+            LookupAddresses();
+        }
+
+        FanOutList list;
+        std::vector<const ADDR *> &dsts = list.dsts;
+        const ADDR &srcAddr = dynamic_cast<const ADDR &>(src->GetAddress());
+        for (auto & kv : replicaAddresses[cfg][groupIdx]) {
+            if (srcAddr == kv.second) {
+                continue;
+            }
+            dsts.push_back(&kv.second);
+        }
+        return SendMessageToAddresses(src, dsts, m);
     }
 
     virtual bool
@@ -180,18 +198,18 @@ public:
             LookupAddresses();
         }
 
+        FanOutList list;
+        std::vector<const ADDR *> &dsts = list.dsts;
         const ADDR &srcAddr = dynamic_cast<const ADDR &>(src->GetAddress());
         for (int groupIdx : groups) {
             for (auto & kv : replicaAddresses[cfg][groupIdx]) {
                 if (srcAddr == kv.second) {
                     continue;
                 }
-                if (!SendMessageInternal(src, kv.second, m)) {
-                    return false;
-                }
+                dsts.push_back(&kv.second);
             }
         }
-        return true;
+        return SendMessageToAddresses(src, dsts, m);
     }
 
     virtual bool SendMessageToFC(TransportReceiver *src, const Message &m) override
@@ -267,6 +285,59 @@ protected:
                                      const Message &m) = 0;
     virtual ADDR LookupAddressInternal(const dsnet::ReplicaAddress &addr) const = 0;
 
+    // Send the same message to every address in dsts. Transports
+    // that can serialize once and transmit the same bytes to all
+    // destinations should override this; the default simply sends
+    // to each destination in turn.
+    virtual bool
+    SendMessageToAddresses(TransportReceiver *src,
+                           const std::vector<const ADDR *> &dsts,
+                           const Message &m)
+    {
+        for (const ADDR *dst : dsts) {
+            if (!SendMessageInternal(src, *dst, m)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Destination list for one fan-out send. Lists are kept per
+    // thread and reused, so that broadcasting does not allocate; a
+    // fan-out started while another is still in progress on the same
+    // thread takes the next list instead of clobbering the outer one.
+    class FanOutList
+    {
+    public:
+        FanOutList() : dsts(Acquire()) { }
+        ~FanOutList() { Depth()--; }
+        FanOutList(const FanOutList &) = delete;
+        FanOutList &operator=(const FanOutList &) = delete;
+
+        std::vector<const ADDR *> &dsts;
+
+    private:
+        static std::vector<const ADDR *> &
+        Acquire()
+        {
+            // A deque, so growing it leaves outer lists in place
+            static thread_local std::deque<std::vector<const ADDR *> > lists;
+            size_t depth = Depth()++;
+            if (lists.size() <= depth) {
+                lists.emplace_back();
+            }
+            lists[depth].clear();
+            return lists[depth];
+        }
+
+        static size_t &
+        Depth()
+        {
+            static thread_local size_t depth = 0;
+            return depth;
+        }
+    };
+
     std::unordered_map<dsnet::Configuration,
         dsnet::Configuration *> canonicalConfigs;
     std::map<TransportReceiver *,
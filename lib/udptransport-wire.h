@@ -0,0 +1,55 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * udptransport-wire.h:
+ *   datagram framing shared by the kernel-socket UDP transports
+ *
+ * Copyright 2013 Dan R. K. Ports  <drkp@cs.washington.edu>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **********************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace dsnet {
+
+// Every datagram starts with a preamble. Unfragmented messages
+// follow it directly; fragments carry (msg id, offset, total length)
+// and then a slice of the serialized message.
+static const size_t MAX_UDP_MESSAGE_SIZE = 9000; // XXX
+static const int SOCKET_BUF_SIZE = 10485760;
+
+typedef uint32_t Preamble;
+static const Preamble NONFRAG_MAGIC = 0x20050318;
+static const Preamble FRAG_MAGIC = 0x20101010;
+static const size_t FRAG_HEADER_LEN =
+    sizeof(Preamble) + sizeof(uint64_t) + 2 * sizeof(size_t);
+
+// Receivers give up on a partially reassembled message after this long
+// without a new fragment, and hold at most this much in partial ones.
+static const uint64_t FRAG_TIMEOUT_MS = 1000;
+static const size_t MAX_REASSEMBLY_BYTES = 256 << 20;
+
+} // namespace dsnet
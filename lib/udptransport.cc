@@ -33,6 +33,7 @@
 #include "lib/configuration.h"
 #include "lib/message.h"
 #include "lib/udptransport.h"
+#include "lib/udptransport-wire.h"
 
 #include <google/protobuf/message.h>
 #include <event2/event.h>
@@ -47,6 +48,7 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/eventfd.h>
 #include <netdb.h>
 #include <signal.h>
 #include <net/if.h>
@@ -59,15 +61,36 @@
 
 namespace dsnet {
 
-static const size_t MAX_UDP_MESSAGE_SIZE = 9000; // XXX
-static const int SOCKET_BUF_SIZE = 10485760;
+static const size_t RECV_BUF_SIZE = 65536;
+static const size_t CACHE_LINE_SIZE = 64;
+// Batched send slots are padded so every packet starts on a cache line
+static const size_t TX_SLOT_SIZE =
+    (MAX_UDP_MESSAGE_SIZE + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1);
 
-typedef uint32_t Preamble;
-static const Preamble NONFRAG_MAGIC = 0x20050318;
-static const Preamble FRAG_MAGIC = 0x20101010;
+// Receive threads only need room for what our senders put on the
+// wire: an unfragmented message or one fragment plus its header.
+static const size_t SHARD_SLOT_SIZE =
+    (MAX_UDP_MESSAGE_SIZE + FRAG_HEADER_LEN + CACHE_LINE_SIZE - 1) &
+    ~(CACHE_LINE_SIZE - 1);
+static const size_t SHARD_RING_SLOTS = 1024;
 
 using std::pair;
 
+// Transport whose event loop callback is currently running on this
+// thread. Outgoing packets are only queued for sendmmsg while inside a
+// callback, so that sends from other threads (or outside the event
+// loop) still go out immediately.
+static thread_local UDPTransport *batchingTransport = nullptr;
+
+// Serialization buffer reused by every unbatched send on this thread.
+// It only grows, so steady-state sends do not touch the heap.
+static thread_local struct SendBuffer
+{
+    char *buf = nullptr;
+    size_t size = 0;
+    ~SendBuffer() { free(buf); }
+} sendBuffer;
+
 UDPTransportAddress::UDPTransportAddress(const std::string &s)
 {
     memcpy(&addr, s.data(), sizeof(addr));
@@ -176,12 +199,41 @@ BindToPort(int fd, const string &host, const string &port)
 }
 
 UDPTransport::UDPTransport(double dropRate, double reorderRate,
-                           event_base *evbase)
-    : dropRate(dropRate), reorderRate(reorderRate)
+                           event_base *evbase, int batchSize,
+                           int recvThreads, RecvDispatch dispatch)
+    : dropRate(dropRate), reorderRate(reorderRate),
+      reassembler(MAX_UDP_MESSAGE_SIZE, MAX_REASSEMBLY_BYTES),
+      batchSize(batchSize), recvThreads(recvThreads), dispatch(dispatch)
 {
     struct timeval tv;
-    lastTimerId = 0;
     lastFragMsgId = 0;
+    fragSweepPending = false;
+    txBuffers = nullptr;
+    txQueued = 0;
+    txFd = -1;
+    memset(&stats, 0, sizeof(stats));
+    sendBufferAllocs = 0;
+    fanoutMessages = 0;
+    fanoutPackets = 0;
+    shardsRunning = false;
+    shardNotifyFd = -1;
+
+    ASSERT(batchSize >= 1);
+    if (batchSize > 1) {
+        Notice("Batching up to %d datagrams per recvmmsg/sendmmsg", batchSize);
+        rxBuffers.resize(batchSize * RECV_BUF_SIZE);
+        rxMsgs.resize(batchSize);
+        rxIovecs.resize(batchSize);
+        rxAddrs.resize(batchSize);
+        txBuffers = (char *)aligned_alloc(CACHE_LINE_SIZE,
+                                          batchSize * TX_SLOT_SIZE);
+        if (txBuffers == nullptr) {
+            Panic("Failed to allocate send batch buffers");
+        }
+        txMsgs.resize(batchSize);
+        txIovecs.resize(batchSize);
+        txAddrs.resize(batchSize);
+    }
 
     uniformDist = std::uniform_real_distribution<double>(0.0, 1.0);
     gettimeofday(&tv, NULL);
@@ -194,6 +246,12 @@ UDPTransport::UDPTransport(double dropRate, double reorderRate,
         Warning("Reordering packets with probability %g", reorderRate);
     }
 
+    ASSERT(recvThreads >= 1);
+    if (recvThreads > 1 && dispatch == RecvDispatch::Independent &&
+        (dropRate > 0 || reorderRate > 0)) {
+        Panic("Simulated drops and reordering need a single protocol thread");
+    }
+
     // Set up libevent
     event_set_log_callback(LogCallback);
     event_set_fatal_callback(FatalCallback);
@@ -217,24 +275,53 @@ UDPTransport::UDPTransport(double dropRate, double reorderRate,
         event_add(x, NULL);
     }
 
+    clock_gettime(CLOCK_MONOTONIC, &timerEpoch);
+    timerEvent = event_new(libeventBase, -1, 0, TimerCallback, this);
+    timerDeadline = UINT64_MAX;
+
+    if (recvThreads > 1) {
+        Notice("Receiving on %d SO_REUSEPORT sockets per address (%s)",
+               recvThreads,
+               dispatch == RecvDispatch::Forward ? "forward" : "independent");
+        if (dispatch == RecvDispatch::Forward) {
+            shardNotifyFd = eventfd(0, EFD_NONBLOCK);
+            if (shardNotifyFd < 0) {
+                PPanic("Failed to create eventfd");
+            }
+            event *ev = event_new(libeventBase, shardNotifyFd,
+                                  EV_READ | EV_PERSIST,
+                                  ShardNotifyCallback, (void *)this);
+            event_add(ev, NULL);
+            listenerEvents.push_back(ev);
+        }
+    }
 }
 
 UDPTransport::~UDPTransport()
 {
-    // XXX Shut down libevent?
+    StopShards();
+    for (RecvShard *shard : shards) {
+        if (shard->thread.joinable()) {
+            // Stopped from this shard's own thread
+            shard->thread.detach();
+        }
+        event_free(shard->ev);
+        event_base_free(shard->base);
+        close(shard->fd);
+        delete shard;
+    }
+    if (shardNotifyFd >= 0) {
+        close(shardNotifyFd);
+    }
+    free(txBuffers);
+    event_free(timerEvent);
 
-    // for (auto kv : timers) {
-    //     delete kv.second;
-    // }
+    // XXX Shut down libevent?
 }
 
-void
-UDPTransport::RegisterInternal(TransportReceiver *receiver,
-                               const dsnet::ReplicaAddress *addr,
-                               int groupIdx, int replicaIdx)
+static int
+NewSocket(bool reusePort)
 {
-    struct sockaddr_in sin;
-
     // Create socket
     int fd;
     if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
@@ -253,6 +340,13 @@ UDPTransport::RegisterInternal(TransportReceiver *receiver,
         PWarning("Failed to set SO_BROADCAST on socket");
     }
 
+    // Let several sockets share the port so the kernel spreads
+    // incoming flows across receive threads
+    if (reusePort && setsockopt(fd, SOL_SOCKET,
+                                SO_REUSEPORT, (char *)&n, sizeof(n)) < 0) {
+        PPanic("Failed to set SO_REUSEPORT on socket");
+    }
+
     // Increase buffer size
     n = SOCKET_BUF_SIZE;
     if (setsockopt(fd, SOL_SOCKET,
@@ -264,6 +358,21 @@ UDPTransport::RegisterInternal(TransportReceiver *receiver,
         PWarning("Failed to set SO_SNDBUF on socket");
     }
 
+    return fd;
+}
+
+void
+UDPTransport::RegisterInternal(TransportReceiver *receiver,
+                               const dsnet::ReplicaAddress *addr,
+                               int groupIdx, int replicaIdx)
+{
+    struct sockaddr_in sin;
+
+    // Only sockets bound to a well-known address are worth sharding;
+    // clients listen on an ephemeral port.
+    bool sharded = recvThreads > 1 && addr != nullptr;
+    int fd = NewSocket(sharded);
+
     if (addr != nullptr) {
         BindToPort(fd, addr->host, addr->port);
     } else {
@@ -289,6 +398,98 @@ UDPTransport::RegisterInternal(TransportReceiver *receiver,
     fds[receiver] = fd;
 
     Notice("Listening on UDP port %hu", ntohs(sin.sin_port));
+
+    if (sharded) {
+        AddShards(fd, sin);
+    }
+}
+
+UDPTransport::RecvShard::RecvShard(UDPTransport *transport, int fd,
+                                   int primaryFd)
+    : transport(transport), fd(fd), primaryFd(primaryFd),
+      ring(transport->dispatch == RecvDispatch::Forward ?
+           SHARD_RING_SLOTS : 1),
+      slots(transport->batchSize),
+      msgs(transport->batchSize), iovecs(transport->batchSize),
+      rxBatches(0), rxPackets(0), rxDropped(0)
+{
+    // Slots point into one buffer allocated up front; in forward
+    // mode the ring slots are the receive buffers, so packets are
+    // handed over without copying.
+    if (transport->dispatch == RecvDispatch::Forward) {
+        buffers.resize(SHARD_RING_SLOTS * SHARD_SLOT_SIZE);
+        for (size_t i = 0; i < SHARD_RING_SLOTS; i++) {
+            ring.WriteSlot(i).data = &buffers[i * SHARD_SLOT_SIZE];
+        }
+        spill.resize(SHARD_SLOT_SIZE);
+    } else {
+        buffers.resize(transport->batchSize * SHARD_SLOT_SIZE);
+        batch.resize(transport->batchSize);
+        for (int i = 0; i < transport->batchSize; i++) {
+            batch[i].data = &buffers[i * SHARD_SLOT_SIZE];
+        }
+    }
+
+    base = event_base_new();
+    evthread_make_base_notifiable(base);
+    ev = event_new(base, fd, EV_READ | EV_PERSIST,
+                   ShardCallback, (void *)this);
+    event_add(ev, NULL);
+}
+
+void
+UDPTransport::AddShards(int primaryFd, const sockaddr_in &sin)
+{
+    for (int i = 1; i < recvThreads; i++) {
+        int fd = NewSocket(true);
+        if (bind(fd, (const sockaddr *)&sin, sizeof(sin)) < 0) {
+            PPanic("Failed to bind SO_REUSEPORT socket");
+        }
+        RecvShard *shard = new RecvShard(this, fd, primaryFd);
+        shards.push_back(shard);
+        if (shardsRunning) {
+            shard->thread = std::thread(&UDPTransport::RunShard, this, shard);
+        }
+    }
+}
+
+void
+UDPTransport::StartShards()
+{
+    if (shardsRunning) {
+        return;
+    }
+    shardsRunning = true;
+    for (RecvShard *shard : shards) {
+        if (shard->thread.joinable()) {
+            shard->thread.join();
+        }
+        shard->thread = std::thread(&UDPTransport::RunShard, this, shard);
+    }
+}
+
+void
+UDPTransport::StopShards()
+{
+    if (!shardsRunning) {
+        return;
+    }
+    for (RecvShard *shard : shards) {
+        event_base_loopbreak(shard->base);
+    }
+    for (RecvShard *shard : shards) {
+        if (shard->thread.joinable() &&
+            shard->thread.get_id() != std::this_thread::get_id()) {
+            shard->thread.join();
+        }
+    }
+    shardsRunning = false;
+}
+
+void
+UDPTransport::RunShard(RecvShard *shard)
+{
+    event_base_dispatch(shard->base);
 }
 
 void
@@ -365,17 +566,25 @@ UDPTransport::SendMessageInternal(TransportReceiver *src,
                                   const Message &m)
 {
     sockaddr_in sin = dst.addr;
-
-    // Serialize message
+    int fd = fds[src];
     size_t msg_len = sizeof(Preamble) + m.SerializedSize();
-    char *buf = new char[msg_len];
+
+    if (batchingTransport == this) {
+        if (msg_len <= MAX_UDP_MESSAGE_SIZE) {
+            return EnqueuePacket(fd, sin, m, msg_len);
+        }
+        // Keep packets in order: anything queued goes out before
+        // the fragments of this message.
+        FlushSendQueue();
+    }
+
+    // Serialize message into the reusable per-thread buffer
+    char *buf = GetSendBuffer(msg_len);
     char *ptr = buf;
     *(Preamble *)ptr = NONFRAG_MAGIC;
     ptr += sizeof(Preamble);
     m.Serialize(ptr);
 
-    int fd = fds[src];
-
     // XXX All of this assumes that the socket is going to be
     // available for writing, which since it's a UDP socket it ought
     // to be.
@@ -383,52 +592,243 @@ UDPTransport::SendMessageInternal(TransportReceiver *src,
         if (sendto(fd, buf, msg_len, 0,
                    (sockaddr *)&sin, sizeof(sin)) < 0) {
             PWarning("Failed to send message");
-            goto fail;
+            return false;
         }
     } else {
-        msg_len -= sizeof(Preamble);
-        char *body_start = buf + sizeof(Preamble);
-        int num_frags = ((msg_len - 1) / MAX_UDP_MESSAGE_SIZE) + 1;
-        Notice("Sending large %s message in %d fragments",
-               m.Type().c_str(), num_frags);
+        Notice("Sending large %s message in %zu fragments",
+               m.Type().c_str(),
+               ((msg_len - sizeof(Preamble) - 1) / MAX_UDP_MESSAGE_SIZE) + 1);
+        return SendFragments(fd, sin, buf + sizeof(Preamble),
+                             msg_len - sizeof(Preamble), ++lastFragMsgId);
+    }
+
+    return true;
+}
+
+bool
+UDPTransport::SendMessageToAddresses(
+    TransportReceiver *src,
+    const std::vector<const UDPTransportAddress *> &dsts,
+    const Message &m)
+{
+    if (dsts.size() <= 1) {
+        return TransportCommon::SendMessageToAddresses(src, dsts, m);
+    }
+
+    int fd = fds[src];
+    size_t msg_len = sizeof(Preamble) + m.SerializedSize();
+
+    if (batchingTransport == this) {
+        FlushSendQueue();
+    }
+
+    // Serialize once; every destination gets the same bytes.
+    char *buf = GetSendBuffer(msg_len);
+    *(Preamble *)buf = NONFRAG_MAGIC;
+    m.Serialize(buf + sizeof(Preamble));
+    fanoutMessages++;
+    fanoutPackets += dsts.size();
+
+    if (msg_len > MAX_UDP_MESSAGE_SIZE) {
+        Notice("Sending large %s message in %zu fragments to %zu replicas",
+               m.Type().c_str(),
+               ((msg_len - sizeof(Preamble) - 1) / MAX_UDP_MESSAGE_SIZE) + 1,
+               dsts.size());
         uint64_t msg_id = ++lastFragMsgId;
-        for (size_t frag_start = 0; frag_start < msg_len;
-                frag_start += MAX_UDP_MESSAGE_SIZE) {
-            size_t frag_len = std::min(msg_len - frag_start,
-                                      MAX_UDP_MESSAGE_SIZE);
-            size_t frag_header_len = 2 * sizeof(size_t) + sizeof(uint64_t) + sizeof(Preamble);
-            char frag_buf[frag_len + frag_header_len];
-            char *ptr = frag_buf;
-            *((Preamble *)ptr) = FRAG_MAGIC;
-            ptr += sizeof(Preamble);
-            *((uint64_t *)ptr) = msg_id;
-            ptr += sizeof(uint64_t);
-            *((size_t *)ptr) = frag_start;
-            ptr += sizeof(size_t);
-            *((size_t *)ptr) = msg_len;
-            ptr += sizeof(size_t);
-            memcpy(ptr, &body_start[frag_start], frag_len);
-
-            if (sendto(fd, frag_buf, frag_len + frag_header_len, 0,
-                       (sockaddr *)&sin, sizeof(sin)) < 0) {
-                PWarning("Failed to send message fragment %ld",
-                         frag_start);
-                goto fail;
-            }
+        bool ok = true;
+        for (const UDPTransportAddress *dst : dsts) {
+            ok &= SendFragments(fd, dst->addr, buf + sizeof(Preamble),
+                                msg_len - sizeof(Preamble), msg_id);
         }
+        return ok;
     }
 
-    delete [] buf;
+    // One sendmmsg for the whole group: the headers share a single
+    // iovec and differ only in the destination address.
+    static thread_local std::vector<struct mmsghdr> msgs;
+    struct iovec iov;
+    iov.iov_base = buf;
+    iov.iov_len = msg_len;
+    msgs.resize(dsts.size());
+    for (size_t i = 0; i < dsts.size(); i++) {
+        struct msghdr &hdr = msgs[i].msg_hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.msg_name = const_cast<sockaddr_in *>(&dsts[i]->addr);
+        hdr.msg_namelen = sizeof(sockaddr_in);
+        hdr.msg_iov = &iov;
+        hdr.msg_iovlen = 1;
+    }
+
+    bool ok = true;
+    size_t sent = 0;
+    while (sent < msgs.size()) {
+        int n = sendmmsg(fd, &msgs[sent], msgs.size() - sent, 0);
+        if (n < 0) {
+            PWarning("Failed to send message");
+            ok = false;
+            sent++;
+            continue;
+        }
+        sent += n;
+    }
+    return ok;
+}
+
+bool
+UDPTransport::SendFragments(int fd, const sockaddr_in &dst,
+                            const char *body, size_t len, uint64_t msg_id)
+{
+    // Each fragment is sent as (header, slice of the serialized
+    // body) without copying the body.
+    char frag_header[FRAG_HEADER_LEN];
+    struct iovec iov[2];
+    iov[0].iov_base = frag_header;
+    iov[0].iov_len = FRAG_HEADER_LEN;
+    struct msghdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_name = const_cast<sockaddr_in *>(&dst);
+    hdr.msg_namelen = sizeof(dst);
+    hdr.msg_iov = iov;
+    hdr.msg_iovlen = 2;
+
+    for (size_t frag_start = 0; frag_start < len;
+            frag_start += MAX_UDP_MESSAGE_SIZE) {
+        size_t frag_len = std::min(len - frag_start,
+                                  MAX_UDP_MESSAGE_SIZE);
+        char *ptr = frag_header;
+        *((Preamble *)ptr) = FRAG_MAGIC;
+        ptr += sizeof(Preamble);
+        *((uint64_t *)ptr) = msg_id;
+        ptr += sizeof(uint64_t);
+        *((size_t *)ptr) = frag_start;
+        ptr += sizeof(size_t);
+        *((size_t *)ptr) = len;
+        iov[1].iov_base = const_cast<char *>(&body[frag_start]);
+        iov[1].iov_len = frag_len;
+
+        if (sendmsg(fd, &hdr, 0) < 0) {
+            PWarning("Failed to send message fragment %ld",
+                     frag_start);
+            return false;
+        }
+    }
     return true;
+}
 
-fail:
-    delete [] buf;
-    return false;
+char *
+UDPTransport::GetSendBuffer(size_t len)
+{
+    if (len > sendBuffer.size) {
+        size_t size = std::max(len, MAX_UDP_MESSAGE_SIZE);
+        size = (size + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1);
+        free(sendBuffer.buf);
+        sendBuffer.buf = (char *)aligned_alloc(CACHE_LINE_SIZE, size);
+        if (sendBuffer.buf == nullptr) {
+            Panic("Failed to allocate %zu byte send buffer", size);
+        }
+        sendBuffer.size = size;
+        sendBufferAllocs++;
+    }
+    return sendBuffer.buf;
+}
+
+bool
+UDPTransport::EnqueuePacket(int fd, const sockaddr_in &dst, const Message &m,
+                            size_t msg_len)
+{
+    // sendmmsg works on a single socket
+    if (txQueued > 0 && txFd != fd) {
+        FlushSendQueue();
+    }
+
+    char *buf = &txBuffers[txQueued * TX_SLOT_SIZE];
+    *(Preamble *)buf = NONFRAG_MAGIC;
+    m.Serialize(buf + sizeof(Preamble));
+
+    txAddrs[txQueued] = dst;
+    txIovecs[txQueued].iov_base = buf;
+    txIovecs[txQueued].iov_len = msg_len;
+    struct msghdr &hdr = txMsgs[txQueued].msg_hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_name = &txAddrs[txQueued];
+    hdr.msg_namelen = sizeof(sockaddr_in);
+    hdr.msg_iov = &txIovecs[txQueued];
+    hdr.msg_iovlen = 1;
+    txFd = fd;
+
+    if (++txQueued == batchSize) {
+        FlushSendQueue();
+    }
+    return true;
+}
+
+void
+UDPTransport::FlushSendQueue()
+{
+    int sent = 0;
+    while (sent < txQueued) {
+        int n = sendmmsg(txFd, &txMsgs[sent], txQueued - sent, 0);
+        if (n < 0) {
+            // Drop the packet that failed, same as a failed sendto
+            PWarning("Failed to send message");
+            sent++;
+            continue;
+        }
+        sent += n;
+        stats.txBatches++;
+        stats.txPackets += n;
+    }
+    txQueued = 0;
+}
+
+UDPTransport::Stats
+UDPTransport::GetStats() const
+{
+    Stats s = stats;
+    s.sendBufferAllocs = sendBufferAllocs;
+    s.fanoutMessages = fanoutMessages;
+    s.fanoutPackets = fanoutPackets;
+    for (const RecvShard *shard : shards) {
+        s.rxBatches += shard->rxBatches;
+        s.rxPackets += shard->rxPackets;
+        s.rxDropped += shard->rxDropped;
+    }
+    return s;
+}
+
+void
+UDPTransport::PrintStats() const
+{
+    Notice("Send path: %lu buffer allocations",
+           sendBufferAllocs.load());
+    if (fanoutMessages > 0) {
+        Notice("Fan-out: %lu messages serialized once for %lu packets",
+               fanoutMessages.load(), fanoutPackets.load());
+    }
+    for (size_t i = 0; i < shards.size(); i++) {
+        const RecvShard *shard = shards[i];
+        Notice("Receive thread %zu: %lu packets in %lu batches, "
+               "%lu dropped with the main loop behind",
+               i + 1, shard->rxPackets.load(), shard->rxBatches.load(),
+               shard->rxDropped.load());
+    }
+    if (batchSize == 1) {
+        return;
+    }
+    Notice("recvmmsg: %lu packets in %lu batches (avg %.2f/%d)",
+           stats.rxPackets, stats.rxBatches,
+           stats.rxBatches == 0 ? 0.0 :
+           (double)stats.rxPackets / stats.rxBatches, batchSize);
+    Notice("sendmmsg: %lu packets in %lu batches (avg %.2f/%d)",
+           stats.txPackets, stats.txBatches,
+           stats.txBatches == 0 ? 0.0 :
+           (double)stats.txPackets / stats.txBatches, batchSize);
 }
 
 void
 UDPTransport::Run()
 {
+    StartShards();
     event_base_dispatch(libeventBase);
 }
 
@@ -436,18 +836,23 @@ void
 UDPTransport::Stop()
 {
     event_base_loopbreak(libeventBase);
+    StopShards();
 }
 
 void
 UDPTransport::OnReadable(int fd)
 {
-    const int BUFSIZE = 65536;
+    if (batchSize > 1) {
+        OnReadableBatch(fd);
+        return;
+    }
+
     ssize_t sz;
-    char buf[BUFSIZE];
+    char buf[RECV_BUF_SIZE];
     sockaddr_in sender;
     socklen_t sender_size = sizeof(sender);
 
-    sz = recvfrom(fd, buf, BUFSIZE, 0,
+    sz = recvfrom(fd, buf, RECV_BUF_SIZE, 0,
             (struct sockaddr *) &sender, &sender_size);
     if (sz == -1) {
         if (errno == EAGAIN || errno == EWOULDBLOCK) {
@@ -461,6 +866,173 @@ UDPTransport::OnReadable(int fd)
     ProcessPacket(fd, sender, sender_size, buf, sz);
 }
 
+void
+UDPTransport::OnReadableBatch(int fd)
+{
+    for (int i = 0; i < batchSize; i++) {
+        rxIovecs[i].iov_base = &rxBuffers[i * RECV_BUF_SIZE];
+        rxIovecs[i].iov_len = RECV_BUF_SIZE;
+        struct msghdr &hdr = rxMsgs[i].msg_hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.msg_name = &rxAddrs[i];
+        hdr.msg_namelen = sizeof(sockaddr_in);
+        hdr.msg_iov = &rxIovecs[i];
+        hdr.msg_iovlen = 1;
+    }
+
+    int n = recvmmsg(fd, rxMsgs.data(), batchSize, MSG_DONTWAIT, nullptr);
+    if (n < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            PWarning("Failed to receive messages from socket");
+        }
+        return;
+    }
+    stats.rxBatches++;
+    stats.rxPackets += n;
+
+    // Replies generated while processing the batch are queued and
+    // sent together with sendmmsg once the whole batch is done.
+    UDPTransport *prev = batchingTransport;
+    batchingTransport = this;
+    for (int i = 0; i < n; i++) {
+        ProcessPacket(fd, rxAddrs[i], rxMsgs[i].msg_hdr.msg_namelen,
+                      (char *)rxIovecs[i].iov_base, rxMsgs[i].msg_len);
+    }
+    FlushSendQueue();
+    batchingTransport = prev;
+}
+
+void
+UDPTransport::OnShardReadable(RecvShard *shard)
+{
+    std::vector<RecvSlot *> &slots = shard->slots;
+    int want = batchSize;
+
+    if (dispatch == RecvDispatch::Forward) {
+        size_t free = shard->ring.Writable();
+        if (free == 0) {
+            // The main loop has fallen behind. Rather than spin until
+            // it catches up, shed a batch, as a full socket buffer
+            // would have.
+            DropShardBatch(shard);
+            return;
+        }
+        want = std::min((size_t)batchSize, free);
+        for (int i = 0; i < want; i++) {
+            slots[i] = &shard->ring.WriteSlot(i);
+        }
+    } else {
+        for (int i = 0; i < want; i++) {
+            slots[i] = &shard->batch[i];
+        }
+    }
+
+    for (int i = 0; i < want; i++) {
+        shard->iovecs[i].iov_base = slots[i]->data;
+        shard->iovecs[i].iov_len = SHARD_SLOT_SIZE;
+        struct msghdr &hdr = shard->msgs[i].msg_hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.msg_name = &slots[i]->addr;
+        hdr.msg_namelen = sizeof(sockaddr_in);
+        hdr.msg_iov = &shard->iovecs[i];
+        hdr.msg_iovlen = 1;
+    }
+
+    int n = recvmmsg(shard->fd, shard->msgs.data(), want,
+                     MSG_DONTWAIT, nullptr);
+    if (n < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            PWarning("Failed to receive messages from socket");
+        }
+        return;
+    }
+    shard->rxBatches++;
+    shard->rxPackets += n;
+
+    // Compact out anything that did not fit in a slot
+    int kept = 0;
+    for (int i = 0; i < n; i++) {
+        if (shard->msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+            Warning("Dropping oversized %u byte packet", shard->msgs[i].msg_len);
+            continue;
+        }
+        if (kept != i) {
+            std::swap(slots[kept]->data, slots[i]->data);
+            slots[kept]->addr = slots[i]->addr;
+        }
+        slots[kept]->len = shard->msgs[i].msg_len;
+        kept++;
+    }
+
+    if (dispatch == RecvDispatch::Forward) {
+        if (kept > 0) {
+            shard->ring.Push(kept);
+            uint64_t one = 1;
+            if (write(shardNotifyFd, &one, sizeof(one)) < 0 &&
+                errno != EAGAIN) {
+                PWarning("Failed to signal receive ring");
+            }
+        }
+    } else {
+        for (int i = 0; i < kept; i++) {
+            ProcessPacket(shard->primaryFd, slots[i]->addr,
+                          sizeof(sockaddr_in), slots[i]->data, slots[i]->len);
+        }
+    }
+}
+
+void
+UDPTransport::DropShardBatch(RecvShard *shard)
+{
+    // Every packet lands in the same spill buffer; only the count
+    // matters
+    for (int i = 0; i < batchSize; i++) {
+        shard->iovecs[i].iov_base = shard->spill.data();
+        shard->iovecs[i].iov_len = shard->spill.size();
+        struct msghdr &hdr = shard->msgs[i].msg_hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.msg_iov = &shard->iovecs[i];
+        hdr.msg_iovlen = 1;
+    }
+    int n = recvmmsg(shard->fd, shard->msgs.data(), batchSize,
+                     MSG_DONTWAIT, nullptr);
+    if (n < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            PWarning("Failed to receive messages from socket");
+        }
+        return;
+    }
+    shard->rxDropped += n;
+}
+
+void
+UDPTransport::OnShardNotify()
+{
+    uint64_t count;
+    if (read(shardNotifyFd, &count, sizeof(count)) < 0 &&
+        errno != EAGAIN) {
+        PWarning("Failed to read receive ring eventfd");
+    }
+
+    UDPTransport *prev = batchingTransport;
+    if (batchSize > 1) {
+        batchingTransport = this;
+    }
+    for (RecvShard *shard : shards) {
+        size_t n = shard->ring.Readable();
+        for (size_t i = 0; i < n; i++) {
+            RecvSlot &slot = shard->ring.ReadSlot(0);
+            ProcessPacket(shard->primaryFd, slot.addr, sizeof(sockaddr_in),
+                          slot.data, slot.len);
+            shard->ring.Pop(1);
+        }
+    }
+    if (batchSize > 1) {
+        FlushSendQueue();
+        batchingTransport = prev;
+    }
+}
+
 void
 UDPTransport::ProcessPacket(int fd, sockaddr_in sender, socklen_t sender_size,
                             char *buf, ssize_t sz)
@@ -471,7 +1043,7 @@ UDPTransport::ProcessPacket(int fd, sockaddr_in sender, socklen_t sender_size,
     // a fragment. Otherwise, we can process it directly
     ASSERT(sz > (long int)sizeof(Preamble));
     Preamble magic = *(Preamble *)buf;
-    std::unique_ptr<char> copy_buf;
+    std::unique_ptr<char[]> copy_buf;
     void *msg_buf;
     size_t msg_size;
 
@@ -481,53 +1053,30 @@ UDPTransport::ProcessPacket(int fd, sockaddr_in sender, socklen_t sender_size,
         msg_size = sz - sizeof(Preamble);
     } else if (magic == FRAG_MAGIC) {
         // This is a fragment. Decode the header
+        if (sz <= (ssize_t)FRAG_HEADER_LEN) {
+            Warning("Received runt fragment");
+            return;
+        }
         const char *ptr = buf;
         ptr += sizeof(Preamble);
-        ASSERT(ptr - buf < sz);
         uint64_t msg_id = *((uint64_t *)ptr);
         ptr += sizeof(uint64_t);
-        ASSERT(ptr - buf < sz);
         size_t frag_start = *((size_t *)ptr);
         ptr += sizeof(size_t);
-        ASSERT(ptr - buf < sz);
         size_t msg_len = *((size_t *)ptr);
         ptr += sizeof(size_t);
-        ASSERT(ptr - buf < sz);
-        ASSERT(buf + sz - ptr == (ssize_t) std::min(msg_len - frag_start,
-                                                    MAX_UDP_MESSAGE_SIZE));
-        Notice("Received fragment of %zd byte packet %lx starting at %zd",
-               msg_len, msg_id, frag_start);
-        UDPTransportFragInfo &info = fragInfo[sender_addr];
-        if (info.msgId == 0) {
-            info.msgId = msg_id;
-            info.data.clear();
-        }
-        if (info.msgId != msg_id) {
-            ASSERT(msg_id > info.msgId);
-            Warning("Failed to reconstruct packet %lx", info.msgId);
-            info.msgId = msg_id;
-            info.data.clear();
-        }
-
-        if (frag_start != info.data.size()) {
-            Warning("Fragments out of order for packet %lx; "
-                    "expected start %zd, got %zd",
-                    msg_id, info.data.size(), frag_start);
-            return;
-        }
+        Debug("Received fragment of %zd byte packet %lx starting at %zd",
+              msg_len, msg_id, frag_start);
 
-        info.data.append(string(ptr, buf + sz - ptr));
-        if (info.data.size() == msg_len) {
-            Debug("Completed packet reconstruction");
-            msg_size = info.data.size();
-            copy_buf = std::unique_ptr<char>(new char(msg_size));
-            memcpy(copy_buf.get(), info.data.data(), msg_size);
-            msg_buf = copy_buf.get();
-            info.msgId = 0;
-            info.data.clear();
-        } else {
+        std::lock_guard<std::mutex> l(fragLock);
+        if (!reassembler.Add(sender_addr, msg_id, frag_start, msg_len,
+                             ptr, buf + sz - ptr, TimerNow(), copy_buf)) {
+            ScheduleFragmentSweep();
             return;
         }
+        Debug("Completed packet reconstruction");
+        msg_buf = copy_buf.get();
+        msg_size = msg_len;
     } else {
         Warning("Received packet with bad magic number");
         return;
@@ -584,7 +1133,7 @@ deliver:
     if (reorderBuffer.valid) {
         reorderBuffer.valid = false;
         msg_size = reorderBuffer.message.size();
-        copy_buf = std::unique_ptr<char>(new char(msg_size));
+        copy_buf.reset(new char[msg_size]);
         memcpy(copy_buf.get(), reorderBuffer.message.data(), msg_size);
         msg_buf = copy_buf.get();
         fd = reorderBuffer.fd;
@@ -595,71 +1144,123 @@ deliver:
     }
 }
 
-int
-UDPTransport::Timer(uint64_t ms, timer_callback_t cb)
+// Requires fragLock. One timer at a time is enough: partial messages
+// only need to be looked at once they could have gone stale.
+void
+UDPTransport::ScheduleFragmentSweep()
 {
-    std::lock_guard<std::mutex> lck(this->timersLock);
-    UDPTransportTimerInfo *info = new UDPTransportTimerInfo();
-
-    struct timeval tv;
-    tv.tv_sec = ms / 1000;
-    tv.tv_usec = (ms % 1000) * 1000;
-
-    ++lastTimerId;
+    if (fragSweepPending || reassembler.Empty()) {
+        return;
+    }
+    fragSweepPending = true;
+    Timer(FRAG_TIMEOUT_MS, [this]() { SweepFragments(); });
+}
 
-    info->transport = this;
-    info->id = lastTimerId;
-    info->cb = cb;
-    info->ev = event_new(libeventBase, -1, 0,
-                         TimerCallback, info);
+void
+UDPTransport::SweepFragments()
+{
+    std::lock_guard<std::mutex> l(fragLock);
+    fragSweepPending = false;
+    uint64_t now = TimerNow();
+    if (now > FRAG_TIMEOUT_MS * 1000) {
+        reassembler.Expire(now - FRAG_TIMEOUT_MS * 1000);
+    }
+    ScheduleFragmentSweep();
+}
 
-    timers[info->id] = info;
+uint64_t
+UDPTransport::TimerNow() const
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec - timerEpoch.tv_sec) * 1000000 +
+        (ts.tv_nsec - timerEpoch.tv_nsec) / 1000;
+}
 
-    event_add(info->ev, &tv);
+void
+UDPTransport::ArmTimerEvent(uint64_t now)
+{
+    // Called with timersLock held. The event only ever needs pulling
+    // in; if it fires early the wheel simply has nothing due yet.
+    uint64_t next = timers.NextExpiry();
+    if (next >= timerDeadline) {
+        return;
+    }
+    uint64_t delay = next > now ? next - now : 0;
+    struct timeval tv;
+    tv.tv_sec = delay / 1000000;
+    tv.tv_usec = delay % 1000000;
+    timerDeadline = next;
+    event_add(timerEvent, &tv);
+}
 
-    return info->id;
+int
+UDPTransport::Timer(uint64_t ms, timer_callback_t cb)
+{
+    std::lock_guard<std::mutex> l(this->timersLock);
+    uint64_t now = TimerNow();
+    int id = timers.Add(now + ms * 1000, std::move(cb));
+    ArmTimerEvent(now);
+    return id;
 }
 
 bool
 UDPTransport::CancelTimer(int id)
 {
     std::lock_guard<std::mutex> l(this->timersLock);
-    UDPTransportTimerInfo *info = timers[id];
+    return timers.Cancel(id);
+}
 
-    if (info == NULL) {
+bool
+UDPTransport::RearmTimer(int id, uint64_t ms)
+{
+    std::lock_guard<std::mutex> l(this->timersLock);
+    uint64_t now = TimerNow();
+    if (!timers.Rearm(id, now + ms * 1000)) {
         return false;
     }
-
-    event_del(info->ev);
-    event_free(info->ev);
-    timers.erase(info->id);
-    delete info;
-
+    ArmTimerEvent(now);
     return true;
 }
 
 void
 UDPTransport::CancelAllTimers()
 {
-    while (!timers.empty()) {
-        auto kv = timers.begin();
-        CancelTimer(kv->first);
+    {
+        std::lock_guard<std::mutex> l(this->timersLock);
+        timers.Clear();
     }
+    // That included the fragment sweep
+    std::lock_guard<std::mutex> l(fragLock);
+    fragSweepPending = false;
+    ScheduleFragmentSweep();
 }
 
 void
-UDPTransport::OnTimer(UDPTransportTimerInfo *info)
+UDPTransport::OnTimers()
 {
-    {
-        std::lock_guard<std::mutex> l(this->timersLock);
-        timers.erase(info->id);
-        event_del(info->ev);
-        event_free(info->ev);
+    UDPTransport *prev = batchingTransport;
+    if (batchSize > 1) {
+        batchingTransport = this;
     }
 
-    info->cb();
+    // Callbacks run without the lock: they usually set new timers
+    timer_callback_t cb;
+    std::unique_lock<std::mutex> l(this->timersLock);
+    timerDeadline = UINT64_MAX;
+    uint64_t now = TimerNow();
+    while (timers.PopExpired(now, cb)) {
+        l.unlock();
+        cb();
+        l.lock();
+    }
+    ArmTimerEvent(TimerNow());
+    l.unlock();
 
-    delete info;
+    if (batchSize > 1) {
+        FlushSendQueue();
+        batchingTransport = prev;
+    }
 }
 
 void
@@ -674,12 +1275,29 @@ UDPTransport::SocketCallback(evutil_socket_t fd, short what, void *arg)
 void
 UDPTransport::TimerCallback(evutil_socket_t fd, short what, void *arg)
 {
-    UDPTransport::UDPTransportTimerInfo *info =
-        (UDPTransport::UDPTransportTimerInfo *)arg;
+    UDPTransport *transport = (UDPTransport *)arg;
 
     ASSERT(what & EV_TIMEOUT);
 
-    info->transport->OnTimer(info);
+    transport->OnTimers();
+}
+
+void
+UDPTransport::ShardCallback(evutil_socket_t fd, short what, void *arg)
+{
+    RecvShard *shard = (RecvShard *)arg;
+    if (what & EV_READ) {
+        shard->transport->OnShardReadable(shard);
+    }
+}
+
+void
+UDPTransport::ShardNotifyCallback(evutil_socket_t fd, short what, void *arg)
+{
+    UDPTransport *transport = (UDPTransport *)arg;
+    if (what & EV_READ) {
+        transport->OnShardNotify();
+    }
 }
 
 void
@@ -717,6 +1335,7 @@ UDPTransport::SignalCallback(evutil_socket_t fd, short what, void *arg)
 {
     Notice("Terminating on SIGTERM/SIGINT");
     UDPTransport *transport = (UDPTransport *)arg;
+    transport->PrintStats();
     transport->Stop();
     exit(1);
 }
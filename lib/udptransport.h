@@ -34,6 +34,9 @@
 #include "lib/configuration.h"
 #include "lib/transport.h"
 #include "lib/transportcommon.h"
+#include "lib/fragmentreassembler.h"
+#include "lib/spscring.h"
+#include "lib/timerwheel.h"
 
 #include <event2/event.h>
 
@@ -43,8 +46,12 @@
 #include <unordered_map>
 #include <random>
 #include <netinet/in.h>
+#include <sys/socket.h>
+#include <atomic>
 #include <map>
 #include <mutex>
+#include <thread>
+#include <time.h>
 
 namespace dsnet {
 
@@ -58,6 +65,7 @@ private:
     UDPTransportAddress(const sockaddr_in &addr);
     sockaddr_in addr;
     friend class UDPTransport;
+    friend class IOUringTransport;
     friend bool operator==(const UDPTransportAddress &a,
                            const UDPTransportAddress &b);
     friend bool operator!=(const UDPTransportAddress &a,
@@ -69,8 +77,24 @@ private:
 class UDPTransport : public TransportCommon<UDPTransportAddress>
 {
 public:
+    // With recvThreads > 1, every bound socket is opened
+    // recvThreads times with SO_REUSEPORT. The first copy is served
+    // by the main event loop, the others each by their own receive
+    // thread and event loop. The dispatch policy decides how packets
+    // from those threads reach the receiver.
+    enum class RecvDispatch {
+        // Hand packets to the main event loop through SPSC rings;
+        // protocol code stays single-threaded.
+        Forward,
+        // Call the receiver directly on each receive thread. Only
+        // for receivers that are safe to call concurrently.
+        Independent,
+    };
+
     UDPTransport(double dropRate = 0.0, double reorderRate = 0.0,
-                 event_base *evbase = nullptr);
+                 event_base *evbase = nullptr, int batchSize = 1,
+                 int recvThreads = 1,
+                 RecvDispatch dispatch = RecvDispatch::Forward);
     virtual ~UDPTransport();
     virtual void RegisterInternal(TransportReceiver *receiver,
                                   const dsnet::ReplicaAddress *addr,
@@ -81,19 +105,30 @@ public:
     void Stop() override;
     int Timer(uint64_t ms, timer_callback_t cb) override;
     bool CancelTimer(int id) override;
+    bool RearmTimer(int id, uint64_t ms) override;
     void CancelAllTimers() override;
     virtual ReplicaAddress
     ReverseLookupAddress(const TransportAddress &addr) const override;
-
-private:
-    struct UDPTransportTimerInfo
+    struct Stats
     {
-        UDPTransport *transport;
-        timer_callback_t cb;
-        event *ev;
-        int id;
+        // Batch occupancy, updated when batchSize > 1 and by the
+        // receive threads
+        uint64_t rxBatches;
+        uint64_t rxPackets;
+        uint64_t txBatches;
+        uint64_t txPackets;
+        // Dropped by receive threads because the main loop fell behind
+        uint64_t rxDropped;
+        // Heap allocations made by the send path
+        uint64_t sendBufferAllocs;
+        // Group sends serialized once, and the packets they produced
+        uint64_t fanoutMessages;
+        uint64_t fanoutPackets;
     };
+    Stats GetStats() const;
+    void PrintStats() const;
 
+private:
     double dropRate;
     double reorderRate;
     std::uniform_real_distribution<double> uniformDist;
@@ -112,30 +147,109 @@ private:
     std::map<TransportReceiver*, int> fds; // receiver -> fd
     std::map<const dsnet::Configuration *, int> multicastFds;
     std::map<int, const dsnet::Configuration *> multicastConfigs;
-    int lastTimerId;
-    std::map<int, UDPTransportTimerInfo *> timers;
+    // Timers tick in microseconds since construction; a single
+    // libevent timeout is kept armed for the wheel's next expiry.
+    TimerWheel timers;
     std::mutex timersLock;
-    uint64_t lastFragMsgId;
-    struct UDPTransportFragInfo
+    struct timespec timerEpoch;
+    event *timerEvent;
+    uint64_t timerDeadline;     // UINT64_MAX when timerEvent is idle
+    std::atomic<uint64_t> lastFragMsgId;
+    FragmentReassembler<UDPTransportAddress> reassembler;
+    bool fragSweepPending;
+    std::mutex fragLock;
+
+    /* Batched I/O (recvmmsg/sendmmsg) */
+    int batchSize;
+    std::vector<char> rxBuffers;
+    std::vector<struct mmsghdr> rxMsgs;
+    std::vector<struct iovec> rxIovecs;
+    std::vector<sockaddr_in> rxAddrs;
+    char *txBuffers;
+    std::vector<struct mmsghdr> txMsgs;
+    std::vector<struct iovec> txIovecs;
+    std::vector<sockaddr_in> txAddrs;
+    int txQueued;
+    int txFd;
+    Stats stats;
+    // Also counted on receive threads that send (Independent dispatch)
+    std::atomic<uint64_t> sendBufferAllocs;
+    std::atomic<uint64_t> fanoutMessages;
+    std::atomic<uint64_t> fanoutPackets;
+
+    /* SO_REUSEPORT receive threads */
+    struct RecvSlot
     {
-        uint64_t msgId;
-        string data;
+        sockaddr_in addr;
+        size_t len;
+        char *data;
     };
-    std::map<UDPTransportAddress, UDPTransportFragInfo> fragInfo;
+    struct RecvShard
+    {
+        UDPTransport *transport;
+        int fd;                 // SO_REUSEPORT copy of primaryFd
+        int primaryFd;          // socket the receiver is registered on
+        event_base *base;
+        event *ev;
+        std::thread thread;
+        std::vector<char> buffers;
+        std::vector<RecvSlot> batch;    // Independent: reused slots
+        SPSCRing<RecvSlot> ring;        // Forward: handed to main loop
+        std::vector<char> spill;        // Forward: drained when ring full
+        std::vector<RecvSlot *> slots;  // this batch's slots
+        std::vector<struct mmsghdr> msgs;
+        std::vector<struct iovec> iovecs;
+        std::atomic<uint64_t> rxBatches;
+        std::atomic<uint64_t> rxPackets;
+        std::atomic<uint64_t> rxDropped; // Forward: ring was full
+
+        RecvShard(UDPTransport *transport, int fd, int primaryFd);
+    };
+    int recvThreads;
+    RecvDispatch dispatch;
+    std::vector<RecvShard *> shards;
+    bool shardsRunning;
+    int shardNotifyFd;          // eventfd: rings have packets
 
     bool SendMessageInternal(TransportReceiver *src,
                              const UDPTransportAddress &dst,
                              const Message &m) override;
+    bool SendMessageToAddresses(
+        TransportReceiver *src,
+        const std::vector<const UDPTransportAddress *> &dsts,
+        const Message &m) override;
+    bool SendFragments(int fd, const sockaddr_in &dst,
+                       const char *body, size_t len, uint64_t msg_id);
     UDPTransportAddress
     LookupAddressInternal(const dsnet::ReplicaAddress &addr) const override;
     void OnReadable(int fd);
+    void OnReadableBatch(int fd);
+    bool EnqueuePacket(int fd, const sockaddr_in &dst, const Message &m,
+                       size_t msg_len);
+    void FlushSendQueue();
+    char *GetSendBuffer(size_t len);
+    void AddShards(int primaryFd, const sockaddr_in &sin);
+    void StartShards();
+    void StopShards();
+    void RunShard(RecvShard *shard);
+    void OnShardReadable(RecvShard *shard);
+    void DropShardBatch(RecvShard *shard);
+    void OnShardNotify();
     void ProcessPacket(int fd, sockaddr_in sender, socklen_t senderSize,
                      char *buf, ssize_t sz);
-    void OnTimer(UDPTransportTimerInfo *info);
+    void ScheduleFragmentSweep();
+    void SweepFragments();
+    uint64_t TimerNow() const;
+    void ArmTimerEvent(uint64_t now);
+    void OnTimers();
     static void SocketCallback(evutil_socket_t fd,
                                short what, void *arg);
     static void TimerCallback(evutil_socket_t fd,
                               short what, void *arg);
+    static void ShardCallback(evutil_socket_t fd,
+                              short what, void *arg);
+    static void ShardNotifyCallback(evutil_socket_t fd,
+                                    short what, void *arg);
     static void LogCallback(int severity, const char *msg);
     static void FatalCallback(int err);
     static void SignalCallback(evutil_socket_t fd,
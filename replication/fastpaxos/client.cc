@@ -29,6 +29,7 @@
  **********************************************************************/
 
 #include "common/client.h"
+#include "common/clienttable.h"
 #include "common/request.pb.h"
 #include "common/pbmessage.h"
 #include "lib/assert.h"
@@ -44,16 +45,16 @@ using namespace proto;
 FastPaxosClient::FastPaxosClient(const Configuration &config,
                                  const ReplicaAddress &addr,
                                  Transport *transport,
-                                 uint64_t clientid)
-    : Client(config, addr, transport, clientid)
+                                 uint64_t clientid,
+                                 unsigned int maxPending)
+    : Client(config, addr, transport, clientid), maxPending(maxPending)
 {
-    pendingRequest = NULL;
+    // Replicas only tell apart requests within their client table
+    // window
+    ASSERT(maxPending >= 1 && maxPending <= ClientTable::WINDOW);
     pendingUnloggedRequest = NULL;
     lastReqId = 0;
 
-    requestTimeout = new Timeout(transport, 7000, [this]() {
-            ResendRequest();
-        });
     unloggedRequestTimeout = new Timeout(transport, 1000, [this]() {
             UnloggedRequestTimeoutCallback();
         });
@@ -61,13 +62,12 @@ FastPaxosClient::FastPaxosClient(const Configuration &config,
 
 FastPaxosClient::~FastPaxosClient()
 {
-    if (pendingRequest) {
-        delete pendingRequest;
+    for (auto &kv : pendingRequests) {
+        delete kv.second;
     }
     if (pendingUnloggedRequest) {
         delete pendingUnloggedRequest;
     }
-    delete requestTimeout;
     delete unloggedRequestTimeout;
 }
 
@@ -75,16 +75,19 @@ void
 FastPaxosClient::Invoke(const string &request,
                  continuation_t continuation)
 {
-    // XXX Can only handle one pending request for now
-    if (pendingRequest != NULL) {
-        Panic("Client only supports one pending request");
+    if (pendingRequests.size() >= maxPending) {
+        Panic("Client only supports %u pending requests", maxPending);
     }
 
     ++lastReqId;
     uint64_t reqId = lastReqId;
-    pendingRequest = new PendingRequest(request, reqId, continuation);
+    PendingRequest *req = new PendingRequest(request, reqId, continuation);
+    req->timeout.reset(new Timeout(transport, 7000, [this, reqId]() {
+            ResendRequest(reqId);
+        }));
+    pendingRequests[reqId] = req;
 
-    SendRequest();
+    SendRequest(req);
 }
 
 void
@@ -120,25 +123,31 @@ FastPaxosClient::InvokeUnlogged(int replicaIdx,
 }
 
 void
-FastPaxosClient::SendRequest()
+FastPaxosClient::SendRequest(const PendingRequest *req)
 {
     ToReplicaMessage m;
     RequestMessage *reqMsg = m.mutable_request();
-    reqMsg->mutable_req()->set_op(pendingRequest->request);
+    reqMsg->mutable_req()->set_op(req->request);
     reqMsg->mutable_req()->set_clientid(clientid);
-    reqMsg->mutable_req()->set_clientreqid(pendingRequest->clientReqId);
+    reqMsg->mutable_req()->set_clientreqid(req->clientReqId);
+    // Every request before the oldest pending one has been answered
+    reqMsg->mutable_req()->set_ackedreqid(pendingRequests.begin()->first - 1);
 
     // XXX Try sending only to (what we think is) the leader first
     transport->SendMessageToAll(this, PBMessage(m));
 
-    requestTimeout->Reset();
+    req->timeout->Reset();
 }
 
 void
-FastPaxosClient::ResendRequest()
+FastPaxosClient::ResendRequest(uint64_t clientReqId)
 {
-    Warning("Client timeout; resending request");
-    SendRequest();
+    auto it = pendingRequests.find(clientReqId);
+    if (it == pendingRequests.end()) {
+        return;
+    }
+    Warning("Client timeout; resending request %lu", clientReqId);
+    SendRequest(it->second);
 }
 
 
@@ -169,19 +178,15 @@ FastPaxosClient::HandleReply(const TransportAddress &remote,
                       const proto::ReplyMessage &msg)
 {
     Debug("Client received reply for " FMT_VIEWSTAMP, msg.view(), msg.opnum());
-    if (pendingRequest == NULL) {
-        Debug("Received reply when no request was pending");
-        return;
-    }
-    if (msg.clientreqid() != pendingRequest->clientReqId) {
-        Debug("Received reply for a different request");
+    auto it = pendingRequests.find(msg.clientreqid());
+    if (it == pendingRequests.end()) {
+        Debug("Received reply for a request that is not pending");
         return;
     }
 
-    requestTimeout->Stop();
-
-    PendingRequest *req = pendingRequest;
-    pendingRequest = NULL;
+    PendingRequest *req = it->second;
+    pendingRequests.erase(it);
+    req->timeout->Stop();
 
     req->continuation(req->request, msg.reply());
     delete req;
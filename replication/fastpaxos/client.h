@@ -35,6 +35,9 @@
 #include "lib/configuration.h"
 #include "replication/fastpaxos/fastpaxos-proto.pb.h"
 
+#include <map>
+#include <memory>
+
 namespace dsnet {
 namespace fastpaxos {
 
@@ -44,7 +47,8 @@ public:
     FastPaxosClient(const Configuration &config,
                     const ReplicaAddress &addr,
                     Transport *transport,
-                    uint64_t clientid = 0);
+                    uint64_t clientid = 0,
+                    unsigned int maxPending = 1);
     virtual ~FastPaxosClient();
     virtual void Invoke(const string &request,
                         continuation_t continuation);
@@ -67,18 +71,21 @@ protected:
         uint64_t clientReqId;
         continuation_t continuation;
         timeout_continuation_t timeoutContinuation;
+        std::unique_ptr<Timeout> timeout;
         inline PendingRequest(string request, uint64_t clientReqId,
                               continuation_t continuation)
             : request(request), clientReqId(clientReqId),
               continuation(continuation) { }
     };
-    PendingRequest *pendingRequest;
+    // Requests awaiting replies, by clientReqId, each resent on its
+    // own timeout. At most maxPending at once.
+    std::map<uint64_t, PendingRequest *> pendingRequests;
+    unsigned int maxPending;
     PendingRequest *pendingUnloggedRequest;
-    Timeout *requestTimeout;
     Timeout *unloggedRequestTimeout;
 
-    void SendRequest();
-    void ResendRequest();
+    void SendRequest(const PendingRequest *req);
+    void ResendRequest(uint64_t clientReqId);
     void HandleReply(const TransportAddress &remote,
                      const proto::ReplyMessage &msg);
     void HandleUnloggedReply(const TransportAddress &remote,
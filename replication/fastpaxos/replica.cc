@@ -124,23 +124,13 @@ FastPaxosReplica::CommitUpTo(opnum_t upto)
         log.SetStatus(lastCommitted, LOG_STATE_COMMITTED);
 
         // Store reply in the client table
-        ClientTableEntry &cte =
+        ClientTable::Entry &cte =
             clientTable[entry->request.clientid()];
-        if (cte.lastReqId <= entry->request.clientreqid()) {
-            cte.lastReqId = entry->request.clientreqid();
-            cte.replied = true;
-            cte.reply = m;
-        } else {
-            // We've subsequently prepared another operation from the
-            // same client. So this request must have been completed
-            // at the client, and there's no need to record the
-            // result.
-        }
+        cte.SetReply(entry->request.clientreqid(), m);
 
         /* Send reply */
-        auto iter = clientAddresses.find(entry->request.clientid());
-        if (iter != clientAddresses.end()) {
-            transport->SendMessage(this, *iter->second, PBMessage(m));
+        if (cte.address != nullptr) {
+            transport->SendMessage(this, *cte.address, PBMessage(m));
         }
     }
 
@@ -227,15 +217,8 @@ FastPaxosReplica::EnterView(view_t newview)
 void
 FastPaxosReplica::UpdateClientTable(const Request &req)
 {
-    ClientTableEntry &entry = clientTable[req.clientid()];
-
-    if (entry.lastReqId >= req.clientreqid()) {
-        return;
-    }
-
-    entry.lastReqId = req.clientreqid();
-    entry.replied = false;
-    entry.reply.Clear();
+    // Requests from a pipelining client may be logged out of order
+    clientTable[req.clientid()].Accept(req.clientreqid(), req.ackedreqid());
 }
 
 void
@@ -301,43 +284,28 @@ FastPaxosReplica::HandleRequest(const TransportAddress &remote,
         return;
     }
 
-    // Save the client's address
-    clientAddresses.erase(msg.req().clientid());
-    clientAddresses.insert(
-        std::pair<uint64_t, std::unique_ptr<TransportAddress> >(
-            msg.req().clientid(),
-            std::unique_ptr<TransportAddress>(remote.clone())));
-
-    // Check the client table to see if this is a duplicate request
-    auto kv = clientTable.find(msg.req().clientid());
-    if (kv != clientTable.end()) {
-        ClientTableEntry &entry = kv->second;
-        if (msg.req().clientreqid() < entry.lastReqId) {
-            RNotice("Ignoring stale request");
-            return;
-        }
-        if (msg.req().clientreqid() == entry.lastReqId) {
-            // This is a duplicate request. Resend the reply if we
-            // have one. We might not have a reply to resend if we're
-            // waiting for the other replicas; in that case, just
-            // discard the request.
-            if (entry.replied) {
-                RNotice("Received duplicate request; resending reply");
-                if (!(transport->SendMessage(this, remote,
-                                             PBMessage(entry.reply)))) {
-                    RWarning("Failed to resend reply to client");
-                }
-                return;
-            } else {
-                RNotice("Received duplicate request but no reply available; ignoring");
-                return;
+    // Save the client's address, and check the client table to see
+    // if this is a duplicate request
+    ClientTable::Entry &entry = clientTable[msg.req().clientid()];
+    entry.address.reset(remote.clone());
+    if (!entry.Accept(msg.req().clientreqid(), msg.req().ackedreqid())) {
+        // This is a duplicate or stale request. Resend the reply
+        // if we have one. We might not have a reply to resend if
+        // we're waiting for the other replicas, or if the request
+        // is too old; in that case, just discard the request.
+        const string *reply = entry.Reply(msg.req().clientreqid());
+        if (reply != NULL) {
+            RNotice("Received duplicate request; resending reply");
+            if (!(transport->SendMessage(this, remote,
+                                         SerializedMessage(*reply)))) {
+                RWarning("Failed to resend reply to client");
             }
+        } else {
+            RNotice("Received duplicate request but no reply available; ignoring");
         }
+        return;
     }
 
-    // Update the client table
-    UpdateClientTable(msg.req());
-
     /* Assign it an opnum */
     if (AmLeader()) {
         ASSERT(lastFastPath == lastSlowPath);
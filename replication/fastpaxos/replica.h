@@ -32,6 +32,7 @@
 #define _FASTPAXOS_REPLICA_H_
 
 #include "lib/configuration.h"
+#include "common/clienttable.h"
 #include "common/log.h"
 #include "common/replica.h"
 #include "common/quorumset.h"
@@ -68,14 +69,8 @@ private:
     proto::ToReplicaMessage lastPrepare;
 
     Log log;
-    std::map<uint64_t, std::unique_ptr<TransportAddress> > clientAddresses;
-    struct ClientTableEntry
-    {
-        uint64_t lastReqId;
-        bool replied;
-        proto::ToClientMessage reply;
-    };
-    std::map<uint64_t, ClientTableEntry> clientTable;
+    // Replies are the bytes of ToClientMessage
+    ClientTable clientTable;
 
     QuorumSet<viewstamp_t, proto::PrepareOKMessage> slowPrepareOKQuorum;
     QuorumSet<viewstamp_t, proto::PrepareOKMessage> fastPrepareOKQuorum;
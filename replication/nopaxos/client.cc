@@ -29,6 +29,7 @@
  *
  **********************************************************************/
 
+#include "common/clienttable.h"
 #include "lib/assert.h"
 #include "lib/message.h"
 #include "replication/nopaxos/client.h"
@@ -44,17 +45,30 @@ using namespace proto;
 NOPaxosClient::NOPaxosClient(const Configuration &config,
                              const ReplicaAddress &addr,
                              Transport *transport,
-                             uint64_t clientid)
+                             uint64_t clientid,
+                             unsigned int maxPending,
+                             unsigned int batchSize,
+                             uint64_t batchLinger)
     : Client(config, addr, transport, clientid),
+    maxPending(maxPending), batchSize(batchSize),
     replyQuorum(config.QuorumSize())
 {
-    pendingRequest = NULL;
+    // Replicas only tell apart requests within their client table
+    // window
+    ASSERT(maxPending >= 1 && maxPending <= ClientTable::WINDOW);
+    ASSERT(batchSize >= 1 && batchSize <= maxPending);
     pendingUnloggedRequest = NULL;
+    view = 0;
+    sessnum = 0;
+    sequencerIdx = 0;
     lastReqID = 0;
+    stats.batches = 0;
+    stats.batchedRequests = 0;
 
-    requestTimeout = new Timeout(transport, 2000, [this]() {
-        ResendRequest();
+    batchTimeout = new Timeout(transport, batchLinger, [this]() {
+        CloseBatch();
     });
+
     unloggedRequestTimeout = new Timeout(transport, 100, [this]() {
         UnloggedRequestTimeoutCallback();
     });
@@ -63,26 +77,64 @@ NOPaxosClient::NOPaxosClient(const Configuration &config,
 
 NOPaxosClient::~NOPaxosClient()
 {
-    if (pendingRequest) {
-        delete pendingRequest;
+    for (auto &kv : pendingRequests) {
+        delete kv.second;
     }
     if (pendingUnloggedRequest) {
         delete pendingUnloggedRequest;
     }
+    delete batchTimeout;
 }
 
 void
 NOPaxosClient::Invoke(const string &request,
                       continuation_t continuation)
 {
-    if (pendingRequest != NULL) {
-        Panic("Client only supports one pending request");
+    if (pendingRequests.size() >= maxPending) {
+        Panic("Client only supports %u pending requests", maxPending);
     }
 
     ++lastReqID;
-    pendingRequest = new PendingRequest(request, lastReqID, continuation);
+    PendingRequest *req = new PendingRequest(request, lastReqID, continuation);
+    pendingRequests[lastReqID] = req;
+    openBatch.push_back(req);
+
+    if (openBatch.size() >= batchSize) {
+        CloseBatch();
+    } else if (!batchTimeout->Active()) {
+        batchTimeout->Start();
+    }
+}
 
-    SendRequest();
+void
+NOPaxosClient::CloseBatch()
+{
+    batchTimeout->Stop();
+    if (openBatch.empty()) {
+        return;
+    }
+
+    PendingRequest *req = openBatch.front();
+    if (openBatch.size() > 1) {
+        for (PendingRequest *r : openBatch) {
+            req->batch.push_back(r->clientReqID);
+        }
+    }
+    stats.batches++;
+    stats.batchedRequests += openBatch.size();
+    openBatch.clear();
+
+    MakeTimeout(req);
+    SendRequest(req);
+}
+
+void
+NOPaxosClient::MakeTimeout(PendingRequest *req)
+{
+    opnum_t reqID = req->clientReqID;
+    req->timeout.reset(new Timeout(transport, 2000, [this, reqID]() {
+        ResendRequest(reqID);
+    }));
 }
 
 void
@@ -91,6 +143,29 @@ NOPaxosClient::InvokeUnlogged(int replicaIdx,
                               continuation_t continuation,
                               timeout_continuation_t timeoutContinuation,
                               uint32_t timeout)
+{
+    SendUnlogged(replicaIdx, request, continuation, timeoutContinuation,
+                 timeout, false);
+}
+
+void
+NOPaxosClient::InvokeRead(const string &request,
+                          continuation_t continuation)
+{
+    // Ask the leader, as far as we know, to read under its lease. If
+    // it does not answer, order the read instead.
+    SendUnlogged(config.GetLeaderIndex(view), request, continuation,
+                 [this, continuation](const string &request) {
+                     Invoke(request, continuation);
+                 },
+                 DEFAULT_UNLOGGED_OP_TIMEOUT, true);
+}
+
+void
+NOPaxosClient::SendUnlogged(int replicaIdx, const string &request,
+                            continuation_t continuation,
+                            timeout_continuation_t timeoutContinuation,
+                            uint32_t timeout, bool leaseRead)
 {
     if (pendingUnloggedRequest != NULL) {
         Panic("Client only supports one pending request");
@@ -105,6 +180,9 @@ NOPaxosClient::InvokeUnlogged(int replicaIdx,
     reqMsg->mutable_req()->set_op(request);
     reqMsg->mutable_req()->set_clientid(clientid);
     reqMsg->mutable_req()->set_clientreqid(lastReqID);
+    if (leaseRead) {
+        reqMsg->mutable_req()->set_leaseread(true);
+    }
 
     ASSERT(!unloggedRequestTimeout->Active());
     unloggedRequestTimeout->SetTimeout(timeout);
@@ -114,33 +192,59 @@ NOPaxosClient::InvokeUnlogged(int replicaIdx,
 }
 
 void
-NOPaxosClient::SendRequest()
+NOPaxosClient::SendRequest(PendingRequest *req)
 {
     ToReplicaMessage m;
     RequestMessage *reqMsg = m.mutable_request();
-    reqMsg->mutable_req()->set_op(pendingRequest->request);
+    if (req->batch.empty()) {
+        reqMsg->mutable_req()->set_op(req->request);
+    } else {
+        reqMsg->mutable_req()->set_op("");
+        for (opnum_t id : req->batch) {
+            Request *sub = reqMsg->mutable_req()->add_batch();
+            sub->set_op(pendingRequests.at(id)->request);
+            sub->set_clientid(clientid);
+            sub->set_clientreqid(id);
+        }
+    }
     reqMsg->mutable_req()->set_clientid(clientid);
-    reqMsg->mutable_req()->set_clientreqid(pendingRequest->clientReqID);
+    reqMsg->mutable_req()->set_clientreqid(req->clientReqID);
+    // Every request before the oldest pending one has been answered
+    reqMsg->mutable_req()->set_ackedreqid(pendingRequests.begin()->first - 1);
     reqMsg->mutable_req()->set_clientaddr(node_addr_->Serialize());
     reqMsg->set_msgnum(0);
     reqMsg->set_sessnum(0);
 
     if (config.NumSequencers() > 0) {
-        transport->SendMessageToSequencer(this, 0,
+        req->sequencerIdx = sequencerIdx;
+        transport->SendMessageToSequencer(this, sequencerIdx,
                 NOPaxosMessage(m, true));
     } else {
         transport->SendMessageToMulticast(this,
                 NOPaxosMessage(m, true));
     }
 
-    requestTimeout->Reset();
+    req->timeout->Reset();
 }
 
 void
-NOPaxosClient::ResendRequest()
+NOPaxosClient::ResendRequest(opnum_t clientReqID)
 {
-    Warning("Client timeout; resending request");
-    SendRequest();
+    auto it = pendingRequests.find(clientReqID);
+    if (it == pendingRequests.end()) {
+        return;
+    }
+    Warning("Client timeout; resending request %lu", clientReqID);
+    if (config.NumSequencers() > 1 &&
+        it->second->sequencerIdx == sequencerIdx) {
+        // The sequencer may have failed, so try the next one. A
+        // standby passes requests on to the active sequencer, so
+        // this costs nothing if it had not. Requests sent to an
+        // earlier sequencer have been accounted for already, and
+        // must not move every timeout of a burst one step further.
+        sequencerIdx = (sequencerIdx + 1) % config.NumSequencers();
+    }
+    SendRequest(it->second);
 }
 
 void
@@ -169,25 +273,79 @@ void
 NOPaxosClient::CompleteOperation(const proto::ReplyMessage &msg)
 {
     ASSERT(msg.has_reply());
-    requestTimeout->Stop();
 
-    PendingRequest *req = pendingRequest;
-    pendingRequest = NULL;
-
-    req->continuation(req->request, msg.reply());
-    replyQuorum.Clear();
+    auto it = pendingRequests.find(msg.clientreqid());
+    ASSERT(it != pendingRequests.end());
+    PendingRequest *req = it->second;
+    req->timeout->Stop();
+
+    if (req->batch.empty()) {
+        pendingRequests.erase(it);
+        // msg is one of the quorum's, so drop them only afterwards
+        req->continuation(req->request, msg.reply());
+        replyQuorum.Remove(req->clientReqID);
+        delete req;
+        return;
+    }
 
-    delete req;
+    // Take the whole batch out before running any continuation, as
+    // they may invoke further requests. Requests the leader had run
+    // before but lost the replies to stay pending, and are resent on
+    // their own.
+    ASSERT(msg.batchreply_size() == (int)req->batch.size());
+    std::vector<bool> missing(req->batch.size(), false);
+    for (uint32_t i : msg.batchmissing()) {
+        ASSERT(i < missing.size());
+        missing[i] = true;
+    }
+    std::vector<PendingRequest *> done(req->batch.size(), NULL);
+    std::vector<PendingRequest *> retry;
+    for (size_t i = 0; i < req->batch.size(); i++) {
+        auto bit = pendingRequests.find(req->batch[i]);
+        ASSERT(bit != pendingRequests.end());
+        if (missing[i]) {
+            retry.push_back(bit->second);
+        } else {
+            done[i] = bit->second;
+            pendingRequests.erase(bit);
+        }
+    }
+    for (PendingRequest *r : retry) {
+        Warning("Reply to request %lu lost; will resend it", r->clientReqID);
+        r->batch.clear();
+        MakeTimeout(r);
+        r->timeout->Start();
+    }
+    for (size_t i = 0; i < done.size(); i++) {
+        if (done[i] != NULL) {
+            done[i]->continuation(done[i]->request, msg.batchreply(i));
+        }
+    }
+    replyQuorum.Remove(msg.clientreqid());
+    for (PendingRequest *r : done) {
+        delete r;
+    }
 }
 
 void
 NOPaxosClient::HandleReply(const TransportAddress &remote,
                            const proto::ReplyMessage &msg)
 {
-    if (pendingRequest == NULL) {
+    if (msg.sessnum() > sessnum) {
+        // A replica has moved to a new session, so its sequencer is
+        // up: send there from now on, even if this reply is late
+        sessnum = msg.sessnum();
+        if (config.NumSequencers() > 0) {
+            sequencerIdx = sessnum % config.NumSequencers();
+        }
+    }
+
+    auto it = pendingRequests.find(msg.clientreqid());
+    if (it == pendingRequests.end()) {
         return;
     }
-    if (msg.clientreqid() != pendingRequest->clientReqID) {
+    if (it->second->batch.empty() && msg.batchreply_size() > 0) {
+        // A late reply to a batch this request was left over from
         return;
     }
 
@@ -234,6 +392,9 @@ NOPaxosClient::HandleReply(const TransportAddress &remote,
             }
 
             if (matching >= config.QuorumSize()) {
+                if (leaderMessage.view() > view) {
+                    view = leaderMessage.view();
+                }
                 CompleteOperation(leaderMessage);
             }
         }
@@ -248,6 +409,11 @@ NOPaxosClient::HandleUnloggedReply(const TransportAddress &remote,
         Warning("Received unloggedReply when no request was pending");
         return;
     }
+    if (msg.has_clientreqid() &&
+        msg.clientreqid() != pendingUnloggedRequest->clientReqID) {
+        // Answer to a request that timed out
+        return;
+    }
 
     unloggedRequestTimeout->Stop();
 
@@ -37,6 +37,10 @@
 #include "lib/configuration.h"
 #include "replication/nopaxos/nopaxos-proto.pb.h"
 
+#include <map>
+#include <memory>
+#include <vector>
+
 namespace dsnet {
 namespace nopaxos {
 
@@ -46,7 +50,10 @@ public:
     NOPaxosClient(const Configuration &config,
                   const ReplicaAddress &addr,
                   Transport *transport,
-                  uint64_t clientid = 0);
+                  uint64_t clientid = 0,
+                  unsigned int maxPending = 1,
+                  unsigned int batchSize = 1,
+                  uint64_t batchLinger = 1);
     ~NOPaxosClient();
     void Invoke(const string &request,
                 continuation_t continuation) override;
@@ -55,11 +62,27 @@ public:
                         continuation_t continuation,
                         timeout_continuation_t timeoutContinuation = nullptr,
                         uint32_t timeout = DEFAULT_UNLOGGED_OP_TIMEOUT) override;
+    void InvokeRead(const string &request,
+                    continuation_t continuation) override;
     void ReceiveMessage(const TransportAddress &remote,
                         void *buf, size_t size) override;
 
+    struct Stats
+    {
+        uint64_t batches;
+        uint64_t batchedRequests;
+    };
+    Stats GetStats() const { return stats; }
+
 private:
     opnum_t lastReqID;
+    // The latest view a leader has replied in
+    view_t view;
+    // The latest session any replica has replied in, and the sequencer
+    // requests go to: the one stamping that session, unless a request
+    // sent there has timed out since
+    sessnum_t sessnum;
+    int sequencerIdx;
 
     struct PendingRequest
     {
@@ -67,19 +90,40 @@ private:
         opnum_t clientReqID;
         continuation_t continuation;
         timeout_continuation_t timeoutContinuation;
+        std::unique_ptr<Timeout> timeout;
+        // The requests sent along with this one, itself included, if
+        // it leads a batch
+        std::vector<opnum_t> batch;
+        // The sequencer it was last sent to
+        int sequencerIdx;
         inline PendingRequest(string request, opnum_t clientReqID,
                               continuation_t continuation)
             : request(request), clientReqID(clientReqID),
-            continuation(continuation) { }
+            continuation(continuation), sequencerIdx(-1) { }
     };
-    PendingRequest *pendingRequest;
+    // Requests awaiting replies, by clientReqID. At most maxPending
+    // at once. Each batch is resent on the timeout of its first
+    // request, and replied to under that request's id.
+    std::map<opnum_t, PendingRequest *> pendingRequests;
+    unsigned int maxPending;
+    // Requests not sent yet; they go out as one batch once there are
+    // batchSize of them, or batchLinger ms after the first
+    std::vector<PendingRequest *> openBatch;
+    unsigned int batchSize;
+    Timeout *batchTimeout;
+    Stats stats;
     PendingRequest *pendingUnloggedRequest;
-    Timeout *requestTimeout;
     Timeout *unloggedRequestTimeout;
-    QuorumSet<int, proto::ReplyMessage> replyQuorum;
+    QuorumSet<opnum_t, proto::ReplyMessage> replyQuorum;
 
-    void SendRequest();
-    void ResendRequest();
+    void CloseBatch();
+    void MakeTimeout(PendingRequest *req);
+    void SendUnlogged(int replicaIdx, const string &request,
+                      continuation_t continuation,
+                      timeout_continuation_t timeoutContinuation,
+                      uint32_t timeout, bool leaseRead);
+    void SendRequest(PendingRequest *req);
+    void ResendRequest(opnum_t clientReqID);
     void CompleteOperation(const proto::ReplyMessage &msg);
     void HandleReply(const TransportAddress &remote,
                      const proto::ReplyMessage &msg);
@@ -1,3 +1,4 @@
+#include "lib/assert.h"
 #include "lib/message.h"
 #include "replication/nopaxos/nopaxos-proto.pb.h"
 #include "replication/nopaxos/message.h"
@@ -10,6 +11,11 @@ using namespace proto;
 /*
  * Packet format:
  * sequencer header size + sess num + msg num
+ *
+ * A retransmission request has header size RETRANSMIT_HEADER, followed
+ * by the sess num and msg num of the message wanted. A sequencer
+ * heartbeat has header size HEARTBEAT_HEADER, followed by the sess num
+ * the sequencer stamps and the last msg num it used.
  */
 
 NOPaxosMessage::NOPaxosMessage(::google::protobuf::Message &msg, bool sequencing)
@@ -77,5 +83,97 @@ NOPaxosMessage::Serialize(void *buf) const
     PBMessage::Serialize(p);
 }
 
+RetransmitRequestMessage *
+RetransmitRequestMessage::Clone() const
+{
+    return new RetransmitRequestMessage(sessnum, msgnum);
+}
+
+std::string
+RetransmitRequestMessage::Type() const
+{
+    return std::string("Retransmit Request");
+}
+
+size_t
+RetransmitRequestMessage::SerializedSize() const
+{
+    return sizeof(HeaderSize) + sizeof(SessNum) + sizeof(MsgNum);
+}
+
+bool
+RetransmitRequestMessage::Is(const void *buf, size_t size)
+{
+    return size == sizeof(HeaderSize) + sizeof(SessNum) + sizeof(MsgNum) &&
+        NTOH_HEADERSIZE(*(const HeaderSize *)buf) == RETRANSMIT_HEADER;
+}
+
+void
+RetransmitRequestMessage::Parse(const void *buf, size_t size)
+{
+    ASSERT(Is(buf, size));
+    const char *p = (const char *)buf + sizeof(HeaderSize);
+    sessnum = NTOH_SESSNUM(*(const SessNum *)p);
+    p += sizeof(SessNum);
+    msgnum = NTOH_MSGNUM(*(const MsgNum *)p);
+}
+
+void
+RetransmitRequestMessage::Serialize(void *buf) const
+{
+    char *p = (char *)buf;
+    *(HeaderSize *)p = HTON_HEADERSIZE(RETRANSMIT_HEADER);
+    p += sizeof(HeaderSize);
+    *(SessNum *)p = HTON_SESSNUM(sessnum);
+    p += sizeof(SessNum);
+    *(MsgNum *)p = HTON_MSGNUM(msgnum);
+}
+
+SequencerHeartbeatMessage *
+SequencerHeartbeatMessage::Clone() const
+{
+    return new SequencerHeartbeatMessage(sessnum, msgnum);
+}
+
+std::string
+SequencerHeartbeatMessage::Type() const
+{
+    return std::string("Sequencer Heartbeat");
+}
+
+size_t
+SequencerHeartbeatMessage::SerializedSize() const
+{
+    return sizeof(HeaderSize) + sizeof(SessNum) + sizeof(MsgNum);
+}
+
+bool
+SequencerHeartbeatMessage::Is(const void *buf, size_t size)
+{
+    return size == sizeof(HeaderSize) + sizeof(SessNum) + sizeof(MsgNum) &&
+        NTOH_HEADERSIZE(*(const HeaderSize *)buf) == HEARTBEAT_HEADER;
+}
+
+void
+SequencerHeartbeatMessage::Parse(const void *buf, size_t size)
+{
+    ASSERT(Is(buf, size));
+    const char *p = (const char *)buf + sizeof(HeaderSize);
+    sessnum = NTOH_SESSNUM(*(const SessNum *)p);
+    p += sizeof(SessNum);
+    msgnum = NTOH_MSGNUM(*(const MsgNum *)p);
+}
+
+void
+SequencerHeartbeatMessage::Serialize(void *buf) const
+{
+    char *p = (char *)buf;
+    *(HeaderSize *)p = HTON_HEADERSIZE(HEARTBEAT_HEADER);
+    p += sizeof(HeaderSize);
+    *(SessNum *)p = HTON_SESSNUM(sessnum);
+    p += sizeof(SessNum);
+    *(MsgNum *)p = HTON_MSGNUM(msgnum);
+}
+
 } // namespace nopaxos
 } // namespace dsnet
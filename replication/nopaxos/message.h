@@ -21,5 +21,50 @@ private:
     bool sequencing_;
 };
 
+// Asks the sequencer to resend the message it stamped with (sessnum,
+// msgnum), so a replica that missed it need not go through gap
+// agreement. The sequencer returns the request unchanged if it no
+// longer has the message.
+class RetransmitRequestMessage : public Message
+{
+public:
+    RetransmitRequestMessage(SessNum sessnum = 0, MsgNum msgnum = 0)
+        : sessnum(sessnum), msgnum(msgnum) { }
+
+    virtual RetransmitRequestMessage *Clone() const override;
+    virtual std::string Type() const override;
+    virtual size_t SerializedSize() const override;
+    virtual void Parse(const void *buf, size_t size) override;
+    virtual void Serialize(void *buf) const override;
+
+    // Whether buf holds a retransmission request
+    static bool Is(const void *buf, size_t size);
+
+    SessNum sessnum;
+    MsgNum msgnum;
+};
+
+// Sent by the active sequencer to the standbys, so they know it is
+// alive, and to the replicas when it takes over a new session, so they
+// start the session change before the first request of it arrives.
+class SequencerHeartbeatMessage : public Message
+{
+public:
+    SequencerHeartbeatMessage(SessNum sessnum = 0, MsgNum msgnum = 0)
+        : sessnum(sessnum), msgnum(msgnum) { }
+
+    virtual SequencerHeartbeatMessage *Clone() const override;
+    virtual std::string Type() const override;
+    virtual size_t SerializedSize() const override;
+    virtual void Parse(const void *buf, size_t size) override;
+    virtual void Serialize(void *buf) const override;
+
+    // Whether buf holds a sequencer heartbeat
+    static bool Is(const void *buf, size_t size);
+
+    SessNum sessnum;
+    MsgNum msgnum;
+};
+
 } // namespace nopaxos
 } // namespace dsnet
@@ -0,0 +1,234 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * nopaxos/reorderbuffer.h:
+ *   requests received ahead of their turn, parked in order
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **********************************************************************/
+
+#ifndef _NOPAXOS_REORDERBUFFER_H_
+#define _NOPAXOS_REORDERBUFFER_H_
+
+#include "lib/assert.h"
+#include "lib/viewstamp.h"
+
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace dsnet {
+namespace nopaxos {
+
+// Ordered requests that arrived before the ones preceding them, kept
+// until the replica reaches them. MSG has sessnum() and msgnum().
+//
+// Requests of the current session that are less than a window ahead of
+// the next expected msgnum sit in a ring indexed by msgnum, so parking
+// one and draining the next are O(1) however much the network
+// reorders. Requests further ahead or of a later session go to an
+// ordered overflow map, and move into the ring once it reaches them.
+// Ring slots are reused, so a parked request is copied into storage
+// the previous occupant already allocated. It has to be copied rather
+// than moved: the replica parses each message into an arena that is
+// reset for the next one, and protobuf copies across arenas anyway.
+template <class MSG>
+class ReorderBuffer
+{
+public:
+    static const size_t DEFAULT_WINDOW = 1024;
+
+    ReorderBuffer(size_t window = DEFAULT_WINDOW)
+        : ring(window), mask(window - 1),
+          ringSessnum(0), base(1), lowest(1), ringCount(0),
+          frontInRing(false), maxSize(0)
+    {
+        ASSERT(window > 0 && (window & (window - 1)) == 0);
+    }
+
+    // Park msg, unless it comes before (sessnum, nextMsgnum)
+    void Add(const MSG &msg, sessnum_t sessnum, msgnum_t nextMsgnum) {
+        Key key(msg.sessnum(), msg.msgnum());
+        if (key < Key(sessnum, nextMsgnum)) {
+            return;
+        }
+        Rebase(sessnum, nextMsgnum);
+        if (InWindow(key)) {
+            Slot &slot = ring[key.second & mask];
+            if (!slot.full) {
+                slot.full = true;
+                slot.msg = msg;
+                if (ringCount++ == 0 || key.second < lowest) {
+                    lowest = key.second;
+                }
+            }
+        } else {
+            overflow.emplace(key, msg);
+        }
+        if (Size() > maxSize) {
+            maxSize = Size();
+        }
+    }
+
+    // The earliest parked request at or after (sessnum, nextMsgnum),
+    // discarding any before it; NULL if there are none. It stays
+    // parked until PopFront.
+    MSG *Front(sessnum_t sessnum, msgnum_t nextMsgnum) {
+        Rebase(sessnum, nextMsgnum);
+        if (ringCount > 0) {
+            while (!Occupied(lowest)) {
+                lowest++;
+            }
+            frontInRing = true;
+            return &ring[lowest & mask].msg;
+        }
+        if (!overflow.empty()) {
+            frontInRing = false;
+            return &overflow.begin()->second;
+        }
+        return NULL;
+    }
+
+    // Remove the request last returned by Front
+    void PopFront() {
+        if (frontInRing) {
+            ASSERT(ringCount > 0 && Occupied(lowest));
+            Release(lowest++);
+        } else {
+            ASSERT(!overflow.empty());
+            overflow.erase(overflow.begin());
+        }
+    }
+
+    void Clear() {
+        for (Slot &slot : ring) {
+            slot.full = false;
+        }
+        ringCount = 0;
+        overflow.clear();
+    }
+
+    size_t Size() const { return ringCount + overflow.size(); }
+    // Most requests parked at once
+    size_t MaxSize() const { return maxSize; }
+
+private:
+    typedef std::pair<sessnum_t, msgnum_t> Key;
+
+    struct Slot
+    {
+        Slot() : full(false) { }
+        bool full;
+        MSG msg;
+    };
+
+    bool InWindow(const Key &key) const {
+        return key.first == ringSessnum && key.second >= base &&
+            key.second - base < ring.size();
+    }
+
+    bool Occupied(msgnum_t msgnum) const {
+        const Slot &slot = ring[msgnum & mask];
+        return slot.full && slot.msg.msgnum() == msgnum;
+    }
+
+    void Release(msgnum_t msgnum) {
+        ring[msgnum & mask].full = false;
+        ringCount--;
+    }
+
+    // Move the window to start at (sessnum, nextMsgnum), dropping the
+    // requests it passes and pulling in overflow it now covers
+    void Rebase(sessnum_t sessnum, msgnum_t nextMsgnum) {
+        if (sessnum == ringSessnum && nextMsgnum == base) {
+            return;
+        }
+
+        if (sessnum != ringSessnum ||
+            (nextMsgnum > base && nextMsgnum - base >= ring.size())) {
+            // Sessions only move forward, so a new one leaves nothing
+            // in the ring worth keeping; neither does a long jump
+            if (ringCount > 0) {
+                for (Slot &slot : ring) {
+                    slot.full = false;
+                }
+                ringCount = 0;
+            }
+        } else if (nextMsgnum > base) {
+            while (ringCount > 0 && lowest < nextMsgnum) {
+                if (Occupied(lowest)) {
+                    Release(lowest);
+                }
+                lowest++;
+            }
+        } else {
+            // The replica went back within the session (after a view
+            // change); requests at the far end of the ring may fall
+            // outside the window, so send them all to the overflow
+            for (Slot &slot : ring) {
+                if (slot.full) {
+                    overflow.emplace(Key(ringSessnum, slot.msg.msgnum()),
+                                     std::move(slot.msg));
+                    slot.full = false;
+                }
+            }
+            ringCount = 0;
+        }
+        ringSessnum = sessnum;
+        base = nextMsgnum;
+        if (ringCount == 0) {
+            lowest = base;
+        }
+
+        Key start(sessnum, nextMsgnum);
+        while (!overflow.empty() && overflow.begin()->first < start) {
+            overflow.erase(overflow.begin());
+        }
+        while (!overflow.empty() && InWindow(overflow.begin()->first)) {
+            auto it = overflow.begin();
+            Slot &slot = ring[it->first.second & mask];
+            slot.full = true;
+            slot.msg = std::move(it->second);
+            if (ringCount++ == 0 || it->first.second < lowest) {
+                lowest = it->first.second;
+            }
+            overflow.erase(it);
+        }
+    }
+
+    std::vector<Slot> ring;
+    size_t mask;
+    // The ring holds requests of ringSessnum with msgnums in
+    // [base, base + window); none is below lowest
+    sessnum_t ringSessnum;
+    msgnum_t base;
+    msgnum_t lowest;
+    size_t ringCount;
+    std::map<Key, MSG> overflow;
+    bool frontInRing;
+    size_t maxSize;
+};
+
+} // namespace nopaxos
+} // namespace dsnet
+
+#endif /* _NOPAXOS_REORDERBUFFER_H_ */
@@ -33,6 +33,8 @@
 #include "lib/message.h"
 #include "lib/assert.h"
 
+#include <algorithm>
+
 #define RDebug(fmt, ...) Debug("[%d] " fmt, this->replicaIdx, ##__VA_ARGS__)
 #define RNotice(fmt, ...) Notice("[%d] " fmt, this->replicaIdx, ##__VA_ARGS__)
 #define RWarning(fmt, ...) Warning("[%d] " fmt, this->replicaIdx, ##__VA_ARGS__)
@@ -43,19 +45,14 @@ namespace nopaxos {
 
 using namespace proto;
 
-/* Comparator for sorting pending requests */
-bool ComparePendingRequests(const RequestMessage &first,
-                            const RequestMessage &second) {
-    if (first.sessnum() != second.sessnum()) {
-        return first.sessnum() < second.sessnum();
-    }
-    return first.msgnum() < second.msgnum();
-}
-
 NOPaxosReplica::NOPaxosReplica(const Configuration &config, int myIdx, bool initialize,
-                               Transport *transport, AppReplica *app)
+                               Transport *transport, AppReplica *app,
+                               opnum_t checkpointInterval)
 : Replica(config, 0, myIdx, initialize, transport, app),
     log(false),
+    checkpointInterval(checkpointInterval),
+    lease(transport, config.QuorumSize()),
+    leasePromise(transport),
     gapReplyQuorum(config.n-1),
     gapCommitQuorum(config.QuorumSize()-1),
     viewChangeQuorum(config.QuorumSize()-1),
@@ -74,8 +71,6 @@ NOPaxosReplica::NOPaxosReplica(const Configuration &config, int myIdx, bool init
     this->lastCommittedOp = 0;
     this->lastExecutedOp = 0;
 
-    this->pendingRequestsSorted = false;
-
     this->stateTransferOpBegin = 0;
     this->stateTransferOpEnd = 0;
     this->stateTransferReplicaIdx = 0;
@@ -86,6 +81,12 @@ NOPaxosReplica::NOPaxosReplica(const Configuration &config, int myIdx, bool init
 
     this->leaderLastSyncPreparePoint = 0;
 
+    this->retransmitTimeout = new Timeout(transport,
+                                          RETRANSMIT_TIMEOUT,
+                                          [this, myIdx]() {
+                                              RWarning("Retransmission request timed out!");
+                                              SendGapRequest();
+                                          });
     this->gapRequestTimeout = new Timeout(transport,
                                           GAP_REQUEST_TIMEOUT,
                                           [this, myIdx]() {
@@ -132,6 +133,11 @@ NOPaxosReplica::NOPaxosReplica(const Configuration &config, int myIdx, bool init
                                                    RWarning("Starting view change; haven't received SyncPrepare from the leader");
                                                    StartViewChange(this->sessnum, this->view + 1);
                                                });
+    this->leaseTimeout = new Timeout(transport,
+                                     Lease::DEFAULT_RENEW_INTERVAL,
+                                     [this]() {
+                                         RenewLease();
+                                     });
     if (AmLeader()) {
         this->syncTimeout->Start();
     } else {
@@ -141,6 +147,7 @@ NOPaxosReplica::NOPaxosReplica(const Configuration &config, int myIdx, bool init
 
 NOPaxosReplica::~NOPaxosReplica()
 {
+    delete retransmitTimeout;
     delete gapRequestTimeout;
     delete gapCommitTimeout;
     delete viewChangeTimeout;
@@ -148,14 +155,38 @@ NOPaxosReplica::~NOPaxosReplica()
     delete startViewTimeout;
     delete syncTimeout;
     delete leaderSyncHeardTimeout;
+    delete leaseTimeout;
+}
+
+NOPaxosReplica::Stats
+NOPaxosReplica::GetStats() const
+{
+    Stats s;
+    s.pendingRequests = pendingRequests.Size();
+    s.maxPendingRequests = pendingRequests.MaxSize();
+    return s;
 }
 
 void
 NOPaxosReplica::ReceiveMessage(const TransportAddress &remote,
                                void *buf, size_t size)
 {
-    static ToReplicaMessage replica_msg;
-    static NOPaxosMessage m(replica_msg);
+    if (RetransmitRequestMessage::Is(buf, size)) {
+        RetransmitRequestMessage miss;
+        miss.Parse(buf, size);
+        HandleRetransmitMiss(remote, miss);
+        return;
+    }
+    if (SequencerHeartbeatMessage::Is(buf, size)) {
+        SequencerHeartbeatMessage heartbeat;
+        heartbeat.Parse(buf, size);
+        HandleSequencerHeartbeat(remote, heartbeat);
+        return;
+    }
+
+    static PBArena<ToReplicaMessage> arena;
+    ToReplicaMessage &replica_msg = arena.New();
+    NOPaxosMessage m(replica_msg);
 
     m.Parse(buf, size);
 
@@ -210,6 +241,9 @@ NOPaxosReplica::ReceiveMessage(const TransportAddress &remote,
         case ToReplicaMessage::MsgCase::kSyncCommit:
             HandleSyncCommit(remote, replica_msg.sync_commit());
             break;
+        case ToReplicaMessage::MsgCase::kLeaseReply:
+            HandleLeaseReply(remote, replica_msg.lease_reply());
+            break;
         default:
             Panic("Received unexpected message type: %u", replica_msg.msg_case());
     }
@@ -234,16 +268,66 @@ void
 NOPaxosReplica::HandleUnloggedRequest(const TransportAddress &remote,
                                       const UnloggedRequestMessage &msg)
 {
+    if (msg.req().leaseread()) {
+        HandleLeaseRead(remote, msg.req());
+        return;
+    }
+
     ToClientMessage m;
     UnloggedReplyMessage *reply = m.mutable_unlogged_reply();
 
     ExecuteUnlogged(msg.req(), *reply);
+    reply->set_clientreqid(msg.req().clientreqid());
 
     if (!(transport->SendMessage(this, remote, NOPaxosMessage(m)))) {
         RWarning("Failed to send unlogged reply message");
     }
 }
 
+void
+NOPaxosReplica::HandleLeaseRead(const TransportAddress &remote,
+                                const UnloggedRequest &req)
+{
+    if (this->status != STATUS_NORMAL || !AmLeader()) {
+        // The client will time out and order the read instead
+        RDebug("Ignoring lease read; not the leader");
+        return;
+    }
+
+    // The leader executes operations as soon as they are ordered, so
+    // the read waits for everything logged before it to be
+    // synchronized; only then is all of it sure to survive a view
+    // change
+    lease.Use();
+    this->pendingReads.push_back(PendingRead());
+    this->pendingReads.back().remote.reset(remote.clone());
+    this->pendingReads.back().req = req;
+    this->pendingReads.back().opnum = this->lastOp;
+
+    if (!this->leaseTimeout->Active()) {
+        RenewLease();
+    } else {
+        if (this->lastOp > this->lastCommittedOp &&
+            this->leaderLastSyncPreparePoint < this->lastOp) {
+            SendSyncPrepare();
+        }
+        ProcessPendingReads();
+    }
+}
+
+void
+NOPaxosReplica::HandleLeaseReply(const TransportAddress &remote,
+                                 const proto::LeaseReplyMessage &msg)
+{
+    if (msg.sessnum() != this->sessnum || msg.view() != this->view ||
+        this->status != STATUS_NORMAL || !AmLeader()) {
+        return;
+    }
+
+    lease.Ack(msg.leaseround(), msg.replicaidx());
+    ProcessPendingReads();
+}
+
 void
 NOPaxosReplica::HandleGapRequest(const TransportAddress &remote,
                                  const GapRequestMessage &msg)
@@ -320,7 +404,8 @@ NOPaxosReplica::HandleGapReply(const TransportAddress &remote,
                 // Optimization: if the leader received 'not found' from
                 // all replicas, it can immediately start the gap agreement
                 // protocol, no need to wait for the timeout.
-                if (gapReplyQuorum.AddAndCheckForQuorum(this->lastOp+1, msg.replicaidx(), msg)) {
+                gapReplyQuorum.Rebase(this->lastOp+1);
+                if (gapReplyQuorum.AddAndCheckForQuorum(this->lastOp+1, msg.replicaidx())) {
                     StartGapAgreement();
                 }
             }
@@ -395,9 +480,9 @@ NOPaxosReplica::HandleGapCommitReply(const TransportAddress &remote,
     // we have already added NOOP to the log, waiting for a
     // quorum of replies for that NOOP operation.
     if (msg.opnum() == this->lastOp) {
+        gapCommitQuorum.Rebase(msg.opnum());
         if (gapCommitQuorum.AddAndCheckForQuorum(msg.opnum(),
-                                                 msg.replicaidx(),
-                                                 msg)) {
+                                                 msg.replicaidx())) {
             // We have a quorum, safe to continue processing
             // client requests.
             this->status = STATUS_NORMAL;
@@ -407,6 +492,33 @@ NOPaxosReplica::HandleGapCommitReply(const TransportAddress &remote,
     }
 }
 
+void
+NOPaxosReplica::HandleRetransmitMiss(const TransportAddress &remote,
+                                     const RetransmitRequestMessage &msg)
+{
+    // The sequencer no longer has the message (or has moved on to
+    // another session), so fall back to asking the replicas
+    if (!this->retransmitTimeout->Active() ||
+        msg.sessnum != this->sessnum || msg.msgnum != this->nextMsgnum) {
+        return;
+    }
+    RDebug("Sequencer no longer has msgnum %lu", msg.msgnum);
+    this->retransmitTimeout->Stop();
+    SendGapRequest();
+}
+
+void
+NOPaxosReplica::HandleSequencerHeartbeat(const TransportAddress &remote,
+                                         const SequencerHeartbeatMessage &msg)
+{
+    // A standby sequencer has taken over; change sessions now rather
+    // than when its first request arrives
+    if (msg.sessnum > this->sessnum) {
+        RNotice("Sequencer for sessnum %u has taken over", msg.sessnum);
+        StartViewChange(msg.sessnum, this->view);
+    }
+}
+
 void
 NOPaxosReplica::HandleStateTransferRequest(const TransportAddress &remote,
                                            const StateTransferRequestMessage &msg)
@@ -433,7 +545,20 @@ NOPaxosReplica::HandleStateTransferRequest(const TransportAddress &remote,
     reply->set_begin(msg.begin());
     reply->set_end(msg.end());
 
-    this->log.Dump(msg.begin(), msg.end(), reply->mutable_entries());
+    opnum_t begin = msg.begin();
+    if (begin < this->log.FirstOpnum()) {
+        // We no longer have the first entries; our checkpoint
+        // stands in for them, unless it goes past the range.
+        if (this->checkpoint.opnum() == 0 ||
+            this->checkpoint.opnum() >= msg.end()) {
+            RWarning("Cannot transfer ops %lu to %lu; log truncated before %lu",
+                     msg.begin(), msg.end(), this->log.FirstOpnum());
+            return;
+        }
+        *reply->mutable_checkpoint() = this->checkpoint;
+        begin = this->checkpoint.opnum() + 1;
+    }
+    this->log.Dump(begin, msg.end(), reply->mutable_entries());
 
     RDebug("Sending StateTransfer from %lu to %lu",
            msg.begin(),
@@ -457,12 +582,26 @@ NOPaxosReplica::HandleStateTransferReply(const TransportAddress &remote,
         return;
     }
 
-    ASSERT(msg.entries(0).opnum() == msg.begin());
+    opnum_t begin = msg.begin();
+    if (msg.has_checkpoint()) {
+        InstallCheckpoint(msg.checkpoint());
+        begin = msg.checkpoint().opnum() + 1;
+    }
+    if (msg.entries_size() == 0) {
+        if (this->lastOp + 1 == this->stateTransferOpEnd) {
+            // The checkpoint alone covered the transfer
+            this->stateTransferTimeout->Stop();
+            this->stateTransferCallback();
+        }
+        return;
+    }
+
+    ASSERT(msg.entries(0).opnum() == begin);
     ASSERT(msg.entries(msg.entries_size()-1).opnum() == msg.end()-1);
 
     RDebug("Installing StateTransfer from op %lu to %lu", this->lastOp+1, msg.end());
 
-    for (int i = this->lastOp + 1 - msg.begin(); i < msg.entries().size(); i++) {
+    for (int i = this->lastOp + 1 - begin; i < msg.entries().size(); i++) {
         auto &msgEntry = msg.entries(i);
         ASSERT(msgEntry.opnum() == this->lastOp+1);
         viewstamp_t vs(msgEntry.view(), msgEntry.opnum(), msgEntry.sessnum(), msgEntry.msgnum());
@@ -480,6 +619,10 @@ NOPaxosReplica::HandleStateTransferReply(const TransportAddress &remote,
 void
 NOPaxosReplica::HandleViewChangeRequest(const TransportAddress &remote,
                                         const ViewChangeRequestMessage &msg) {
+    if (LeasePromised(msg.view())) {
+        RDebug("Ignoring view change request; lease promised to the leader");
+        return;
+    }
     if (msg.sessnum() > this->sessnum || msg.view() > this->view) {
         StartViewChange(msg.sessnum(), msg.view());
     }
@@ -489,6 +632,11 @@ void
 NOPaxosReplica::HandleViewChange(const TransportAddress &remote,
                                  const ViewChangeMessage &msg)
 {
+    if (LeasePromised(msg.view())) {
+        RDebug("Ignoring view change; lease promised to the leader");
+        return;
+    }
+
     if (msg.sessnum() > this->sessnum || msg.view() > this->view) {
         StartViewChange(msg.sessnum(), msg.view());
     }
@@ -772,6 +920,20 @@ NOPaxosReplica::HandleSyncPrepare(const TransportAddress &remote,
 
     this->leaderSyncHeardTimeout->Reset();
 
+    if (msg.has_leaseround()) {
+        // Promise not to help elect another leader for a while
+        this->leasePromise.Grant();
+        ToReplicaMessage m;
+        LeaseReplyMessage *reply = m.mutable_lease_reply();
+        reply->set_sessnum(this->sessnum);
+        reply->set_view(this->view);
+        reply->set_leaseround(msg.leaseround());
+        reply->set_replicaidx(this->replicaIdx);
+        if (!this->transport->SendMessage(this, remote, NOPaxosMessage(m))) {
+            RWarning("Failed to send LeaseReplyMessage");
+        }
+    }
+
     // If we have already committed operations beyond the
     // sync point, can ignore the message.
     if (this->lastCommittedOp >= msg.lastop()) {
@@ -830,10 +992,11 @@ NOPaxosReplica::HandleSyncPrepareReply(const TransportAddress &remote,
         return;
     }
 
-    // We need a quorum of sync prepare replies to commit.
+    // We need a quorum of sync prepare replies to commit. Only the
+    // latest sync point counts, however far past the last one it is.
+    this->syncPrepareQuorum.Rebase(msg.syncpoint());
     if (this->syncPrepareQuorum.AddAndCheckForQuorum(msg.syncpoint(),
-                                                     msg.replicaidx(),
-                                                     msg)) {
+                                                     msg.replicaidx())) {
         CommitUptoOp(msg.syncpoint());
     }
 }
@@ -955,15 +1118,20 @@ NOPaxosReplica::TryProcessClientRequest(const RequestMessage &msg)
             this->nextMsgnum = msg.msgnum();
         } else {
             // Detected message gap
-            // None leader replicas ask the leader for the
+            // The sequencer most likely still has the missing
+            // message, so first ask it to resend it. Failing
+            // that, none leader replicas ask the leader for the
             // missing message. Leader replica as an optimization
             // will ask other replicas for the missing message
             // before initiating a gap agreement protocol. Do
             // not ask again if we have already done so: timeout
             // will make sure we resend the request.
-            if (!gapRequestTimeout->Active() &&
+            if (!retransmitTimeout->Active() &&
+                    !gapRequestTimeout->Active() &&
                     !gapCommitTimeout->Active()) {
-                SendGapRequest();
+                if (!SendRetransmitRequest()) {
+                    SendGapRequest();
+                }
             }
             // Try the request later once we received all
             // previous requests.
@@ -1005,6 +1173,7 @@ NOPaxosReplica::ProcessNextOperation(const Request &request,
     // client. Note if the leader is in the gap agreement
     // protocol, it won't process any client request, and
     // will eventually commit the log slot as NOOP.
+    this->retransmitTimeout->Stop();
     if (this->gapRequestTimeout->Active()) {
         this->gapRequestTimeout->Stop();
         this->gapReplyQuorum.Clear();
@@ -1039,10 +1208,10 @@ NOPaxosReplica::ProcessNextOperation(const Request &request,
         }
     }
 
-    if (vs.opnum == this->stateTransferOpEnd) {
-        // We have completed the state transfer, can stop
-        // the timeout now and complete the view change or
-        // synchronization.
+    if (vs.opnum + 1 == this->stateTransferOpEnd) {
+        // We have completed the state transfer (the end is
+        // exclusive), can stop the timeout now and complete
+        // the view change or synchronization.
         this->stateTransferTimeout->Stop();
         this->stateTransferCallback();
     }
@@ -1082,27 +1251,22 @@ NOPaxosReplica::ExecuteUptoOp(opnum_t opnum)
             ToClientMessage m;
             ReplyMessage *reply = m.mutable_reply();
 
-            // Check client table for duplicate requests.
-            auto kv = this->clientTable.find(request.clientid());
-            if (kv != this->clientTable.end()) {
-                const ClientTableEntry &entry = kv->second;
-                if (request.clientreqid() < entry.lastReqId) {
-                    // Ignore stale request
-                    continue;
-                }
-                if (request.clientreqid() == entry.lastReqId) {
-                    // Duplicate request (potentially client
-                    // retry). Send back the last reply.
-                    reply->set_reply(entry.reply.reply());
-                }
-            }
-
-            // Only execute if this is not a duplicate
-            // of the last request (client table check
-            // will otherwise fill the reply).
-            if (!reply->has_reply()) {
+            // Check client table for duplicate requests, and
+            // only execute if this is not one.
+            ClientTable::Entry &cte = this->clientTable[request.clientid()];
+            if (request.batch_size() > 0) {
+                ExecuteBatch(op, request, *reply);
+            } else if (cte.Accept(request.clientreqid(), request.ackedreqid())) {
                 Execute(op, request, *reply);
                 UpdateClientTable(request, *reply);
+            } else if (const string *saved =
+                       cte.Reply(request.clientreqid())) {
+                // Duplicate request (potentially client
+                // retry). Send back the saved reply.
+                reply->set_reply(*saved);
+            } else {
+                // Ignore stale request
+                continue;
             }
 
             // Only reply back to client if the replica
@@ -1153,27 +1317,114 @@ NOPaxosReplica::CommitUptoOp(opnum_t opnum)
     // commit point (for both leader and
     // non-leader).
     ExecuteUptoOp(opnum);
+
+    if (this->checkpointInterval > 0 &&
+        this->lastExecutedOp - this->checkpoint.opnum() >= this->checkpointInterval) {
+        TakeCheckpoint();
+    }
+
+    if (!this->pendingReads.empty()) {
+        ProcessPendingReads();
+    }
 }
 
 void
-NOPaxosReplica::UpdateClientTable(const Request &req,
-                                  const proto::ReplyMessage &reply)
+NOPaxosReplica::TakeCheckpoint()
 {
-    ClientTableEntry &entry = clientTable[req.clientid()];
+    Checkpoint cp;
+    if (!Snapshot(*cp.mutable_state())) {
+        RNotice("Application does not support snapshots; keeping the whole log");
+        this->checkpointInterval = 0;
+        return;
+    }
 
-    ASSERT(entry.lastReqId <= req.clientreqid());
+    // The leader may have executed past the commit point, so the
+    // checkpoint is at the last executed operation.
+    const LogEntry *entry = this->log.Find(this->lastExecutedOp);
+    ASSERT(entry != nullptr);
+    cp.set_view(entry->viewstamp.view);
+    cp.set_opnum(entry->viewstamp.opnum);
+    cp.set_sessnum(entry->viewstamp.sessnum);
+    cp.set_msgnum(entry->viewstamp.msgnum);
+    cp.set_hash(entry->hash);
+    for (const ClientTable::Entry &cte : this->clientTable) {
+        CheckpointClient *client = cp.add_clients();
+        client->set_clientid(cte.clientId);
+        client->set_clientreqid(cte.lastReqId);
+        client->set_seen(cte.seen);
+        client->set_reply(cte.reply);
+    }
+
+    RDebug("Took checkpoint at op %lu", cp.opnum());
+
+    // Only committed entries can go, and the log has to keep the
+    // last committed one for RewindLogToOpnum. Keep the entries
+    // since the previous checkpoint, so that replicas only a little
+    // behind can still catch up from the log.
+    this->log.TruncateBefore(std::min(this->checkpoint.opnum(),
+                                      this->lastCommittedOp));
+    this->checkpoint = std::move(cp);
+}
 
-    if (entry.lastReqId == req.clientreqid()) {
-        // Duplicate request
+void
+NOPaxosReplica::InstallCheckpoint(const Checkpoint &cp)
+{
+    if (cp.opnum() <= this->lastOp) {
         return;
     }
 
-    entry.lastReqId = req.clientreqid();
-    if (AmLeader()) {
-        // Only leader needs to store the reply
-        // replicas do not execute the request
-        entry.reply = reply;
+    RNotice("Installing checkpoint at op %lu", cp.opnum());
+
+    Restore(cp.state());
+    this->clientTable.Clear();
+    for (const CheckpointClient &client : cp.clients()) {
+        ClientTable::Entry &entry = this->clientTable[client.clientid()];
+        entry.SetReply(client.clientreqid(), client.reply());
+        entry.seen = client.seen();
+    }
+
+    viewstamp_t vs(cp.view(), cp.opnum(), cp.sessnum(), cp.msgnum());
+    this->log.Reset(vs, cp.hash());
+    this->lastOp = cp.opnum();
+    // A checkpoint is only transferred as part of the committed log,
+    // and the log below it is gone, so later view changes must not
+    // try to rewind past it
+    this->lastCommittedOp = cp.opnum();
+    this->lastExecutedOp = cp.opnum();
+    this->nextMsgnum = cp.msgnum() + 1;
+    this->checkpoint = cp;
+}
+
+void
+NOPaxosReplica::ExecuteBatch(opnum_t op, const Request &request,
+                             proto::ReplyMessage &reply)
+{
+    // A resent batch is ordered again, so some of its requests may
+    // have run already; check each against the client table
+    for (int i = 0; i < request.batch_size(); i++) {
+        const Request &sub = request.batch(i);
+        string *out = reply.add_batchreply();
+        ClientTable::Entry &cte = this->clientTable[sub.clientid()];
+        if (cte.Accept(sub.clientreqid(), request.ackedreqid())) {
+            proto::ReplyMessage subReply;
+            Execute(op, sub, subReply);
+            UpdateClientTable(sub, subReply);
+            out->swap(*subReply.mutable_reply());
+        } else if (const string *saved = cte.Reply(sub.clientreqid())) {
+            *out = *saved;
+        } else {
+            reply.add_batchmissing(i);
+        }
     }
+    reply.set_reply("");
+}
+
+void
+NOPaxosReplica::UpdateClientTable(const Request &req,
+                                  const proto::ReplyMessage &reply)
+{
+    this->clientTable[req.clientid()].SetReply(req.clientreqid(),
+                                               reply.reply());
 }
 
 void
@@ -1183,25 +1434,17 @@ NOPaxosReplica::ProcessPendingRequests()
         return;
     }
 
-    // Try if we can process pending requests
-    // sort the pending requests in increasing sessnum msgnum first (performance optimization)
-    if (!this->pendingRequests.empty()) {
-        if (!this->pendingRequestsSorted) {
-            this->pendingRequests.sort(ComparePendingRequests);
-            this->pendingRequestsSorted = true;
-        }
-
-        while (!this->pendingRequests.empty()) {
-            RequestMessage request = this->pendingRequests.front();
-            if (!TryProcessClientRequest(request)) {
-                // request is still pending, since we have
-                // already sorted the list, all subsequent
-                // requests will also be pending. Safe to return.
-                return;
-            }
-            // request is either processed, or is discarded
-            pendingRequests.pop_front();
+    // Try if we can process pending requests, in increasing
+    // sessnum msgnum order
+    while (RequestMessage *request =
+           this->pendingRequests.Front(this->sessnum, this->nextMsgnum)) {
+        if (!TryProcessClientRequest(*request)) {
+            // request is still pending, and so are all
+            // subsequent requests. Safe to return.
+            return;
         }
+        // request is either processed, or is discarded
+        this->pendingRequests.PopFront();
     }
 }
 
@@ -1335,6 +1578,7 @@ NOPaxosReplica::EnterView(sessnum_t newsessnum, view_t newview) {
 void
 NOPaxosReplica::ClearTimeoutAndQuorums()
 {
+    this->retransmitTimeout->Stop();
     this->gapRequestTimeout->Stop();
     this->gapReplyQuorum.Clear();
     this->gapCommitTimeout->Stop();
@@ -1347,6 +1591,7 @@ NOPaxosReplica::ClearTimeoutAndQuorums()
     this->syncTimeout->Stop();
     this->syncPrepareQuorum.Clear();
     this->leaderSyncHeardTimeout->Stop();
+    DropLease();
 
     // Since we only accept Sync messages from the
     // current view, we can delete all SyncPrepare
@@ -1421,6 +1666,25 @@ NOPaxosReplica::ProcessSyncPrepare(opnum_t syncpoint)
     }
 }
 
+bool
+NOPaxosReplica::SendRetransmitRequest()
+{
+    if (this->configuration.NumSequencers() == 0) {
+        return false;
+    }
+
+    // Sequencer i stamps session i (see NOPaxosSequencer)
+    RDebug("Asking sequencer to resend msgnum %lu", this->nextMsgnum);
+    int idx = this->sessnum % this->configuration.NumSequencers();
+    if (!this->transport->SendMessageToSequencer(this, idx,
+                RetransmitRequestMessage(this->sessnum, this->nextMsgnum))) {
+        RWarning("Failed to send retransmission request to sequencer");
+        return false;
+    }
+    this->retransmitTimeout->Reset();
+    return true;
+}
+
 void
 NOPaxosReplica::SendGapRequest()
 {
@@ -1569,7 +1833,58 @@ NOPaxosReplica::SendStartViewReply()
 }
 
 void
-NOPaxosReplica::SendSyncPrepare()
+NOPaxosReplica::RenewLease()
+{
+    if (this->status != STATUS_NORMAL || !AmLeader() ||
+        (this->pendingReads.empty() && !lease.Wanted())) {
+        // Nobody has been reading; let the lease lapse
+        this->leaseTimeout->Stop();
+        return;
+    }
+
+    // Synchronization doubles as the renewal, and also commits the
+    // operations pending reads are waiting for
+    SendSyncPrepare(lease.StartRound());
+    this->syncTimeout->Reset();
+    if (!this->leaseTimeout->Active()) {
+        this->leaseTimeout->Start();
+    }
+    ProcessPendingReads();
+}
+
+void
+NOPaxosReplica::DropLease()
+{
+    // Readers still waiting time out and order their reads instead
+    lease.Revoke();
+    this->leaseTimeout->Stop();
+    this->pendingReads.clear();
+}
+
+void
+NOPaxosReplica::ProcessPendingReads()
+{
+    if (!lease.Valid()) {
+        return;
+    }
+
+    while (!this->pendingReads.empty() &&
+           this->pendingReads.front().opnum <= this->lastCommittedOp) {
+        PendingRead &read = this->pendingReads.front();
+        ToClientMessage m;
+        UnloggedReplyMessage *reply = m.mutable_unlogged_reply();
+        ExecuteUnlogged(read.req, *reply);
+        reply->set_clientreqid(read.req.clientreqid());
+        if (!this->transport->SendMessage(this, *read.remote,
+                                          NOPaxosMessage(m))) {
+            RWarning("Failed to send lease read reply");
+        }
+        this->pendingReads.pop_front();
+    }
+}
+
+void
+NOPaxosReplica::SendSyncPrepare(uint64_t leaseRound)
 {
     ASSERT(AmLeader());
 
@@ -1584,6 +1899,9 @@ NOPaxosReplica::SendSyncPrepare()
     for (opnum_t gap : this->leaderLastSyncCommittedGaps) {
         syncPrepareMessage->add_committedgaps(gap);
     }
+    if (leaseRound != 0) {
+        syncPrepareMessage->set_leaseround(leaseRound);
+    }
 
     if (!this->transport->SendMessageToAll(this, NOPaxosMessage(m))) {
         RWarning("Failed to send SyncPrepare");
@@ -1615,11 +1933,7 @@ NOPaxosReplica::AmLeader() const
 inline void
 NOPaxosReplica::AddPendingRequest(const RequestMessage &msg)
 {
-    if (msg.sessnum() >= this->sessnum &&
-        msg.msgnum() >= this->nextMsgnum) {
-        this->pendingRequests.push_back(msg);
-        this->pendingRequestsSorted = false;
-    }
+    this->pendingRequests.Add(msg, this->sessnum, this->nextMsgnum);
 }
 
 inline bool
@@ -1630,7 +1944,9 @@ NOPaxosReplica::CheckViewNumAndStatus(sessnum_t sessnum, view_t view)
     }
 
     if (sessnum > this->sessnum || view > this->view) {
-        StartViewChange(sessnum, view);
+        if (!LeasePromised(view)) {
+            StartViewChange(sessnum, view);
+        }
         return false;
     }
 
@@ -1641,6 +1957,16 @@ NOPaxosReplica::CheckViewNumAndStatus(sessnum_t sessnum, view_t view)
     return true;
 }
 
+// Whether moving to newview would help elect a new leader while the
+// current one may still be serving reads under its lease
+inline bool
+NOPaxosReplica::LeasePromised(view_t newview) const
+{
+    return this->status == STATUS_NORMAL && this->leasePromise.Held() &&
+        this->configuration.GetLeaderIndex(newview) !=
+        this->configuration.GetLeaderIndex(this->view);
+}
+
 inline void
 NOPaxosReplica::RewindLogToOpnum(opnum_t opnum)
 {
@@ -1650,7 +1976,7 @@ NOPaxosReplica::RewindLogToOpnum(opnum_t opnum)
                not implemented yet");
     }
     this->lastOp = opnum;
-    this->log.RemoveAfter(opnum);
+    this->log.RemoveAfter(opnum+1);
     this->nextMsgnum = this->log.LastViewstamp().msgnum + 1;
 }
 
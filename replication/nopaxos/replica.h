@@ -33,14 +33,17 @@
 #define _NOPAXOS_REPLICA_H_
 
 #include "lib/configuration.h"
+#include "common/clienttable.h"
+#include "common/lease.h"
 #include "common/log.h"
 #include "common/replica.h"
 #include "common/quorumset.h"
 #include "replication/nopaxos/nopaxos-proto.pb.h"
 #include "replication/nopaxos/message.h"
+#include "replication/nopaxos/reorderbuffer.h"
 
-#include <map>
 #include <list>
+#include <map>
 #include <memory>
 #include <set>
 
@@ -51,12 +54,21 @@ class NOPaxosReplica : public Replica
 {
 public:
     NOPaxosReplica(const Configuration &config, int myIdx, bool initialize,
-                   Transport *transport, AppReplica *app);
+                   Transport *transport, AppReplica *app,
+                   opnum_t checkpointInterval = DEFAULT_CHECKPOINT_INTERVAL);
     ~NOPaxosReplica();
 
     void ReceiveMessage(const TransportAddress &remote,
                         void *buf, size_t size) override;
 
+    struct Stats
+    {
+        // Requests parked waiting for earlier ones, now and at most
+        uint64_t pendingRequests;
+        uint64_t maxPendingRequests;
+    };
+    Stats GetStats() const;
+
 public:
     Log log;
 
@@ -78,29 +90,45 @@ private:
     opnum_t lastCommittedOp;
     opnum_t lastExecutedOp;
 
+    /* Checkpoints */
+    opnum_t checkpointInterval;
+    // Latest checkpoint, at an executed operation. The log goes back
+    // to the previous one (or the last committed operation).
+    Checkpoint checkpoint;
+
     /* Client information */
-    struct ClientTableEntry
-    {
-        uint64_t lastReqId;
-        proto::ReplyMessage reply;
-    };
-    std::map<uint64_t, ClientTableEntry> clientTable;
+    // Replies are the bytes of ReplyMessage.reply
+    ClientTable clientTable;
 
     /* Pending requests */
-    std::list<proto::RequestMessage> pendingRequests;
-    bool pendingRequestsSorted;
+    ReorderBuffer<proto::RequestMessage> pendingRequests;
+
+    /* Read lease, held by the leader and promised by the others */
+    Lease lease;
+    LeasePromise leasePromise;
+    // Lease reads waiting for the lease, or for the operations logged
+    // before they arrived to be synchronized
+    struct PendingRead
+    {
+        std::unique_ptr<TransportAddress> remote;
+        UnloggedRequest req;
+        opnum_t opnum;
+    };
+    std::list<PendingRead> pendingReads;
 
     /* Quorums */
-    QuorumSet<opnum_t, proto::GapReplyMessage> gapReplyQuorum; // If none of the replicas received a message, the leader can immediately start gap agreement protocol
-    QuorumSet<opnum_t, proto::GapCommitReplyMessage> gapCommitQuorum;
+    WindowedQuorumSet<proto::GapReplyMessage> gapReplyQuorum; // If none of the replicas received a message, the leader can immediately start gap agreement protocol
+    WindowedQuorumSet<proto::GapCommitReplyMessage> gapCommitQuorum;
     QuorumSet<std::pair<sessnum_t, view_t>, proto::ViewChangeMessage> viewChangeQuorum;
     QuorumSet<std::pair<sessnum_t, view_t>, proto::StartViewReplyMessage> startViewQuorum;
-    QuorumSet<opnum_t, proto::SyncPrepareReplyMessage> syncPrepareQuorum;
+    WindowedQuorumSet<proto::SyncPrepareReplyMessage> syncPrepareQuorum;
 
     /* Gaps */
     std::set<opnum_t> committedGaps;
 
     /* Timeouts */
+    Timeout *retransmitTimeout;
+    const int RETRANSMIT_TIMEOUT = 2;
     Timeout *gapRequestTimeout;
     const int GAP_REQUEST_TIMEOUT = 10;
     Timeout *gapCommitTimeout;
@@ -115,6 +143,7 @@ private:
     const int SYNC_TIMEOUT = 1000;
     Timeout *leaderSyncHeardTimeout;
     const int LEADER_SYNC_HEARD_TIMEOUT = 20000;
+    Timeout *leaseTimeout;
 
     /* State transfer */
     opnum_t stateTransferOpBegin;
@@ -168,6 +197,14 @@ private:
                           const proto::SyncCommitMessage &msg);
     void HandleSyncPrepareRequest(const TransportAddress &remote,
                                   const proto::SyncPrepareRequestMessage &msg);
+    void HandleRetransmitMiss(const TransportAddress &remote,
+                              const RetransmitRequestMessage &msg);
+    void HandleSequencerHeartbeat(const TransportAddress &remote,
+                                  const SequencerHeartbeatMessage &msg);
+    void HandleLeaseRead(const TransportAddress &remote,
+                         const UnloggedRequest &req);
+    void HandleLeaseReply(const TransportAddress &remote,
+                          const proto::LeaseReplyMessage &msg);
 
     // Returns true if the request is processed/ignored.
     // false if the request should be processed later (pending)
@@ -176,7 +213,11 @@ private:
                               viewstamp_t vs,
                               LogEntryState state);
     void ExecuteUptoOp(opnum_t opnum);
+    void ExecuteBatch(opnum_t op, const Request &request,
+                      proto::ReplyMessage &reply);
     void CommitUptoOp(opnum_t opnum);
+    void TakeCheckpoint();
+    void InstallCheckpoint(const Checkpoint &cp);
     void UpdateClientTable(const Request &req,
                            const proto::ReplyMessage &reply);
     void ProcessPendingRequests();
@@ -187,19 +228,26 @@ private:
     void ClearTimeoutAndQuorums();
     void InstallCommittedGaps(const ::google::protobuf::RepeatedField< ::google::protobuf::uint64 > &committedgaps);
     void ProcessSyncPrepare(opnum_t syncpoint);
+    void RenewLease();
+    void DropLease();
+    void ProcessPendingReads();
 
+    bool SendRetransmitRequest();
     void SendGapRequest();
     void SendGapCommit();
     void SendViewChange();
     void SendStateTransferRequest();
     void SendStartView();
     void SendStartViewReply();
-    void SendSyncPrepare();
+    // A non-zero leaseRound also asks the replicas to renew the
+    // leader's read lease
+    void SendSyncPrepare(uint64_t leaseRound = 0);
     void SendSyncCommit();
 
     inline bool AmLeader() const;
     inline void AddPendingRequest(const proto::RequestMessage &msg);
     inline bool CheckViewNumAndStatus(sessnum_t sessnum, view_t view);
+    inline bool LeasePromised(view_t newview) const;
     inline void RewindLogToOpnum(opnum_t opnum);
 };
 
@@ -1,14 +1,65 @@
+#include "lib/assert.h"
+#include "lib/message.h"
 #include "replication/nopaxos/sequencer.h"
 
 namespace dsnet {
 namespace nopaxos {
 
 NOPaxosSequencer::NOPaxosSequencer(const Configuration &config,
-                                   Transport *transport, int id)
+                                   Transport *transport, int id,
+                                   uint64_t failoverTimeout,
+                                   size_t retransmitWindow)
     : Sequencer(config, transport, id),
-      sess_num_(id), msg_num_(0) { }
+      id_(id), active_(id == 0), sess_num_(id), msg_num_(0),
+      latest_sess_num_(0), failover_timeout_(failoverTimeout),
+      tick_timeout_(nullptr), heard_(false), silent_ticks_(0),
+      retransmitted_(0), retransmit_misses_(0),
+      stamped_(retransmitWindow), stamped_mask_(retransmitWindow - 1)
+{
+    ASSERT(retransmitWindow > 0 &&
+           (retransmitWindow & (retransmitWindow - 1)) == 0);
+    for (Stamped &s : stamped_) {
+        s.sess_num = 0;
+        s.msg_num = 0;
+    }
+    if (failover_timeout_ > 0) {
+        uint64_t interval = failover_timeout_ / HEARTBEATS_PER_TIMEOUT;
+        tick_timeout_ = new Timeout(transport_, interval > 0 ? interval : 1,
+                                    [this]() { Tick(); });
+        tick_timeout_->Start();
+    }
+}
 
-NOPaxosSequencer::~NOPaxosSequencer() { }
+NOPaxosSequencer::~NOPaxosSequencer()
+{
+    delete tick_timeout_;
+}
+
+NOPaxosSequencer::Stats
+NOPaxosSequencer::GetStats() const
+{
+    Stats s;
+    s.active = active_;
+    s.sessNum = sess_num_;
+    s.stamped = msg_num_;
+    s.retransmitted = retransmitted_;
+    s.retransmitMisses = retransmit_misses_;
+    return s;
+}
+
+void
+NOPaxosSequencer::PrintStats() const
+{
+    Stats s = GetStats();
+    if (!s.active) {
+        Notice("Standby; latest session is %u",
+               (SessNum)latest_sess_num_);
+        return;
+    }
+    Notice("Session %u: stamped %lu messages; %lu retransmitted, "
+           "%lu retransmission misses",
+           s.sessNum, s.stamped, s.retransmitted, s.retransmitMisses);
+}
 
 void
 NOPaxosSequencer::ReceiveMessage(const TransportAddress &remote, void *buf, size_t size)
@@ -16,17 +67,168 @@ NOPaxosSequencer::ReceiveMessage(const TransportAddress &remote, void *buf, size
     char *p = (char *)buf;
     HeaderSize header_sz = NTOH_HEADERSIZE(*(HeaderSize *)p);
     p += sizeof(HeaderSize);
-    if (header_sz > 0) {
+    if (header_sz == RETRANSMIT_HEADER) {
+        HandleRetransmitRequest(remote, buf, size);
+    } else if (header_sz == HEARTBEAT_HEADER) {
+        HandleHeartbeat(buf, size);
+    } else if (header_sz > 0) {
+        if (!active_) {
+            Forward(buf, size);
+            return;
+        }
         // Session number
-        *(SessNum *)p = HTON_SESSNUM(sess_num_);
+        SessNum sess_num = sess_num_;
+        *(SessNum *)p = HTON_SESSNUM(sess_num);
         p += sizeof(SessNum);
         // Message number
-        *(MsgNum *)p = HTON_MSGNUM(++msg_num_);
+        MsgNum msg_num = ++msg_num_;
+        *(MsgNum *)p = HTON_MSGNUM(msg_num);
         p += sizeof(MsgNum);
 
+        Stamped &s = stamped_[msg_num & stamped_mask_];
+        {
+            std::lock_guard<std::mutex> l(s.lock);
+            s.sess_num = sess_num;
+            s.msg_num = msg_num;
+            s.packet.assign((const char *)buf, size);
+        }
+
         transport_->SendMessageToAll(this, BufferMessage(buf, size));
     }
 }
 
+void
+NOPaxosSequencer::HandleRetransmitRequest(const TransportAddress &remote,
+                                          void *buf, size_t size)
+{
+    if (size != sizeof(HeaderSize) + sizeof(SessNum) + sizeof(MsgNum)) {
+        Warning("Malformed retransmission request");
+        return;
+    }
+    const char *p = (const char *)buf + sizeof(HeaderSize);
+    SessNum sess_num = NTOH_SESSNUM(*(const SessNum *)p);
+    p += sizeof(SessNum);
+    MsgNum msg_num = NTOH_MSGNUM(*(const MsgNum *)p);
+
+    Stamped &s = stamped_[msg_num & stamped_mask_];
+    std::unique_lock<std::mutex> l(s.lock);
+    if (msg_num != 0 && s.sess_num == sess_num && s.msg_num == msg_num) {
+        transport_->SendMessage(this, remote,
+                                BufferMessage(s.packet.data(),
+                                              s.packet.size()));
+        retransmitted_++;
+    } else {
+        l.unlock();
+        retransmit_misses_++;
+        // Too old, or from another session: send the request back so
+        // the replica falls back to gap agreement straight away
+        transport_->SendMessage(this, remote, BufferMessage(buf, size));
+    }
+}
+
+void
+NOPaxosSequencer::HandleHeartbeat(void *buf, size_t size)
+{
+    if (size != sizeof(HeaderSize) + sizeof(SessNum) + sizeof(MsgNum)) {
+        Warning("Malformed sequencer heartbeat");
+        return;
+    }
+    const char *p = (const char *)buf + sizeof(HeaderSize);
+    SessNum sess_num = NTOH_SESSNUM(*(const SessNum *)p);
+
+    SessNum latest = latest_sess_num_;
+    while (sess_num > latest &&
+           !latest_sess_num_.compare_exchange_weak(latest, sess_num)) {
+    }
+    if (sess_num < latest) {
+        // From a sequencer that has since been replaced
+        return;
+    }
+    heard_ = true;
+
+    if (active_ && sess_num > sess_num_) {
+        Notice("Session %u has taken over; sequencer %d standing by",
+               sess_num, id_);
+        active_ = false;
+    }
+}
+
+void
+NOPaxosSequencer::Forward(void *buf, size_t size)
+{
+    int active = latest_sess_num_ % config_.NumSequencers();
+    if (active == id_) {
+        Warning("No active sequencer to pass the request on to");
+        return;
+    }
+    transport_->SendMessageToSequencer(this, active,
+                                       BufferMessage(buf, size));
+}
+
+void
+NOPaxosSequencer::Tick()
+{
+    if (active_) {
+        SendHeartbeat(false);
+        return;
+    }
+    if (heard_.exchange(false)) {
+        silent_ticks_ = 0;
+        return;
+    }
+
+    // Standbys wait one timeout for each place they are behind the
+    // active sequencer, so the next in line takes over first and the
+    // rest hear from it before their turn
+    int n = config_.NumSequencers();
+    uint64_t behind = (id_ - latest_sess_num_ % n + n) % n;
+    if (behind == 0) {
+        behind = n;
+    }
+    if (++silent_ticks_ >= behind * HEARTBEATS_PER_TIMEOUT) {
+        TakeOver();
+    }
+}
+
+void
+NOPaxosSequencer::TakeOver()
+{
+    // The first session after the latest one that is ours to stamp
+    int n = config_.NumSequencers();
+    SessNum next = latest_sess_num_ + 1;
+    SessNum sess_num = next + (id_ - next % n + n) % n;
+
+    latest_sess_num_ = sess_num;
+    sess_num_ = sess_num;
+    msg_num_ = 0;
+    active_ = true;
+    silent_ticks_ = 0;
+    Notice("Sequencer %d taking over with session %u", id_, sess_num);
+
+    SendHeartbeat(true);
+}
+
+void
+NOPaxosSequencer::SendHeartbeat(bool toReplicas)
+{
+    char buf[sizeof(HeaderSize) + sizeof(SessNum) + sizeof(MsgNum)];
+    char *p = buf;
+    *(HeaderSize *)p = HTON_HEADERSIZE(HEARTBEAT_HEADER);
+    p += sizeof(HeaderSize);
+    *(SessNum *)p = HTON_SESSNUM(sess_num_);
+    p += sizeof(SessNum);
+    *(MsgNum *)p = HTON_MSGNUM(msg_num_);
+
+    BufferMessage m(buf, sizeof(buf));
+    for (int i = 0; i < config_.NumSequencers(); i++) {
+        if (i != id_) {
+            transport_->SendMessageToSequencer(this, i, m);
+        }
+    }
+    if (toReplicas) {
+        transport_->SendMessageToAll(this, m);
+    }
+}
+
 } // namespace nopaxos
 } // namespace dsnet
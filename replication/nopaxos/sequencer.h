@@ -3,20 +3,91 @@
 #include "sequencer/sequencer.h"
 #include "replication/nopaxos/types.h"
 
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
 namespace dsnet {
 namespace nopaxos {
 
+// Stamps each packet in place and sends the same buffer on to every
+// replica. ReceiveMessage may be called from several receive threads
+// at once (UDPTransport::RecvDispatch::Independent): msg nums come
+// from an atomic counter, so packets can leave out of order, which
+// replicas already put right.
+//
+// Sequencer 0 starts out active; the others are standbys, which pass
+// any request they get on to the active sequencer. Session s is
+// stamped by sequencer s % NumSequencers(). With a failover timeout,
+// the active sequencer sends the standbys a heartbeat several times
+// per timeout. A standby that hears nothing for as many timeouts as it
+// is places behind the active one takes over, with the next session
+// number that is its own, and tells the replicas so they change
+// sessions at once. An active sequencer that hears of a later session
+// steps down, so a failed primary that comes back rejoins as a
+// standby.
 class NOPaxosSequencer : public Sequencer {
 public:
-    NOPaxosSequencer(const Configuration &config, Transport *transport, int id);
+    static const size_t DEFAULT_RETRANSMIT_WINDOW = 16384;
+    static const int HEARTBEATS_PER_TIMEOUT = 4;
+
+    // failoverTimeout is in ms; 0 turns failover off
+    NOPaxosSequencer(const Configuration &config, Transport *transport, int id,
+                     uint64_t failoverTimeout = 0,
+                     size_t retransmitWindow = DEFAULT_RETRANSMIT_WINDOW);
     ~NOPaxosSequencer();
 
     virtual void ReceiveMessage(const TransportAddress &remote,
                                 void *buf, size_t size) override;
 
+    struct Stats {
+        bool active;
+        SessNum sessNum;
+        // Msg num of the last packet stamped in the session
+        MsgNum stamped;
+        // Retransmission requests answered, and those that missed
+        uint64_t retransmitted;
+        uint64_t retransmitMisses;
+    };
+    Stats GetStats() const;
+    virtual void PrintStats() const override;
+
 private:
-    SessNum sess_num_;
-    MsgNum msg_num_;
+    void HandleRetransmitRequest(const TransportAddress &remote,
+                                 void *buf, size_t size);
+    void HandleHeartbeat(void *buf, size_t size);
+    void Forward(void *buf, size_t size);
+    void Tick();
+    void TakeOver();
+    void SendHeartbeat(bool toReplicas);
+
+    int id_;
+    std::atomic<bool> active_;
+    std::atomic<SessNum> sess_num_;
+    std::atomic<MsgNum> msg_num_;
+    // The latest session any sequencer is known to stamp
+    std::atomic<SessNum> latest_sess_num_;
+    // Heartbeat ticks run on the transport's timer, while heartbeats
+    // arrive on the receive threads
+    uint64_t failover_timeout_;
+    Timeout *tick_timeout_;
+    std::atomic<bool> heard_;
+    uint64_t silent_ticks_;
+    std::atomic<uint64_t> retransmitted_;
+    std::atomic<uint64_t> retransmit_misses_;
+
+    // The last retransmitWindow messages stamped, by msg num, so a
+    // replica that missed one can fetch it here. Slots keep their
+    // buffers, so recording a message does not allocate once warm.
+    struct Stamped {
+        std::mutex lock;
+        SessNum sess_num;
+        MsgNum msg_num;
+        std::string packet;
+    };
+    std::vector<Stamped> stamped_;
+    size_t stamped_mask_;
 };
 
 } // namespace nopaxos
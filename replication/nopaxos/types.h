@@ -15,6 +15,13 @@ typedef uint64_t MsgNum;
 typedef uint16_t HeaderSize;
 #define HTON_HEADERSIZE(n) htons(n)
 #define NTOH_HEADERSIZE(n) ntohs(n)
+// Header size of a replica's request that the sequencer resend a
+// message it stamped; the SessNum and MsgNum wanted follow it
+#define RETRANSMIT_HEADER 0xffff
+// Header size of the heartbeat the active sequencer sends the standbys
+// (and the replicas, when it takes over); the SessNum it stamps and the
+// last MsgNum it used follow it
+#define HEARTBEAT_HEADER 0xfffe
 
 } // namespace nopaxos
 } // namespace dsnet
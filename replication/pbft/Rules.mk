@@ -12,4 +12,5 @@ OBJS-pbft-client := $(o)client.o $(o)pbft-proto.o \
 
 OBJS-pbft-replica := $(o)replica.o $(o)pbft-proto.o \
                $(OBJS-replica) $(LIB-message) \
-               $(LIB-configuration) $(LIB-signature) $(LIB-pbmessage)
+               $(LIB-configuration) $(LIB-signature) $(LIB-pbmessage) \
+               $(LIB-sigpipeline)
@@ -23,13 +23,15 @@ using namespace proto;
 
 PbftReplica::PbftReplica(const Configuration &config, int myIdx,
                          bool initialize, Transport *transport,
-                         const Security &sec, AppReplica *app)
+                         const Security &sec, AppReplica *app,
+                         int verifyWorkers)
     : Replica(config, 0, myIdx, initialize, transport, app),
       security(sec),
       lastExecuted(0),
       log(false),
       prepareSet(2 * config.f),
-      commitSet(2 * config.f + 1) {
+      commitSet(2 * config.f + 1),
+      pipeline(transport, verifyWorkers) {
   if (!initialize) NOT_IMPLEMENTED();
 
   this->status = STATUS_NORMAL;
@@ -43,58 +45,121 @@ PbftReplica::PbftReplica(const Configuration &config, int myIdx,
 
 void PbftReplica::ReceiveMessage(const TransportAddress &remote, void *buf,
                                  size_t size) {
-  static ToReplicaMessage replica_msg;
-  static PBMessage m(replica_msg);
+  if (pipeline.Workers() == 0) {
+    static ToReplicaMessage replica_msg;
+    static PBMessage m(replica_msg);
 
+    m.Parse(buf, size);
+    if (VerifyMessage(replica_msg)) {
+      HandleMessage(remote, replica_msg);
+    }
+    return;
+  }
+
+  // the message outlives this call, until a worker has checked it and
+  // its turn comes to be handled
+  auto replica_msg = std::make_shared<ToReplicaMessage>();
+  PBMessage m(*replica_msg);
   m.Parse(buf, size);
+  std::shared_ptr<TransportAddress> from(remote.clone());
+  pipeline.Submit(
+      [this, replica_msg]() { return VerifyMessage(*replica_msg); },
+      [this, replica_msg, from]() { HandleMessage(*from, *replica_msg); });
+}
+
+bool PbftReplica::VerifyMessage(const ToReplicaMessage &msg) const {
+  switch (msg.msg_case()) {
+    case ToReplicaMessage::MsgCase::kRequest:
+      if (!security.ClientVerifier().Verify(
+              msg.request().req().SerializeAsString(), msg.request().sig())) {
+        RWarning("Wrong signature for client");
+        return false;
+      }
+      return true;
+    case ToReplicaMessage::MsgCase::kPrePrepare: {
+      const PrePrepareMessage &prePrepare = msg.pre_prepare();
+      // signed by the leader of the view it claims, which the handler
+      // then checks is ours
+      int leader = configuration.GetLeaderIndex(prePrepare.common().view());
+      if (!security.ReplicaVerifier(leader).Verify(
+              prePrepare.common().SerializeAsString(), prePrepare.sig())) {
+        RWarning("Wrong signature for PrePrepare");
+        return false;
+      }
+      if (!security.ClientVerifier().Verify(
+              prePrepare.message().req().SerializeAsString(),
+              prePrepare.message().sig())) {
+        RWarning("Wrong signature for client in PrePrepare");
+        return false;
+      }
+      return true;
+    }
+    case ToReplicaMessage::MsgCase::kPrepare:
+      if (!security.ReplicaVerifier(msg.prepare().replicaid())
+               .Verify(msg.prepare().common().SerializeAsString(),
+                       msg.prepare().sig())) {
+        RWarning("Wrong signature for Prepare");
+        return false;
+      }
+      return true;
+    case ToReplicaMessage::MsgCase::kCommit:
+      if (!security.ReplicaVerifier(msg.commit().replicaid())
+               .Verify(msg.commit().common().SerializeAsString(),
+                       msg.commit().sig())) {
+        RWarning("Wrong signature for Commit");
+        return false;
+      }
+      return true;
+    default:
+      // state transfer requests are not signed
+      return true;
+  }
+}
 
-  switch (replica_msg.msg_case()) {
+void PbftReplica::HandleMessage(const TransportAddress &remote,
+                                const ToReplicaMessage &msg) {
+  switch (msg.msg_case()) {
     case ToReplicaMessage::MsgCase::kRequest:
-      HandleRequest(remote, replica_msg.request());
+      HandleRequest(remote, msg.request());
       break;
     case ToReplicaMessage::MsgCase::kPrePrepare:
-      HandlePrePrepare(remote, replica_msg.pre_prepare());
+      HandlePrePrepare(remote, msg.pre_prepare());
       break;
     case ToReplicaMessage::MsgCase::kPrepare:
-      HandlePrepare(remote, replica_msg.prepare());
+      HandlePrepare(remote, msg.prepare());
       break;
     case ToReplicaMessage::MsgCase::kCommit:
-      HandleCommit(remote, replica_msg.commit());
+      HandleCommit(remote, msg.commit());
       break;
     case ToReplicaMessage::MsgCase::kStateTransferRequest:
-      HandleStateTransferRequest(remote, replica_msg.state_transfer_request());
+      HandleStateTransferRequest(remote, msg.state_transfer_request());
       break;
     default:
       RPanic("Received unexpected message type in pbft proto: %u",
-             replica_msg.msg_case());
+             msg.msg_case());
   }
 }
 
 void PbftReplica::HandleRequest(const TransportAddress &remote,
                                 const RequestMessage &msg) {
-  if (!security.ClientVerifier().Verify(msg.req().SerializeAsString(),
-                                        msg.sig())) {
-    RWarning("Wrong signature for client");
-    return;
-  }
-
   if (!msg.relayed()) {
-    clientAddressTable[msg.req().clientid()] =
-        unique_ptr<TransportAddress>(remote.clone());
+    clientTable.SetAddress(msg.req().clientid(), remote);
   }
-  auto kv = clientTable.find(msg.req().clientid());
-  if (kv != clientTable.end()) {
-    ClientTableEntry &entry = kv->second;
+  if (ClientTable::Entry *kv = clientTable.Find(msg.req().clientid())) {
+    ClientTable::Entry &entry = *kv;
     if (msg.req().clientreqid() < entry.lastReqId) {
       RNotice("Ignoring stale request");
       return;
     }
     if (msg.req().clientreqid() == entry.lastReqId) {
+      if (!entry.replied) {
+        RNotice("Received duplicate request; reply not signed yet");
+        return;
+      }
       RNotice("Received duplicate request; resending reply");
-      Assert(clientAddressTable.count(msg.req().clientid()));
-      if (!(transport->SendMessage(this,
-                                   *clientAddressTable[msg.req().clientid()],
-                                   PBMessage(entry.reply)))) {
+      Assert(entry.address != nullptr);
+      if (!(transport->SendMessage(this, *entry.address,
+                                   SerializedMessage(entry.reply)))) {
         RWarning("Failed to resend reply to client");
       }
       return;
@@ -161,22 +226,6 @@ void PbftReplica::HandlePrePrepare(const TransportAddress &remote,
 
   if (view != msg.common().view()) return;
 
-  if (!security.ReplicaVerifier(configuration.GetLeaderIndex(view))
-           .Verify(msg.common().SerializeAsString(), msg.sig())) {
-    RWarning("Wrong signature for PrePrepare");
-    return;
-  }
-  // uint64_t clientid = msg.message().req().clientid();
-  // if (!clientAddressTable.count(clientid)) {
-  //   RWarning("sig@PrePrepare: no client address record");
-  //   return;
-  // }
-  if (!security.ClientVerifier().Verify(msg.message().req().SerializeAsString(),
-                                        msg.message().sig())) {
-    RWarning("Wrong signature for client in PrePrepare");
-    return;
-  }
-
   opnum_t seqNum = msg.common().seqnum();
   // if (commonTable.count(seqNum) && !Match(commonTable[seqNum], msg.common()))
   if (commonTable.count(seqNum)) return;
@@ -207,12 +256,6 @@ void PbftReplica::HandlePrePrepare(const TransportAddress &remote,
 
 void PbftReplica::HandlePrepare(const TransportAddress &remote,
                                 const proto::PrepareMessage &msg) {
-  if (!security.ReplicaVerifier(msg.replicaid())
-           .Verify(msg.common().SerializeAsString(), msg.sig())) {
-    RWarning("Wrong signature for Prepare");
-    return;
-  }
-
   // TODO verify incoming prepare matches prepared proposal
   if (LoggedPrepared(msg.common().seqnum())) {
     RDebug("not broadcast for delayed Prepare; directly resp instead");
@@ -226,12 +269,6 @@ void PbftReplica::HandlePrepare(const TransportAddress &remote,
 
 void PbftReplica::HandleCommit(const TransportAddress &remote,
                                const proto::CommitMessage &msg) {
-  if (!security.ReplicaVerifier(msg.replicaid())
-           .Verify(msg.common().SerializeAsString(), msg.sig())) {
-    RWarning("Wrong signature for Commit");
-    return;
-  }
-
   if (msg.replicaid() == configuration.GetLeaderIndex(view))
     viewChangeTimeout->Stop();  // TODO filter out faulty message
 
@@ -337,15 +374,17 @@ void PbftReplica::TryReachCommitPoint(const proto::Common &msg) {
   while (auto *entry = static_cast<LogEntry *>(log.Find(executing))) {
     // speculative case
     if (entry->state == LOG_STATE_SPECULATIVE) {
-      Assert(clientTable.count(entry->request.clientid()));
-      Assert(clientTable[entry->request.clientid()].lastReqId ==
-             entry->request.clientreqid());
+      ClientTable::Entry *cte = clientTable.Find(entry->request.clientid());
+      Assert(cte != nullptr);
+      Assert(cte->lastReqId == entry->request.clientreqid());
 
       entry->state = LOG_STATE_COMMITTED;
-      ToClientMessage m = clientTable[entry->request.clientid()].reply;
+      // the reply is recorded even while its signature is in flight;
+      // this one says something different, so it is signed afresh
+      ToClientMessage m;
+      m.ParseFromString(cte->reply);
       m.mutable_reply()->set_speculative(false);
-      transport->SendMessage(
-          this, *clientAddressTable[entry->request.clientid()], PBMessage(m));
+      SendReply(m);
       executing += 1;
       continue;
     }
@@ -357,6 +396,9 @@ void PbftReplica::TryReachCommitPoint(const proto::Common &msg) {
     executing += 1;
   }
   lastExecuted = executing - 1;
+  // every slot below is committed and will not be voted on again
+  prepareSet.Advance(executing);
+  commitSet.Advance(executing);
   TrySpeculative();
 }
 
@@ -378,14 +420,14 @@ void PbftReplica::TrySpeculative() {
 void PbftReplica::ExecuteEntry(LogEntry *entry, bool speculative) {
   const Request &req = entry->request;
   opnum_t executing = entry->viewstamp.opnum;
-  if (clientTable.count(req.clientid()) &&
-      clientTable[req.clientid()].lastReqId >= req.clientreqid()) {
+  ClientTable::Entry *cte = clientTable.Find(req.clientid());
+  if (cte != nullptr && cte->lastReqId >= req.clientreqid()) {
     RNotice("Skip execute duplicated; seq = %lu, req = %lu@%lu", executing,
             req.clientreqid(), req.clientid());
-    if (clientTable[req.clientid()].lastReqId == req.clientreqid()) {
-      Assert(clientAddressTable.count(req.clientid()));
-      transport->SendMessage(this, *clientAddressTable[req.clientid()],
-                             PBMessage(clientTable[req.clientid()].reply));
+    if (cte->lastReqId == req.clientreqid() && cte->replied) {
+      Assert(cte->address != nullptr);
+      transport->SendMessage(this, *cte->address,
+                             SerializedMessage(cte->reply));
     }
     return;
   }
@@ -399,13 +441,31 @@ void PbftReplica::ExecuteEntry(LogEntry *entry, bool speculative) {
   *reply.mutable_req() = req;
   reply.set_replicaid(ReplicaId());
   reply.set_speculative(speculative);
-  reply.set_sig(std::string());
-  security.ReplicaSigner(ReplicaId())
-      .Sign(reply.SerializeAsString(), *reply.mutable_sig());
   UpdateClientTable(req, m);
-  if (clientAddressTable.count(req.clientid()))
-    transport->SendMessage(this, *clientAddressTable[req.clientid()],
-                           PBMessage(m));
+  SendReply(m);
+}
+
+void PbftReplica::SendReply(const ToClientMessage &m) {
+  // signed on a worker when there are any, and sent in order with the
+  // messages handled meanwhile
+  auto reply = std::make_shared<ToClientMessage>(m);
+  pipeline.Submit(
+      [this, reply]() {
+        ReplyMessage &r = *reply->mutable_reply();
+        r.set_sig(std::string());
+        return security.ReplicaSigner(ReplicaId())
+            .Sign(r.SerializeAsString(), *r.mutable_sig());
+      },
+      [this, reply]() {
+        const Request &req = reply->reply().req();
+        ClientTable::Entry *entry = clientTable.Find(req.clientid());
+        // a later request may have run meanwhile
+        if (entry != nullptr && entry->lastReqId == req.clientreqid()) {
+          entry->SetReply(*reply);
+        }
+        if (const TransportAddress *addr = clientTable.Address(req.clientid()))
+          transport->SendMessage(this, *addr, PBMessage(*reply));
+      });
 }
 
 void PbftReplica::ScheduleStateTransfer(opnum_t seqNum) {
@@ -433,14 +493,16 @@ void PbftReplica::ScheduleStateTransfer(opnum_t seqNum) {
 
 void PbftReplica::UpdateClientTable(const Request &req,
                                     const ToClientMessage &reply) {
-  ClientTableEntry &entry = clientTable[req.clientid()];
+  ClientTable::Entry &entry = clientTable[req.clientid()];
   ASSERT(entry.lastReqId <= req.clientreqid());
 
   if (entry.lastReqId == req.clientreqid()) {  // Duplicate request
     return;
   }
   entry.lastReqId = req.clientreqid();
-  entry.reply = reply;
+  entry.SetReply(reply);
+  // not to be resent until SendReply has signed it
+  entry.replied = false;
 }
 
 }  // namespace pbft
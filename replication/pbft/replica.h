@@ -34,10 +34,12 @@
 #ifndef _PBFT_REPLICA_H_
 #define _PBFT_REPLICA_H_
 
+#include "common/clienttable.h"
 #include "common/log.h"
 #include "common/pbmessage.h"
 #include "common/quorumset.h"
 #include "common/replica.h"
+#include "lib/sigpipeline.h"
 #include "lib/signature.h"
 #include "replication/pbft/pbft-proto.pb.h"
 
@@ -71,17 +73,28 @@ struct LogEntry : public dsnet::LogEntry {
       : dsnet::LogEntry(vs, state, req), signature(sig) {}
 };
 
+// With verifyWorkers > 0, signatures of incoming messages are checked,
+// and replies signed, on that many worker threads (see
+// SignaturePipeline); the protocol itself still runs on the transport's
+// thread, in arrival order, and only on messages that checked out.
 class PbftReplica : public Replica {
  public:
   PbftReplica(const Configuration &config, int myIdx, bool initialize,
-              Transport *transport, const Security &sec, AppReplica *app);
+              Transport *transport, const Security &sec, AppReplica *app,
+              int verifyWorkers = 0);
   void ReceiveMessage(const TransportAddress &remote, void *buf,
                       size_t size) override;
 
  private:
   const Security &security;
 
-  // message handlers
+  // check every signature a message carries; safe to call on a worker
+  // since it reads nothing the protocol changes
+  bool VerifyMessage(const proto::ToReplicaMessage &msg) const;
+  void HandleMessage(const TransportAddress &remote,
+                     const proto::ToReplicaMessage &msg);
+
+  // message handlers, for messages that have been verified
   void HandleRequest(const TransportAddress &remote,
                      const proto::RequestMessage &msg);
   void HandlePrePrepare(const TransportAddress &remote,
@@ -156,7 +169,7 @@ class PbftReplica : public Replica {
   // additional states that keep tracks of each proposal
   // common data of a proposal includes viewstamp and request signature
   std::unordered_map<opnum_t, proto::Common> commonTable;
-  ByzantineProtoQuorumSet<opnum_t, proto::Common> prepareSet, commitSet;
+  WindowedByzantineProtoQuorumSet<proto::Common> prepareSet, commitSet;
   // prepared(m, v, n, i) where v(view) and i(replica index) should
   // be fixed for each calling
   // theoretically this verb could use const this, but underlying CheckForQuorum
@@ -184,6 +197,8 @@ class PbftReplica : public Replica {
   void ScheduleStateTransfer(opnum_t target);
   void TrySpeculative();
   void ExecuteEntry(LogEntry *entry, bool speculative);
+  // sign the reply, then record it for resending and send it
+  void SendReply(const proto::ToClientMessage &m);
 
   template <typename MsgTy>  // PrepareMessage/CommitMessage
   void CommonSend(const proto::Common &common,
@@ -202,19 +217,19 @@ class PbftReplica : public Replica {
   }
 
   // client states, copied from unreplicated/vr
-  struct ClientTableEntry {
-    uint64_t lastReqId;
-    proto::ToClientMessage reply;
-  };
-  std::unordered_map<uint64_t, ClientTableEntry> clientTable;
-  std::unordered_map<uint64_t, std::unique_ptr<TransportAddress>>
-      clientAddressTable;
+  // Replies are serialized ToClientMessages. A reply is recorded unsigned
+  // when its request executes, and only marked replied, and so resent to
+  // duplicates, once SendReply has signed it.
+  ClientTable clientTable;
   void UpdateClientTable(const Request &req,
                          const proto::ToClientMessage &reply);
 
   static bool Match(const proto::Common &lhs, const proto::Common &rhs) {
     return lhs.SerializeAsString() == rhs.SerializeAsString();
   }
+
+  // last, so its workers stop before anything they use goes away
+  SignaturePipeline pipeline;
 };
 
 }  // namespace pbft
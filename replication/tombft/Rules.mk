@@ -12,4 +12,4 @@ OBJS-tombft-client := $(o)client.o $(o)tombft-proto.o $(o)message.o \
 
 OBJS-tombft-replica := $(o)replica.o $(o)tombft-proto.o $(o)message.o \
                    $(OBJS-replica) $(LIB-message) \
-                   $(LIB-configuration) $(LIB-pbmessage)
+                   $(LIB-configuration) $(LIB-pbmessage) $(LIB-sigpipeline)
@@ -50,7 +50,8 @@ void TomBFTClient::SendRequest() {
   security.ClientSigner().Sign(msg.request().SerializeAsString(),
                                *msg.mutable_request()->mutable_sig());
   if (config.NumSequencers()) {
-    transport->SendMessageToSequencer(this, 0, TomBFTMessage(msg, true));
+    transport->SendMessageToSequencer(this, 0,
+                                      TomBFTMessage(msg, true, config.n));
   } else {
     transport->SendMessageToMulticast(this, TomBFTMessage(msg, true));
   }
@@ -12,15 +12,20 @@ namespace tombft {
 void TomBFTMessage::Parse(const void *buf, size_t size) {
   auto bytes = reinterpret_cast<const uint8_t *>(buf);
   if (NTOH_SESSNUM(reinterpret_cast<const Header *>(buf)->sess_num != 0)) {
-    const size_t header_size = sizeof(Header);
-    Assert(size > header_size);
-    std::memcpy(&meta, buf, header_size);
+    Assert(size > sizeof(Header));
+    std::memcpy(&meta, buf, sizeof(Header));
     meta.sess_num = NTOH_SESSNUM(meta.sess_num);
     meta.msg_num = NTOH_MSGNUM(meta.msg_num);
-    bytes += sizeof(Header);
-    size -= sizeof(Header);
+    meta.num_hmacs = NTOH_NUMHMACS(meta.num_hmacs);
+    const size_t header_size = StampedHeaderSize(meta.num_hmacs);
+    Assert(size > header_size);
+    hmacs.assign(reinterpret_cast<const char *>(bytes) + sizeof(Header),
+                 meta.num_hmacs * kHmacSize);
+    bytes += header_size;
+    size -= header_size;
   } else {
     meta.sess_num = 0;
+    hmacs.clear();
     bytes += sizeof(size_t);
     size -= sizeof(size_t);
   }
@@ -35,8 +40,16 @@ void TomBFTMessage::Serialize(void *buf) const {
     Header hton_meta(meta);
     hton_meta.sess_num = HTON_SESSNUM(hton_meta.sess_num);
     hton_meta.msg_num = HTON_MSGNUM(hton_meta.msg_num);
-    header_size = sizeof(Header);
-    std::memcpy(bytes, &hton_meta, header_size);
+    hton_meta.num_hmacs = HTON_NUMHMACS(hton_meta.num_hmacs);
+    std::memcpy(bytes, &hton_meta, sizeof(Header));
+    // the sequencer fills in the HMACs
+    const size_t hmacs_size = meta.num_hmacs * kHmacSize;
+    if (hmacs.size() == hmacs_size) {
+      std::memcpy(bytes + sizeof(Header), hmacs.data(), hmacs_size);
+    } else {
+      std::memset(bytes + sizeof(Header), 0, hmacs_size);
+    }
+    header_size = StampedHeaderSize(meta.num_hmacs);
   } else {
     header_size = sizeof(size_t);
     reinterpret_cast<Header *>(buf)->sess_num = 0;
@@ -12,10 +12,15 @@
 #define NTOH_SESSNUM(n) ntohs(n)
 #define HTON_MSGNUM(n) htobe64(n)
 #define NTOH_MSGNUM(n) be64toh(n)
+#define HTON_NUMHMACS(n) htons(n)
+#define NTOH_NUMHMACS(n) ntohs(n)
 
 namespace dsnet {
 namespace tombft {
 
+// A sequenced packet is the header, one HMAC per replica (num_hmacs of
+// them, filled in by the sequencer) and then the message. Each HMAC
+// covers the stamp -- sess_num and msg_num as sent -- and the message.
 class TomBFTMessage : public Message {
  public:
   struct __attribute__((packed)) Header {
@@ -23,19 +28,34 @@ class TomBFTMessage : public Message {
     // non-sequencing packet has garbage in this header
     std::uint16_t sess_num;
     std::uint64_t msg_num;
-    char hmac_list[4][SHA256_DIGEST_LENGTH];  // TODO configurable
+    std::uint16_t num_hmacs;
   };
+  static const size_t kStampSize = sizeof(std::uint16_t) + sizeof(std::uint64_t);
+  static const size_t kHmacSize = SHA256_DIGEST_LENGTH;
   Header meta;
+  // the replicas' HMACs, in order, once parsed
+  std::string hmacs;
 
-  TomBFTMessage(::google::protobuf::Message &msg, bool sequencing = false)
+  // a sequenced message leaves room for num_hmacs HMACs, which should
+  // be the number of replicas
+  TomBFTMessage(::google::protobuf::Message &msg, bool sequencing = false,
+                int num_hmacs = 0)
       : pb_msg(PBMessage(msg)), sequencing(sequencing) {
     meta.sess_num = 0;
+    meta.msg_num = 0;
+    meta.num_hmacs = num_hmacs;
   }
   ~TomBFTMessage() {}
 
+  // size of a sequenced packet's header and HMACs
+  static size_t StampedHeaderSize(int num_hmacs) {
+    return sizeof(Header) + num_hmacs * kHmacSize;
+  }
+
  private:
   TomBFTMessage(const TomBFTMessage &msg)
       : meta(msg.meta),
+        hmacs(msg.hmacs),
         pb_msg(*std::unique_ptr<PBMessage>(msg.pb_msg.Clone())),
         sequencing(msg.sequencing) {}
 
@@ -45,7 +65,7 @@ class TomBFTMessage : public Message {
   }
   virtual std::string Type() const override { return pb_msg.Type(); }
   virtual size_t SerializedSize() const override {
-    return (sequencing ? sizeof(Header) : sizeof(size_t)) +
+    return (sequencing ? StampedHeaderSize(meta.num_hmacs) : sizeof(size_t)) +
            pb_msg.SerializedSize();
   }
   virtual void Parse(const void *buf, size_t size) override;
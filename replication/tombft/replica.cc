@@ -14,45 +14,115 @@ namespace tombft {
 
 TomBFTReplica::TomBFTReplica(const Configuration &config, int myIdx,
                              bool initialize, Transport *transport,
-                             const Security &security, AppReplica *app)
+                             const Security &security, AppReplica *app,
+                             int verifyWorkers)
     : Replica(config, 0, myIdx, initialize, transport, app),
       security(security),
       vs(0, 0),
-      log(false) {
+      log(false),
+      pipeline(transport, verifyWorkers) {
   transport->ListenOnMulticast(this, config);
+  for (int i = 0; i < config.NumSequencers(); i += 1) {
+    seq_verifiers.push_back(&security.SequencerVerifier(myIdx, i));
+    seq_hmac_verifiers.push_back(
+        dynamic_cast<const HmacVerifier *>(seq_verifiers[i]));
+  }
   // TODO
 }
 
+bool TomBFTReplica::VerifyStamp(const void *buf, size_t size) const {
+  auto header = reinterpret_cast<const TomBFTMessage::Header *>(buf);
+  const int n = NTOH_NUMHMACS(header->num_hmacs);
+  const size_t header_size = TomBFTMessage::StampedHeaderSize(n);
+  // sequencer i stamps session i + 1
+  const int seq_idx = NTOH_SESSNUM(header->sess_num) - 1;
+  if (n != configuration.n || size <= header_size ||
+      seq_idx >= (int)seq_verifiers.size()) {
+    return false;
+  }
+
+  const char *hmac = reinterpret_cast<const char *>(buf) +
+                     sizeof(TomBFTMessage::Header) +
+                     replicaIdx * TomBFTMessage::kHmacSize;
+  struct iovec pieces[2] = {
+      {const_cast<void *>(buf), TomBFTMessage::kStampSize},
+      {const_cast<char *>(reinterpret_cast<const char *>(buf)) + header_size,
+       size - header_size}};
+  if (seq_hmac_verifiers[seq_idx]) {
+    return seq_hmac_verifiers[seq_idx]->Verify(
+        pieces, 2, reinterpret_cast<const unsigned char *>(hmac));
+  }
+  std::string message(reinterpret_cast<const char *>(buf),
+                      TomBFTMessage::kStampSize);
+  message.append(reinterpret_cast<const char *>(pieces[1].iov_base),
+                 pieces[1].iov_len);
+  return seq_verifiers[seq_idx]->Verify(
+      message, std::string(hmac, TomBFTMessage::kHmacSize));
+}
+
 void TomBFTReplica::ReceiveMessage(const TransportAddress &remote, void *buf,
                                    size_t size) {
-  proto::Message msg;
-  TomBFTMessage m(msg);
-  m.Parse(buf, size);
-  switch (msg.msg_case()) {
-    case proto::Message::kRequest:
-      HandleRequest(msg.request(), remote, m.meta, m);
+  // only this replica's HMAC is checked, before anything is parsed, so
+  // a forged packet costs one MAC whatever the number of replicas
+  if (size >= sizeof(TomBFTMessage::Header) &&
+      reinterpret_cast<const TomBFTMessage::Header *>(buf)->sess_num != 0 &&
+      !VerifyStamp(buf, size)) {
+    RWarning("Incorrect sequencer HMAC");
+    return;
+  }
+
+  if (pipeline.Workers() == 0) {
+    proto::Message msg;
+    TomBFTMessage m(msg);
+    m.Parse(buf, size);
+    switch (msg.msg_case()) {
+      case proto::Message::kRequest:
+        if (VerifyRequest(msg.request())) {
+          HandleRequest(msg.request(), remote, m.meta, m);
+        }
+        break;
+      default:
+        Panic("Received unexpected message type #%u", msg.msg_case());
+    }
+    return;
+  }
+
+  // kept until a worker has checked the client's signature and the
+  // request's turn comes
+  auto msg = std::make_shared<proto::Message>();
+  auto m = std::make_shared<TomBFTMessage>(*msg);
+  m->Parse(buf, size);
+  switch (msg->msg_case()) {
+    case proto::Message::kRequest: {
+      std::shared_ptr<TransportAddress> from(remote.clone());
+      pipeline.Submit(
+          [this, msg]() { return VerifyRequest(msg->request()); },
+          [this, msg, m, from]() {
+            HandleRequest(msg->request(), *from, m->meta, *m);
+          });
       break;
+    }
     default:
-      Panic("Received unexpected message type #%u", msg.msg_case());
+      Panic("Received unexpected message type #%u", msg->msg_case());
   }
 }
 
+bool TomBFTReplica::VerifyRequest(const proto::RequestMessage &msg) const {
+  if (!security.ClientVerifier().Verify(msg.req().SerializeAsString(),
+                                        msg.sig())) {
+    RWarning("Incorrect client signature");
+    return false;
+  }
+  return true;
+}
+
 void TomBFTReplica::HandleRequest(const proto::RequestMessage &msg,
                                   const TransportAddress &remote,
                                   const TomBFTMessage::Header &meta,
                                   const TomBFTMessage &m) {
+  // the sequencer's HMAC was checked on receipt, and the client's
+  // signature before the request was handed here
   Assert(meta.sess_num != 0);
-  std::string seq_sig(meta.hmac_list[replicaIdx], 32);
-  // if (!security.SequencerVerifier(replicaIdx)
-  //          .Verify(msg.SerializeAsString(), seq_sig)) {
-  //   RWarning("Incorrect sequencer signature");
-  //   return;
-  // }
-  if (!security.ClientVerifier().Verify(msg.req().SerializeAsString(),
-                                        msg.sig())) {
-    RWarning("Incorrect client signature");
-    return;
-  }
 
   if (meta.msg_num != vs.msgnum + 1) {
     NOT_IMPLEMENTED();  // slow path
@@ -61,22 +131,28 @@ void TomBFTReplica::HandleRequest(const proto::RequestMessage &msg,
   vs.msgnum = vs.opnum = meta.msg_num;
   log.Append(new TomBFTLogEntry(vs, LOG_STATE_EXECUTED, msg.req(), m));
 
-  proto::Message reply_msg;
-  reply_msg.mutable_reply()->set_view(vs.view);
-  reply_msg.mutable_reply()->set_replicaid(replicaIdx);
-  reply_msg.mutable_reply()->set_opnum(vs.opnum);
-  reply_msg.mutable_reply()->set_clientreqid(msg.req().clientreqid());
-
-  Execute(vs.opnum, msg.req(), *reply_msg.mutable_reply());
+  auto reply_msg = std::make_shared<proto::Message>();
+  reply_msg->mutable_reply()->set_view(vs.view);
+  reply_msg->mutable_reply()->set_replicaid(replicaIdx);
+  reply_msg->mutable_reply()->set_opnum(vs.opnum);
+  reply_msg->mutable_reply()->set_clientreqid(msg.req().clientreqid());
 
-  reply_msg.mutable_reply()->set_sig(string());
-  security.ReplicaSigner(replicaIdx)
-      .Sign(reply_msg.SerializeAsString(),
-            *reply_msg.mutable_reply()->mutable_sig());
+  Execute(vs.opnum, msg.req(), *reply_msg->mutable_reply());
 
-  TransportAddress *client_addr =
-      transport->LookupAddress(ReplicaAddress(msg.req().clientaddr()));
-  transport->SendMessage(this, *client_addr, TomBFTMessage(reply_msg));
+  // signed on a worker when there are any; replies still go out in
+  // execution order
+  std::shared_ptr<TransportAddress> client_addr(
+      transport->LookupAddress(ReplicaAddress(msg.req().clientaddr())));
+  pipeline.Submit(
+      [this, reply_msg]() {
+        reply_msg->mutable_reply()->set_sig(string());
+        return security.ReplicaSigner(replicaIdx)
+            .Sign(reply_msg->SerializeAsString(),
+                  *reply_msg->mutable_reply()->mutable_sig());
+      },
+      [this, reply_msg, client_addr]() {
+        transport->SendMessage(this, *client_addr, TomBFTMessage(*reply_msg));
+      });
 }
 
 }  // namespace tombft
@@ -1,8 +1,11 @@
 //
 #pragma once
 
+#include <vector>
+
 #include "common/log.h"
 #include "common/replica.h"
+#include "lib/sigpipeline.h"
 #include "lib/signature.h"
 #include "replication/tombft/message.h"
 #include "replication/tombft/tombft-proto.pb.h"
@@ -18,24 +21,37 @@ struct TomBFTLogEntry : public LogEntry {
       : LogEntry(vs, state, req), msg(msg.Clone()) {}
 };
 
+// With verifyWorkers > 0, client signatures are checked, and replies
+// signed, on that many worker threads (see SignaturePipeline); requests
+// still reach HandleRequest one at a time, in the order they arrived.
 class TomBFTReplica : public Replica {
  public:
   TomBFTReplica(const Configuration &config, int myIdx, bool initialize,
                 Transport *transport, const Security &securtiy,
-                AppReplica *app);
+                AppReplica *app, int verifyWorkers = 0);
   ~TomBFTReplica() {}
 
   void ReceiveMessage(const TransportAddress &remote, void *buf,
                       size_t size) override;
 
  private:
+  // check this replica's HMAC of a sequenced packet, in place
+  bool VerifyStamp(const void *buf, size_t size) const;
+  // check the client's signature; safe to call on a worker
+  bool VerifyRequest(const proto::RequestMessage &msg) const;
   void HandleRequest(const proto::RequestMessage &msg,
                      const TransportAddress &remote,
                      const TomBFTMessage::Header &meta, const TomBFTMessage &m);
 
   const Security &security;
+  // by sequencer index; the HmacVerifier ones are checked without
+  // copying the message out
+  std::vector<const Verifier *> seq_verifiers;
+  std::vector<const HmacVerifier *> seq_hmac_verifiers;
   viewstamp_t vs;
   Log log;
+  // last, so its workers stop before anything they use goes away
+  SignaturePipeline pipeline;
 };
 
 }  // namespace tombft
@@ -1,5 +1,10 @@
 #pragma once
 
+#include <cstring>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
 #include "lib/message.h"
 #include "lib/signature.h"
 #include "replication/tombft/message.h"
@@ -16,25 +21,51 @@ class TomBFTSequencer : public Sequencer {
         s(s),
         id(id),
         sess_num(id + 1),
-        msg_num(0) {}
+        msg_num(0) {
+    // an HmacSigner per replica MACs straight out of the packet; a
+    // signature has to fit the fixed MAC slot, so the only other signer
+    // taken is NopSecurity's placeholder, for debugging
+    for (int i = 0; i < config.n; i += 1) {
+      signers.push_back(&s.SequencerSigner(i, id));
+      hmac_signers.push_back(dynamic_cast<const HmacSigner *>(signers[i]));
+      if (!hmac_signers[i] && typeid(*signers[i]) != typeid(Signer)) {
+        Panic("Sequencer signer for replica %d is not an HmacSigner", i);
+      }
+    }
+  }
   ~TomBFTSequencer() {}
 
   virtual void ReceiveMessage(const TransportAddress &remote, void *buf,
                               size_t size) override {
     auto header = reinterpret_cast<TomBFTMessage::Header *>(buf);
-    Assert(header->sess_num == 0);
     Assert(size >= sizeof(TomBFTMessage::Header));
+    Assert(header->sess_num == 0);
+    const int n = NTOH_NUMHMACS(header->num_hmacs);
+    if (n != config_.n || size < TomBFTMessage::StampedHeaderSize(n)) {
+      Warning("Request has room for %d HMACs, not %d", n, config_.n);
+      return;
+    }
     msg_num += 1;
     header->sess_num = HTON_SESSNUM(sess_num);
     header->msg_num = HTON_MSGNUM(msg_num);
 
-    std::string msg;
-    msg.assign(reinterpret_cast<char *>(buf) + sizeof(TomBFTMessage::Header),
-               size - sizeof(TomBFTMessage::Header));
-    for (int i = 0; i < 4; i += 1) {  // TODO configurable replica number
-      std::string replica_sig;
-      s.SequencerSigner(i, id).Sign(msg, replica_sig);
-      replica_sig.copy(header->hmac_list[i], SHA256_DIGEST_LENGTH);
+    auto hmac_list = reinterpret_cast<unsigned char *>(buf) +
+                     sizeof(TomBFTMessage::Header);
+    const size_t header_size = TomBFTMessage::StampedHeaderSize(n);
+    struct iovec pieces[2] = {
+        {buf, TomBFTMessage::kStampSize},
+        {reinterpret_cast<char *>(buf) + header_size, size - header_size}};
+    for (int i = 0; i < n; i += 1) {
+      unsigned char *hmac = hmac_list + i * TomBFTMessage::kHmacSize;
+      if (hmac_signers[i]) {
+        hmac_signers[i]->Sign(pieces, 2, hmac);
+        continue;
+      }
+      // the placeholder signs nothing in particular
+      signers[i]->Sign(std::string(), signature);
+      Assert(signature.size() <= TomBFTMessage::kHmacSize);
+      std::memset(hmac, 0, TomBFTMessage::kHmacSize);
+      signature.copy(reinterpret_cast<char *>(hmac), signature.size());
     }
     transport_->SendMessageToAll(this, BufferMessage(buf, size));
   }
@@ -44,6 +75,10 @@ class TomBFTSequencer : public Sequencer {
   int id;
   const uint16_t sess_num;
   uint64_t msg_num;
+  std::vector<const Signer *> signers;
+  std::vector<const HmacSigner *> hmac_signers;
+  // reused across packets for the placeholder signer
+  std::string signature;
 };
 
 }  // namespace tombft
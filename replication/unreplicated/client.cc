@@ -29,8 +29,10 @@
  **********************************************************************/
 
 #include "common/client.h"
+#include "common/clienttable.h"
 #include "common/request.pb.h"
 #include "common/pbmessage.h"
+#include "lib/assert.h"
 #include "lib/message.h"
 #include "lib/transport.h"
 #include "replication/unreplicated/client.h"
@@ -44,21 +46,21 @@ using namespace proto;
 UnreplicatedClient::UnreplicatedClient(const Configuration &config,
                                        const ReplicaAddress &addr,
                                        Transport *transport,
-                                       uint64_t clientid)
-    : Client(config, addr, transport, clientid)
+                                       uint64_t clientid,
+                                       unsigned int maxPending)
+    : Client(config, addr, transport, clientid), maxPending(maxPending)
 {
-    pendingRequest = NULL;
+    // The replica only tells apart requests within its client table
+    // window
+    ASSERT(maxPending >= 1 && maxPending <= ClientTable::WINDOW);
     pendingUnloggedRequest = NULL;
     lastReqId = 0;
-    requestTimeout = new Timeout(transport, 1000, [this]() {
-	    ResendRequest();
-	});
 }
 
 UnreplicatedClient::~UnreplicatedClient()
 {
-    if (pendingRequest) {
-        delete pendingRequest;
+    for (auto &kv : pendingRequests) {
+        delete kv.second;
     }
     if (pendingUnloggedRequest) {
         delete pendingUnloggedRequest;
@@ -69,37 +71,47 @@ void
 UnreplicatedClient::Invoke(const string &request,
                            continuation_t continuation)
 {
-    // XXX Can only handle one pending request for now
-    if (pendingRequest != NULL) {
-        Panic("Client only supports one pending request");
+    if (pendingRequests.size() >= maxPending) {
+        Panic("Client only supports %u pending requests", maxPending);
     }
 
     ++lastReqId;
-    pendingRequest = new PendingRequest(request, lastReqId, continuation);
-
-    SendRequest();
+    uint64_t reqId = lastReqId;
+    PendingRequest *req = new PendingRequest(request, reqId, continuation);
+    req->timeout.reset(new Timeout(transport, 1000, [this, reqId]() {
+	    ResendRequest(reqId);
+	}));
+    pendingRequests[reqId] = req;
+
+    SendRequest(req);
 }
 
 void
-UnreplicatedClient::SendRequest()
+UnreplicatedClient::SendRequest(const PendingRequest *req)
 {
     ToReplicaMessage m;
     RequestMessage *reqMsg = m.mutable_request();
-    reqMsg->mutable_req()->set_op(pendingRequest->request);
+    reqMsg->mutable_req()->set_op(req->request);
     reqMsg->mutable_req()->set_clientid(clientid);
-    reqMsg->mutable_req()->set_clientreqid(lastReqId);
+    reqMsg->mutable_req()->set_clientreqid(req->clientreqid);
+    // Every request before the oldest pending one has been answered
+    reqMsg->mutable_req()->set_ackedreqid(pendingRequests.begin()->first - 1);
 
     // Unreplicated: just send to replica 0
     transport->SendMessageToReplica(this, 0, PBMessage(m));
 
-    requestTimeout->Reset();
+    req->timeout->Reset();
 }
 
 void
-UnreplicatedClient::ResendRequest()
+UnreplicatedClient::ResendRequest(uint64_t clientreqid)
 {
-    Warning("Timeout, resending request for req id %lu", lastReqId);
-    SendRequest();
+    auto it = pendingRequests.find(clientreqid);
+    if (it == pendingRequests.end()) {
+        return;
+    }
+    Warning("Timeout, resending request for req id %lu", clientreqid);
+    SendRequest(it->second);
 }
 
 void
@@ -156,21 +168,17 @@ void
 UnreplicatedClient::HandleReply(const TransportAddress &remote,
                                 const proto::ReplyMessage &msg)
 {
-    if (pendingRequest == NULL) {
-        Warning("Received reply when no request was pending");
-	return;
-    }
-
-    if (msg.req().clientreqid() != pendingRequest->clientreqid) {
+    auto it = pendingRequests.find(msg.req().clientreqid());
+    if (it == pendingRequests.end()) {
+        Debug("Received reply for a request that is not pending");
 	return;
     }
 
     Debug("Client received reply");
 
-    requestTimeout->Stop();
-
-    PendingRequest *req = pendingRequest;
-    pendingRequest = NULL;
+    PendingRequest *req = it->second;
+    pendingRequests.erase(it);
+    req->timeout->Stop();
 
     req->continuation(req->request, msg.reply());
     delete req;
@@ -36,6 +36,9 @@
 #include "lib/configuration.h"
 #include "replication/unreplicated/unreplicated-proto.pb.h"
 
+#include <map>
+#include <memory>
+
 namespace dsnet {
 namespace unreplicated {
 
@@ -45,7 +48,8 @@ public:
     UnreplicatedClient(const Configuration &config,
                        const ReplicaAddress &addr,
                        Transport *transport,
-                       uint64_t clientid = 0);
+                       uint64_t clientid = 0,
+                       unsigned int maxPending = 1);
     virtual ~UnreplicatedClient();
     virtual void Invoke(const string &request, continuation_t continuation) override;
     virtual void InvokeUnlogged(int replicaIdx,
@@ -63,20 +67,23 @@ protected:
         uint64_t clientid;
         uint64_t clientreqid;
         continuation_t continuation;
+        std::unique_ptr<Timeout> timeout;
         inline PendingRequest(string request, uint64_t clientreqid, continuation_t continuation)
             : request(request), clientreqid(clientreqid), continuation(continuation) { }
     };
-    PendingRequest *pendingRequest;
+    // Requests awaiting replies, by clientreqid, each resent on its
+    // own timeout. At most maxPending at once.
+    std::map<uint64_t, PendingRequest *> pendingRequests;
+    unsigned int maxPending;
     PendingRequest *pendingUnloggedRequest;
-    Timeout *requestTimeout;
     uint64_t lastReqId;
 
     void HandleReply(const TransportAddress &remote,
                      const proto::ReplyMessage &msg);
     void HandleUnloggedReply(const TransportAddress &remote,
                              const proto::UnloggedReplyMessage &msg);
-    void SendRequest();
-    void ResendRequest();
+    void SendRequest(const PendingRequest *req);
+    void ResendRequest(uint64_t clientreqid);
 };
 
 } // namespace dsnet::unreplicated
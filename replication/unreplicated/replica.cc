@@ -48,18 +48,14 @@ UnreplicatedReplica::HandleRequest(const TransportAddress &remote,
     ToClientMessage m;
     ReplyMessage *reply = m.mutable_reply();
 
-    auto kv = clientTable.find(msg.req().clientid());
-    if (kv != clientTable.end()) {
-        ClientTableEntry &entry = kv->second;
-        if (msg.req().clientreqid() < entry.lastReqId) {
-            return;
-        }
-        if (msg.req().clientreqid() == entry.lastReqId) {
-            if (!(transport->SendMessage(this, remote, PBMessage(entry.reply)))) {
-                Warning("Failed to resend reply to client");
-            }
-            return;
+    ClientTable::Entry &entry = clientTable[msg.req().clientid()];
+    if (!entry.Accept(msg.req().clientreqid(), msg.req().ackedreqid())) {
+        const string *saved = entry.Reply(msg.req().clientreqid());
+        if (saved != NULL &&
+            !(transport->SendMessage(this, remote, SerializedMessage(*saved)))) {
+            Warning("Failed to resend reply to client");
         }
+        return;
     }
 
     ++last_op_;
@@ -138,17 +134,7 @@ void
 UnreplicatedReplica::UpdateClientTable(const Request &req,
 				       const ToClientMessage &reply)
 {
-    ClientTableEntry &entry = clientTable[req.clientid()];
-
-    ASSERT(entry.lastReqId <= req.clientreqid());
-
-    if (entry.lastReqId == req.clientreqid()) {
-        // Duplicate request
-        return;
-    }
-
-    entry.lastReqId = req.clientreqid();
-    entry.reply = reply;
+    clientTable[req.clientid()].SetReply(req.clientreqid(), reply);
 }
 
 } // namespace dsnet::unreplicated
@@ -32,6 +32,7 @@
 #ifndef _UNREPLICATED_REPLICA_H_
 #define _UNREPLICATED_REPLICA_H_
 
+#include "common/clienttable.h"
 #include "common/replica.h"
 #include "replication/unreplicated/unreplicated-proto.pb.h"
 
@@ -60,12 +61,8 @@ private:
 
     opnum_t last_op_;
     Log log;
-    struct ClientTableEntry
-    {
-        uint64_t lastReqId;
-        proto::ToClientMessage reply;
-    };
-    std::map<uint64_t, ClientTableEntry> clientTable;
+    // Replies are the bytes of ToClientMessage
+    ClientTable clientTable;
 };
 
 } // namespace dsnet::unreplicated
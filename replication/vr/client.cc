@@ -29,6 +29,7 @@
  **********************************************************************/
 
 #include "common/client.h"
+#include "common/clienttable.h"
 #include "common/request.pb.h"
 #include "common/pbmessage.h"
 #include "lib/assert.h"
@@ -42,16 +43,17 @@ namespace vr {
 VRClient::VRClient(const Configuration &config,
                    const ReplicaAddress &addr,
                    Transport *transport,
-                   uint64_t clientid)
-    : Client(config, addr, transport, clientid)
+                   uint64_t clientid,
+                   unsigned int maxPending)
+    : Client(config, addr, transport, clientid), maxPending(maxPending)
 {
-    pendingRequest = NULL;
+    // Replicas only tell apart requests within their client table
+    // window
+    ASSERT(maxPending >= 1 && maxPending <= ClientTable::WINDOW);
     pendingUnloggedRequest = NULL;
     lastReqId = 0;
+    view = 0;
 
-    requestTimeout = new Timeout(transport, 7000, [this]() {
-            ResendRequest();
-        });
     unloggedRequestTimeout = new Timeout(transport, 1000, [this]() {
             UnloggedRequestTimeoutCallback();
         });
@@ -59,13 +61,12 @@ VRClient::VRClient(const Configuration &config,
 
 VRClient::~VRClient()
 {
-    if (pendingRequest) {
-        delete pendingRequest;
+    for (auto &kv : pendingRequests) {
+        delete kv.second;
     }
     if (pendingUnloggedRequest) {
         delete pendingUnloggedRequest;
     }
-    delete requestTimeout;
     delete unloggedRequestTimeout;
 }
 
@@ -73,16 +74,19 @@ void
 VRClient::Invoke(const string &request,
                  continuation_t continuation)
 {
-    // XXX Can only handle one pending request for now
-    if (pendingRequest != NULL) {
-        Panic("Client only supports one pending request");
+    if (pendingRequests.size() >= maxPending) {
+        Panic("Client only supports %u pending requests", maxPending);
     }
 
     ++lastReqId;
     uint64_t reqId = lastReqId;
-    pendingRequest = new PendingRequest(request, reqId, continuation);
+    PendingRequest *req = new PendingRequest(request, reqId, continuation);
+    req->timeout.reset(new Timeout(transport, 7000, [this, reqId]() {
+            ResendRequest(reqId);
+        }));
+    pendingRequests[reqId] = req;
 
-    SendRequest();
+    SendRequest(req);
 }
 
 void
@@ -91,6 +95,28 @@ VRClient::InvokeUnlogged(int replicaIdx,
                          continuation_t continuation,
                          timeout_continuation_t timeoutContinuation,
                          uint32_t timeout)
+{
+    SendUnlogged(replicaIdx, request, continuation, timeoutContinuation,
+                 timeout, false);
+}
+
+void
+VRClient::InvokeRead(const string &request, continuation_t continuation)
+{
+    // Ask the leader, as far as we know, to read under its lease. If
+    // it does not answer, order the read instead.
+    SendUnlogged(config.GetLeaderIndex(view), request, continuation,
+                 [this, continuation](const string &request) {
+                     Invoke(request, continuation);
+                 },
+                 DEFAULT_UNLOGGED_OP_TIMEOUT, true);
+}
+
+void
+VRClient::SendUnlogged(int replicaIdx, const string &request,
+                       continuation_t continuation,
+                       timeout_continuation_t timeoutContinuation,
+                       uint32_t timeout, bool leaseRead)
 {
     // XXX Can only handle one pending request for now
     if (pendingUnloggedRequest != NULL) {
@@ -108,6 +134,9 @@ VRClient::InvokeUnlogged(int replicaIdx,
     reqMsg->mutable_req()->set_op(pendingUnloggedRequest->request);
     reqMsg->mutable_req()->set_clientid(clientid);
     reqMsg->mutable_req()->set_clientreqid(pendingUnloggedRequest->clientReqId);
+    if (leaseRead) {
+        reqMsg->mutable_req()->set_leaseread(true);
+    }
 
     ASSERT(!unloggedRequestTimeout->Active());
     unloggedRequestTimeout->SetTimeout(timeout);
@@ -119,40 +148,52 @@ VRClient::InvokeUnlogged(int replicaIdx,
 void
 VRClient::InvokeAsync(const string &request)
 {
-    if (pendingRequest != NULL) {
-        Panic("Client only supports one pending request");
-    }
-
     ++lastReqId;
     proto::ToReplicaMessage m;
     proto::RequestMessage *reqMsg = m.mutable_request();
     reqMsg->mutable_req()->set_op(request);
     reqMsg->mutable_req()->set_clientid(this->clientid);
     reqMsg->mutable_req()->set_clientreqid(this->lastReqId);
+    reqMsg->mutable_req()->set_ackedreqid(AckedReqId());
 
     transport->SendMessageToAll(this, PBMessage(m));
 }
 
+// Every request before the oldest pending one has been answered
+uint64_t
+VRClient::AckedReqId() const
+{
+    if (pendingRequests.empty()) {
+        return lastReqId - 1;
+    }
+    return pendingRequests.begin()->first - 1;
+}
+
 void
-VRClient::SendRequest()
+VRClient::SendRequest(const PendingRequest *req)
 {
     proto::ToReplicaMessage m;
     proto::RequestMessage *reqMsg = m.mutable_request();
-    reqMsg->mutable_req()->set_op(pendingRequest->request);
+    reqMsg->mutable_req()->set_op(req->request);
     reqMsg->mutable_req()->set_clientid(clientid);
-    reqMsg->mutable_req()->set_clientreqid(pendingRequest->clientReqId);
+    reqMsg->mutable_req()->set_clientreqid(req->clientReqId);
+    reqMsg->mutable_req()->set_ackedreqid(AckedReqId());
 
     // XXX Try sending only to (what we think is) the leader first
     transport->SendMessageToAll(this, PBMessage(m));
 
-    requestTimeout->Reset();
+    req->timeout->Reset();
 }
 
 void
-VRClient::ResendRequest()
+VRClient::ResendRequest(uint64_t clientReqId)
 {
-    Warning("Client timeout; resending request");
-    SendRequest();
+    auto it = pendingRequests.find(clientReqId);
+    if (it == pendingRequests.end()) {
+        return;
+    }
+    Warning("Client timeout; resending request %lu", clientReqId);
+    SendRequest(it->second);
 }
 
 
@@ -181,21 +222,20 @@ void
 VRClient::HandleReply(const TransportAddress &remote,
                       const proto::ReplyMessage &msg)
 {
-    if (pendingRequest == NULL) {
-        Debug("Received reply when no request was pending");
-        return;
-    }
-    if (msg.clientreqid() != pendingRequest->clientReqId) {
-        Debug("Received reply for a different request");
+    auto it = pendingRequests.find(msg.clientreqid());
+    if (it == pendingRequests.end()) {
+        Debug("Received reply for a request that is not pending");
         return;
     }
 
     Debug("Client received reply");
+    if ((int)msg.view() > view) {
+        view = msg.view();
+    }
 
-    requestTimeout->Stop();
-
-    PendingRequest *req = pendingRequest;
-    pendingRequest = NULL;
+    PendingRequest *req = it->second;
+    pendingRequests.erase(it);
+    req->timeout->Stop();
 
     req->continuation(req->request, msg.reply());
     delete req;
@@ -209,6 +249,11 @@ VRClient::HandleUnloggedReply(const TransportAddress &remote,
         Warning("Received unloggedReply when no request was pending");
         return;
     }
+    if (msg.has_clientreqid() &&
+        msg.clientreqid() != pendingUnloggedRequest->clientReqId) {
+        // Answer to a request that timed out
+        return;
+    }
 
     Debug("Client received unloggedReply");
 
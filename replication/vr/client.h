@@ -36,6 +36,9 @@
 #include "lib/configuration.h"
 #include "replication/vr/vr-proto.pb.h"
 
+#include <map>
+#include <memory>
+
 namespace dsnet {
 namespace vr {
 
@@ -45,7 +48,8 @@ public:
     VRClient(const Configuration &config,
              const ReplicaAddress &addr,
              Transport *transport,
-             uint64_t clientid = 0);
+             uint64_t clientid = 0,
+             unsigned int maxPending = 1);
     virtual ~VRClient();
     virtual void Invoke(const string &request,
                         continuation_t continuation) override;
@@ -54,6 +58,8 @@ public:
                                 continuation_t continuation,
                                 timeout_continuation_t timeoutContinuation = nullptr,
                                 uint32_t timeout = DEFAULT_UNLOGGED_OP_TIMEOUT) override;
+    virtual void InvokeRead(const string &request,
+                            continuation_t continuation) override;
     virtual void InvokeAsync(const string &request) override;
     virtual void ReceiveMessage(const TransportAddress &remote,
                                 void *buf, size_t size) override;
@@ -69,18 +75,26 @@ protected:
         uint64_t clientReqId;
         continuation_t continuation;
         timeout_continuation_t timeoutContinuation;
+        std::unique_ptr<Timeout> timeout;
         inline PendingRequest(string request, uint64_t clientReqId,
                               continuation_t continuation)
             : request(request), clientReqId(clientReqId),
               continuation(continuation) { }
     };
-    PendingRequest *pendingRequest;
+    // Requests awaiting replies, by clientReqId, each resent on its
+    // own timeout. At most maxPending at once.
+    std::map<uint64_t, PendingRequest *> pendingRequests;
+    unsigned int maxPending;
     PendingRequest *pendingUnloggedRequest;
-    Timeout *requestTimeout;
     Timeout *unloggedRequestTimeout;
 
-    void SendRequest();
-    void ResendRequest();
+    void SendUnlogged(int replicaIdx, const string &request,
+                      continuation_t continuation,
+                      timeout_continuation_t timeoutContinuation,
+                      uint32_t timeout, bool leaseRead);
+    uint64_t AckedReqId() const;
+    void SendRequest(const PendingRequest *req);
+    void ResendRequest(uint64_t clientReqId);
     void HandleReply(const TransportAddress &remote,
                      const proto::ReplyMessage &msg);
     void HandleUnloggedReply(const TransportAddress &remote,
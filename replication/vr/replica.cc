@@ -54,10 +54,13 @@ using namespace proto;
 VRReplica::VRReplica(Configuration config, int myIdx,
                      bool initialize,
                      Transport *transport, int batchSize,
-                     AppReplica *app)
+                     AppReplica *app, opnum_t checkpointInterval)
     : Replica(config, 0, myIdx, initialize, transport, app),
       batchSize(batchSize),
       log(false),
+      checkpointInterval(checkpointInterval),
+      lease(transport, config.QuorumSize()),
+      leasePromise(transport),
       prepareOKQuorum(config.QuorumSize()-1),
       startViewChangeQuorum(config.QuorumSize()-1),
       doViewChangeQuorum(config.QuorumSize()-1),
@@ -97,6 +100,10 @@ VRReplica::VRReplica(Configuration config, int myIdx,
     this->recoveryTimeout = new Timeout(transport, 5000, [this]() {
             SendRecoveryMessages();
         });
+    this->leaseTimeout = new Timeout(transport, Lease::DEFAULT_RENEW_INTERVAL,
+                                     [this]() {
+            RenewLease();
+        });
 
     _Latency_Init(&requestLatency, "request");
     _Latency_Init(&executeAndReplyLatency, "executeAndReply");
@@ -108,6 +115,8 @@ VRReplica::VRReplica(Configuration config, int myIdx,
             viewChangeTimeout->Start();
         }
     } else {
+        // We may have promised a lease before restarting
+        leasePromise.Grant();
         this->status = STATUS_RECOVERING;
         this->recoveryNonce = GenerateNonce();
         SendRecoveryMessages();
@@ -126,6 +135,7 @@ VRReplica::~VRReplica()
     delete resendPrepareTimeout;
     delete closeBatchTimeout;
     delete recoveryTimeout;
+    delete leaseTimeout;
 
     for (auto &kv : pendingPrepares) {
         delete kv.first;
@@ -177,27 +187,103 @@ VRReplica::CommitUpTo(opnum_t upto)
         log.SetStatus(lastCommitted, LOG_STATE_COMMITTED);
 
         // Store reply in the client table
-        ClientTableEntry &cte =
+        ClientTable::Entry &cte =
             clientTable[entry->request.clientid()];
-        if (cte.lastReqId <= entry->request.clientreqid()) {
-            cte.lastReqId = entry->request.clientreqid();
-            cte.replied = true;
-            cte.reply = m;
-        } else {
-            // We've subsequently prepared another operation from the
-            // same client. So this request must have been completed
-            // at the client, and there's no need to record the
-            // result.
-        }
+        cte.SetReply(entry->request.clientreqid(), m);
 
         /* Send reply */
-        auto iter = clientAddresses.find(entry->request.clientid());
-        if (iter != clientAddresses.end()) {
-            transport->SendMessage(this, *iter->second, PBMessage(m));
+        if (cte.address != nullptr) {
+            transport->SendMessage(this, *cte.address, PBMessage(m));
+        }
+
+        if (checkpointInterval > 0 &&
+            lastCommitted - checkpoint.opnum() >= checkpointInterval) {
+            TakeCheckpoint();
         }
 
         Latency_End(&executeAndReplyLatency);
     }
+
+    if (!pendingReads.empty()) {
+        ProcessPendingReads();
+    }
+}
+
+void
+VRReplica::TakeCheckpoint()
+{
+    Checkpoint cp;
+    if (!Snapshot(*cp.mutable_state())) {
+        RNotice("Application does not support snapshots; "
+                "keeping the whole log");
+        checkpointInterval = 0;
+        return;
+    }
+
+    const LogEntry *entry = log.Find(lastCommitted);
+    ASSERT(entry != NULL);
+    cp.set_view(entry->viewstamp.view);
+    cp.set_opnum(lastCommitted);
+    cp.set_sessnum(entry->viewstamp.sessnum);
+    cp.set_msgnum(entry->viewstamp.msgnum);
+    cp.set_hash(entry->hash);
+    for (const ClientTable::Entry &cte : clientTable) {
+        CheckpointClient *client = cp.add_clients();
+        client->set_clientid(cte.clientId);
+        client->set_clientreqid(cte.lastReqId);
+        client->set_seen(cte.seen);
+        if (cte.replied) {
+            client->set_reply(cte.reply);
+        }
+    }
+
+    RDebug("Took checkpoint at " FMT_OPNUM, lastCommitted);
+
+    // Keep the entries since the previous checkpoint, so that replicas
+    // only a little behind can still catch up from the log
+    log.TruncateBefore(checkpoint.opnum()+1);
+    checkpoint = std::move(cp);
+}
+
+void
+VRReplica::InstallCheckpoint(const Checkpoint &cp)
+{
+    if (cp.opnum() <= lastCommitted) {
+        return;
+    }
+
+    RNotice("Installing checkpoint at " FMT_OPNUM, cp.opnum());
+
+    Restore(cp.state());
+    clientTable.Clear();
+    for (const CheckpointClient &client : cp.clients()) {
+        ClientTable::Entry &cte = clientTable[client.clientid()];
+        cte.lastReqId = client.clientreqid();
+        cte.seen = client.seen();
+        cte.replied = client.has_reply();
+        cte.reply = client.reply();
+    }
+
+    // Everything in our log up to the checkpoint is superseded by it,
+    // and whatever follows is resent along with it
+    log.Reset(viewstamp_t(cp.view(), cp.opnum(), cp.sessnum(), cp.msgnum()),
+              cp.hash());
+    lastCommitted = cp.opnum();
+    lastOp = cp.opnum();
+    checkpoint = cp;
+}
+
+// Dump the log from opnum from into msg, substituting our checkpoint
+// for the entries that have been truncated
+template <class MSG>
+void
+VRReplica::DumpLog(opnum_t from, MSG *msg)
+{
+    if (from < log.FirstOpnum() && checkpoint.opnum() > 0) {
+        *msg->mutable_checkpoint() = checkpoint;
+        from = checkpoint.opnum()+1;
+    }
+    log.Dump(from, msg->mutable_entries());
 }
 
 void
@@ -285,6 +371,7 @@ VRReplica::EnterView(view_t newview)
     batchComplete = true;
 
     recoveryTimeout->Stop();
+    DropLease();
 
     if (AmLeader()) {
         viewChangeTimeout->Stop();
@@ -314,6 +401,7 @@ VRReplica::StartViewChange(view_t newview)
     nullCommitTimeout->Stop();
     resendPrepareTimeout->Stop();
     closeBatchTimeout->Stop();
+    DropLease();
 
     ToReplicaMessage m;
     StartViewChangeMessage *svc = m.mutable_start_view_change();
@@ -344,17 +432,8 @@ VRReplica::SendNullCommit()
 void
 VRReplica::UpdateClientTable(const Request &req)
 {
-    ClientTableEntry &entry = clientTable[req.clientid()];
-
-    ASSERT(entry.lastReqId <= req.clientreqid());
-
-    if (entry.lastReqId == req.clientreqid()) {
-        return;
-    }
-
-    entry.lastReqId = req.clientreqid();
-    entry.replied = false;
-    entry.reply.Clear();
+    // Requests from a pipelining client may be logged out of order
+    clientTable[req.clientid()].Accept(req.clientreqid(), req.ackedreqid());
 }
 
 void
@@ -407,12 +486,70 @@ VRReplica::CloseBatch()
     closeBatchTimeout->Stop();
 }
 
+void
+VRReplica::RenewLease()
+{
+    if (!AmLeader() || status != STATUS_NORMAL ||
+        (pendingReads.empty() && !lease.Wanted())) {
+        // Nobody has been reading; let the lease lapse
+        leaseTimeout->Stop();
+        return;
+    }
+
+    // A commit doubles as the renewal, and as a heartbeat
+    ToReplicaMessage m;
+    CommitMessage *c = m.mutable_commit();
+    c->set_view(this->view);
+    c->set_opnum(this->lastCommitted);
+    c->set_leaseround(lease.StartRound());
+
+    if (!(transport->SendMessageToAll(this, PBMessage(m)))) {
+        RWarning("Failed to send lease renewal to all replicas");
+    }
+    nullCommitTimeout->Reset();
+    if (!leaseTimeout->Active()) {
+        leaseTimeout->Start();
+    }
+    ProcessPendingReads();
+}
+
+void
+VRReplica::DropLease()
+{
+    // Readers still waiting time out and order their reads instead
+    lease.Revoke();
+    leaseTimeout->Stop();
+    pendingReads.clear();
+}
+
+void
+VRReplica::ProcessPendingReads()
+{
+    if (!lease.Valid()) {
+        return;
+    }
+
+    while (!pendingReads.empty() &&
+           pendingReads.front().opnum <= lastCommitted) {
+        PendingRead &read = pendingReads.front();
+        ToClientMessage m;
+        UnloggedReplyMessage *reply = m.mutable_unlogged_reply();
+        ExecuteUnlogged(read.req, *reply);
+        reply->set_clientreqid(read.req.clientreqid());
+        if (!(transport->SendMessage(this, *read.remote, PBMessage(m)))) {
+            RWarning("Failed to send lease read reply");
+        }
+        pendingReads.pop_front();
+    }
+}
+
 void
 VRReplica::ReceiveMessage(const TransportAddress &remote,
                           void *buf, size_t size)
 {
-    static ToReplicaMessage replica_msg;
-    static PBMessage m(replica_msg);
+    static PBArena<ToReplicaMessage> arena;
+    ToReplicaMessage &replica_msg = arena.New();
+    PBMessage m(replica_msg);
 
     m.Parse(buf, size);
 
@@ -454,6 +591,9 @@ VRReplica::ReceiveMessage(const TransportAddress &remote,
         case ToReplicaMessage::MsgCase::kRecoveryResponse:
             HandleRecoveryResponse(remote, replica_msg.recovery_response());
             break;
+        case ToReplicaMessage::MsgCase::kLeaseReply:
+            HandleLeaseReply(remote, replica_msg.lease_reply());
+            break;
         default:
             RPanic("Received unexpected message type %u",
                     replica_msg.msg_case());
@@ -479,51 +619,35 @@ VRReplica::HandleRequest(const TransportAddress &remote,
         return;
     }
 
-    // Save the client's address
-    clientAddresses.erase(msg.req().clientid());
-    clientAddresses.insert(
-        std::pair<uint64_t, std::unique_ptr<TransportAddress> >(
-            msg.req().clientid(),
-            std::unique_ptr<TransportAddress>(remote.clone())));
-
-    // Check the client table to see if this is a duplicate request
-    auto kv = clientTable.find(msg.req().clientid());
-    if (kv != clientTable.end()) {
-        ClientTableEntry &entry = kv->second;
-        if (msg.req().clientreqid() < entry.lastReqId) {
-            RNotice("Ignoring stale request");
-            Latency_EndType(&requestLatency, 's');
-            return;
-        }
-        if (msg.req().clientreqid() == entry.lastReqId) {
-            // This is a duplicate request. Resend the reply if we
-            // have one. We might not have a reply to resend if we're
-            // waiting for the other replicas; in that case, just
-            // discard the request.
-            if (entry.replied) {
-                RNotice("Received duplicate request; resending reply");
-                if (!(transport->SendMessage(this, remote,
-                                             PBMessage(entry.reply)))) {
-                    RWarning("Failed to resend reply to client");
-                }
-                Latency_EndType(&requestLatency, 'r');
-                return;
-            } else {
-                RNotice("Received duplicate request but no reply available; ignoring");
-                Latency_EndType(&requestLatency, 'd');
-                return;
+    // Save the client's address, and check the client table to see
+    // if this is a duplicate request
+    ClientTable::Entry &entry = clientTable[msg.req().clientid()];
+    entry.address.reset(remote.clone());
+    if (!entry.Accept(msg.req().clientreqid(), msg.req().ackedreqid())) {
+        // This is a duplicate or stale request. Resend the reply
+        // if we have one. We might not have a reply to resend if
+        // we're waiting for the other replicas, or if the request
+        // is too old; in that case, just discard the request.
+        const string *reply = entry.Reply(msg.req().clientreqid());
+        if (reply != NULL) {
+            RNotice("Received duplicate request; resending reply");
+            if (!(transport->SendMessage(this, remote,
+                                         SerializedMessage(*reply)))) {
+                RWarning("Failed to resend reply to client");
             }
+            Latency_EndType(&requestLatency, 'r');
+        } else {
+            RNotice("Received duplicate request but no reply available; ignoring");
+            Latency_EndType(&requestLatency, 'd');
         }
+        return;
     }
 
-    // Update the client table
-    UpdateClientTable(msg.req());
-
     // Leader Upcall
     bool replicate = false;
     string res;
     LeaderUpcall(lastCommitted, msg.req().op(), replicate, res);
-    ClientTableEntry &cte =
+    ClientTable::Entry &cte =
         clientTable[msg.req().clientid()];
 
     // Check whether this request should be committed to replicas
@@ -536,8 +660,7 @@ VRReplica::HandleRequest(const TransportAddress &remote,
         reply->set_view(0);
         reply->set_opnum(0);
         reply->set_clientreqid(msg.req().clientreqid());
-        cte.replied = true;
-        cte.reply = m;
+        cte.SetReply(msg.req().clientreqid(), m);
         transport->SendMessage(this, remote, PBMessage(m));
         Latency_EndType(&requestLatency, 'f');
     } else {
@@ -545,6 +668,7 @@ VRReplica::HandleRequest(const TransportAddress &remote,
         request.set_op(res);
         request.set_clientid(msg.req().clientid());
         request.set_clientreqid(msg.req().clientreqid());
+        request.set_ackedreqid(msg.req().ackedreqid());
 
         /* Assign it an opnum */
         ++this->lastOp;
@@ -575,6 +699,11 @@ void
 VRReplica::HandleUnloggedRequest(const TransportAddress &remote,
                                  const UnloggedRequestMessage &msg)
 {
+    if (msg.req().leaseread()) {
+        HandleLeaseRead(remote, msg.req());
+        return;
+    }
+
     if (status != STATUS_NORMAL) {
         // Not clear if we should ignore this or just let the request
         // go ahead, but this seems reasonable.
@@ -588,11 +717,37 @@ VRReplica::HandleUnloggedRequest(const TransportAddress &remote,
     Debug("Received unlogged request %s", (char *)msg.req().op().c_str());
 
     ExecuteUnlogged(msg.req(), *reply);
+    reply->set_clientreqid(msg.req().clientreqid());
 
     if (!(transport->SendMessage(this, remote, PBMessage(m))))
         Warning("Failed to send reply message");
 }
 
+void
+VRReplica::HandleLeaseRead(const TransportAddress &remote,
+                           const UnloggedRequest &req)
+{
+    if (status != STATUS_NORMAL || !AmLeader()) {
+        // The client will time out and order the read instead
+        RDebug("Ignoring lease read; not the leader");
+        return;
+    }
+
+    // The read has to see every operation that might have completed
+    // before it arrived, so it waits for whatever is logged to commit
+    lease.Use();
+    pendingReads.push_back(PendingRead());
+    pendingReads.back().remote.reset(remote.clone());
+    pendingReads.back().req = req;
+    pendingReads.back().opnum = lastOp;
+
+    if (!leaseTimeout->Active()) {
+        RenewLease();
+    } else {
+        ProcessPendingReads();
+    }
+}
+
 void
 VRReplica::HandlePrepare(const TransportAddress &remote,
                          const PrepareMessage &msg)
@@ -703,9 +858,9 @@ VRReplica::HandlePrepareOK(const TransportAddress &remote,
         return;
     }
 
-    viewstamp_t vs = { msg.view(), msg.opnum() };
-    if (auto msgs =
-        (prepareOKQuorum.AddAndCheckForQuorum(vs, msg.replicaidx(), msg))) {
+    // Only PrepareOKs for this view get here, and the quorum is cleared
+    // on view change, so it can be keyed by opnum alone
+    if (prepareOKQuorum.AddAndCheckForQuorum(msg.opnum(), msg.replicaidx())) {
         /*
          * We have a quorum of PrepareOK messages for this
          * opnumber. Execute it and all previous operations.
@@ -715,9 +870,13 @@ VRReplica::HandlePrepareOK(const TransportAddress &remote,
          *
          * This also notifies the client of the result.
          */
+        int count = prepareOKQuorum.Count(msg.opnum());
         CommitUpTo(msg.opnum());
 
-        if (msgs->size() >= (unsigned int)configuration.QuorumSize()) {
+        // Late PrepareOKs for committed operations can be dropped
+        prepareOKQuorum.Advance(this->lastCommitted+1);
+
+        if (count > prepareOKQuorum.NumRequired()) {
             return;
         }
 
@@ -775,6 +934,19 @@ VRReplica::HandleCommit(const TransportAddress &remote,
 
     viewChangeTimeout->Reset();
 
+    if (msg.has_leaseround()) {
+        // Promise not to help elect another leader for a while
+        leasePromise.Grant();
+        ToReplicaMessage m;
+        LeaseReplyMessage *reply = m.mutable_lease_reply();
+        reply->set_view(this->view);
+        reply->set_leaseround(msg.leaseround());
+        reply->set_replicaidx(this->replicaIdx);
+        if (!(transport->SendMessage(this, remote, PBMessage(m)))) {
+            RWarning("Failed to send LeaseReply message");
+        }
+    }
+
     if (msg.opnum() <= this->lastCommitted) {
         RDebug("Ignoring COMMIT; already committed that operation");
         return;
@@ -815,7 +987,7 @@ VRReplica::HandleRequestStateTransfer(const TransportAddress &remote,
     reply->set_view(view);
     reply->set_opnum(lastCommitted);
 
-    log.Dump(msg.opnum()+1, reply->mutable_entries());
+    DumpLog(msg.opnum()+1, reply);
 
     transport->SendMessage(this, remote, PBMessage(m));
 }
@@ -831,6 +1003,10 @@ VRReplica::HandleStateTransfer(const TransportAddress &remote,
         return;
     }
 
+    if (msg.has_checkpoint()) {
+        InstallCheckpoint(msg.checkpoint());
+    }
+
     opnum_t oldLastOp = lastOp;
 
     /* Install the new log entries */
@@ -839,9 +1015,11 @@ VRReplica::HandleStateTransfer(const TransportAddress &remote,
             // Already committed this operation; nothing to be done.
 #if PARANOID
             const LogEntry *entry = log.Find(newEntry.opnum());
-            ASSERT(entry->viewstamp.opnum == newEntry.opnum());
-            ASSERT(entry->viewstamp.view == newEntry.view());
-//          ASSERT(entry->request == newEntry.request());
+            if (entry != NULL) {
+                ASSERT(entry->viewstamp.opnum == newEntry.opnum());
+                ASSERT(entry->viewstamp.view == newEntry.view());
+//              ASSERT(entry->request == newEntry.request());
+            }
 #endif
         } else if (newEntry.opnum() <= lastOp) {
             // We already have an entry with this opnum, but maybe
@@ -915,6 +1093,12 @@ VRReplica::HandleStartViewChange(const TransportAddress &remote,
         return;
     }
 
+    if (status == STATUS_NORMAL && leasePromise.Held()) {
+        // The sender will try again once the promise runs out
+        RDebug("Ignoring STARTVIEWCHANGE; lease promised to the leader");
+        return;
+    }
+
     if ((status != STATUS_VIEW_CHANGE) || (msg.view() > view)) {
         RWarning("Received StartViewChange for view " FMT_VIEW
                  "from replica %d", msg.view(), msg.replicaidx());
@@ -947,8 +1131,7 @@ VRReplica::HandleStartViewChange(const TransportAddress &remote,
                 })->second.lastcommitted();
             minCommitted = std::min(minCommitted, lastCommitted);
 
-            log.Dump(minCommitted,
-                     dvc->mutable_entries());
+            DumpLog(minCommitted, dvc);
 
             if (!(transport->SendMessageToReplica(this, leader, PBMessage(m)))) {
                 RWarning("Failed to send DoViewChange message to leader of new view");
@@ -977,6 +1160,11 @@ VRReplica::HandleDoViewChange(const TransportAddress &remote,
         return;
     }
 
+    if (status == STATUS_NORMAL && leasePromise.Held()) {
+        RDebug("Ignoring DOVIEWCHANGE; lease promised to the leader");
+        return;
+    }
+
     if ((status != STATUS_VIEW_CHANGE) || (msg.view() > view)) {
         // It's superfluous to send the StartViewChange messages here,
         // but harmless...
@@ -1013,6 +1201,9 @@ VRReplica::HandleDoViewChange(const TransportAddress &remote,
         if (latestMsg != NULL) {
             RDebug("Selected log from replica %d with lastop=" FMT_OPNUM,
                    latestMsg->replicaidx(), latestMsg->lastop());
+            if (latestMsg->has_checkpoint()) {
+                InstallCheckpoint(latestMsg->checkpoint());
+            }
             if (latestMsg->entries_size() == 0) {
                 // There weren't actually any entries in the
                 // log. That should only happen in the corner case
@@ -1072,7 +1263,7 @@ VRReplica::HandleDoViewChange(const TransportAddress &remote,
         sv->set_lastop(lastOp);
         sv->set_lastcommitted(lastCommitted);
 
-        log.Dump(minCommitted, sv->mutable_entries());
+        DumpLog(minCommitted, sv);
 
         if (!(transport->SendMessageToAll(this, PBMessage(m)))) {
             RWarning("Failed to send StartView message to all replicas");
@@ -1102,6 +1293,10 @@ VRReplica::HandleStartView(const TransportAddress &remote,
 
     ASSERT(configuration.GetLeaderIndex(msg.view()) != this->replicaIdx);
 
+    if (msg.has_checkpoint()) {
+        InstallCheckpoint(msg.checkpoint());
+    }
+
     if (msg.entries_size() == 0) {
         ASSERT(msg.lastcommitted() == lastCommitted);
         ASSERT(msg.lastop() == msg.lastcommitted());
@@ -1146,7 +1341,7 @@ VRReplica::HandleRecovery(const TransportAddress &remote,
     if (AmLeader()) {
         reply->set_lastcommitted(lastCommitted);
         reply->set_lastop(lastOp);
-        log.Dump(0, reply->mutable_entries());
+        DumpLog(0, reply);
     }
 
     if (!(transport->SendMessage(this, remote, PBMessage(m)))) {
@@ -1195,6 +1390,9 @@ VRReplica::HandleRecoveryResponse(const TransportAddress &remote,
 
         Notice("Recovery completed");
 
+        if (leaderResponse->second.has_checkpoint()) {
+            InstallCheckpoint(leaderResponse->second.checkpoint());
+        }
         log.Install(leaderResponse->second.entries().begin(),
                     leaderResponse->second.entries().end());
         EnterView(leaderResponse->second.view());
@@ -1203,5 +1401,18 @@ VRReplica::HandleRecoveryResponse(const TransportAddress &remote,
     }
 }
 
+void
+VRReplica::HandleLeaseReply(const TransportAddress &remote,
+                            const LeaseReplyMessage &msg)
+{
+    if (msg.view() != view || status != STATUS_NORMAL || !AmLeader()) {
+        RDebug("Ignoring LEASEREPLY for view " FMT_VIEW, msg.view());
+        return;
+    }
+
+    lease.Ack(msg.leaseround(), msg.replicaidx());
+    ProcessPendingReads();
+}
+
 } // namespace dsnet::vr
 } // namespace dsnet
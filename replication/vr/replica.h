@@ -33,6 +33,8 @@
 
 #include "lib/configuration.h"
 #include "lib/latency.h"
+#include "common/clienttable.h"
+#include "common/lease.h"
 #include "common/log.h"
 #include "common/replica.h"
 #include "common/quorumset.h"
@@ -50,7 +52,8 @@ class VRReplica : public Replica
 public:
     VRReplica(Configuration config, int myIdx, bool initialize,
               Transport *transport, int batchSize,
-              AppReplica *app);
+              AppReplica *app,
+              opnum_t checkpointInterval = DEFAULT_CHECKPOINT_INTERVAL);
     ~VRReplica();
 
     void ReceiveMessage(const TransportAddress &remote,
@@ -71,16 +74,26 @@ private:
     bool batchComplete;
 
     Log log;
-    std::map<uint64_t, std::unique_ptr<TransportAddress> > clientAddresses;
-    struct ClientTableEntry
+    opnum_t checkpointInterval;
+    // Latest checkpoint; the log goes back to the one before it
+    Checkpoint checkpoint;
+    // Replies are serialized ToClientMessages
+    ClientTable clientTable;
+
+    // Read lease, held by the leader and promised by the others
+    Lease lease;
+    LeasePromise leasePromise;
+    // Lease reads waiting for the lease, or for the operations logged
+    // before they arrived to commit
+    struct PendingRead
     {
-        uint64_t lastReqId;
-        bool replied;
-        proto::ToClientMessage reply;
+        std::unique_ptr<TransportAddress> remote;
+        UnloggedRequest req;
+        opnum_t opnum;
     };
-    std::map<uint64_t, ClientTableEntry> clientTable;
+    std::list<PendingRead> pendingReads;
 
-    QuorumSet<viewstamp_t, proto::PrepareOKMessage> prepareOKQuorum;
+    WindowedQuorumSet<proto::PrepareOKMessage> prepareOKQuorum;
     QuorumSet<view_t, proto::StartViewChangeMessage> startViewChangeQuorum;
     QuorumSet<view_t, proto::DoViewChangeMessage> doViewChangeQuorum;
     QuorumSet<uint64_t, proto::RecoveryResponseMessage> recoveryResponseQuorum;
@@ -91,6 +104,7 @@ private:
     Timeout *resendPrepareTimeout;
     Timeout *closeBatchTimeout;
     Timeout *recoveryTimeout;
+    Timeout *leaseTimeout;
 
     Latency_t requestLatency;
     Latency_t executeAndReplyLatency;
@@ -98,6 +112,9 @@ private:
     uint64_t GenerateNonce() const;
     bool AmLeader() const;
     void CommitUpTo(opnum_t upto);
+    void TakeCheckpoint();
+    void InstallCheckpoint(const Checkpoint &cp);
+    template <class MSG> void DumpLog(opnum_t from, MSG *msg);
     void SendPrepareOKs(opnum_t oldLastOp);
     void SendRecoveryMessages();
     void RequestStateTransfer();
@@ -107,11 +124,16 @@ private:
     void UpdateClientTable(const Request &req);
     void ResendPrepare();
     void CloseBatch();
+    void RenewLease();
+    void DropLease();
+    void ProcessPendingReads();
 
     void HandleRequest(const TransportAddress &remote,
                        const proto::RequestMessage &msg);
     void HandleUnloggedRequest(const TransportAddress &remote,
                                const proto::UnloggedRequestMessage &msg);
+    void HandleLeaseRead(const TransportAddress &remote,
+                         const UnloggedRequest &req);
 
     void HandlePrepare(const TransportAddress &remote,
                        const proto::PrepareMessage &msg);
@@ -133,6 +155,8 @@ private:
                         const proto::RecoveryMessage &msg);
     void HandleRecoveryResponse(const TransportAddress &remote,
                                 const proto::RecoveryResponseMessage &msg);
+    void HandleLeaseReply(const TransportAddress &remote,
+                          const proto::LeaseReplyMessage &msg);
 };
 
 } // namespace dsnet::vr
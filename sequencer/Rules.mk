@@ -3,9 +3,16 @@ d := $(dir $(lastword $(MAKEFILE_LIST)))
 SRCS += $(addprefix $(d), \
 	sequencer.cc sequencer_main.cc)
 
+# The Eris sequencer needs nothing else from transaction/, so it is
+# built from here, for the -m eris mode, whether or not transaction/ is
+# part of the build; transaction/eris/Rules.mk leaves it out
+SRCS += transaction/eris/sequencer.cc
+OBJS-eris-sequencer := .obj/transaction/eris/sequencer.o
+
 OBJS-sequencer := $(o)sequencer.o $(LIB-message) $(LIB-configuration)
 
 $(d)sequencer: $(o)sequencer_main.o $(OBJS-sequencer) $(LIB-udptransport) \
+		$(LIB-iouringtransport) $(LIB-shmtransport) \
 		$(OBJS-nopaxos-sequencer) $(OBJS-eris-sequencer)
 
 BINS += $(d)sequencer
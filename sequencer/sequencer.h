@@ -33,6 +33,9 @@ public:
     Sequencer(const Configuration &config, Transport *transport, int id);
     virtual ~Sequencer();
 
+    // Log the stamping counters
+    virtual void PrintStats() const { }
+
 protected:
     const Configuration &config_;
     Transport *transport_;
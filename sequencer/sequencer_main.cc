@@ -1,39 +1,134 @@
 #include <cstring>
 #include <fstream>
 
+#include "lib/iouringtransport.h"
+#include "lib/shmtransport.h"
 #include "lib/udptransport.h"
 #include "replication/nopaxos/sequencer.h"
 #include "sequencer/sequencer.h"
+#include "transaction/eris/sequencer.h"
 
 static void Usage(const char *name) {
-  fprintf(stderr, "usage: %s -c conf-file -m nopaxos\n", name);
+  fprintf(stderr,
+          "usage: %s -c conf-file -m nopaxos|eris [-s sequencer-index] "
+          "[-F failover-timeout-ms] [-B io-batch-size] "
+          "[-T recv-threads [-P]] [-p udp|iouring|shm] "
+          "[-i stats-interval-ms]\n"
+          "  -P  stamp on every receive thread instead of forwarding "
+          "to one\n"
+          "  -F  (nopaxos) heartbeat the standby sequencers, or as a "
+          "standby take over\n"
+          "      when the active one is silent this long\n",
+          name);
   exit(1);
 }
 
 int main(int argc, char *argv[]) {
   const char *config_path = nullptr;
   dsnet::Sequencer *sequencer = nullptr;
+  int batch_size = 1;
+  int recv_threads = 1;
+  bool parallel = false;
+  uint64_t stats_interval = 0;
+  int index = 0;
+  uint64_t failover_timeout = 0;
   int opt;
 
   enum {
     PROTO_UNKNOWN,
     PROTO_NOPAXOS,
+    PROTO_ERIS,
   } proto = PROTO_UNKNOWN;
 
-  while ((opt = getopt(argc, argv, "c:m:")) != -1) {
+  enum {
+    TRANSPORT_UDP,
+    TRANSPORT_IOURING,
+    TRANSPORT_SHM,
+  } transport_type = TRANSPORT_UDP;
+
+  while ((opt = getopt(argc, argv, "B:c:F:i:m:Pp:s:T:")) != -1) {
     switch (opt) {
+      case 'B': {
+        char *strtol_ptr;
+        batch_size = strtoul(optarg, &strtol_ptr, 10);
+        if ((*optarg == '\0') || (*strtol_ptr != '\0') || (batch_size < 1)) {
+          fprintf(stderr, "option -B requires a numeric arg\n");
+          Usage(argv[0]);
+        }
+        break;
+      }
+
       case 'c':
         config_path = optarg;
         break;
 
+      case 'F': {
+        char *strtol_ptr;
+        failover_timeout = strtoul(optarg, &strtol_ptr, 10);
+        if ((*optarg == '\0') || (*strtol_ptr != '\0')) {
+          fprintf(stderr, "option -F requires a numeric arg\n");
+          Usage(argv[0]);
+        }
+        break;
+      }
+
+      case 'i': {
+        char *strtol_ptr;
+        stats_interval = strtoul(optarg, &strtol_ptr, 10);
+        if ((*optarg == '\0') || (*strtol_ptr != '\0')) {
+          fprintf(stderr, "option -i requires a numeric arg\n");
+          Usage(argv[0]);
+        }
+        break;
+      }
+
       case 'm':
         if (strcasecmp(optarg, "nopaxos") == 0) {
           proto = PROTO_NOPAXOS;
+        } else if (strcasecmp(optarg, "eris") == 0) {
+          proto = PROTO_ERIS;
         } else {
           Panic("Unknown sequencer mode '%s'", optarg);
         }
         break;
 
+      case 'P':
+        parallel = true;
+        break;
+
+      case 'p':
+        if (strcasecmp(optarg, "udp") == 0) {
+          transport_type = TRANSPORT_UDP;
+        } else if (strcasecmp(optarg, "iouring") == 0) {
+          transport_type = TRANSPORT_IOURING;
+        } else if (strcasecmp(optarg, "shm") == 0) {
+          transport_type = TRANSPORT_SHM;
+        } else {
+          fprintf(stderr, "unknown transport '%s'\n", optarg);
+          Usage(argv[0]);
+        }
+        break;
+
+      case 's': {
+        char *strtol_ptr;
+        index = strtoul(optarg, &strtol_ptr, 10);
+        if ((*optarg == '\0') || (*strtol_ptr != '\0')) {
+          fprintf(stderr, "option -s requires a numeric arg\n");
+          Usage(argv[0]);
+        }
+        break;
+      }
+
+      case 'T': {
+        char *strtol_ptr;
+        recv_threads = strtoul(optarg, &strtol_ptr, 10);
+        if ((*optarg == '\0') || (*strtol_ptr != '\0') || (recv_threads < 1)) {
+          fprintf(stderr, "option -T requires a numeric arg\n");
+          Usage(argv[0]);
+        }
+        break;
+      }
+
       default:
         fprintf(stderr, "Unknown argument %s\n", argv[optind]);
         break;
@@ -50,22 +145,62 @@ int main(int argc, char *argv[]) {
     Usage(argv[0]);
   }
 
+  if (failover_timeout > 0 && proto != PROTO_NOPAXOS) {
+    fprintf(stderr, "option -F requires -m nopaxos\n");
+    Usage(argv[0]);
+  }
+
+  if (parallel && transport_type != TRANSPORT_UDP) {
+    fprintf(stderr, "option -P requires the udp transport\n");
+    Usage(argv[0]);
+  }
+
   std::ifstream config_stream(config_path);
   if (config_stream.fail()) {
     Panic("unable to read configuration file: %s\n", config_path);
   }
 
   dsnet::Configuration config(config_stream);
-  dsnet::UDPTransport transport;
+  dsnet::Transport *transport = nullptr;
+  switch (transport_type) {
+    case TRANSPORT_UDP:
+      // By default receive threads forward to the single protocol
+      // thread. The sequencers can also stamp concurrently, and then
+      // each thread stamps and sends what it receives.
+      transport = new dsnet::UDPTransport(
+          0.0, 0.0, nullptr, batch_size, recv_threads,
+          parallel ? dsnet::UDPTransport::RecvDispatch::Independent
+                   : dsnet::UDPTransport::RecvDispatch::Forward);
+      break;
+    case TRANSPORT_IOURING:
+      transport = new dsnet::IOUringTransport();
+      break;
+    case TRANSPORT_SHM:
+      transport = new dsnet::ShmTransport();
+      break;
+  }
   switch (proto) {
     case PROTO_NOPAXOS:
-      sequencer = new dsnet::nopaxos::NOPaxosSequencer(config, &transport, 0);
+      // Sequencer 0 starts out active and the others as standbys
+      sequencer = new dsnet::nopaxos::NOPaxosSequencer(
+          config, transport, index, failover_timeout);
+      break;
+    case PROTO_ERIS:
+      sequencer = new dsnet::transaction::eris::ErisSequencer(config,
+                                                              transport, index);
       break;
     default:
       NOT_REACHABLE();
   }
-  transport.Run();
+  dsnet::Timeout stats_timeout(transport, stats_interval,
+                               [sequencer]() { sequencer->PrintStats(); });
+  if (stats_interval > 0) {
+    stats_timeout.Start();
+  }
+  transport->Run();
+  stats_timeout.Stop();
   delete sequencer;
+  delete transport;
 
   return 0;
 }
@@ -8,7 +8,12 @@ GTEST_SRCS += $(addprefix $(d), \
 			  configuration-test.cc \
 			  simtransport-test.cc \
 			  signature-test.cc \
-			  quorumset-test.cc)
+			  quorumset-test.cc \
+			  timerwheel-test.cc \
+			  fragmentreassembler-test.cc \
+			  log-test.cc \
+			  clienttable-test.cc \
+			  sigpipeline-test.cc)
 
 PROTOS += $(d)simtransport-testmessage.proto
 
@@ -27,3 +32,23 @@ TEST_BINS += $(d)signature-test
 $(d)quorumset-test: $(o)quorumset-test.o $(LIB-message) $(GTEST_MAIN)
 
 TEST_BINS += $(d)quorumset-test
+
+$(d)timerwheel-test: $(o)timerwheel-test.o $(LIB-transport) $(GTEST_MAIN)
+
+TEST_BINS += $(d)timerwheel-test
+
+$(d)fragmentreassembler-test: $(o)fragmentreassembler-test.o $(LIB-message) $(GTEST_MAIN)
+
+TEST_BINS += $(d)fragmentreassembler-test
+
+$(d)log-test: $(o)log-test.o $(LIB-log) $(GTEST_MAIN)
+
+TEST_BINS += $(d)log-test
+
+$(d)clienttable-test: $(o)clienttable-test.o $(LIB-clienttable) $(GTEST_MAIN)
+
+TEST_BINS += $(d)clienttable-test
+
+$(d)sigpipeline-test: $(o)sigpipeline-test.o $(LIB-sigpipeline) $(LIB-simtransport) $(GTEST_MAIN)
+
+TEST_BINS += $(d)sigpipeline-test
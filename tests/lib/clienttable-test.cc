@@ -0,0 +1,162 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * clienttable-test.cc:
+ *   test cases for the replica ClientTable (under common/)
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **********************************************************************/
+
+#include "common/clienttable.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+using namespace dsnet;
+
+struct TestAddress : public TransportAddress
+{
+    TestAddress(int id) : id(id) { }
+    TestAddress *clone() const override { return new TestAddress(id); }
+    int id;
+};
+
+TEST(ClientTable, Lookup)
+{
+    ClientTable table;
+    EXPECT_EQ(nullptr, table.Find(1));
+
+    // Enough clients to grow the index several times, with ids that
+    // share their low bits
+    for (uint64_t i = 1; i <= 10000; i++) {
+        table[i << 20].lastReqId = i;
+    }
+    EXPECT_EQ(10000u, table.Size());
+    for (uint64_t i = 1; i <= 10000; i++) {
+        ClientTable::Entry *entry = table.Find(i << 20);
+        ASSERT_NE(nullptr, entry);
+        EXPECT_EQ(i << 20, entry->clientId);
+        EXPECT_EQ(i, entry->lastReqId);
+    }
+    EXPECT_EQ(nullptr, table.Find(3));
+
+    EXPECT_EQ(nullptr, table.Address(1 << 20));
+    table.SetAddress(1 << 20, TestAddress(7));
+    ASSERT_NE(nullptr, table.Address(1 << 20));
+    EXPECT_EQ(7, static_cast<const TestAddress *>(
+                  table.Address(1 << 20))->id);
+
+    size_t n = 0;
+    for (const ClientTable::Entry &entry : table) {
+        EXPECT_EQ(entry.clientId >> 20, entry.lastReqId);
+        n++;
+    }
+    EXPECT_EQ(10000u, n);
+
+    table.Clear();
+    EXPECT_EQ(0u, table.Size());
+    EXPECT_EQ(nullptr, table.Find(1 << 20));
+}
+
+TEST(ClientTable, EvictIdle)
+{
+    ClientTable table(8);
+    for (uint64_t i = 1; i <= 8; i++) {
+        table[i].lastReqId = i;
+    }
+    // Clients 1 and 2 were used last, so 3 and 4 are the idlest
+    table.Find(1);
+    table.Find(2);
+    table[9];
+    EXPECT_EQ(7u, table.Size());
+    EXPECT_EQ(nullptr, table.Find(3));
+    EXPECT_EQ(nullptr, table.Find(4));
+    for (uint64_t i : { 1, 2, 5, 6, 7, 8 }) {
+        ASSERT_NE(nullptr, table.Find(i));
+        EXPECT_EQ(i, table.Find(i)->lastReqId);
+    }
+    EXPECT_NE(nullptr, table.Find(9));
+}
+
+TEST(ClientTable, SerializedReply)
+{
+    ClientTable table;
+    ClientTable::Entry &entry = table[1];
+    entry.reply = "reply bytes";
+    entry.replied = true;
+
+    SerializedMessage m(entry.reply);
+    ASSERT_EQ(entry.reply.size(), m.SerializedSize());
+    std::string buf(m.SerializedSize(), '\0');
+    m.Serialize(&buf[0]);
+    EXPECT_EQ(entry.reply, buf);
+
+    // Clones own their bytes
+    std::unique_ptr<Message> copy(m.Clone());
+    entry.ClearReply();
+    EXPECT_FALSE(entry.replied);
+    std::string copied(copy->SerializedSize(), '\0');
+    copy->Serialize(&copied[0]);
+    EXPECT_EQ("reply bytes", copied);
+}
+
+TEST(ClientTable, Window)
+{
+    ClientTable table;
+    ClientTable::Entry &entry = table[1];
+
+    // Pipelined requests arriving out of order each run once
+    EXPECT_TRUE(entry.Accept(3));
+    EXPECT_TRUE(entry.Accept(1));
+    EXPECT_FALSE(entry.Accept(3));
+    EXPECT_FALSE(entry.Accept(1));
+    EXPECT_TRUE(entry.Accept(2));
+    EXPECT_FALSE(entry.Accept(2));
+    EXPECT_EQ(3u, entry.lastReqId);
+
+    // Replies are kept for the whole window, out of order too
+    EXPECT_EQ(nullptr, entry.Reply(2));
+    entry.SetReply(2, std::string("two"));
+    entry.SetReply(3, std::string("three"));
+    EXPECT_TRUE(entry.Accept(4));
+    entry.SetReply(4, std::string("four"));
+    ASSERT_NE(nullptr, entry.Reply(2));
+    EXPECT_EQ("two", *entry.Reply(2));
+    EXPECT_EQ("three", *entry.Reply(3));
+    EXPECT_EQ("four", *entry.Reply(4));
+
+    // ...until the client says it has them
+    EXPECT_TRUE(entry.Accept(5, 3));
+    EXPECT_EQ(nullptr, entry.Reply(2));
+    EXPECT_EQ(nullptr, entry.Reply(3));
+    EXPECT_EQ("four", *entry.Reply(4));
+
+    // Anything older than the window counts as seen
+    EXPECT_TRUE(entry.Accept(5 + ClientTable::WINDOW));
+    EXPECT_FALSE(entry.Accept(5));
+    EXPECT_FALSE(entry.Accept(4));
+    EXPECT_TRUE(entry.Accept(6));
+    EXPECT_TRUE(entry.Accept(1000));
+    EXPECT_FALSE(entry.Accept(6 + ClientTable::WINDOW));
+    EXPECT_EQ(nullptr, entry.Reply(4));
+}
@@ -0,0 +1,128 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * fragmentreassembler-test.cc:
+ *   test cases for the FragmentReassembler class
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **********************************************************************/
+
+#include "lib/fragmentreassembler.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+using namespace dsnet;
+using std::string;
+
+static const size_t FRAG = 4;
+
+// Feed fragment i of msg from sender src
+static bool
+Feed(FragmentReassembler<int> &r, int src, uint64_t id,
+     const string &msg, size_t i, uint64_t now,
+     std::unique_ptr<char[]> &out)
+{
+    size_t start = i * FRAG;
+    size_t len = std::min(FRAG, msg.size() - start);
+    return r.Add(src, id, start, msg.size(), &msg[start], len, now, out);
+}
+
+TEST(FragmentReassembler, OutOfOrderAndInterleaved)
+{
+    FragmentReassembler<int> r(FRAG, 1024);
+    string a = "the quick brown fox";      // 5 fragments
+    string b = "jumps over the lazy dog";  // 6 fragments
+    std::unique_ptr<char[]> out;
+
+    int order[] = { 3, 0, 4, 2 };
+    for (int i : order) {
+        EXPECT_FALSE(Feed(r, 1, 7, a, i, 0, out));
+        EXPECT_FALSE(Feed(r, 1, 8, b, i, 0, out));
+    }
+    // Same id from another sender is another message
+    EXPECT_FALSE(Feed(r, 2, 7, b, 0, 0, out));
+    EXPECT_EQ(3u, r.Pending());
+    EXPECT_EQ(a.size() + 2 * b.size(), r.Bytes());
+
+    // Duplicates are ignored
+    EXPECT_FALSE(Feed(r, 1, 7, a, 3, 0, out));
+
+    ASSERT_TRUE(Feed(r, 1, 7, a, 1, 0, out));
+    EXPECT_EQ(a, string(out.get(), a.size()));
+    EXPECT_FALSE(Feed(r, 1, 8, b, 5, 0, out));
+    ASSERT_TRUE(Feed(r, 1, 8, b, 1, 0, out));
+    EXPECT_EQ(b, string(out.get(), b.size()));
+
+    EXPECT_EQ(1u, r.Pending());
+    EXPECT_EQ(b.size(), r.Bytes());
+}
+
+TEST(FragmentReassembler, Malformed)
+{
+    FragmentReassembler<int> r(FRAG, 1024);
+    std::unique_ptr<char[]> out;
+    const char data[] = "abcdefgh";
+
+    // Misaligned offset, wrong slice length, offset past the end
+    EXPECT_FALSE(r.Add(1, 1, 2, 8, data, 4, 0, out));
+    EXPECT_FALSE(r.Add(1, 1, 0, 8, data, 3, 0, out));
+    EXPECT_FALSE(r.Add(1, 1, 8, 8, data, 0, 0, out));
+    EXPECT_TRUE(r.Empty());
+
+    // Length disagreeing with earlier fragments
+    EXPECT_FALSE(r.Add(1, 1, 0, 8, data, 4, 0, out));
+    EXPECT_FALSE(r.Add(1, 1, 4, 12, data, 4, 0, out));
+    ASSERT_TRUE(r.Add(1, 1, 4, 8, data + 4, 4, 0, out));
+    EXPECT_EQ("abcdefgh", string(out.get(), 8));
+}
+
+TEST(FragmentReassembler, ExpireAndCap)
+{
+    FragmentReassembler<int> r(FRAG, 40);
+    string m(16, 'x');
+    std::unique_ptr<char[]> out;
+
+    EXPECT_FALSE(Feed(r, 1, 1, m, 0, 10, out));
+    EXPECT_FALSE(Feed(r, 1, 2, m, 0, 20, out));
+    EXPECT_EQ(0u, r.Expire(10));
+    EXPECT_EQ(1u, r.Expire(15));
+    EXPECT_EQ(1u, r.Pending());
+
+    // Too big to ever fit
+    EXPECT_FALSE(Feed(r, 1, 3, string(41, 'y'), 0, 30, out));
+    EXPECT_EQ(1u, r.Pending());
+
+    // Needs the room of the least recently active message
+    EXPECT_FALSE(Feed(r, 1, 4, m, 0, 30, out));
+    EXPECT_FALSE(Feed(r, 1, 2, m, 1, 40, out));
+    EXPECT_FALSE(Feed(r, 1, 5, m, 0, 50, out));
+    EXPECT_EQ(2u, r.Pending());
+    EXPECT_EQ(32u, r.Bytes());
+    // Message 2 survived, message 4 was evicted
+    EXPECT_FALSE(Feed(r, 1, 2, m, 2, 60, out));
+    ASSERT_TRUE(Feed(r, 1, 2, m, 3, 60, out));
+    for (size_t i = 0; i < 3; i++) {
+        EXPECT_FALSE(Feed(r, 1, 4, m, i, 60, out));
+    }
+}
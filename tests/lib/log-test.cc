@@ -0,0 +1,164 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * log-test.cc:
+ *   test cases for the replica Log (under common/)
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **********************************************************************/
+
+#include "common/log.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+using namespace dsnet;
+
+static int liveEntries = 0;
+
+// Counts live entries, and is bigger than a LogEntry
+struct TestEntry : public LogEntry
+{
+    TestEntry(opnum_t op) : LogEntry(viewstamp_t(1, op), LOG_STATE_PREPARED,
+                                     Request()) {
+        request.set_clientreqid(op);
+        liveEntries++;
+    }
+    ~TestEntry() { liveEntries--; }
+    char padding[300];
+};
+
+static void
+Append(Log &log, opnum_t from, opnum_t to)
+{
+    for (opnum_t op = from; op <= to; op++) {
+        log.Append(new TestEntry(op));
+    }
+}
+
+static void
+CheckRange(Log &log, opnum_t first, opnum_t last)
+{
+    EXPECT_EQ(first, log.FirstOpnum());
+    EXPECT_EQ(last, log.LastOpnum());
+    EXPECT_EQ(nullptr, log.Find(first-1));
+    EXPECT_EQ(nullptr, log.Find(last+1));
+    for (opnum_t op = first; op <= last; op++) {
+        LogEntry *entry = log.Find(op);
+        ASSERT_NE(nullptr, entry);
+        EXPECT_EQ(op, entry->request.clientreqid());
+    }
+    EXPECT_EQ(static_cast<int>(last+1-first), liveEntries);
+}
+
+TEST(Log, Segments)
+{
+    {
+        Log log(false);
+        EXPECT_TRUE(log.Empty());
+        EXPECT_EQ(0u, log.LastOpnum());
+
+        // Several segments' worth
+        Append(log, 1, 10000);
+        CheckRange(log, 1, 10000);
+        EXPECT_EQ(10000u, log.Last()->viewstamp.opnum);
+
+        // Suffix removal across segment boundaries
+        log.RemoveAfter(4096);
+        CheckRange(log, 1, 4095);
+        log.RemoveAfter(4000);
+        CheckRange(log, 1, 3999);
+        Append(log, 4000, 9000);
+        CheckRange(log, 1, 9000);
+
+        // Prefix release, partway into and then across segments
+        log.TruncateBefore(100);
+        CheckRange(log, 100, 9000);
+        log.TruncateBefore(8193);
+        CheckRange(log, 8193, 9000);
+        Append(log, 9001, 20000);
+        CheckRange(log, 8193, 20000);
+
+        // Emptying the log either way keeps its position
+        log.RemoveAfter(8193);
+        CheckRange(log, 8193, 8192);
+        EXPECT_TRUE(log.Empty());
+        EXPECT_EQ(8192u, log.LastViewstamp().opnum);
+        Append(log, 8193, 8200);
+        log.TruncateBefore(8201);
+        CheckRange(log, 8201, 8200);
+        EXPECT_EQ(viewstamp_t(1, 8200), log.LastViewstamp());
+
+        log.Reset(viewstamp_t(2, 50000));
+        Append(log, 50001, 50010);
+        CheckRange(log, 50001, 50010);
+    }
+    EXPECT_EQ(0, liveEntries);
+}
+
+TEST(Log, Hash)
+{
+    Log a(true), b(true);
+    Append(a, 1, 5000);
+    Append(b, 1, 5000);
+    string hash = a.LastHash();
+    EXPECT_NE(EMPTY_HASH, hash);
+
+    // Truncation keeps the chain going
+    a.TruncateBefore(4500);
+    a.RemoveAfter(5000);
+    b.RemoveAfter(5000);
+    Append(a, 5000, 6000);
+    Append(b, 5000, 6000);
+    EXPECT_EQ(b.LastHash(), a.LastHash());
+    a.TruncateBefore(6001);
+    EXPECT_EQ(b.LastHash(), a.LastHash());
+}
+
+TEST(Log, HashChain)
+{
+    // Hashes are filled in lazily, a batch at a time, and must match
+    // chaining ComputeHash entry by entry
+    Log log(true);
+    Append(log, 1, 5000);
+    string hash = EMPTY_HASH;
+    std::vector<string> expected;
+    for (opnum_t op = 1; op <= 5000; op++) {
+        TestEntry entry(op);
+        hash = Log::ComputeHash(hash, &entry);
+        expected.push_back(hash);
+    }
+    EXPECT_EQ(expected[2999], log.Find(3000)->hash);
+    EXPECT_EQ(expected[4999], log.LastHash());
+    for (opnum_t op = 1; op <= 5000; op++) {
+        EXPECT_EQ(expected[op-1], log.Find(op)->hash);
+    }
+
+    // Removing a suffix drops its hashes, and re-appending recomputes
+    // them from the new entries
+    log.RemoveAfter(4000);
+    TestEntry *entry = new TestEntry(4000);
+    entry->request.set_clientreqid(40000);
+    log.Append(entry);
+    EXPECT_NE(expected[3999], log.LastHash());
+}
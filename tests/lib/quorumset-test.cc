@@ -3,8 +3,9 @@
 // Althrough implementation is under common/
 // currectly there is no test dir for common and it seems quorum set should be
 // moved to lib/ eventually...
-// Notice: only ByzantineQuorumSet is tested
+// Notice: only ByzantineQuorumSet and the windowed sets are tested
 
+#include "common/messageset.h"
 #include "common/quorumset.h"
 
 #include <gtest/gtest.h>
@@ -31,4 +32,82 @@ TEST(QuorumSetTest, BasicByzantine) {
   ASSERT_TRUE(qs.CheckForQuorum(1, "cowsay"));
   qs.Clear(1);
   ASSERT_FALSE(qs.CheckForQuorum(1, "cowsay"));
-}
\ No newline at end of file
+}
+TEST(QuorumSetTest, Windowed) {
+  WindowedQuorumSet<string> qs(2, true, 8);
+  ASSERT_FALSE(qs.AddAndCheckForQuorum(1, 0, "a"));
+  ASSERT_FALSE(qs.AddAndCheckForQuorum(1, 0, "b"));
+  ASSERT_EQ(1, qs.Count(1));
+  ASSERT_TRUE(qs.AddAndCheckForQuorum(1, 3, "c"));
+  ASSERT_EQ("b", qs.GetMessages(1)->at(0));
+
+  // Going past the end of the window grows it, keeping the open IDs
+  ASSERT_FALSE(qs.AddAndCheckForQuorum(9, 0));
+  ASSERT_TRUE(qs.CheckForQuorum(1));
+  ASSERT_EQ("c", qs.GetMessages(1)->at(3));
+  ASSERT_EQ(0u, qs.Watermark());
+
+  // Only up to a point, past which IDs are refused
+  ASSERT_FALSE(qs.AddAndCheckForQuorum(8 * 64, 0));
+  ASSERT_EQ(0, qs.Count(8 * 64));
+  ASSERT_TRUE(qs.CheckForQuorum(1));
+
+  // Advancing the watermark drops the IDs below it
+  ASSERT_TRUE(qs.AddAndCheckForQuorum(9, 1));
+  qs.Advance(10);
+  ASSERT_FALSE(qs.CheckForQuorum(1));
+  ASSERT_FALSE(qs.CheckForQuorum(9));
+  ASSERT_FALSE(qs.AddAndCheckForQuorum(9, 2));
+  ASSERT_FALSE(qs.AddAndCheckForQuorum(500, 2));
+  ASSERT_EQ(1, qs.Count(500));
+
+  // Rebasing moves the window anywhere, dropping what it held
+  qs.Rebase(100000);
+  ASSERT_EQ(0, qs.Count(500));
+  ASSERT_FALSE(qs.AddAndCheckForQuorum(100000, 0));
+  qs.Rebase(100000);
+  ASSERT_EQ(1, qs.Count(100000));
+  qs.Rebase(20);
+  ASSERT_EQ(0, qs.Count(100000));
+  ASSERT_FALSE(qs.AddAndCheckForQuorum(20, 1));
+  ASSERT_EQ(1, qs.Count(20));
+
+  // Bodies are only kept when asked for
+  WindowedQuorumSet<string> votes(1);
+  ASSERT_TRUE(votes.AddAndCheckForQuorum(5, 0, "a"));
+  ASSERT_EQ(nullptr, votes.GetMessages(5));
+}
+
+TEST(QuorumSetTest, WindowedByzantine) {
+  WindowedByzantineQuorumSet<string> qs(3, 8);
+  qs.Add(1, 0, "cowsay");
+  qs.Add(1, 0, "cowsay");
+  qs.Add(1, 1, "cowsay");
+  qs.Add(1, 2, "catsay");
+  ASSERT_FALSE(qs.CheckForQuorum(1, "cowsay"));
+  ASSERT_TRUE(qs.Add(1, 3, "cowsay"));
+  ASSERT_FALSE(qs.CheckForQuorum(1, "catsay"));
+  qs.Clear(1);
+  ASSERT_FALSE(qs.CheckForQuorum(1, "cowsay"));
+
+  ASSERT_FALSE(qs.Add(2, 0, "cowsay"));
+  ASSERT_FALSE(qs.Add(2, 1, "cowsay"));
+  qs.Advance(3);
+  ASSERT_FALSE(qs.Add(2, 2, "cowsay"));
+}
+
+TEST(QuorumSetTest, WindowedMessageSet) {
+  WindowedMessageSet<string> ms(2, true, 8);
+  // Not expecting replies for 1 yet
+  ASSERT_FALSE(ms.AddAndCheckForQuorum(1, 0, 0, "a"));
+  ms.SetShardRequired(1, 2);
+  ASSERT_FALSE(ms.AddAndCheckForQuorum(1, 0, 0, "a"));
+  ASSERT_FALSE(ms.AddAndCheckForQuorum(1, 0, 1, "a"));
+  ASSERT_FALSE(ms.AddAndCheckForQuorum(1, 1, 0, "b"));
+  ASSERT_TRUE(ms.AddAndCheckForQuorum(1, 1, 2, "b"));
+  ASSERT_EQ(2u, ms.GetMessages(1)->size());
+  ASSERT_EQ("b", ms.GetMessages(1)->at(1).at(2));
+  ms.Advance(2);
+  ASSERT_FALSE(ms.CheckForQuorum(1));
+  ASSERT_EQ(nullptr, ms.GetMessages(1));
+}
@@ -0,0 +1,139 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * sigpipeline-test.cc:
+ *   test cases for the SignaturePipeline class
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **********************************************************************/
+
+#include "lib/sigpipeline.h"
+#include "lib/simtransport.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace dsnet;
+using std::vector;
+
+static void
+Sleep(int ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+TEST(SignaturePipeline, Inline)
+{
+    SimulatedTransport transport;
+    SignaturePipeline pipeline(&transport);
+    vector<int> done;
+    pipeline.Submit([]() { return true; }, [&done]() { done.push_back(0); });
+    pipeline.Submit([]() { return false; }, [&done]() { done.push_back(1); });
+    // Nothing is deferred
+    EXPECT_EQ(vector<int>({ 0 }), done);
+    EXPECT_EQ(0u, pipeline.Pending());
+    EXPECT_EQ(0, pipeline.Workers());
+}
+
+TEST(SignaturePipeline, InOrder)
+{
+    SimulatedTransport transport;
+    SignaturePipeline pipeline(&transport, 4);
+    std::thread::id self = std::this_thread::get_id();
+    vector<int> done;
+    for (int i = 0; i < 32; i++) {
+        // Later jobs tend to finish first; every third one fails
+        pipeline.Submit([i]() { Sleep((32 - i) % 5); return i % 3 != 0; },
+                        [&done, self, i]() {
+                            EXPECT_EQ(self, std::this_thread::get_id());
+                            done.push_back(i);
+                        });
+    }
+    EXPECT_TRUE(done.empty());
+    transport.Run();
+
+    vector<int> expected;
+    for (int i = 0; i < 32; i++) {
+        if (i % 3 != 0) {
+            expected.push_back(i);
+        }
+    }
+    EXPECT_EQ(expected, done);
+    EXPECT_EQ(0u, pipeline.Pending());
+}
+
+TEST(SignaturePipeline, SubmitFromCompletion)
+{
+    SimulatedTransport transport;
+    SignaturePipeline pipeline(&transport, 2);
+    vector<int> done;
+    pipeline.Submit([]() { return true; }, [&]() {
+        done.push_back(0);
+        pipeline.Submit([]() { return true; },
+                        [&done]() { done.push_back(2); });
+    });
+    pipeline.Submit([]() { return true; }, [&done]() { done.push_back(1); });
+    transport.Run();
+    EXPECT_EQ(vector<int>({ 0, 1, 2 }), done);
+}
+
+TEST(SignaturePipeline, Parallel)
+{
+    SimulatedTransport transport;
+    SignaturePipeline pipeline(&transport, 4);
+    std::atomic<int> running(0), peak(0);
+    int done = 0;
+    for (int i = 0; i < 8; i++) {
+        pipeline.Submit([&]() {
+            int now = ++running;
+            int seen = peak;
+            while (now > seen && !peak.compare_exchange_weak(seen, now)) { }
+            Sleep(20);
+            running--;
+            return true;
+        }, [&done]() { done++; });
+    }
+    transport.Run();
+    EXPECT_EQ(8, done);
+    EXPECT_GT(peak, 1);
+    EXPECT_LE(peak, 4);
+}
+
+TEST(SignaturePipeline, DropPendingOnDestroy)
+{
+    SimulatedTransport transport;
+    int done = 0;
+    {
+        SignaturePipeline pipeline(&transport, 2);
+        for (int i = 0; i < 4; i++) {
+            pipeline.Submit([]() { Sleep(5); return true; },
+                            [&done]() { done++; });
+        }
+    }
+    // The drain timer went with the pipeline
+    transport.Run();
+    EXPECT_EQ(0, done);
+}
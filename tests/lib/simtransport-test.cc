@@ -51,11 +51,16 @@ public:
 
     int numReceived;
     TestMessage lastMsg;
+    // Virtual time of the last message, if transport is set
+    SimulatedTransport *transport;
+    uint64_t lastReceived;
 };
 
 TestReceiver::TestReceiver()
 {
     numReceived = 0;
+    transport = nullptr;
+    lastReceived = 0;
 }
 
 void
@@ -65,6 +70,9 @@ TestReceiver::ReceiveMessage(const TransportAddress &src,
     PBMessage m(lastMsg);
     m.Parse(buf, size);
     numReceived++;
+    if (transport != nullptr) {
+        lastReceived = transport->Now();
+    }
 }
 
 class SimTransportTest : public testing::Test
@@ -179,6 +187,37 @@ TEST_F(SimTransportTest, Filter)
     EXPECT_EQ(receiver2->lastMsg.test(), "bar");
 }
 
+TEST_F(SimTransportTest, NestedFanOut)
+{
+    // A broadcast made from inside another one, here by a filter,
+    // must not disturb the outer one's destinations
+    bool nested = false;
+    transport->AddFilter(10, [&](TransportReceiver *src, pair<int, int> srcIdx,
+                                 TransportReceiver *dst, pair<int, int> dstIdx,
+                                 Message &m, uint64_t &delay) {
+        if (!nested) {
+            nested = true;
+            TestMessage inner;
+            inner.set_test("inner");
+            transport->SendMessageToAll(receiver2, PBMessage(inner));
+        }
+        return true;
+    });
+
+    TestMessage msg;
+    msg.set_test("outer");
+    PBMessage m(msg);
+    transport->SendMessageToAll(receiver0, m);
+    transport->Run();
+
+    EXPECT_EQ(receiver0->numReceived, 1);
+    EXPECT_EQ(receiver1->numReceived, 2);
+    EXPECT_EQ(receiver2->numReceived, 1);
+    EXPECT_EQ(receiver0->lastMsg.test(), "inner");
+    EXPECT_EQ(receiver1->lastMsg.test(), "outer");
+    EXPECT_EQ(receiver2->lastMsg.test(), "outer");
+}
+
 TEST_F(SimTransportTest, FilterModify)
 {
     transport->AddFilter(10, [](TransportReceiver *src, pair<int, int> srcIdx,
@@ -390,3 +429,49 @@ TEST_F(SimTransportTest, Timeout)
     transport->Run();
     EXPECT_EQ(2, n);
 }
+
+TEST_F(SimTransportTest, LinkModel)
+{
+    receiver1->transport = transport;
+    receiver2->transport = transport;
+
+    SimulatedTransport::LinkModel lan;
+    lan.latency = 100;
+    transport->SetLinkModel(lan);
+    // One byte per microsecond to replica 2
+    SimulatedTransport::LinkModel slow;
+    slow.latency = 2000;
+    slow.bandwidth = 1000000;
+    transport->SetLinkModel(std::make_pair(0, 0), std::make_pair(0, 2), slow);
+
+    TestMessage msg;
+    msg.set_test("foo");
+    PBMessage m(msg);
+    uint64_t size = m.SerializedSize();
+
+    bool timerCalled = false;
+    transport->Timer(1, [&]() {
+            EXPECT_EQ(1000u, transport->Now());
+            EXPECT_EQ(1, receiver1->numReceived);
+            EXPECT_EQ(0, receiver2->numReceived);
+            timerCalled = true;
+        });
+    transport->SendMessageToAll(receiver0, m);
+    transport->SendMessageToReplica(receiver0, 2, m);
+    transport->Run();
+
+    EXPECT_TRUE(timerCalled);
+    EXPECT_EQ(1, receiver1->numReceived);
+    EXPECT_EQ(100u, receiver1->lastReceived);
+    // The second message waits for the first to go out
+    EXPECT_EQ(2, receiver2->numReceived);
+    EXPECT_EQ(2000 + 2 * size, receiver2->lastReceived);
+
+    SimulatedTransport::LinkModel lossy;
+    lossy.loss = 1.0;
+    transport->SetLinkModel(std::make_pair(0, 0), std::make_pair(0, 1), lossy);
+    transport->SendMessageToAll(receiver0, m);
+    transport->Run();
+    EXPECT_EQ(1, receiver1->numReceived);
+    EXPECT_EQ(3, receiver2->numReceived);
+}
@@ -0,0 +1,178 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * timerwheel-test.cc:
+ *   test cases for the TimerWheel class
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **********************************************************************/
+
+#include "lib/timerwheel.h"
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <random>
+#include <vector>
+
+using namespace dsnet;
+using std::vector;
+
+TEST(TimerWheel, Order)
+{
+    TimerWheel wheel;
+    vector<int> fired;
+    // Spread over several levels, with ties
+    uint64_t whens[] = { 70000, 5, 300, 5, 1 << 20, 300, 0, 65536 };
+    for (int i = 0; i < 8; i++) {
+        wheel.Add(whens[i], [&fired, i]() { fired.push_back(i); });
+    }
+    EXPECT_EQ(8u, wheel.Size());
+
+    timer_callback_t cb;
+    uint64_t when, last = 0;
+    while (wheel.PopEarliest(when, cb)) {
+        EXPECT_LE(last, when);
+        EXPECT_EQ(when, wheel.Now());
+        last = when;
+        cb();
+    }
+    EXPECT_EQ(vector<int>({ 6, 1, 3, 2, 5, 7, 0, 4 }), fired);
+    EXPECT_TRUE(wheel.Empty());
+}
+
+TEST(TimerWheel, PopExpired)
+{
+    TimerWheel wheel;
+    int fired = 0;
+    wheel.Add(1000, [&fired]() { fired++; });
+    wheel.Add(100000, [&fired]() { fired++; });
+
+    timer_callback_t cb;
+    EXPECT_LE(wheel.NextExpiry(), 1000u);
+    EXPECT_FALSE(wheel.PopExpired(999, cb));
+    EXPECT_EQ(999u, wheel.Now());
+    ASSERT_TRUE(wheel.PopExpired(1000, cb));
+    cb();
+    EXPECT_FALSE(wheel.PopExpired(99999, cb));
+    ASSERT_TRUE(wheel.PopExpired(200000, cb));
+    cb();
+    EXPECT_EQ(2, fired);
+    EXPECT_EQ(UINT64_MAX, wheel.NextExpiry());
+
+    // Timers added in the past are due straight away
+    wheel.Add(10, [&fired]() { fired++; });
+    ASSERT_TRUE(wheel.PopExpired(200000, cb));
+    cb();
+    EXPECT_EQ(3, fired);
+}
+
+TEST(TimerWheel, CancelAndRearm)
+{
+    TimerWheel wheel;
+    int a = 0, b = 0;
+    int ida = wheel.Add(10, [&a]() { a++; });
+    int idb = wheel.Add(20, [&b]() { b++; });
+    EXPECT_GT(ida, 0);
+    EXPECT_GT(idb, 0);
+
+    EXPECT_TRUE(wheel.Rearm(ida, 30));
+    EXPECT_TRUE(wheel.Cancel(idb));
+    EXPECT_FALSE(wheel.Cancel(idb));
+    EXPECT_FALSE(wheel.Rearm(idb, 40));
+
+    timer_callback_t cb;
+    EXPECT_FALSE(wheel.PopExpired(29, cb));
+    ASSERT_TRUE(wheel.PopExpired(30, cb));
+    cb();
+    EXPECT_EQ(1, a);
+    EXPECT_EQ(0, b);
+
+    // A stale id must not touch the timer that reuses its entry
+    EXPECT_FALSE(wheel.Cancel(ida));
+    int idc = wheel.Add(50, []() { });
+    int idd = wheel.Add(60, []() { });
+    EXPECT_NE(ida, idc);
+    EXPECT_NE(ida, idd);
+    EXPECT_FALSE(wheel.Cancel(ida));
+    EXPECT_EQ(2u, wheel.Size());
+
+    wheel.Clear();
+    EXPECT_TRUE(wheel.Empty());
+    EXPECT_FALSE(wheel.Cancel(idc));
+}
+
+TEST(TimerWheel, Random)
+{
+    // Check against a multimap, which keeps equal keys in insertion
+    // order too
+    TimerWheel wheel;
+    std::multimap<uint64_t, int> expected;
+    std::map<int, std::multimap<uint64_t, int>::iterator> live;
+    std::default_random_engine rng(1);
+    int fired = -1;
+    int next = 0;
+    uint64_t now = 0;
+
+    for (int round = 0; round < 20000; round++) {
+        int op = rng() % 8;
+        if (op < 4 || live.empty()) {
+            uint64_t when = now + rng() % (1 << (rng() % 30));
+            int n = next++;
+            int id = wheel.Add(when, [&fired, n]() { fired = n; });
+            live[id] = expected.insert(std::make_pair(when, n));
+        } else {
+            auto it = live.begin();
+            std::advance(it, rng() % live.size());
+            if (op == 4) {
+                ASSERT_TRUE(wheel.Cancel(it->first));
+                expected.erase(it->second);
+                live.erase(it);
+            } else if (op == 5) {
+                uint64_t when = now + rng() % 100000;
+                ASSERT_TRUE(wheel.Rearm(it->first, when));
+                int n = it->second->second;
+                expected.erase(it->second);
+                it->second = expected.insert(std::make_pair(when, n));
+            } else {
+                now += rng() % (1 << (rng() % 20));
+                timer_callback_t cb;
+                while (wheel.PopExpired(now, cb)) {
+                    ASSERT_FALSE(expected.empty());
+                    ASSERT_LE(expected.begin()->first, now);
+                    cb();
+                    ASSERT_EQ(expected.begin()->second, fired);
+                    for (auto l = live.begin(); l != live.end(); l++) {
+                        if (l->second == expected.begin()) {
+                            live.erase(l);
+                            break;
+                        }
+                    }
+                    expected.erase(expected.begin());
+                }
+                ASSERT_TRUE(expected.empty() ||
+                            expected.begin()->first > now);
+            }
+        }
+        ASSERT_EQ(expected.size(), wheel.Size());
+    }
+}
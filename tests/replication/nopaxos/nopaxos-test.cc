@@ -33,12 +33,14 @@
 #include "lib/simtransport.h"
 
 #include "replication/nopaxos/client.h"
+#include "replication/nopaxos/reorderbuffer.h"
 #include "replication/nopaxos/replica.h"
 #include "replication/nopaxos/sequencer.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <gtest/gtest.h>
+#include <sstream>
 
 using namespace dsnet;
 using namespace dsnet::nopaxos;
@@ -61,6 +63,23 @@ public:
         reply = "unreply: " + req;
     }
 
+    bool SnapshotUpcall(string &snapshot) override {
+        snapshot.clear();
+        for (const string &op : ops) {
+            snapshot += op + '\n';
+        }
+        return true;
+    }
+
+    void RestoreUpcall(const string &snapshot) override {
+        std::istringstream stream(snapshot);
+        string op;
+        ops.clear();
+        while (std::getline(stream, op)) {
+            ops.push_back(op);
+        }
+    }
+
     std::vector<string> ops;
     std::vector<string> unloggedOps;
 };
@@ -106,6 +125,8 @@ protected:
     std::vector<NOPaxosSequencer *> sequencers;
     SimulatedTransport *transport;
     Configuration *config;
+    opnum_t checkpointInterval = Replica::DEFAULT_CHECKPOINT_INTERVAL;
+    uint64_t failoverTimeout = 0;
 
     virtual void SetUp() {
         std::map<int, std::vector<ReplicaAddress> > replicaAddrs =
@@ -131,10 +152,12 @@ protected:
 
         for (int i = 0; i < config->n; i++) {
             apps.push_back(new NOPaxosTestApp());
-            replicas.push_back(new NOPaxosReplica(*config, i, true, transport, apps[i]));
+            replicas.push_back(new NOPaxosReplica(*config, i, true, transport,
+                                                  apps[i], checkpointInterval));
         }
         for (int i = 0; i < config->NumSequencers(); i++) {
-            sequencers.push_back(new NOPaxosSequencer(*config, transport, i));
+            sequencers.push_back(new NOPaxosSequencer(*config, transport, i,
+                                                      failoverTimeout));
         }
     }
 
@@ -277,6 +300,47 @@ TEST_F(NOPaxosTest, OneOpUnlogged)
     EXPECT_EQ(0, timeouts);
 }
 
+TEST_F(NOPaxosTest, LeaseRead)
+{
+    NOPaxosClient nopaxosClient(*config,
+                                ReplicaAddress("localhost", "0"),
+                                transport);
+    TestClient client(&nopaxosClient);
+
+    int reads = 0;
+    Client::continuation_t readUpcall = [&](const string &request,
+                                            const string &reply) {
+        EXPECT_EQ(request, client.LastRequestOp());
+        EXPECT_EQ(reply, "unreply: " + request);
+        if (++reads < 3) {
+            client.requestNum++;
+            nopaxosClient.InvokeRead(client.LastRequestOp(), readUpcall);
+        } else {
+            transport->CancelAllTimers();
+        }
+    };
+    auto upcall = [&](const string &request, const string &reply) {
+        EXPECT_EQ(reply, "reply: " + request);
+        client.requestNum++;
+        nopaxosClient.InvokeRead(client.LastRequestOp(), readUpcall);
+    };
+
+    client.SendNext(upcall);
+    transport->Run();
+
+    // The leader answered the reads itself once the write before
+    // them was synchronized, without logging them
+    EXPECT_EQ(3, reads);
+    EXPECT_EQ(3, apps[0]->unloggedOps.size());
+    for (int i = 0; i < config->n; i++) {
+        EXPECT_EQ(1, apps[i]->ops.size());
+        EXPECT_EQ(nullptr, replicas[i]->log.Find(2));
+        if (i != 0) {
+            EXPECT_EQ(0, apps[i]->unloggedOps.size());
+        }
+    }
+}
+
 TEST_F(NOPaxosTest, ManyOps)
 {
     NOPaxosClient nopaxosClient(*config,
@@ -344,6 +408,201 @@ TEST_F(NOPaxosTest, ManyOps)
     EXPECT_EQ(10, numUpcalls);
 }
 
+TEST_F(NOPaxosTest, Batched)
+{
+    // Batches of up to three requests, the last one sent on linger
+    NOPaxosClient nopaxosClient(*config,
+                                ReplicaAddress("localhost", "0"),
+                                transport, 0, 8, 3, 5);
+    TestClient client(&nopaxosClient);
+
+    std::vector<string> replies;
+    Client::continuation_t upcall = [&](const string &request,
+                                        const string &reply) {
+        EXPECT_EQ("reply: " + request, reply);
+        replies.push_back(reply);
+    };
+
+    transport->Timer(100, [&]() {
+        transport->CancelAllTimers();
+    });
+
+    for (int i = 0; i < 7; i++) {
+        client.SendNext(upcall);
+    }
+    transport->Run();
+
+    // Every caller got its own reply, in order
+    ASSERT_EQ(7, replies.size());
+    for (int j = 1; j <= 7; j++) {
+        EXPECT_EQ("reply: " + client.RequestOp(j), replies[j-1]);
+    }
+
+    // Each batch took one log entry, and the leader ran its requests
+    // in order
+    const int sizes[] = { 3, 3, 1 };
+    for (int i = 0; i < config->n; i++) {
+        int j = 1;
+        for (opnum_t op = 1; op <= 3; op++) {
+            const LogEntry *entry = replicas[i]->log.Find(op);
+            ASSERT_NE(entry, nullptr);
+            EXPECT_EQ(LOG_STATE_RECEIVED, entry->state);
+            if (sizes[op-1] == 1) {
+                EXPECT_EQ(0, entry->request.batch_size());
+                EXPECT_EQ(client.RequestOp(j++), entry->request.op());
+            } else {
+                ASSERT_EQ(sizes[op-1], entry->request.batch_size());
+                for (const Request &sub : entry->request.batch()) {
+                    EXPECT_EQ(client.RequestOp(j++), sub.op());
+                }
+            }
+        }
+        EXPECT_EQ(nullptr, replicas[i]->log.Find(4));
+    }
+    ASSERT_EQ(7, apps[0]->ops.size());
+    for (int j = 1; j <= 7; j++) {
+        EXPECT_EQ(client.RequestOp(j), apps[0]->ops[j-1]);
+    }
+
+    NOPaxosClient::Stats stats = nopaxosClient.GetStats();
+    EXPECT_EQ(3, stats.batches);
+    EXPECT_EQ(7, stats.batchedRequests);
+}
+
+class NOPaxosCheckpointTest : public NOPaxosTest
+{
+protected:
+    NOPaxosCheckpointTest() {
+        checkpointInterval = 2;
+        failoverTimeout = 20;
+    }
+};
+
+TEST_F(NOPaxosCheckpointTest, TruncateLog)
+{
+    NOPaxosClient nopaxosClient(*config,
+                                ReplicaAddress("localhost", "0"),
+                                transport);
+    TestClient client(&nopaxosClient);
+
+    // Spread the requests over several synchronizations
+    Client::continuation_t upcall = [&](const string & request, const string & reply) {
+        EXPECT_EQ("reply: " + request, reply);
+        if (client.requestNum < 20) {
+            transport->Timer(200, [&]() {
+                client.SendNext(upcall);
+            });
+        }
+    };
+
+    transport->Timer(6000, [&]() {
+        transport->CancelAllTimers();
+    });
+
+    client.SendNext(upcall);
+    transport->Run();
+
+    for (int i = 0; i < config->n; i++) {
+        // Synchronization has executed and checkpointed the
+        // requests everywhere, and released the oldest entries
+        ASSERT_EQ(20, apps[i]->ops.size());
+        for (int j = 1; j <= 20; j++) {
+            EXPECT_EQ(client.RequestOp(j), apps[i]->ops[j-1]);
+        }
+        EXPECT_GT(replicas[i]->log.FirstOpnum(), 1);
+        EXPECT_EQ(nullptr, replicas[i]->log.Find(1));
+        EXPECT_EQ(20, replicas[i]->log.LastOpnum());
+    }
+}
+
+TEST_F(NOPaxosCheckpointTest, InstallThenViewChange)
+{
+    const int NUM_PACKETS = 25;
+    const int lagging = 4;
+
+    // The last replica never hears from the primary sequencer, nor
+    // gets a SyncCommit, and misses the first synchronization's
+    // state transfer, so it catches up only through the checkpoint
+    // in the second's. It is then cut off while the others change
+    // sessions twice, and has to rejoin from behind, rewinding to
+    // its last commit point.
+    bool primaryDown = false;
+    bool secondaryDown = false;
+    bool firstSync = true;
+    bool cutOff = false;
+    transport->AddFilter(1, [&](TransportReceiver *src, std::pair<int, int> srcIdx,
+                                TransportReceiver *dst, std::pair<int, int> dstIdx,
+                                Message &m, uint64_t &delay) {
+        if (primaryDown && (src == sequencers[0] || dst == sequencers[0])) {
+            return false;
+        }
+        if (secondaryDown && (src == sequencers[1] || dst == sequencers[1])) {
+            return false;
+        }
+        if (src == sequencers[0] && dst == replicas[lagging]) {
+            return false;
+        }
+        if (cutOff && (src == replicas[lagging] || dst == replicas[lagging])) {
+            return false;
+        }
+        if (dst == replicas[lagging] &&
+            CheckMessageType(m, ToReplicaMessage::MsgCase::kSyncCommit)) {
+            return false;
+        }
+        if (firstSync && dst == replicas[lagging] &&
+            CheckMessageType(m, ToReplicaMessage::MsgCase::kStateTransferReply)) {
+            return false;
+        }
+        return true;
+    });
+
+    NOPaxosClient nopaxosClient(*config,
+                                ReplicaAddress("localhost", "0"),
+                                transport);
+    TestClient client(&nopaxosClient);
+    int numUpcalls = 0;
+    Client::continuation_t upcall = [&](const string &req, const string &reply) {
+        numUpcalls++;
+        EXPECT_EQ("reply: " + req, reply);
+        if (client.requestNum < NUM_PACKETS) {
+            transport->Timer(200, [&]() {
+                client.SendNext(upcall);
+            });
+        }
+    };
+    client.SendNext(upcall);
+
+    transport->Timer(2100, [&]() {
+        firstSync = false;
+    });
+    transport->Timer(3500, [&]() {
+        // Caught up from a checkpoint, without the log below it
+        EXPECT_GT(replicas[lagging]->log.FirstOpnum(), 1);
+        EXPECT_GT(apps[lagging]->ops.size(), 0);
+        cutOff = true;
+        primaryDown = true;
+    });
+    transport->Timer(4000, [&]() {
+        secondaryDown = true;
+    });
+    transport->Timer(4500, [&]() {
+        cutOff = false;
+    });
+    transport->Timer(9000, [&]() {
+        transport->CancelAllTimers();
+    });
+    transport->Run();
+
+    EXPECT_EQ(NUM_PACKETS, numUpcalls);
+    EXPECT_EQ(2, sequencers[2]->GetStats().sessNum);
+    for (int i = 0; i < config->n; i++) {
+        const LogEntry *entry = replicas[i]->log.Find(replicas[i]->log.LastOpnum());
+        ASSERT_NE(entry, nullptr);
+        EXPECT_EQ(2, entry->viewstamp.sessnum);
+        EXPECT_EQ(client.LastRequestOp(), entry->request.op());
+    }
+}
+
 TEST_F(NOPaxosTest, ReplicaGap)
 {
     const int NUM_CLIENTS = 2;
@@ -418,6 +677,216 @@ TEST_F(NOPaxosTest, ReplicaGap)
     }
 }
 
+TEST_F(NOPaxosTest, SequencerRetransmit)
+{
+    const int NUM_PACKETS = 8;
+
+    // Drop the first copy of the 3rd and 5th packet to the leader and
+    // a replica; they should fetch them again from the sequencer
+    // rather than fall back to gap agreement
+    std::set<std::pair<msgnum_t, int> > drops = {
+        {3, 0}, {3, 2}, {5, 0}, {5, 2}
+    };
+    int gapRequests = 0;
+    transport->AddFilter(1, [&](TransportReceiver *src, std::pair<int, int> srcIdx,
+                                TransportReceiver *dst, std::pair<int, int> dstIdx,
+                                Message &m, uint64_t &delay) {
+        if (IsSequencer(src)) {
+            auto key = std::make_pair(GetRequest(m).msgnum(), dstIdx.second);
+            if (drops.erase(key) > 0) {
+                return false;
+            }
+        } else if (CheckMessageType(m, ToReplicaMessage::MsgCase::kGapRequest)) {
+            gapRequests++;
+        }
+        return true;
+    });
+
+    // Keep all requests in flight, so later ones reveal the drops
+    NOPaxosClient nopaxosClient(*config,
+                                ReplicaAddress("localhost", "0"),
+                                transport, 0, NUM_PACKETS);
+    TestClient client(&nopaxosClient);
+    int numUpcalls = 0;
+    Client::continuation_t upcall = [&](const string &req, const string &reply) {
+        numUpcalls++;
+        EXPECT_EQ("reply: " + req, reply);
+    };
+    for (int i = 0; i < NUM_PACKETS; i++) {
+        client.SendNext(upcall);
+    }
+
+    transport->Timer(100, [&]() {
+        transport->CancelAllTimers();
+    });
+    transport->Run();
+
+    EXPECT_TRUE(drops.empty());
+    EXPECT_EQ(0, gapRequests);
+    EXPECT_EQ(NUM_PACKETS, numUpcalls);
+    for (int i = 0; i < config->n; i++) {
+        for (int j = 1; j <= NUM_PACKETS; j++) {
+            const LogEntry *entry = replicas[i]->log.Find(j);
+            ASSERT_NE(entry, nullptr);
+            EXPECT_EQ(LOG_STATE_RECEIVED, entry->state);
+            EXPECT_EQ(client.RequestOp(j), entry->request.op());
+        }
+    }
+}
+
+class NOPaxosFailoverTest : public NOPaxosTest
+{
+protected:
+    NOPaxosFailoverTest() { failoverTimeout = 20; }
+};
+
+TEST_F(NOPaxosFailoverTest, SequencerFailover)
+{
+    const int NUM_PACKETS = 10;
+
+    // Cut the primary sequencer off at 100ms. Sequencer 1 is next in
+    // line, so it should take over within a failover timeout, and the
+    // replicas should change sessions as soon as it does.
+    bool primaryDown = false;
+    uint64_t sessionChangeAt = 0;
+    transport->AddFilter(1, [&](TransportReceiver *src, std::pair<int, int> srcIdx,
+                                TransportReceiver *dst, std::pair<int, int> dstIdx,
+                                Message &m, uint64_t &delay) {
+        if (primaryDown && (src == sequencers[0] || dst == sequencers[0])) {
+            return false;
+        }
+        if (sessionChangeAt == 0 && !IsSequencer(src) &&
+            CheckMessageType(m, ToReplicaMessage::MsgCase::kStartView)) {
+            sessionChangeAt = transport->Now();
+        }
+        return true;
+    });
+
+    NOPaxosClient nopaxosClient(*config,
+                                ReplicaAddress("localhost", "0"),
+                                transport);
+    TestClient client(&nopaxosClient);
+    int numUpcalls = 0;
+    Client::continuation_t upcall = [&](const string &req, const string &reply) {
+        numUpcalls++;
+        EXPECT_EQ("reply: " + req, reply);
+        if (client.requestNum < NUM_PACKETS) {
+            transport->Timer(20, [&]() {
+                client.SendNext(upcall);
+            });
+        }
+    };
+    client.SendNext(upcall);
+
+    transport->Timer(100, [&]() {
+        primaryDown = true;
+    });
+    // The request lost with the primary is resent after the client's
+    // timeout, through the standbys
+    transport->Timer(3000, [&]() {
+        transport->CancelAllTimers();
+    });
+    transport->Run();
+
+    EXPECT_EQ(NUM_PACKETS, numUpcalls);
+    EXPECT_EQ(NUM_PACKETS, apps[0]->ops.size());
+    // Sequencer 2 heard from sequencer 1 before its own turn came
+    EXPECT_TRUE(sequencers[1]->GetStats().active);
+    EXPECT_EQ(1, sequencers[1]->GetStats().sessNum);
+    EXPECT_FALSE(sequencers[2]->GetStats().active);
+    EXPECT_GT(sessionChangeAt, 100000);
+    EXPECT_LT(sessionChangeAt, 100000 + 2 * failoverTimeout * 1000);
+    for (int i = 0; i < config->n; i++) {
+        const LogEntry *entry = replicas[i]->log.Find(replicas[i]->log.LastOpnum());
+        ASSERT_NE(entry, nullptr);
+        EXPECT_EQ(1, entry->viewstamp.sessnum);
+        EXPECT_EQ(client.LastRequestOp(), entry->request.op());
+    }
+}
+
+TEST_F(NOPaxosFailoverTest, SequencerFailoverBurst)
+{
+    const int NUM_PACKETS = 3;
+
+    // The primary sequencer is down from the start, so every request
+    // in flight times out at once
+    NOPaxosClient nopaxosClient(*config,
+                                ReplicaAddress("localhost", "0"),
+                                transport, 0, NUM_PACKETS);
+    int requestsToSequencer[3] = { 0, 0, 0 };
+    transport->AddFilter(1, [&](TransportReceiver *src, std::pair<int, int> srcIdx,
+                                TransportReceiver *dst, std::pair<int, int> dstIdx,
+                                Message &m, uint64_t &delay) {
+        for (int i = 0; i < 3; i++) {
+            if (src == &nopaxosClient && dst == sequencers[i]) {
+                requestsToSequencer[i]++;
+            }
+        }
+        return src != sequencers[0] && dst != sequencers[0];
+    });
+
+    TestClient client(&nopaxosClient);
+    int numUpcalls = 0;
+    Client::continuation_t upcall = [&](const string &req, const string &reply) {
+        numUpcalls++;
+        EXPECT_EQ("reply: " + req, reply);
+    };
+    for (int i = 0; i < NUM_PACKETS; i++) {
+        client.SendNext(upcall);
+    }
+
+    transport->Timer(3000, [&]() {
+        transport->CancelAllTimers();
+    });
+    transport->Run();
+
+    EXPECT_EQ(NUM_PACKETS, numUpcalls);
+    // The burst of timeouts moves the client on by one sequencer, not
+    // one per request
+    EXPECT_EQ(NUM_PACKETS, requestsToSequencer[0]);
+    EXPECT_EQ(NUM_PACKETS, requestsToSequencer[1]);
+    EXPECT_EQ(0, requestsToSequencer[2]);
+    EXPECT_EQ(1, sequencers[1]->GetStats().sessNum);
+}
+
+TEST_F(NOPaxosTest, ManyOpsBetweenSyncs)
+{
+    // More ops than the quorum windows can grow to before the first
+    // sync, then a packet lost to every replica, so the sync point and
+    // the gap are both far past anything committed
+    const int NUM_PACKETS = 64 * 1024 + 100;
+
+    transport->AddFilter(1, [&](TransportReceiver *src, std::pair<int, int> srcIdx,
+                                TransportReceiver *dst, std::pair<int, int> dstIdx,
+                                Message &m, uint64_t &delay) {
+        return !IsSequencer(src) || GetRequest(m).msgnum() != NUM_PACKETS;
+    });
+
+    NOPaxosClient nopaxosClient(*config,
+                                ReplicaAddress("localhost", "0"),
+                                transport);
+    TestClient client(&nopaxosClient);
+    int numUpcalls = 0;
+    Client::continuation_t upcall = [&](const string &req, const string &reply) {
+        numUpcalls++;
+        if (client.requestNum < NUM_PACKETS + 1) {
+            client.SendNext(upcall);
+        }
+    };
+    client.SendNext(upcall);
+
+    transport->Timer(3500, [&]() {
+        transport->CancelAllTimers();
+    });
+    transport->Run();
+
+    EXPECT_EQ(NUM_PACKETS + 1, numUpcalls);
+    // The followers only execute what a sync has committed
+    for (int i = 1; i < config->n; i++) {
+        EXPECT_EQ(NUM_PACKETS + 1, apps[i]->ops.size());
+    }
+}
+
 TEST_F(NOPaxosTest, LeaderGap)
 {
     const int NUM_CLIENTS = 2;
@@ -1304,3 +1773,68 @@ TEST_F(NOPaxosTest, SessionChange) {
     }
 }
 */
+
+static RequestMessage
+Stamped(sessnum_t sessnum, msgnum_t msgnum)
+{
+    RequestMessage msg;
+    msg.set_sessnum(sessnum);
+    msg.set_msgnum(msgnum);
+    return msg;
+}
+
+TEST(ReorderBuffer, Order)
+{
+    ReorderBuffer<RequestMessage> buf(16);
+    EXPECT_EQ(nullptr, buf.Front(1, 1));
+
+    // Out of order within the window, past it, and in the next session
+    for (msgnum_t m : {5, 3, 40, 4, 2, 20}) {
+        buf.Add(Stamped(1, m), 1, 1);
+    }
+    buf.Add(Stamped(2, 1), 1, 1);
+    buf.Add(Stamped(1, 3), 1, 1);
+    EXPECT_EQ(7u, buf.Size());
+
+    msgnum_t next = 1;
+    std::vector<msgnum_t> order;
+    while (RequestMessage *msg = buf.Front(1, next)) {
+        if (msg->sessnum() != 1) {
+            break;
+        }
+        order.push_back(msg->msgnum());
+        next = msg->msgnum() + 1;
+        buf.PopFront();
+    }
+    EXPECT_EQ((std::vector<msgnum_t>{2, 3, 4, 5, 20, 40}), order);
+
+    // Moving to the next session keeps its requests and drops stale ones
+    buf.Add(Stamped(1, 50), 1, next);
+    RequestMessage *msg = buf.Front(2, 1);
+    ASSERT_NE(nullptr, msg);
+    EXPECT_EQ(2u, msg->sessnum());
+    buf.PopFront();
+    EXPECT_EQ(0u, buf.Size());
+    EXPECT_EQ(7u, buf.MaxSize());
+}
+
+TEST(ReorderBuffer, Skip)
+{
+    ReorderBuffer<RequestMessage> buf(16);
+    for (msgnum_t m = 2; m <= 30; m++) {
+        buf.Add(Stamped(1, m), 1, 1);
+    }
+    // Requests behind the next expected one are discarded, and going
+    // back after a view change finds the rest again
+    RequestMessage *msg = buf.Front(1, 10);
+    ASSERT_NE(nullptr, msg);
+    EXPECT_EQ(10u, msg->msgnum());
+    EXPECT_EQ(21u, buf.Size());
+    msg = buf.Front(1, 5);
+    ASSERT_NE(nullptr, msg);
+    EXPECT_EQ(10u, msg->msgnum());
+    msg = buf.Front(1, 29);
+    ASSERT_NE(nullptr, msg);
+    EXPECT_EQ(29u, msg->msgnum());
+    EXPECT_EQ(2u, buf.Size());
+}
@@ -30,6 +30,7 @@
 
 #include <gtest/gtest.h>
 
+#include <atomic>
 #include <cstdio>
 #include <cstdlib>
 #include <memory>
@@ -38,6 +39,7 @@
 #include "common/replica.h"
 #include "lib/configuration.h"
 #include "lib/message.h"
+#include "lib/sigpipeline.h"
 #include "lib/signature.h"
 #include "lib/simtransport.h"
 #include "lib/transport.h"
@@ -81,7 +83,8 @@ struct System {
   unique_ptr<PbftReplica> *replicas;
   unique_ptr<PbftClient> *clients;
 
-  System(Security &security) : security(security), transport(true) {
+  System(Security &security, int verifyWorkers = 0)
+      : security(security), transport(true) {
     map<int, vector<ReplicaAddress> > replicaAddrs = {
         {0,
          {{"localhost", "1509"},
@@ -93,7 +96,8 @@ struct System {
     replicas = new unique_ptr<PbftReplica>[4];
     for (int i = 0; i < 4; i += 1) {
       replicas[i] = unique_ptr<PbftReplica>(
-          new PbftReplica(c, i, true, &transport, security, &apps[i]));
+          new PbftReplica(c, i, true, &transport, security, &apps[i],
+                          verifyWorkers));
     }
     clients = new unique_ptr<PbftClient>[numberClient];
     for (int i = 0; i < numberClient; i += 1) {
@@ -110,8 +114,9 @@ struct System {
   }
 };
 
-void OneClientMultiOp(int numberOp, Security &security) {
-  System<1> system(security);
+void OneClientMultiOp(int numberOp, Security &security,
+                      int verifyWorkers = 0) {
+  System<1> system(security, verifyWorkers);
   Client &client = *system.clients[0];
   Transport &transport = system.transport;
 
@@ -121,9 +126,16 @@ void OneClientMultiOp(int numberOp, Security &security) {
     char buf[100];
     sprintf(buf, "test%d", opIndex);
     ASSERT_EQ(req, buf);
+    // with workers, a replica whose messages are still being verified
+    // may lag the quorum that answered
+    int executed = 0;
     for (int i = 0; i < 4; i += 1) {
-      ASSERT_EQ(system.apps[i].LastOp(), buf);
+      if (verifyWorkers == 0) {
+        ASSERT_EQ(system.apps[i].LastOp(), buf);
+      }
+      executed += system.apps[i].LastOp() == buf;
     }
+    ASSERT_GE(executed, 2);
 
     sprintf(buf, "reply: test%d", opIndex);
     ASSERT_EQ(reply, buf);
@@ -139,6 +151,9 @@ void OneClientMultiOp(int numberOp, Security &security) {
   transport.Run();
 
   ASSERT_EQ(opIndex, numberOp);
+  for (int i = 0; i < 4; i += 1) {
+    ASSERT_EQ(system.apps[i].opList.size(), numberOp);
+  }
 }
 
 TEST(Pbft, 1Op) {
@@ -155,6 +170,66 @@ TEST(Pbft, 100Op) {
 
 TEST(Pbft, 100OpSign) { OneClientMultiOp(100, defaultSecurity); }
 
+TEST(Pbft, 100OpSignPipelined) { OneClientMultiOp(100, defaultSecurity, 4); }
+
+// every message through the pipeline is checked exactly once, and only
+// the ones with good signatures complete, in the order they came in
+TEST(Pbft, VerifyPipelineOnce) {
+  const int numberMsg = 40;
+  vector<string> packets;
+  for (int i = 0; i < numberMsg; i += 1) {
+    ToReplicaMessage m;
+    RequestMessage &request = *m.mutable_request();
+    request.mutable_req()->set_op("op");
+    request.mutable_req()->set_clientid(42);
+    request.mutable_req()->set_clientreqid(i);
+    request.set_relayed(false);
+    defaultSigner.Sign(request.req().SerializeAsString(),
+                       *request.mutable_sig());
+    if (i % 10 == 9) {
+      request.mutable_req()->set_op("forged");
+    }
+    packets.push_back(m.SerializeAsString());
+  }
+
+  for (int workers : {1, 4}) {
+    SimulatedTransport transport;
+    SignaturePipeline pipeline(&transport, workers);
+    unique_ptr<std::atomic<int>[]> checks(
+        new std::atomic<int>[numberMsg]);
+    vector<int> completed;
+    for (int i = 0; i < numberMsg; i += 1) {
+      checks[i] = 0;
+      auto msg = std::make_shared<ToReplicaMessage>();
+      msg->ParseFromString(packets[i]);
+      std::atomic<int> *check = &checks[i];
+      pipeline.Submit(
+          [msg, check]() {
+            *check += 1;
+            return defaultVerifier.Verify(
+                msg->request().req().SerializeAsString(),
+                msg->request().sig());
+          },
+          [msg, &completed]() {
+            completed.push_back(msg->request().req().clientreqid());
+          });
+    }
+    transport.Run();
+
+    for (int i = 0; i < numberMsg; i += 1) {
+      ASSERT_EQ(checks[i], 1) << "message " << i;
+    }
+    vector<int> expected;
+    for (int i = 0; i < numberMsg; i += 1) {
+      if (i % 10 != 9) {
+        expected.push_back(i);
+      }
+    }
+    ASSERT_EQ(completed, expected);
+    ASSERT_EQ(pipeline.Pending(), 0);
+  }
+}
+
 using filter_t = std::function<bool(TransportReceiver *, std::pair<int, int>,
                                     TransportReceiver *, std::pair<int, int>,
                                     Message &, uint64_t &delay)>;
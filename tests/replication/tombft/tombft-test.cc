@@ -101,3 +101,107 @@ TEST(TomBFT, 1Op) {
   tp.Run();
   // ASSERT_STREQ(reply.c_str(), "reply: test");
 }
+
+// each replica shares its own HMAC key with the sequencer
+class HmacSecurity : public Security {
+ public:
+  HmacSecurity(int n) : Security(client_signer, client_verifier) {
+    for (int i = 0; i < n; i += 1) {
+      signers.emplace_back(new HmacSigner("replica key " + to_string(i)));
+      verifiers.emplace_back(new HmacVerifier(*signers.back()));
+    }
+  }
+
+  const Signer &ReplicaSigner(int replica_id) const override {
+    return client_signer;
+  }
+  const Verifier &ReplicaVerifier(int replica_id) const override {
+    return client_verifier;
+  }
+  const Signer &SequencerSigner(int replica_id, int index) const override {
+    return *signers[replica_id];
+  }
+  const Verifier &SequencerVerifier(int replica_id,
+                                    int index) const override {
+    return *verifiers[replica_id];
+  }
+
+  Signer client_signer;
+  Verifier client_verifier;
+  vector<unique_ptr<HmacSigner> > signers;
+  vector<unique_ptr<HmacVerifier> > verifiers;
+};
+
+TEST(TomBFT, SequencerHmac) {
+  const int n = 7;
+  map<int, vector<ReplicaAddress> > replicaAddrs;
+  for (int i = 0; i < n; i += 1) {
+    replicaAddrs[0].push_back(ReplicaAddress("localhost", to_string(1509 + i)));
+  }
+  Configuration c(1, n, 2, replicaAddrs, nullptr, {{"localhost", "8888"}});
+  SimulatedTransport tp;
+  HmacSecurity s(n);
+  // the last replica has the wrong key, so it must drop the request
+  HmacSecurity wrong(n);
+  wrong.verifiers[n - 1].reset(new HmacVerifier(HmacSigner("wrong key")));
+
+  TestApp app[n];
+  unique_ptr<TomBFTReplica> replica[n];
+  for (int i = 0; i < n; i += 1) {
+    replica[i] = unique_ptr<TomBFTReplica>(new TomBFTReplica(
+        c, i, true, &tp, i == n - 1 ? wrong : s, &app[i]));
+  }
+  TomBFTSequencer seq(c, &tp, s, 0);
+  TomBFTClient client(c, ReplicaAddress("localhost", "0"), &tp, s);
+
+  client.Invoke("test", [&](const string &req, const string &reply) {});
+  tp.Timer(100, [&]() { tp.CancelAllTimers(); });
+  tp.Run();
+
+  for (int i = 0; i < n - 1; i += 1) {
+    ASSERT_EQ(app[i].op_vec.size(), 1);
+    ASSERT_EQ(app[i].op_vec[0], "test");
+  }
+  ASSERT_EQ(app[n - 1].op_vec.size(), 0);
+}
+
+TEST(TomBFT, VerifyPipeline) {
+  map<int, vector<ReplicaAddress> > replicaAddrs = {{0,
+                                                     {{"localhost", "1509"},
+                                                      {"localhost", "1510"},
+                                                      {"localhost", "1511"},
+                                                      {"localhost", "1512"}}}};
+  Configuration c(1, 4, 1, replicaAddrs, nullptr, {{"localhost", "8888"}});
+  SimulatedTransport tp;
+  NopSecurity s;
+  TestApp app[4];
+  unique_ptr<TomBFTReplica> replica[4];
+  for (int i = 0; i < 4; i += 1) {
+    // client signatures checked, and replies signed, on two workers each
+    replica[i] = unique_ptr<TomBFTReplica>(
+        new TomBFTReplica(c, i, true, &tp, s, &app[i], 2));
+  }
+  TomBFTSequencer seq(c, &tp, s, 0);
+  TomBFTClient client(c, ReplicaAddress("localhost", "0"), &tp, s);
+
+  const int num_ops = 20;
+  int done = 0;
+  function<void(const string &, const string &)> on_reply;
+  on_reply = [&](const string &req, const string &reply) {
+    done += 1;
+    if (done < num_ops) {
+      client.Invoke("test" + to_string(done), on_reply);
+    }
+  };
+  client.Invoke("test0", on_reply);
+  tp.Timer(1000, [&]() { tp.CancelAllTimers(); });
+  tp.Run();
+
+  ASSERT_EQ(done, num_ops);
+  for (int i = 0; i < 4; i += 1) {
+    ASSERT_EQ(app[i].op_vec.size(), num_ops);
+    for (int j = 0; j < num_ops; j += 1) {
+      ASSERT_EQ(app[i].op_vec[j], "test" + to_string(j));
+    }
+  }
+}
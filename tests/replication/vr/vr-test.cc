@@ -42,6 +42,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <gtest/gtest.h>
+#include <set>
 #include <vector>
 #include <sstream>
 
@@ -73,8 +74,27 @@ public:
         reply = "unlreply: " + req;
     }
 
+    virtual bool SnapshotUpcall(string &snapshot) override {
+        snapshot.clear();
+        for (const string &op : ops) {
+            snapshot += op + '\n';
+        }
+        return true;
+    }
+
+    virtual void RestoreUpcall(const string &snapshot) override {
+        std::istringstream stream(snapshot);
+        string op;
+        ops.clear();
+        while (std::getline(stream, op)) {
+            ops.push_back(op);
+        }
+        restores++;
+    }
+
     std::vector<string> ops;
     std::vector<string> unloggedOps;
+    int restores = 0;
 
 };
 
@@ -87,6 +107,7 @@ protected:
     SimulatedTransport *transport;
     Configuration *config;
     int requestNum;
+    opnum_t checkpointInterval = Replica::DEFAULT_CHECKPOINT_INTERVAL;
 
     virtual void SetUp() {
         map<int, vector<ReplicaAddress> > replicaAddrs =
@@ -102,7 +123,9 @@ protected:
 
         for (int i = 0; i < config->n; i++) {
             apps.push_back(new VRTestApp());
-            replicas.push_back(new VRReplica(*config, i, true, transport, GetParam(), apps[i]));
+            replicas.push_back(new VRReplica(*config, i, true, transport,
+                                             GetParam(), apps[i],
+                                             checkpointInterval));
         }
 
         client = new VRClient(*config,
@@ -177,6 +200,45 @@ TEST_P(VRTest, OneOp)
     }
 }
 
+TEST_P(VRTest, Pipelined)
+{
+    const int NUM_OPS = 8;
+    VRClient pipelined(*config, ReplicaAddress("localhost", "0"),
+                       transport, 0, NUM_OPS);
+
+    // Deliver the requests in the reverse of the order they were
+    // sent, so each one overtakes the ones before it
+    int sent = 0;
+    transport->AddFilter(10, [&](TransportReceiver *src, pair<int, int> srcIdx,
+                                 TransportReceiver *dst, pair<int, int> dstIdx,
+                                 Message &m, uint64_t &delay) {
+        if (src == &pipelined) {
+            delay = 100 - sent++;
+        }
+        return true;
+    });
+
+    std::set<string> replies;
+    for (int i = 0; i < NUM_OPS; i++) {
+        pipelined.Invoke(RequestOp(i), [&](const string &req,
+                                           const string &reply) {
+            EXPECT_EQ("reply: "+req, reply);
+            replies.insert(reply);
+            if (replies.size() == NUM_OPS) {
+                transport->CancelAllTimers();
+            }
+        });
+    }
+    transport->Run();
+
+    // Every request ran once, newest first
+    EXPECT_EQ(NUM_OPS, replies.size());
+    ASSERT_EQ(NUM_OPS, apps[0]->ops.size());
+    for (int i = 0; i < NUM_OPS; i++) {
+        EXPECT_EQ(RequestOp(NUM_OPS-1-i), apps[0]->ops[i]);
+    }
+}
+
 TEST_P(VRTest, Unlogged)
 {
     auto upcall = [this](const string &req, const string &reply) {
@@ -237,6 +299,39 @@ TEST_P(VRTest, UnloggedTimeout)
     EXPECT_EQ(1, timeouts);
 }
 
+TEST_P(VRTest, LeaseRead)
+{
+    int reads = 0;
+    Client::continuation_t readUpcall = [&](const string &req,
+                                            const string &reply) {
+        EXPECT_EQ(req, LastRequestOp());
+        EXPECT_EQ(reply, "unlreply: "+LastRequestOp());
+        if (++reads < 3) {
+            requestNum++;
+            client->InvokeRead(LastRequestOp(), readUpcall);
+        } else {
+            transport->CancelAllTimers();
+        }
+    };
+    auto upcall = [&](const string &req, const string &reply) {
+        EXPECT_EQ(reply, "reply: "+LastRequestOp());
+        requestNum++;
+        client->InvokeRead(LastRequestOp(), readUpcall);
+    };
+
+    ClientSendNext(upcall);
+    transport->Run();
+
+    // The leader answered the reads itself, without logging them
+    EXPECT_EQ(3, reads);
+    EXPECT_EQ(3, apps[0]->unloggedOps.size());
+    for (int i = 0; i < config->n; i++) {
+        EXPECT_EQ(1, apps[i]->ops.size());
+        if (i != 0) {
+            EXPECT_EQ(0, apps[i]->unloggedOps.size());
+        }
+    }
+}
 
 TEST_P(VRTest, ManyOps)
 {
@@ -648,3 +743,90 @@ TEST_P(VRTest, Stress)
 INSTANTIATE_TEST_CASE_P(Batching,
                         VRTest,
                         ::testing::Values(1, 8));
+
+class VRCheckpointTest : public VRTest
+{
+protected:
+    VRCheckpointTest() { checkpointInterval = 3; }
+};
+
+TEST_P(VRCheckpointTest, StateTransfer)
+{
+    Client::continuation_t upcall = [&](const string &req, const string &reply) {
+        EXPECT_EQ(reply, "reply: "+LastRequestOp());
+
+        if (requestNum == 12) {
+            // Replica 1 is now behind the truncated logs of the others
+            transport->RemoveFilter(10);
+        }
+
+        if (requestNum < 19) {
+            ClientSendNext(upcall);
+        } else {
+            transport->CancelAllTimers();
+        }
+    };
+
+    ClientSendNext(upcall);
+
+    // Drop messages to or from replica 1
+    transport->AddFilter(10, [](TransportReceiver *src, pair<int, int> srcIdx,
+                                TransportReceiver *dst, pair<int, int> dstIdx,
+                                Message &m, uint64_t &delay) {
+        if ((srcIdx.second == 1) || (dstIdx.second == 1)) {
+            return false;
+        }
+        return true;
+    });
+
+    transport->Run();
+
+    EXPECT_EQ(0, apps[0]->restores);
+    EXPECT_EQ(1, apps[1]->restores);
+    for (int i = 0; i < config->n; i++) {
+        EXPECT_EQ(20, apps[i]->ops.size());
+        for (int j = 0; j < 20; j++) {
+            EXPECT_EQ(RequestOp(j), apps[i]->ops[j]);
+        }
+    }
+}
+
+TEST_P(VRCheckpointTest, Recovery)
+{
+    Client::continuation_t upcall = [&](const string &req, const string &reply) {
+        EXPECT_EQ(reply, "reply: "+LastRequestOp());
+
+        if (requestNum == 9) {
+            // Destroy and recover replica 2 from a truncated log
+            delete apps[2];
+            delete replicas[2];
+            apps[2] = new VRTestApp();
+            replicas[2] = new VRReplica(*config, 2, false, transport,
+                                        GetParam(), apps[2],
+                                        checkpointInterval);
+        }
+        if (requestNum < 14) {
+            transport->Timer(10000, [&]() {
+                    ClientSendNext(upcall);
+                });
+        } else {
+            transport->CancelAllTimers();
+        }
+    };
+
+    ClientSendNext(upcall);
+
+    transport->Run();
+
+    EXPECT_EQ(1, apps[2]->restores);
+    for (int i = 0; i < config->n; i++) {
+        EXPECT_EQ(15, apps[i]->ops.size());
+        for (int j = 0; j < 15; j++) {
+            EXPECT_EQ(RequestOp(j), apps[i]->ops[j]);
+        }
+    }
+}
+
+INSTANTIATE_TEST_CASE_P(Batching,
+                        VRCheckpointTest,
+                        ::testing::Values(1, 8));
@@ -9,19 +9,21 @@ OBJS-all-proto-clients := $(OBJS-eris-client) $(OBJS-granola-client) $(OBJS-stor
 OBJS-all-proto-servers := $(OBJS-eris-server) $(OBJS-granola-server) $(OBJS-store-unreplicated-server) \
     $(OBJS-spanner-server) $(OBJS-tapir-server) $(OBJS-eris-fcor)
 
-$(d)terminalClient: $(OBJS-all-app-clients) $(OBJS-all-proto-clients) $(LIB-configuration) $(LIB-udptransport) $(o)terminalClient.o
+$(d)terminalClient: $(OBJS-all-app-clients) $(OBJS-all-proto-clients) $(LIB-configuration) $(LIB-udptransport) $(LIB-shmtransport) $(o)terminalClient.o
 
-$(d)kvClient: $(OBJS-all-app-clients) $(OBJS-all-proto-clients) $(LIB-configuration) $(LIB-udptransport) \
+$(d)kvClient: $(OBJS-all-app-clients) $(OBJS-all-proto-clients) $(LIB-configuration) $(LIB-udptransport) $(LIB-shmtransport) \
     $(LIB-latency) $(o)kvClient.o
 
-$(d)tpccClient: $(OBJS-all-app-clients) $(OBJS-all-proto-clients) $(LIB-configuration) $(LIB-udptransport) \
+$(d)tpccClient: $(OBJS-all-app-clients) $(OBJS-all-proto-clients) $(LIB-configuration) $(LIB-udptransport) $(LIB-shmtransport) \
     $(LIB-latency) $(o)tpccClient.o
 
-$(d)txnServer: $(OBJS-all-app-txnservers) $(OBJS-all-proto-servers) $(LIB-udptransport) $(o)server.o
+$(d)txnServer: $(OBJS-all-app-txnservers) $(OBJS-all-proto-servers) $(LIB-udptransport) $(LIB-shmtransport) \
+    $(LIB-iouringtransport) $(o)server.o
 
-$(d)fcor: $(OBJS-eris-fcor) $(OBJS-vr-replica) $(o)fcor.o
+$(d)fcor: $(OBJS-eris-fcor) $(OBJS-vr-replica) $(LIB-udptransport) $(LIB-shmtransport) \
+    $(o)fcor.o
 
 $(d)ycsb: $(OBJS-all-app-clients) $(OBJS-all-proto-clients) $(LIB-configuration) \
-		$(LIB-udptransport) $(LIB-dpdktransport) $(LIB-latency) $(o)ycsb.o
+		$(LIB-udptransport) $(LIB-shmtransport) $(LIB-dpdktransport) $(LIB-latency) $(o)ycsb.o
 
 BINS += $(d)terminalClient $(d)kvClient $(d)tpccClient $(d)txnServer $(d)fcor $(d)ycsb
@@ -28,6 +28,7 @@
  *
  **********************************************************************/
 
+#include "lib/shmtransport.h"
 #include "lib/udptransport.h"
 #include "replication/vr/replica.h"
 #include "transaction/eris/fcor.h"
@@ -39,7 +40,7 @@ using namespace dsnet::transaction::eris;
 static void
 Usage(const char *prog)
 {
-        fprintf(stderr, "usage: %s -c conf-file -e eris-config-fiel -i replica-index\n", prog);
+        fprintf(stderr, "usage: %s -c conf-file -e eris-config-fiel -i replica-index [-P udp|shm]\n", prog);
         exit(1);
 }
 
@@ -49,9 +50,10 @@ main(int argc, char **argv)
     int index = -1;
     const char *configPath = nullptr;
     const char *erisConfigPath = nullptr;
+    enum { TRANSPORT_UDP, TRANSPORT_SHM } transport_type = TRANSPORT_UDP;
 
     int opt;
-    while ((opt = getopt(argc, argv, "c:e:i:")) != -1) {
+    while ((opt = getopt(argc, argv, "c:e:i:P:")) != -1) {
         switch (opt) {
         case 'c':
         {
@@ -78,6 +80,18 @@ main(int argc, char **argv)
             break;
         }
 
+        case 'P':
+        {
+            if (strcasecmp(optarg, "udp") == 0) {
+                transport_type = TRANSPORT_UDP;
+            } else if (strcasecmp(optarg, "shm") == 0) {
+                transport_type = TRANSPORT_SHM;
+            } else {
+                fprintf(stderr, "unknown transport '%s'\n", optarg);
+            }
+            break;
+        }
+
         default:
             fprintf(stderr, "Unknown argument %s\n", argv[optind]);
             Usage(argv[0]);
@@ -121,7 +135,15 @@ main(int argc, char **argv)
         Usage(argv[0]);
     }
 
-    dsnet::UDPTransport *transport = new dsnet::UDPTransport();
+    dsnet::Transport *transport = nullptr;
+    switch (transport_type) {
+    case TRANSPORT_UDP:
+        transport = new dsnet::UDPTransport();
+        break;
+    case TRANSPORT_SHM:
+        transport = new dsnet::ShmTransport();
+        break;
+    }
     Fcor *fcor = new Fcor(erisConfig, transport);
     VRReplica *replica = new VRReplica(config, index, true, transport, 1, fcor);
 
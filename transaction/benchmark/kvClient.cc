@@ -15,6 +15,7 @@
 #include "lib/timeval.h"
 #include "lib/configuration.h"
 #include "lib/message.h"
+#include "lib/shmtransport.h"
 #include "lib/udptransport.h"
 #include "transaction/common/frontend/txnclientcommon.h"
 #include "transaction/apps/kvstore/client.h"
@@ -69,9 +70,10 @@ main(int argc, char **argv)
     string host;
 
     protomode_t mode = PROTO_UNKNOWN;
+    enum { TRANSPORT_UDP, TRANSPORT_SHM } transport_type = TRANSPORT_UDP;
 
     int opt;
-    while ((opt = getopt(argc, argv, "c:d:h:N:l:w:k:f:m:z:p:g:i:")) != -1) {
+    while ((opt = getopt(argc, argv, "c:d:h:N:l:w:k:f:m:z:p:g:i:P:")) != -1) {
         switch (opt) {
         case 'c': // Configuration path
         {
@@ -210,6 +212,18 @@ main(int argc, char **argv)
             break;
         }
 
+        case 'P':
+        {
+            if (strcasecmp(optarg, "udp") == 0) {
+                transport_type = TRANSPORT_UDP;
+            } else if (strcasecmp(optarg, "shm") == 0) {
+                transport_type = TRANSPORT_SHM;
+            } else {
+                fprintf(stderr, "unknown transport '%s'\n", optarg);
+            }
+            break;
+        }
+
         default:
             fprintf(stderr, "Unknown argument %s\n", argv[optind]);
             break;
@@ -242,7 +256,15 @@ main(int argc, char **argv)
     }
 
     Configuration config(configStream);
-    UDPTransport *transport = new UDPTransport();
+    Transport *transport = nullptr;
+    switch (transport_type) {
+    case TRANSPORT_UDP:
+        transport = new UDPTransport();
+        break;
+    case TRANSPORT_SHM:
+        transport = new ShmTransport();
+        break;
+    }
     ReplicaAddress addr(host, "0");
     switch (mode) {
     case PROTO_ERIS: {
@@ -29,6 +29,8 @@
  **********************************************************************/
 
 #include <sched.h>
+#include "lib/iouringtransport.h"
+#include "lib/shmtransport.h"
 #include "lib/udptransport.h"
 #include "transaction/eris/server.h"
 #include "transaction/granola/server.h"
@@ -58,10 +60,11 @@ main(int argc, char **argv)
     app_t app = APP_UNKNOWN;
     protomode_t mode = PROTO_UNKNOWN;
     float dropRate = 0.0;
+    enum { TRANSPORT_UDP, TRANSPORT_IOURING, TRANSPORT_SHM } transport_type = TRANSPORT_UDP;
 
     // Parse arguments
     int opt;
-    while ((opt = getopt(argc, argv, "c:i:a:m:n:N:w:p:k:f:r:o:d:l")) != -1) {
+    while ((opt = getopt(argc, argv, "c:i:a:m:n:N:w:p:P:k:f:r:o:d:l")) != -1) {
         switch (opt) {
         case 'c':
             configPath = optarg;
@@ -204,6 +207,20 @@ main(int argc, char **argv)
             break;
         }
 
+        case 'P':
+        {
+            if (strcasecmp(optarg, "udp") == 0) {
+                transport_type = TRANSPORT_UDP;
+            } else if (strcasecmp(optarg, "iouring") == 0) {
+                transport_type = TRANSPORT_IOURING;
+            } else if (strcasecmp(optarg, "shm") == 0) {
+                transport_type = TRANSPORT_SHM;
+            } else {
+                fprintf(stderr, "unknown transport '%s'\n", optarg);
+            }
+            break;
+        }
+
         default:
             fprintf(stderr, "Unknown argument %s\n", argv[optind]);
         }
@@ -295,7 +312,18 @@ main(int argc, char **argv)
         exit(1);
     }
 
-    UDPTransport *transport = new UDPTransport(dropRate);
+    Transport *transport = nullptr;
+    switch (transport_type) {
+    case TRANSPORT_UDP:
+        transport = new UDPTransport(dropRate);
+        break;
+    case TRANSPORT_IOURING:
+        transport = new IOUringTransport(dropRate);
+        break;
+    case TRANSPORT_SHM:
+        transport = new ShmTransport(dropRate);
+        break;
+    }
     ASSERT(txnServer != nullptr);
     Replica *protoServer;
 
@@ -7,6 +7,7 @@
  **********************************************************************/
 
 #include <random>
+#include "lib/shmtransport.h"
 #include "lib/udptransport.h"
 #include "transaction/common/frontend/txnclientcommon.h"
 #include "transaction/apps/kvstore/client.h"
@@ -33,9 +34,10 @@ main(int argc, char **argv)
     string host;
 
     protomode_t mode = PROTO_UNKNOWN;
+    enum { TRANSPORT_UDP, TRANSPORT_SHM } transport_type = TRANSPORT_UDP;
 
     int opt;
-    while ((opt = getopt(argc, argv, "c:h:N:m:")) != -1) {
+    while ((opt = getopt(argc, argv, "c:h:N:m:P:")) != -1) {
         switch (opt) {
         case 'c': // Configuration path
         {
@@ -72,6 +74,18 @@ main(int argc, char **argv)
             break;
         }
 
+        case 'P':
+        {
+            if (strcasecmp(optarg, "udp") == 0) {
+                transport_type = TRANSPORT_UDP;
+            } else if (strcasecmp(optarg, "shm") == 0) {
+                transport_type = TRANSPORT_SHM;
+            } else {
+                fprintf(stderr, "unknown transport '%s'\n", optarg);
+            }
+            break;
+        }
+
         default:
             fprintf(stderr, "Unknown argument %s\n", argv[optind]);
             break;
@@ -93,7 +107,15 @@ main(int argc, char **argv)
               configPath);
     }
     Configuration config(configStream);
-    UDPTransport *transport = new UDPTransport();
+    Transport *transport = nullptr;
+    switch (transport_type) {
+    case TRANSPORT_UDP:
+        transport = new UDPTransport();
+        break;
+    case TRANSPORT_SHM:
+        transport = new ShmTransport();
+        break;
+    }
     ReplicaAddress addr(host, "0");
 
     switch (mode) {
@@ -9,6 +9,7 @@
 #include "lib/latency.h"
 #include "lib/timeval.h"
 #include "lib/message.h"
+#include "lib/shmtransport.h"
 #include "lib/udptransport.h"
 #include "transaction/apps/tpcc/clientthread.h"
 #include "transaction/benchmark/header.h"
@@ -51,9 +52,10 @@ main(int argc, char **argv) {
     ClientThread *tpccClient;
 
     protomode_t mode = PROTO_UNKNOWN;
+    enum { TRANSPORT_UDP, TRANSPORT_SHM } transport_type = TRANSPORT_UDP;
 
 	int opt;
-	while ((opt = getopt(argc, argv, "c:h:d:s:w:p:i:r:o:m:")) != -1) {
+	while ((opt = getopt(argc, argv, "c:h:d:s:w:p:i:r:o:m:P:")) != -1) {
 		switch (opt) {
 		case 'c':
 		{
@@ -144,6 +146,18 @@ main(int argc, char **argv) {
             }
             break;
 
+		case 'P':
+		{
+			if (strcasecmp(optarg, "udp") == 0) {
+				transport_type = TRANSPORT_UDP;
+			} else if (strcasecmp(optarg, "shm") == 0) {
+				transport_type = TRANSPORT_SHM;
+			} else {
+				fprintf(stderr, "unknown transport '%s'\n", optarg);
+			}
+			break;
+		}
+
 		default:
 			fprintf(stderr, "Unkown argument %s\n", argv[optind]);
 			break;
@@ -170,7 +184,15 @@ main(int argc, char **argv) {
     dsnet::Configuration config(configStream);
 
     total_warehouses = nshards * warehouse_per_shard;
-    UDPTransport *transport = new UDPTransport();
+    Transport *transport = nullptr;
+    switch (transport_type) {
+    case TRANSPORT_UDP:
+        transport = new UDPTransport();
+        break;
+    case TRANSPORT_SHM:
+        transport = new ShmTransport();
+        break;
+    }
     ReplicaAddress addr(host, "0");
 
     switch (mode) {
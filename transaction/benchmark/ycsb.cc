@@ -15,6 +15,7 @@
 #include "lib/timeval.h"
 #include "lib/configuration.h"
 #include "lib/message.h"
+#include "lib/shmtransport.h"
 #include "lib/udptransport.h"
 #include "lib/dpdktransport.h"
 #include "transaction/common/frontend/txnclientcommon.h"
@@ -153,7 +154,7 @@ main(int argc, char **argv)
     Client *protoClient = nullptr;
 
     protomode_t mode = PROTO_UNKNOWN;
-    enum { TRANSPORT_UDP, TRANSPORT_DPDK } transport_type = TRANSPORT_UDP;
+    enum { TRANSPORT_UDP, TRANSPORT_DPDK, TRANSPORT_SHM } transport_type = TRANSPORT_UDP;
 
     int opt;
     while ((opt = getopt(argc, argv, "c:d:e:f:gh:i:k:m:N:p:r:s:u:v:w:x:z:Z:")) != -1) {
@@ -207,6 +208,8 @@ main(int argc, char **argv)
                 transport_type = TRANSPORT_UDP;
             } else if (strcasecmp(optarg, "dpdk") == 0) {
                 transport_type = TRANSPORT_DPDK;
+            } else if (strcasecmp(optarg, "shm") == 0) {
+                transport_type = TRANSPORT_SHM;
             } else {
                 fprintf(stderr, "unknown transport '%s'\n", optarg);
             }
@@ -379,6 +382,9 @@ main(int argc, char **argv)
         case TRANSPORT_DPDK:
             transport = new dsnet::DPDKTransport(dev_port, 0, transport_cmdline);
             break;
+        case TRANSPORT_SHM:
+            transport = new dsnet::ShmTransport();
+            break;
     }
 
     switch (mode) {
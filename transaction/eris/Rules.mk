@@ -1,7 +1,7 @@
 d := $(dir $(lastword $(MAKEFILE_LIST)))
 
 SRCS += $(addprefix $(d), \
-	message.cc client.cc server.cc fcor.cc sequencer.cc)
+	message.cc client.cc server.cc fcor.cc)
 
 PROTOS += $(addprefix $(d), eris-proto.proto)
 
@@ -14,5 +14,3 @@ OBJS-eris-server := $(o)server.o $(OBJS-replica) \
     $(OBJS-vr-client) $(OBJS-common)
 
 OBJS-eris-fcor := $(o)fcor.o $(LIB-configuration) $(OBJS-replica) $(OBJS-common)
-
-OBJS-eris-sequencer := $(o)sequencer.o
@@ -1,5 +1,6 @@
 #include <vector>
 
+#include "lib/message.h"
 #include "transaction/eris/sequencer.h"
 
 namespace dsnet {
@@ -9,14 +10,45 @@ namespace eris {
 ErisSequencer::ErisSequencer(const Configuration &config,
                              Transport *transport, int id)
     : Sequencer(config, transport, id),
-      sess_num_(id) { }
+      sess_num_(id), num_groups_(config.g),
+      msg_nums_(new std::atomic<MsgNum>[config.g]),
+      multi_group_packets_(0)
+{
+    for (int i = 0; i < num_groups_; i++) {
+        msg_nums_[i] = 0;
+    }
+}
 
 ErisSequencer::~ErisSequencer() { }
 
+ErisSequencer::Stats
+ErisSequencer::GetStats() const
+{
+    Stats s;
+    s.sessNum = sess_num_;
+    for (int i = 0; i < num_groups_; i++) {
+        s.stamped.push_back(msg_nums_[i]);
+    }
+    s.multiGroupPackets = multi_group_packets_;
+    return s;
+}
+
+void
+ErisSequencer::PrintStats() const
+{
+    Stats s = GetStats();
+    for (size_t i = 0; i < s.stamped.size(); i++) {
+        Notice("Session %u group %zu: stamped %lu messages",
+               s.sessNum, i, s.stamped[i]);
+    }
+    Notice("%lu messages addressed to several groups",
+           s.multiGroupPackets);
+}
+
 void
 ErisSequencer::ReceiveMessage(const TransportAddress &remote, void *buf, size_t size)
 {
-    std::vector<int> groups;
+    static thread_local std::vector<int> groups;
     char *p = (char *)buf;
     HeaderSize header_sz = NTOH_HEADERSIZE(*(HeaderSize *)p);
     p += sizeof(HeaderSize);
@@ -27,13 +59,32 @@ ErisSequencer::ReceiveMessage(const TransportAddress &remote, void *buf, size_t
         // Message number for each group
         NumGroups n = NTOH_NUMGROUPS(*(NumGroups *)p);
         p += sizeof(NumGroups);
+        groups.clear();
+        char *stamps = p;
         for (int i = 0; i < n; i++) {
             GroupID g = NTOH_GROUPID(*(GroupID *)p);
+            if (g >= (GroupID)num_groups_) {
+                Warning("Dropping message for unknown group %u", g);
+                return;
+            }
             groups.push_back(g);
+            p += sizeof(GroupID) + sizeof(MsgNum);
+        }
+
+        std::unique_lock<std::mutex> l(multi_group_lock_, std::defer_lock);
+        if (n > 1) {
+            l.lock();
+            multi_group_packets_++;
+        }
+        p = stamps;
+        for (int g : groups) {
             p += sizeof(GroupID);
             *(MsgNum *)p = HTON_MSGNUM(++msg_nums_[g]);
             p += sizeof(MsgNum);
         }
+        if (n > 1) {
+            l.unlock();
+        }
 
         transport_->SendMessageToGroups(this, groups, BufferMessage(buf, size));
     }
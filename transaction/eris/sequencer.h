@@ -1,6 +1,9 @@
 #pragma once
 
-#include <unordered_map>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 #include "sequencer/sequencer.h"
 #include "transaction/eris/types.h"
@@ -9,6 +12,12 @@ namespace dsnet {
 namespace transaction {
 namespace eris {
 
+// Stamps each packet in place with a msg num for every group it is
+// addressed to. ReceiveMessage may be called from several receive
+// threads at once: a packet for one group takes its msg num from that
+// group's atomic counter, while packets for several groups are stamped
+// one at a time, so any two of them are in the same order in every
+// group they share.
 class ErisSequencer : public Sequencer {
 public:
     ErisSequencer(const Configuration &config, Transport *transport, int id);
@@ -17,9 +26,21 @@ public:
     virtual void ReceiveMessage(const TransportAddress &remote,
                                 void *buf, size_t size) override;
 
+    struct Stats {
+        SessNum sessNum;
+        // Msg num of the last packet stamped for each group
+        std::vector<MsgNum> stamped;
+        uint64_t multiGroupPackets;
+    };
+    Stats GetStats() const;
+    virtual void PrintStats() const override;
+
 private:
     SessNum sess_num_;
-    std::unordered_map<GroupID, MsgNum> msg_nums_;
+    int num_groups_;
+    std::unique_ptr<std::atomic<MsgNum>[]> msg_nums_;
+    std::mutex multi_group_lock_;
+    std::atomic<uint64_t> multi_group_packets_;
 };
 
 } // namespace eris
@@ -179,8 +179,9 @@ void
 ErisServer::ReceiveMessage(const TransportAddress &remote,
                            void *buf, size_t size)
 {
-    static ToServerMessage server_msg;
-    static ErisMessage m(server_msg);
+    static PBArena<ToServerMessage> arena;
+    ToServerMessage &server_msg = arena.New();
+    ErisMessage m(server_msg);
 
     m.Parse(buf, size);
 
@@ -1119,7 +1120,7 @@ ErisServer::ProcessNextOperation(const RequestMessage &msg,
 void
 ErisServer::UpdateClientTable(const Request &req)
 {
-    ClientTableEntry &entry = this->clientTable[req.clientid()];
+    ClientTable::Entry &entry = this->clientTable[req.clientid()];
 
     ASSERT(entry.lastReqId <= req.clientreqid());
 
@@ -1129,8 +1130,7 @@ ErisServer::UpdateClientTable(const Request &req)
     }
 
     entry.lastReqId = req.clientreqid();
-    entry.replied = false;
-    entry.reply.Clear();
+    entry.ClearReply();
 }
 
 void
@@ -1187,9 +1187,10 @@ ErisServer::ExecuteUptoOp(opnum_t opnum) {
         this->lastExecutedOp = op;
         if (logEntry->state == LOG_STATE_RECEIVED) {
             // Check client table for duplicates.
-            auto kv = this->clientTable.find(logEntry->request.clientid());
-            if (kv != this->clientTable.end()) {
-                ClientTableEntry &entry = kv->second;
+            ClientTable::Entry *cte =
+                this->clientTable.Find(logEntry->request.clientid());
+            if (cte != nullptr) {
+                ClientTable::Entry &entry = *cte;
                 if (logEntry->request.clientreqid() < entry.lastReqId) {
                     // Ignore stale request
                     continue;
@@ -1200,15 +1201,17 @@ ErisServer::ExecuteUptoOp(opnum_t opnum) {
                     // that case just discard the request.
                     if (entry.replied) {
                         // When we send the reply, update view and opnum in the reply
-                        entry.reply.mutable_view()->set_view_num(this->view);
-                        entry.reply.mutable_view()->set_sess_num(this->sessnum);
-                        entry.reply.set_op_num(op);
+                        ReplyMessage reply;
+                        reply.ParseFromString(entry.reply);
+                        reply.mutable_view()->set_view_num(this->view);
+                        reply.mutable_view()->set_sess_num(this->sessnum);
+                        reply.set_op_num(op);
 
                         TransportAddress *client_addr =
                             transport->LookupAddress(
                                     ReplicaAddress(logEntry->request.clientaddr()));
                         if (!this->transport->SendMessage(this, *client_addr,
-                                        ErisMessage(entry.reply))) {
+                                        ErisMessage(reply))) {
                                 RWarning("Failed to send reply to client");
                         }
                         delete client_addr;
@@ -1294,10 +1297,9 @@ ErisServer::ExecuteTxn(opnum_t opnum) {
         reply.set_commit(txnret.commit ? 1 : 0);
 
         /* Update client table with reply */
-        ClientTableEntry &cte = this->clientTable[logEntry->request.clientid()];
+        ClientTable::Entry &cte = this->clientTable[logEntry->request.clientid()];
         ASSERT(cte.lastReqId == logEntry->request.clientreqid());
-        cte.replied = true;
-        cte.reply = reply;
+        cte.SetReply(reply);
 
         TransportAddress *client_addr =
             transport->LookupAddress(
@@ -35,6 +35,7 @@
 #include "lib/assert.h"
 #include "lib/message.h"
 #include "lib/configuration.h"
+#include "common/clienttable.h"
 #include "common/log.h"
 #include "common/replica.h"
 #include "common/quorumset.h"
@@ -130,13 +131,8 @@ private:
     std::map<shardnum_t, msgnum_t> shardToMsgnum;
 
     /* Client information */
-    struct ClientTableEntry
-    {
-        uint64_t lastReqId;
-        bool replied;
-        proto::ReplyMessage reply;
-    };
-    std::map<uint64_t, ClientTableEntry> clientTable;
+    // Replies are serialized ReplyMessages
+    ClientTable clientTable;
 
     /* Pending requests */
     struct PendingRequest
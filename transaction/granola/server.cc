@@ -134,8 +134,9 @@ GranolaServer::HandleClientRequest(const TransportAddress &remote,
 {
     // Save client's address if not exist. Assume client
     // addresses never change.
-    if (this->clientAddresses.find(msg.request().clientid()) == this->clientAddresses.end()) {
-        this->clientAddresses.insert(std::pair<uint64_t, std::unique_ptr<TransportAddress> >(msg.request().clientid(), std::unique_ptr<TransportAddress>(remote.clone())));
+    ClientTable::Entry &entry = this->clientTable[msg.request().clientid()];
+    if (entry.address == nullptr) {
+        entry.address.reset(remote.clone());
     }
 
     // Non-leader replica ignore client requests
@@ -144,28 +145,24 @@ GranolaServer::HandleClientRequest(const TransportAddress &remote,
     }
 
     // Check the client table to see if this is a duplicate request
-    auto kv = this->clientTable.find(msg.request().clientid());
-    if (kv != this->clientTable.end()) {
-        ClientTableEntry &entry = kv->second;
-        if (msg.request().clientreqid() < entry.lastReqId) {
-            RDebug("Ignoring stale request");
-            return;
-        }
-        if (msg.request().clientreqid() == entry.lastReqId) {
-            // This is a duplicate request. Resend the reply if we
-            // have one. We might not have a reply to resend if we're
-            // waiting for the other replicas; in that case, just
-            // discard the request.
-            if (entry.replied) {
-                if (!(this->transport->SendMessage(this, remote,
-                                                   PBMessage(entry.reply)))) {
-                    RWarning("Failed to resend reply to client");
-                }
-                return;
-            } else {
-                RDebug("Received duplicate request but no reply available; ignoring");
-                return;
+    if (msg.request().clientreqid() < entry.lastReqId) {
+        RDebug("Ignoring stale request");
+        return;
+    }
+    if (msg.request().clientreqid() == entry.lastReqId) {
+        // This is a duplicate request. Resend the reply if we
+        // have one. We might not have a reply to resend if we're
+        // waiting for the other replicas; in that case, just
+        // discard the request.
+        if (entry.replied) {
+            if (!(this->transport->SendMessage(this, remote,
+                                               SerializedMessage(entry.reply)))) {
+                RWarning("Failed to resend reply to client");
             }
+            return;
+        } else {
+            RDebug("Received duplicate request but no reply available; ignoring");
+            return;
         }
     }
 
@@ -465,10 +462,11 @@ GranolaServer::CommitUpTo(opnum_t opnum)
             reply.set_shard_num(this->groupIdx);
             reply.set_status(entry->txnData.status);
             /* Update client table */
-            ClientTableEntry &cte = this->clientTable[entry->request.clientid()];
+            ClientTable::Entry &cte = this->clientTable[entry->request.clientid()];
             if (cte.lastReqId <= entry->request.clientreqid()) {
                 cte.lastReqId = entry->request.clientreqid();
-                cte.reply = reply;
+                // Not a reply to send yet; see the commit phase
+                reply.SerializeToString(&cte.reply);
             }
 
             // XXX If ABORT or CONFLICT should immediately reply to client
@@ -626,20 +624,21 @@ GranolaServer::ExecuteTxn(GranolaLogEntry *entry)
     }
     entry->state = LOG_STATE_EXECUTED;
     // Update client table and reply to client
-    ClientTableEntry &cte = this->clientTable[entry->request.clientid()];
+    ClientTable::Entry &cte = this->clientTable[entry->request.clientid()];
     if (cte.lastReqId <= entry->request.clientreqid()) {
         cte.lastReqId = entry->request.clientreqid();
-        cte.replied = true;
         // Use reply from the prepare phase
-        cte.reply.set_status(entry->txnData.status);
+        ReplyMessage reply;
+        reply.ParseFromString(cte.reply);
+        reply.set_status(entry->txnData.status);
+        cte.SetReply(reply);
 
         // Only leader send reply
         if (this->configuration.GetLeaderIndex(entry->viewstamp.view) == this->replicaIdx) {
-            auto it = this->clientAddresses.find(entry->request.clientid());
-            if (it != this->clientAddresses.end()) {
+            if (cte.address != nullptr) {
                 if (!this->transport->SendMessage(this,
-                            *it->second,
-                            PBMessage(cte.reply))) {
+                            *cte.address,
+                            SerializedMessage(cte.reply))) {
                     RWarning("Failed to send ReplyMessage to client");
                 }
             }
@@ -678,21 +677,19 @@ GranolaServer::ExecuteTxns()
             reply.set_status(proto::COMMIT);
 
             /* Update client table */
-            ClientTableEntry &cte = this->clientTable[entry->request.clientid()];
+            ClientTable::Entry &cte = this->clientTable[entry->request.clientid()];
             // XXX lastReqId should never be smaller once state transfer
             // is implemented
             if (cte.lastReqId <= entry->request.clientreqid()) {
                 cte.lastReqId = entry->request.clientreqid();
-                cte.replied = true;
-                cte.reply = reply;
+                cte.SetReply(reply);
             }
 
             /* Send reply to client (leader only) */
             if (this->configuration.GetLeaderIndex(entry->viewstamp.view) == this->replicaIdx) {
-                auto iter2 = this->clientAddresses.find(entry->request.clientid());
-                if (iter2 != this->clientAddresses.end()) {
+                if (cte.address != nullptr) {
                     if (!this->transport->SendMessage(this,
-                                *iter2->second,
+                                *cte.address,
                                 PBMessage(reply))) {
                         RWarning("Failed to send ReplyMessage to client");
                     }
@@ -713,7 +710,7 @@ GranolaServer::ExecuteTxns()
 void
 GranolaServer::UpdateClientTable(const Request &req)
 {
-    ClientTableEntry &entry = this->clientTable[req.clientid()];
+    ClientTable::Entry &entry = this->clientTable[req.clientid()];
 
     ASSERT(entry.lastReqId <= req.clientreqid());
 
@@ -722,8 +719,7 @@ GranolaServer::UpdateClientTable(const Request &req)
     }
 
     entry.lastReqId = req.clientreqid();
-    entry.replied = false;
-    entry.reply.Clear();
+    entry.ClearReply();
 }
 
 void
@@ -35,6 +35,7 @@
 #include "lib/message.h"
 #include "lib/configuration.h"
 #include "lib/transport.h"
+#include "common/clienttable.h"
 #include "common/replica.h"
 #include "common/quorumset.h"
 #include "common/messageset.h"
@@ -128,14 +129,8 @@ private:
     bool locking;
 
     /* Client information */
-    std::map<uint64_t, std::unique_ptr<TransportAddress> > clientAddresses;
-    struct ClientTableEntry
-    {
-        uint64_t lastReqId;
-        bool replied;
-        proto::ReplyMessage reply;
-    };
-    std::map<uint64_t, ClientTableEntry> clientTable;
+    // Replies are serialized ReplyMessages
+    ClientTable clientTable;
 
 
     /* Timestamps */
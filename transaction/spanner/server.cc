@@ -98,8 +98,9 @@ SpannerServer::HandleClientRequest(const TransportAddress &remote,
 {
     // Save client's address if not exist. Assume client
     // addresses never change.
-    if (this->clientAddresses.find(msg.request().clientid()) == this->clientAddresses.end()) {
-        this->clientAddresses.insert(std::pair<uint64_t, std::unique_ptr<TransportAddress> >(msg.request().clientid(), std::unique_ptr<TransportAddress>(remote.clone())));
+    ClientTable::Entry &entry = this->clientTable[msg.request().clientid()];
+    if (entry.address == nullptr) {
+        entry.address.reset(remote.clone());
     }
 
     // Non-leader replica ignore client requests
@@ -108,28 +109,24 @@ SpannerServer::HandleClientRequest(const TransportAddress &remote,
     }
 
     // Check the client table to see if this is a duplicate request
-    auto kv = this->clientTable.find(msg.request().clientid());
-    if (kv != this->clientTable.end()) {
-        ClientTableEntry &entry = kv->second;
-        if (msg.request().clientreqid() < entry.lastReqId) {
-            RDebug("Ignoring stale request");
-            return;
-        }
-        if (msg.request().clientreqid() == entry.lastReqId) {
-            // This is a duplicate request. Resend the reply if we
-            // have one. We might not have a reply to resend if we're
-            // waiting for the other replicas; in that case, just
-            // discard the request.
-            if (entry.replied) {
-                if (!(this->transport->SendMessage(this, remote,
-                                                   PBMessage(entry.reply)))) {
-                    RWarning("Failed to resend reply to client");
-                }
-                return;
-            } else {
-                RDebug("Received duplicate request but no reply available; ignoring");
-                return;
+    if (msg.request().clientreqid() < entry.lastReqId) {
+        RDebug("Ignoring stale request");
+        return;
+    }
+    if (msg.request().clientreqid() == entry.lastReqId) {
+        // This is a duplicate request. Resend the reply if we
+        // have one. We might not have a reply to resend if we're
+        // waiting for the other replicas; in that case, just
+        // discard the request.
+        if (entry.replied) {
+            if (!(this->transport->SendMessage(this, remote,
+                                               SerializedMessage(entry.reply)))) {
+                RWarning("Failed to resend reply to client");
             }
+            return;
+        } else {
+            RDebug("Received duplicate request but no reply available; ignoring");
+            return;
         }
     }
 
@@ -301,20 +298,18 @@ SpannerServer::ExecuteTxn(SpannerLogEntry *entry)
     reply.set_shard_num(this->groupIdx);
 
     // Update client table
-    ClientTableEntry &cte = this->clientTable[entry->request.clientid()];
+    ClientTable::Entry &cte = this->clientTable[entry->request.clientid()];
     // XXX Hack here to work around state transfer
     cte.lastReqId = entry->request.clientreqid();
     //ASSERT(cte.lastReqId == entry->request.clientreqid());
-    cte.replied = true;
-    cte.reply = reply;
+    cte.SetReply(reply);
 
     // Only leader replies to client
     if (this->configuration.GetLeaderIndex(entry->viewstamp.view) == this->replicaIdx) {
-        auto iter = this->clientAddresses.find(entry->request.clientid());
-        if (iter != this->clientAddresses.end()) {
+        if (cte.address != nullptr) {
             if (!this->transport->SendMessage(this,
-                        *iter->second,
-                        PBMessage(reply))) {
+                        *cte.address,
+                        SerializedMessage(cte.reply))) {
                 RWarning("Failed to send ReplyMessage to client");
             }
         }
@@ -324,7 +319,7 @@ SpannerServer::ExecuteTxn(SpannerLogEntry *entry)
 void
 SpannerServer::UpdateClientTable(const Request &req)
 {
-    ClientTableEntry &entry = this->clientTable[req.clientid()];
+    ClientTable::Entry &entry = this->clientTable[req.clientid()];
 
     ASSERT(entry.lastReqId <= req.clientreqid());
 
@@ -333,8 +328,7 @@ SpannerServer::UpdateClientTable(const Request &req)
     }
 
     entry.lastReqId = req.clientreqid();
-    entry.replied = false;
-    entry.reply.Clear();
+    entry.ClearReply();
 }
 
 void
@@ -35,6 +35,7 @@
 #include "lib/message.h"
 #include "lib/configuration.h"
 #include "lib/transport.h"
+#include "common/clienttable.h"
 #include "common/replica.h"
 #include "common/quorumset.h"
 #include "common/messageset.h"
@@ -97,14 +98,8 @@ private:
     opnum_t lastCommitted;
 
     /* Client information */
-    std::map<uint64_t, std::unique_ptr<TransportAddress> > clientAddresses;
-    struct ClientTableEntry
-    {
-	uint64_t lastReqId;
-        bool replied;
-	proto::ReplyMessage reply;
-    };
-    std::map<uint64_t, ClientTableEntry> clientTable;
+    // Replies are serialized ReplyMessages
+    ClientTable clientTable;
 
 
     /* Quorums */